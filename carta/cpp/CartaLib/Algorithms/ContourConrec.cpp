@@ -6,13 +6,27 @@
 #include "ContourConrec.h"
 #include "IImage.h"
 #include "LineCombiner.h"
+#include "ParallelFor.h"
 
+#include <algorithm>
 #include <cmath>
 #include <QString>
 #include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
 
 typedef std::vector < double > VD;
 
+/// number of rows of cells contoured by one task, bands are small enough that
+/// uneven bands (e.g. ones full of NaNs) balance out between the threads
+static const int BAND_ROWS = 64;
+
+/// number of pixels read from the view at once
+static const int64_t READ_VALUES = 256 * 1024;
+
+/// reads rows [firstRow,lastRow) of the input, one after the other, into dst
+typedef std::function < void (int firstRow, int lastRow, double * dst) > RowReader;
+
 /*
  * The code below is modified version of Paul Bourke's algorithm:
  *
@@ -24,17 +38,19 @@ typedef std::vector < double > VD;
 
 /*
    Derivation from the fortran version of CONREC by Paul Bourke
-   view            ! view of the data
+   rowReader       ! reads rows of the data
    ilb,iub         ! bounds for first coordinate (column), inclusive
    jlb,jub         ! bounds for second coordinate (row), inclusive
    xCoords         ! column coordinates (first index)
    yCoords         ! row coordinates (second index)
    nc              ! number of contour levels
    z               ! contour levels in increasing order
+
+   Only rows jlb..jub are read, so bands of rows can be contoured concurrently.
 */
 static Carta::Lib::Algorithms::ContourConrec::Result
 conrecFaster(
-    Carta::Lib::NdArray::RawViewInterface * view,
+    const RowReader & rowReader,
     int ilb,
     int iub,
     int jlb,
@@ -45,78 +61,49 @@ conrecFaster(
     double * z
     )
 {
-    // we will only need two rows in memory at any given time
-//    int nRows = jub - jlb + 1;
-    int nCols = iub - ilb + 1;
-    double * rows[2] {
-        nullptr, nullptr
-    };
-    std::vector < double > row1( nCols ), row2( nCols );
-    rows[0] = & row1[0];
-    rows[1] = & row2[0];
-    int nextRowToReadIn = 0;
-
-    auto updateRows = [&] () -> void {
-        CARTA_ASSERT( nextRowToReadIn < view-> dims()[1] );
-
-        // make a row view into the view
-        SliceND rowSlice;
-        rowSlice.next().start( nextRowToReadIn ).end( nextRowToReadIn + 1 );
-        auto rawRowView = view-> getView( rowSlice );
-        nextRowToReadIn++;
-
-        // make a double view of this raw row view
-        Carta::Lib::NdArray::Double dview( rawRowView, true );
-
-        // shift the row up
-        // note: we could avoid this memory copy if we swapped row[] pointers instead,
-        // and alternately read in the data into row1,row2..., for a miniscule performance
-        // gain and lot more complicated algorithm
-        row1 = row2;
-
-        // read in the data into row2
-        int i = 0;
-        dview.forEach([&] ( const double & val ) {
-                          row2[i++] = val;
-                      }
-                      );
-        CARTA_ASSERT( i == nCols );
-    };
-    updateRows();
-
-//    NdArray::Double doubleView( view, false );
-//    auto acc = [& doubleView] ( int col, int row ) {
-//        return doubleView.get( { col, row }
-//                               );
-//    };
-
-    // to keep the data accessor easy, we use this lambda, and hope the compiler
-    // optimizes it into an inline expression... :)
-    auto acc = [&] ( int col, int row ) {
-        row -= nextRowToReadIn - 2;
-        return rows[row][col];
-    };
-
     Carta::Lib::Algorithms::ContourConrec::Result result;
     if ( nc < 1 ) {
         return result;
     }
     result.resize( nc );
 
+    // rows are read READ_VALUES pixels at a time into a ring buffer, which keeps the
+    // last row of the previous read around for the cells between the two reads
+    int nCols = iub - ilb + 1;
+    int readRows = std::max( 1, static_cast < int > ( READ_VALUES / nCols ) );
+    int ringRows = readRows + 1;
+    std::vector < double > ring( static_cast < size_t > ( ringRows ) * nCols );
+    int nextRowToReadIn = jlb;
+
+    auto readRowsIn = [&] () -> void {
+        int firstRow = nextRowToReadIn;
+        int lastRow = std::min( firstRow + readRows, jub + 1 );
+
+        // the rows wrap around the end of the ring at most once
+        int row = firstRow;
+        while ( row < lastRow ) {
+            int slot = row % ringRows;
+            int runEnd = std::min( lastRow, row + ringRows - slot );
+            rowReader( row, runEnd, & ring[static_cast < size_t > ( slot ) * nCols] );
+            row = runEnd;
+        }
+        nextRowToReadIn = lastRow;
+    };
+    auto ringRow = [&] ( int row ) -> const double * {
+        return & ring[static_cast < size_t > ( row % ringRows ) * nCols] - ilb;
+    };
+    readRowsIn();
+
 #define xsect( p1, p2 ) ( h[p2] * xh[p1] - h[p1] * xh[p2] ) / ( h[p2] - h[p1] )
 #define ysect( p1, p2 ) ( h[p2] * yh[p1] - h[p1] * yh[p2] ) / ( h[p2] - h[p1] )
 
     int m1, m2, m3, case_value;
     double dmin, dmax, x1 = 0, x2 = 0, y1 = 0, y2 = 0;
     int i, j, k, m;
+    double corners[5];
     double h[5];
     int sh[5];
     double xh[5], yh[5];
-    int im[4] = {
-        0, 1, 1, 0
-    }, jm[4] = {
-        0, 0, 1, 1
-    };
     int castab[3][3][3] = {
         { { 0, 0, 8 }, { 0, 2, 5 }, { 7, 6, 9 } },
         { { 0, 3, 4 }, { 1, 3, 1 }, { 4, 3, 0 } },
@@ -127,36 +114,48 @@ conrecFaster(
     // original code went from bottom to top, not sure why
     //    for ( j = ( jub - 1 ) ; j >= jlb ; j-- ) {
     for ( j = jlb ; j < jub ; j++ ) {
-        updateRows();
+        if ( j + 1 >= nextRowToReadIn ) {
+            readRowsIn();
+        }
+        const double * row0 = ringRow( j );
+        const double * row1 = ringRow( j + 1 );
         for ( i = ilb ; i < iub ; i++ ) {
-            temp1 = std::min( acc( i, j ), acc( i, j + 1 ) );
-            temp2 = std::min( acc( i + 1, j ), acc( i + 1, j + 1 ) );
+            // the corners of the cell, numbered as in the picture below
+            corners[1] = row0[i];
+            corners[2] = row0[i + 1];
+            corners[3] = row1[i + 1];
+            corners[4] = row1[i];
+            temp1 = std::min( corners[1], corners[4] );
+            temp2 = std::min( corners[2], corners[3] );
             dmin = std::min( temp1, temp2 );
 
             // early abort if one of the values is not finite
             if ( ! std::isfinite( dmin ) ) {
                 continue;
             }
-            temp1 = std::max( acc( i, j ), acc( i, j + 1 ) );
-            temp2 = std::max( acc( i + 1, j ), acc( i + 1, j + 1 ) );
+            temp1 = std::max( corners[1], corners[4] );
+            temp2 = std::max( corners[2], corners[3] );
             dmax = std::max( temp1, temp2 );
             if ( dmax < z[0] || dmin > z[nc - 1] ) {
                 continue;
             }
-            for ( k = 0 ; k < nc ; k++ ) {
-                if ( z[k] < dmin || z[k] > dmax ) {
-                    continue;
-                }
+
+            // the coordinates of the corners and the centre are the same for all levels
+            xh[1] = xh[4] = xCoords[i];
+            xh[2] = xh[3] = xCoords[i + 1];
+            yh[1] = yh[2] = yCoords[j];
+            yh[3] = yh[4] = yCoords[j + 1];
+            xh[0] = 0.50 * ( xCoords[i] + xCoords[i + 1] );
+            yh[0] = 0.50 * ( yCoords[j] + yCoords[j + 1] );
+
+            // the levels are sorted, so only the ones between dmin and dmax are visited
+            for ( k = std::lower_bound( z, z + nc, dmin ) - z ; k < nc && z[k] <= dmax ; k++ ) {
                 for ( m = 4 ; m >= 0 ; m-- ) {
                     if ( m > 0 ) {
-                        h[m] = acc( i + im[m - 1], j + jm[m - 1] ) - z[k];
-                        xh[m] = xCoords[i + im[m - 1]];
-                        yh[m] = yCoords[j + jm[m - 1]];
+                        h[m] = corners[m] - z[k];
                     }
                     else {
                         h[0] = 0.25 * ( h[1] + h[2] + h[3] + h[4] );
-                        xh[0] = 0.50 * ( xCoords[i] + xCoords[i + 1] );
-                        yh[0] = 0.50 * ( yCoords[j] + yCoords[j + 1] );
                     }
                     if ( h[m] > 0.0 ) {
                         sh[m] = 1;
@@ -293,6 +292,13 @@ namespace Algorithms
 ContourConrec::ContourConrec()
 { }
 
+void
+ContourConrec::setTransform( const QPointF & origin, double scale )
+{
+    m_origin = origin;
+    m_scale = scale;
+}
+
 void
 ContourConrec::setLevels( const std::vector < double > & levels )
 {
@@ -307,7 +313,63 @@ ContourConrec::compute( NdArray::RawViewInterface * view )
         Result result( m_levels.size() );
         return result;
     }
+    int nCols = view-> dims()[0];
+
+    // the rows are read straight from the view with seek() and read(), doubles
+    // into the destination, other types through a buffer that is reused by all
+    // the reads
+    Image::PixelType pixelType = view-> pixelType();
+    int64_t pixelBytes = Image::pixelType2size( pixelType );
+    bool convert = pixelType != Image::PixelType::Real64;
+    auto converter = getBlockConverter < double > ( pixelType );
+    std::vector < char > rawBuffer;
+
+    // the view is read by all the threads, one at a time
+    QMutex readMutex;
+    auto reader = [&] ( int firstRow, int lastRow, double * dst ) {
+        CARTA_ASSERT( lastRow <= view-> dims()[1] );
+        QMutexLocker locker( & readMutex );
+        int64_t nValues = int64_t( lastRow - firstRow ) * nCols;
+        char * buff = reinterpret_cast < char * > ( dst );
+        if ( convert ) {
+            rawBuffer.resize( nValues * pixelBytes );
+            buff = rawBuffer.data();
+        }
+        view-> seek( int64_t( firstRow ) * nCols );
+        int64_t nBytes = 0;
+        while ( nBytes < nValues * pixelBytes ) {
+            int64_t count = view-> read( nValues * pixelBytes - nBytes, buff + nBytes );
+            if ( count <= 0 ) {
+                break;
+            }
+            nBytes += count;
+        }
+        CARTA_ASSERT( nBytes == nValues * pixelBytes );
+        if ( convert ) {
+            converter( buff, nBytes / pixelBytes, dst );
+        }
+    };
+    return _compute( reader, nCols, view-> dims()[1] );
+}
 
+ContourConrec::Result
+ContourConrec::compute( const float * data, int nCols, int nRows )
+{
+    if ( ! data || m_levels.size() == 0 ) {
+        Result result( m_levels.size() );
+        return result;
+    }
+    auto reader = [&] ( int firstRow, int lastRow, double * dst ) {
+        const float * src = data + int64_t( firstRow ) * nCols;
+        std::copy( src, src + int64_t( lastRow - firstRow ) * nCols, dst );
+    };
+    return _compute( reader, nCols, nRows );
+}
+
+ContourConrec::Result
+ContourConrec::_compute( const std::function < void (int, int, double *) > & reader,
+                         int nCols, int nRows )
+{
     // the c-algorithm conrec() needs the levels in sorted order (to make things little
     // bit faster), but we would like to report the results in the same order that the
     // levels were requested. So we need to sort the levels, call the conrec(), and
@@ -327,46 +389,63 @@ ContourConrec::compute( NdArray::RawViewInterface * view )
         sortedRawLevels[i] = tmpLevels[i].first;
     }
 
-    auto m_nRows = view-> dims()[1];
-    auto m_nCols = view-> dims()[0];
-
     // make x coordinates
-    VD xcoords( m_nCols );
-    for ( int col = 0 ; col < m_nCols ; ++col ) {
-        xcoords[col] = col;
+    VD xcoords( nCols );
+    for ( int col = 0 ; col < nCols ; ++col ) {
+        xcoords[col] = m_origin.x() + col * m_scale;
     }
 
     // make y coordinates
-    VD ycoords( m_nRows );
-    for ( int row = 0 ; row < m_nRows ; ++row ) {
-        ycoords[row] = row;
+    VD ycoords( nRows );
+    for ( int row = 0 ; row < nRows ; ++row ) {
+        ycoords[row] = m_origin.y() + row * m_scale;
     }
 
-    Result result1 =
-        conrecFaster(
-            view,
-            0,
-            m_nCols - 1,
-            0,
-            m_nRows - 1,
-            xcoords,
-            ycoords,
-            m_levels.size(),
-            & sortedRawLevels[0] );
-
-    Result result;
-    QRectF rect( 0, 0, m_nCols, m_nRows);
-    for( size_t i = 0 ; i < m_levels.size() ; ++ i ) {
-        Carta::Lib::Algorithms::LineCombiner lc( rect, m_nRows+1, m_nCols + 1, 1e-9);
-        std::vector < QPolygonF > & v = result1[i];
-        for( QPolygonF & poly : v) {
-            for( int i = 0 ; i < poly.size() - 1 ; ++ i ) {
-                lc.add( poly[i], poly[i+1]);
+    // contour horizontal bands of cells in parallel, neighbouring bands share the row
+    // on their seam, so the segments crossing it end at the same points in both bands
+    int nBands = std::max( 0, ( nRows - 1 + BAND_ROWS - 1 ) / BAND_ROWS );
+    std::vector < Result > bandResults( nBands );
+    parallelFor( 0, nBands, 1, [&] ( int64_t first, int64_t last ) {
+        for ( int64_t band = first ; band < last ; ++band ) {
+            int jlb = static_cast < int > ( band ) * BAND_ROWS;
+            int jub = std::min < int > ( jlb + BAND_ROWS, nRows - 1 );
+            bandResults[band] =
+                conrecFaster(
+                    reader,
+                    0,
+                    nCols - 1,
+                    jlb,
+                    jub,
+                    xcoords,
+                    ycoords,
+                    m_levels.size(),
+                    & sortedRawLevels[0] );
+        }
+    });
+
+    // stitch the bands together: the segments of a level go to one line combiner in
+    // band order, which joins the polylines across the seams; levels are independent
+    // of each other, so they are combined in parallel
+    Result result( m_levels.size() );
+    QRectF rect( m_origin.x(), m_origin.y(), nCols * m_scale, nRows * m_scale);
+    parallelFor( 0, m_levels.size(), 1, [&] ( int64_t first, int64_t last ) {
+        for ( int64_t level = first ; level < last ; ++level ) {
+            Carta::Lib::Algorithms::LineCombiner lc( rect, nRows+1, nCols + 1, 1e-9);
+            size_t nSegments = 0;
+            for ( Result & bandResult : bandResults ) {
+                std::vector < QPolygonF > & v = bandResult[level];
+                for( QPolygonF & poly : v) {
+                    for( int i = 0 ; i < poly.size() - 1 ; ++ i ) {
+                        lc.add( poly[i], poly[i+1]);
+                    }
+                }
+                nSegments += v.size();
+                v.clear();
             }
+            result[level] = lc.getPolygons();
+            qDebug() << "compress" << nSegments << "-->" << result[level].size();
         }
-        result.push_back( lc.getPolygons());
-        qDebug() << "compress" << v.size() << "-->" << result.back().size();
-    }
+    });
 
 //    Result result =
 //        conrecFaster(
@@ -34,13 +34,28 @@ public:
     void
     setLevels( const std::vector < double > & levels );
 
+    /// set the coordinates of the result, the pixel at (col,row) of the input is at
+    /// origin + (col,row) * scale, by default the coordinates are the pixel indices
+    void
+    setTransform( const QPointF & origin, double scale );
+
     /// compute and return the sorted vertices
     Result
     compute( NdArray::RawViewInterface * );
 
+    /// compute the contours of a 2D array of nCols x nRows floats, stored row by row
+    Result
+    compute( const float * data, int nCols, int nRows );
+
 private:
 
+    /// computes the contours of rows read by the given reader
+    Result
+    _compute( const std::function < void (int, int, double *) > & reader, int nCols, int nRows );
+
     std::vector < double > m_levels;
+    QPointF m_origin = QPointF( 0, 0 );
+    double m_scale = 1;
 };
 
 }
@@ -5,7 +5,8 @@
 #include "LineCombiner.h"
 #include "CartaLib/CartaLib.h"
 
-#include <QLinkedList>
+#include <algorithm>
+#include <cmath>
 
 #ifdef qDebug
 #undef qDebug
@@ -18,296 +19,272 @@ namespace Lib
 {
 namespace Algorithms
 {
+/// number of buckets to start with, there are always at least as many buckets as
+/// end points
+static const size_t MIN_BUCKETS = 1024;
+
 LineCombiner::LineCombiner( const QRectF & rect, int rows, int cols, double threshold )
 {
     m_rect = rect;
-    m_nRows = rows;
-    m_nCols = cols;
+    m_nRows = std::max( rows, 1 );
+    m_nCols = std::max( cols, 1 );
     m_thresholdSq = threshold * threshold;
-
-    Cell * rawPtr = new Cell[m_nRows * m_nCols];
-
-    m_grid.resize( m_nRows );
-    for ( int row = 0 ; row < m_nRows ; ++row ) {
-        m_grid[row] = rawPtr + row * m_nCols;
-    }
+    _rehash( MIN_BUCKETS );
 }
 
 LineCombiner::~LineCombiner()
-{
-    if ( m_grid.size() > 0 ) {
-        delete[] m_grid[0];
-    }
-}
-
-//void LineCombiner::setColsRows(int cols, int rows)
-//{
-//    CARTA_ASSERT( m_grid.size() == 0);
-
-//    m_nCols = cols;
-//    m_nRows = rows;
-
-//    Cell * rawPtr = new Cell[ m_nRows * m_nCols];
-
-//    m_grid.resize( m_nRows);
-//    for( int row = 0 ; row < m_nRows ; ++ row){
-//        m_grid[row] = rawPtr + row * m_nCols;
-//    }
-//}
+{ }
 
 void
 LineCombiner::add( QPointF p1, QPointF p2 )
 {
-    bool ok;
-
     qDebug() << "add" << p1 << p2;
 
     // find closest points within the threshold distance of p1 and p2
-    IndexPt * ip1 = _findClosestPt( p1 );
-    IndexPt * ip2 = _findClosestPt( p2 );
+    int ip1 = _findClosestPt( p1 );
+    int ip2 = _findClosestPt( p2 );
 
     // normalize the cases
-    if ( ! ip1 ) {
+    if ( ip1 < 0 ) {
         std::swap( ip1, ip2 );
         std::swap( p1, p2 );
     }
 
-    if ( ip1 ) {
-        CARTA_ASSERT( ip1-> poly );
-    }
-    if ( ip2 ) {
-        CARTA_ASSERT( ip2-> poly );
-    }
-
     // case1: this line segment is not near anything else
-    if ( ip1 == nullptr && ip2 == nullptr ) {
+    if ( ip1 < 0 && ip2 < 0 ) {
         qDebug() << "case null null";
 
-        // we insert a new polyline and update spacial index
-
-        // make a new polyline from p1 and p2
-        Poly * poly = new Poly;
-        poly->append( p1 );
-        poly->append( p2 );
-
-        // insert beginning of this polyline into grid
-        findCell( p1 )-> pts.append( IndexPt( poly, false ) );
-
-        // insert end of this polyine into grid
-        findCell( p2 )-> pts.append( IndexPt( poly, true ) );
-
-        IndexPt ipt1( poly, true );
-        CARTA_ASSERT( findCell( ipt1.pt() )->pts.contains( ipt1 ) );
-
+        // make a new polyline from p1 and p2, and index both of its ends
+        int poly;
+        if ( m_freePolys.empty() ) {
+            poly = m_polys.size();
+            m_polys.push_back( Poly() );
+        }
+        else {
+            poly = m_freePolys.back();
+            m_freePolys.pop_back();
+        }
+        m_polys[poly].tail.push_back( p1 );
+        m_polys[poly].tail.push_back( p2 );
+        _insertEnd( poly, false );
+        _insertEnd( poly, true );
         return;
     }
 
     // catch a super-special case.... both points point to the same polyline, same end...
     // we'll treat this as if only one of the points pointed to a polyline)
-    if( ip2 && ip1->poly == ip2->poly && ip1->flipped == ip2->flipped) {
+    if ( ip2 >= 0 && ip1 == ip2 ) {
         qDebug() << "super special";
-        ip2 = nullptr;
+        ip2 = - 1;
     }
 
     // only one point has a match (ip1, ip2 is null)
-    if ( ip1 != nullptr && ip2 == nullptr ) {
+    if ( ip2 < 0 ) {
         qDebug() << "case poly null";
 
-        // make a copy of what ip1 points to, because it'll be destroyed
-        IndexPt ip1copy = * ip1;
-
-        // remove ip1 from it's corresponding cell (after this ip1 will point to
-        // a destroyed memory!)
-        ok = findCell( ip1-> pt() )-> pts.removeOne( * ip1 );
-        CARTA_ASSERT( ok );
-
-        // re-point ip1 to the copy
-        ip1 = & ip1copy;
-
-        // we extend the polyline that ip1 points to with p2
-        if ( ip1-> flipped ) {
-            ip1-> poly-> append( p2 );
+        // we extend the polyline that ip1 points to with p2, and move its end point
+        int polyIndex = m_endPts[ip1].poly;
+        bool back = m_endPts[ip1].back;
+        _removeEnd( ip1 );
+        Poly & poly = m_polys[polyIndex];
+        if ( back ) {
+            poly.tail.push_back( p2 );
         }
         else {
-            ip1-> poly-> prepend( p2 );
+            poly.head.push_back( p2 );
         }
-
-        // and add a new index point (for p2) to the respective cell
-        findCell( p2 )-> pts.append( * ip1 );
+        _insertEnd( polyIndex, back );
         return;
     }
 
+    int poly1 = m_endPts[ip1].poly;
+    bool back1 = m_endPts[ip1].back;
+    int poly2 = m_endPts[ip2].poly;
+    bool back2 = m_endPts[ip2].back;
+
     // both points have a match, and it's the same polyline, but different ends...
-    if ( ip1-> poly == ip2-> poly ) {
+    if ( poly1 == poly2 ) {
         qDebug() << "case poly poly same";
 
-        CARTA_ASSERT( ip1->flipped == ! ip2->flipped );
-
-        // we need to remove both points from their cells
-        Poly * poly = ip1->poly;
-        ok = findCell( ip1->pt() )->pts.removeOne( * ip1 );
-        CARTA_ASSERT( ok );
-        ok = findCell( ip2->pt() )->pts.removeOne( * ip2 );
-        CARTA_ASSERT( ok );
+        CARTA_ASSERT( back1 == ! back2 );
 
         // make it a closed polyline
-        poly->append( poly->first() );
-
-        QPolygonF polygon = poly2polygon( poly );
-        m_polygons.push_back( polygon );
-        delete poly;
-
+        Poly & poly = m_polys[poly1];
+        QPointF first = poly.front();
+        poly.tail.push_back( first );
+        m_polygons.push_back( poly2polygon( poly ) );
+        _releasePoly( poly1 );
         return;
     }
 
     // last case is: both points have a match to 2 different polylines
     qDebug() << "case poly poly diff";
 
-    // we need to merge these two polylines together
-    IndexPt ip1c = * ip1;
-    IndexPt ip2c = * ip2;
-
-    // remove first polyline from the spatial index
-    ok = findCell( ip1c.poly->front() )-> pts.removeAll( { ip1c.poly, false }
-                                                         );
-    CARTA_ASSERT( ok );
-    ok = findCell( ip1c.poly->back() )-> pts.removeAll( { ip1c.poly, true }
-                                                        );
-    CARTA_ASSERT( ok );
-
-    // remove second polyline from the spatial index
-    ok = findCell( ip2c.poly->front() )-> pts.removeAll( { ip2c.poly, false }
-                                                         );
-    CARTA_ASSERT( ok );
-    ok = findCell( ip2c.poly->back() )-> pts.removeAll( { ip2c.poly, true }
-                                                        );
-    CARTA_ASSERT( ok ); Q_UNUSED(ok);
-
-    // we need to handle 4 cases for merging... in any case, we'll be re-using poly1 and
-    // appending/prepending to it all elements from poly2
-    // case1: append poly2 to the end of poly1, in forward order
-    if ( ip1c.flipped && ! ip2c.flipped ) {
-        qDebug() << "subcase1 - append forward";
-        for ( auto & pt : * ip2c.poly ) {
-            ip1c.poly->append( pt );
-        }
+    // we'll append the points of the shorter polyline to the longer one, which keeps
+    // the total cost of merging at n log n
+    if ( m_polys[poly1].size() < m_polys[poly2].size() ) {
+        std::swap( poly1, poly2 );
+        std::swap( back1, back2 );
     }
-    else if ( ip1c.flipped && ip2c.flipped ) {
-        qDebug() << "subcase2 - append reverse";
-        QLinkedListIterator < QPointF > i( * ip2c.poly );
-        i.toBack();
-        while ( i.hasPrevious() ) {
-            ip1c.poly-> append( i.previous() );
-        }
-    }
-    else if ( ! ip1c.flipped && ! ip2c.flipped ) {
-        qDebug() << "subase3 - prepend forward";
-        for ( auto & pt : * ip2c.poly ) {
-            ip1c.poly->prepend( pt );
-        }
+    Poly & dst = m_polys[poly1];
+    Poly & src = m_polys[poly2];
+    _removeEnd( dst.ends[0] );
+    _removeEnd( dst.ends[1] );
+    std::vector < QPointF > & dstEnd = back1 ? dst.tail : dst.head;
+
+    // the points of src, starting from its matched end, in the order of the stored
+    // vectors: head is reversed, so walking it forward goes away from the front
+    if ( back2 ) {
+        dstEnd.insert( dstEnd.end(), src.tail.rbegin(), src.tail.rend() );
+        dstEnd.insert( dstEnd.end(), src.head.begin(), src.head.end() );
     }
     else {
-        qDebug() << "subase4 - prepend reverse";
-        QLinkedListIterator < QPointF > i( * ip2c.poly );
-        i.toBack();
-        while ( i.hasPrevious() ) {
-            ip1c.poly-> prepend( i.previous() );
-        }
+        dstEnd.insert( dstEnd.end(), src.head.rbegin(), src.head.rend() );
+        dstEnd.insert( dstEnd.end(), src.tail.begin(), src.tail.end() );
     }
 
-    // get rid of poly2
-    delete ip2c.poly;
-
-    // re-insert the endpoints of poly1 into spatial index
-    ip1c = IndexPt( ip1c.poly, false );
-    ip2c = IndexPt( ip1c.poly, true );
-    findCell( ip1c.poly->first() )->pts.append( ip1c );
-    findCell( ip1c.poly->last() )->pts.append( ip2c );
+    // get rid of poly2, and re-insert the end points of poly1 into spatial index
+    _releasePoly( poly2 );
+    _insertEnd( poly1, false );
+    _insertEnd( poly1, true );
 } // add
 
 std::vector < QPolygonF >
 LineCombiner::getPolygons()
 {
-    // collect all polylines that are still in grid cells
-    for ( int row = 0 ; row < m_nRows ; ++row ) {
-        for ( int col = 0 ; col < m_nCols ; ++col ) {
-            for ( IndexPt & ipt : cell( row, col ).pts ) {
-                // only consider non-flipped pts, since there will always be 2 per polyline
-                if ( ipt.flipped ) {
-                    qDebug() << "Skipping " << ipt.poly;
-                    continue;
-                }
-
-                // convert the polyline to QPolygonF
-                QPolygonF pf = poly2polygon( ipt.poly );
-
-                // delete the polyline
-                qDebug() << "Deleting poly" << ipt.poly;
-
-                delete ipt.poly;
-
-                // add the new polygon to our list
-                m_polygons.push_back( pf );
-            }
-            cell( row, col ).pts.clear();
+    // collect all polylines that are still open
+    for ( size_t i = 0 ; i < m_polys.size() ; ++i ) {
+        if ( m_polys[i].ends[0] < 0 ) {
+            continue;
         }
+        m_polygons.push_back( poly2polygon( m_polys[i] ) );
+        _releasePoly( i );
     }
     return m_polygons;
-} // add
+} // getPolygons
 
 void
-LineCombiner::pt2rowcol( const QPointF & p, int & row, int & col )
+LineCombiner::pt2rowcol( const QPointF & p, int & row, int & col ) const
 {
     double cellx = m_rect.width() / m_nCols;
     double celly = m_rect.height() / m_nRows;
-    col = ( p.x() - m_rect.left() ) / cellx;
-    row = ( p.y() - m_rect.top() ) / celly;
+    double fcol = ( p.x() - m_rect.left() ) / cellx;
+    double frow = ( p.y() - m_rect.top() ) / celly;
+
+    // clamp before converting, so points far outside (or an empty rect) stay in range
+    col = std::isfinite( fcol ) ? std::min( std::max( fcol, 0.0 ), m_nCols - 1.0 ) : 0;
+    row = std::isfinite( frow ) ? std::min( std::max( frow, 0.0 ), m_nRows - 1.0 ) : 0;
+} // pt2rowcol
 
-    if ( col < 0 ) {
-        col = 0;
+int64_t
+LineCombiner::_cellKey( int row, int col ) const
+{
+    return static_cast < int64_t > ( row ) * m_nCols + col;
+}
+
+size_t
+LineCombiner::_bucket( int64_t cellKey ) const
+{
+    // fibonacci hashing, the number of buckets is a power of two
+    uint64_t hash = static_cast < uint64_t > ( cellKey ) * 0x9E3779B97F4A7C15ull;
+    return ( hash >> 32 ) & ( m_buckets.size() - 1 );
+}
+
+void
+LineCombiner::_rehash( size_t nBuckets )
+{
+    m_buckets.assign( nBuckets, - 1 );
+    for ( size_t i = 0 ; i < m_endPts.size() ; ++i ) {
+        EndPt & endPt = m_endPts[i];
+        if ( endPt.poly < 0 ) {
+            continue;
+        }
+        size_t bucket = _bucket( endPt.cellKey );
+        endPt.next = m_buckets[bucket];
+        m_buckets[bucket] = i;
     }
-    if ( col >= m_nCols ) {
-        col = m_nCols-1;
+}
+
+void
+LineCombiner::_insertEnd( int poly, bool back )
+{
+    if ( m_nEndPts >= m_buckets.size() ) {
+        _rehash( m_buckets.size() * 2 );
     }
-    if ( row < 0 ) {
-        row = 0;
+    int index;
+    if ( m_freeEndPts < 0 ) {
+        index = m_endPts.size();
+        m_endPts.push_back( EndPt() );
     }
-    if ( row >= m_nRows ) {
-        row = m_nRows-1;
+    else {
+        index = m_freeEndPts;
+        m_freeEndPts = m_endPts[index].next;
     }
-} // pt2rowcol
+    EndPt & endPt = m_endPts[index];
+    endPt.pt = back ? m_polys[poly].back() : m_polys[poly].front();
+    int row, col;
+    pt2rowcol( endPt.pt, row, col );
+    endPt.cellKey = _cellKey( row, col );
+    endPt.poly = poly;
+    endPt.back = back;
+    size_t bucket = _bucket( endPt.cellKey );
+    endPt.next = m_buckets[bucket];
+    m_buckets[bucket] = index;
+    m_polys[poly].ends[back ? 1 : 0] = index;
+    m_nEndPts++;
+}
 
-LineCombiner::Cell *
-LineCombiner::findCell( const QPointF & pt )
+void
+LineCombiner::_removeEnd( int index )
 {
-    int row, col;
-    pt2rowcol( pt, row, col );
-    return & cell( row, col );
+    CARTA_ASSERT( index >= 0 && m_endPts[index].poly >= 0 );
+    EndPt & endPt = m_endPts[index];
+
+    // unlink it from its bucket
+    int * link = & m_buckets[_bucket( endPt.cellKey )];
+    while ( * link != index ) {
+        CARTA_ASSERT( * link >= 0 );
+        link = & m_endPts[* link].next;
+    }
+    * link = endPt.next;
+
+    m_polys[endPt.poly].ends[endPt.back ? 1 : 0] = - 1;
+    endPt.poly = - 1;
+    endPt.next = m_freeEndPts;
+    m_freeEndPts = index;
+    m_nEndPts--;
 }
 
-LineCombiner::Cell &
-LineCombiner::cell( int row, int col )
+void
+LineCombiner::_releasePoly( int poly )
 {
-    CARTA_ASSERT( row >= 0 );
-    CARTA_ASSERT( col >= 0 );
-    CARTA_ASSERT( row < m_nRows );
-    CARTA_ASSERT( col < m_nCols );
-    CARTA_ASSERT( m_grid.size() > 0 );
-    return m_grid[row][col];
+    Poly & p = m_polys[poly];
+    for ( int end = 0 ; end < 2 ; ++end ) {
+        if ( p.ends[end] >= 0 ) {
+            _removeEnd( p.ends[end] );
+        }
+    }
+    std::vector < QPointF > ().swap( p.head );
+    std::vector < QPointF > ().swap( p.tail );
+    m_freePolys.push_back( poly );
 }
 
 QPolygonF
-LineCombiner::poly2polygon( LineCombiner::Poly * poly )
+LineCombiner::poly2polygon( const LineCombiner::Poly & poly )
 {
     QPolygonF pf;
-    for ( QPointF & pt : * poly ) {
+    pf.reserve( poly.size() );
+    for ( auto it = poly.head.rbegin() ; it != poly.head.rend() ; ++it ) {
+        pf.append( * it );
+    }
+    for ( const QPointF & pt : poly.tail ) {
         pf.append( pt );
     }
     return pf;
 }
 
-LineCombiner::IndexPt *
-LineCombiner::_findClosestPt( const QPointF & p )
+int
+LineCombiner::_findClosestPt( const QPointF & p ) const
 {
     // find the row/column of the grid cell containing this point
     int row, col;
@@ -315,24 +292,27 @@ LineCombiner::_findClosestPt( const QPointF & p )
 
     // we'll be searching 3x3 cells around row/col
     double bestDist = - 1.0;
-    IndexPt * result = nullptr;
+    int result = - 1;
     for ( int r = row - 1 ; r <= row + 1 ; ++r ) {
         if ( r < 0 || r >= m_nRows ) {
             continue;
         }
-        for ( int c = col - 1 ; c <= col ; ++c ) {
+        for ( int c = col - 1 ; c <= col + 1 ; ++c ) {
             if ( c < 0 || c >= m_nCols ) {
                 continue;
             }
-            Cell & cell = this-> cell( r, c );
-            for ( auto & ipt : cell.pts ) {
-                QPointF & pt = ipt.pt();
-                double dx = pt.x() - p.x();
-                double dy = pt.y() - p.y();
+            int64_t cellKey = _cellKey( r, c );
+            for ( int i = m_buckets[_bucket( cellKey )] ; i >= 0 ; i = m_endPts[i].next ) {
+                const EndPt & endPt = m_endPts[i];
+                if ( endPt.cellKey != cellKey ) {
+                    continue;
+                }
+                double dx = endPt.pt.x() - p.x();
+                double dy = endPt.pt.y() - p.y();
                 double dsq = dx * dx + dy * dy;
                 if ( dsq < m_thresholdSq && ( dsq < bestDist || bestDist < 0 ) ) {
                     bestDist = dsq;
-                    result = & ipt;
+                    result = i;
                 }
             }
         }
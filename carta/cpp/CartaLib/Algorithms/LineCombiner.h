@@ -4,10 +4,10 @@
 
 #pragma once
 
-class QRectF;
-class QPointF;
-#include <QLinkedList>
 #include <QPolygonF>
+#include <QRectF>
+#include <cstddef>
+#include <cstdint>
 #include <vector>
 namespace Carta
 {
@@ -15,6 +15,13 @@ namespace Lib
 {
 namespace Algorithms
 {
+/// Joins line segments that share end points into polylines (closed ones if the ends
+/// meet). End points closer than the threshold are considered to be the same point.
+///
+/// The end points of the polylines built so far are kept in a hashed grid with
+/// rows x cols cells over the bounding rectangle, so finding the polyline a new
+/// segment continues takes constant expected time, and memory grows with the number
+/// of open polylines rather than the number of cells.
 class LineCombiner
 {
 public:
@@ -22,21 +29,6 @@ public:
     LineCombiner( const QRectF & rect, int rows, int cols, double threshold);
     ~LineCombiner();
 
-//    void
-//    setRect( const QRectF & rect )
-//    {
-//        m_rect = rect;
-//    }
-
-//    void
-//    setThreshold( double threshold )
-//    {
-//        m_thresholdSq = threshold * threshold;
-//    }
-
-//    void
-//    setColsRows( int cols, int rows );
-
     void
     setSmallestY( double y );
 
@@ -48,52 +40,90 @@ public:
 
 private:
 
-    typedef QLinkedList < QPointF > Poly;
+    /// A polyline, stored so that points can be added cheaply at both ends: the
+    /// points before the first one are in 'head', in reverse order.
+    struct Poly {
+        std::vector < QPointF > head;
+        std::vector < QPointF > tail;
 
-    struct IndexPt {
-        Poly * poly = nullptr;
-        bool flipped = false;
+        /// index of the end points in m_endPts, front and back
+        int ends[2] = { - 1, - 1 };
 
-        QPointF &
-        pt()
+        int
+        size() const
         {
-            if ( flipped ) {
-                return poly-> last();
-            }
-            else {
-                return poly-> first();
-            }
+            return head.size() + tail.size();
         }
 
-        IndexPt( Poly * p, bool f) { poly = p; flipped = f; }
-        bool operator ==( const IndexPt & pt) {
-            return pt.poly == poly && pt.flipped == flipped;
+        const QPointF &
+        front() const
+        {
+            return head.empty() ? tail.front() : head.back();
+        }
+
+        const QPointF &
+        back() const
+        {
+            return tail.empty() ? head.front() : tail.back();
         }
     };
 
+    /// An end point of a polyline in the spatial index.
+    struct EndPt {
+        QPointF pt;
+        int64_t cellKey = - 1;
+        int poly = - 1;
+        /// whether this is the back end of the polyline
+        bool back = false;
+        /// next end point in the same bucket, or in the free list
+        int next = - 1;
+    };
+
+    /// index of the end point closest to p, within the threshold, or -1
+    int
+    _findClosestPt( const QPointF & p ) const;
+
+    void
+    _insertEnd( int poly, bool back );
+
+    void
+    _removeEnd( int endPt );
+
+    void
+    _rehash( size_t nBuckets );
+
+    size_t
+    _bucket( int64_t cellKey ) const;
+
+    int64_t
+    _cellKey( int row, int col ) const;
 
-    IndexPt *
-    _findClosestPt( const QPointF & p );
+    void
+    pt2rowcol( const QPointF & p, int & row, int & col ) const;
+
+    void
+    _releasePoly( int poly );
+
+    static QPolygonF
+    poly2polygon( const Poly & poly );
 
     int m_nRows, m_nCols;
 
     double m_thresholdSq = 1e-9;
-    void
-    pt2rowcol( const QPointF & p, int & row, int & col );
 
-    struct Cell {
-        QLinkedList < IndexPt > pts;
-    };
-    std::vector< Cell * > m_grid;
     QRectF m_rect; // bounding rect
 
-    std::vector<QPolygonF> m_polygons;
-
-    Cell * findCell( const QPointF & pt);
+    /// all polylines, the ones that were merged or closed are empty and reused
+    std::vector < Poly > m_polys;
+    std::vector < int > m_freePolys;
 
-    Cell & cell( int row, int col);
+    /// the end points, chained per bucket, and the first one of each bucket
+    std::vector < EndPt > m_endPts;
+    std::vector < int > m_buckets;
+    int m_freeEndPts = - 1;
+    size_t m_nEndPts = 0;
 
-    static QPolygonF poly2polygon( Poly * poly);
+    std::vector<QPolygonF> m_polygons;
 };
 }
 }
@@ -0,0 +1,150 @@
+/**
+ *
+ **/
+
+#include "ParallelFor.h"
+#include "CartaLib/CartaLib.h"
+#include <QThreadPool>
+#include <QRunnable>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QWaitCondition>
+#include <algorithm>
+#include <atomic>
+#include <exception>
+#include <memory>
+
+namespace Carta
+{
+namespace Lib
+{
+namespace Algorithms
+{
+namespace
+{
+/// state shared by all threads working on one parallelFor() call
+struct SharedState {
+    int64_t begin, end, chunkSize, nChunks;
+    std::function < void (int64_t, int64_t) > func;
+
+    /// index of the next chunk to hand out
+    std::atomic < int64_t > nextChunk { 0 };
+
+    /// number of chunks finished so far
+    int64_t doneChunks = 0;
+    QMutex mutex;
+    QWaitCondition allDone;
+
+    /// the first exception thrown by func, once there is one the remaining chunks
+    /// are skipped (but still counted as finished)
+    std::exception_ptr error;
+    std::atomic < bool > failed { false };
+
+    /// keep processing chunks until there are none left
+    void
+    work()
+    {
+        while ( true ) {
+            int64_t chunk = nextChunk++;
+            if ( chunk >= nChunks ) {
+                return;
+            }
+            if ( ! failed ) {
+                int64_t first = begin + chunk * chunkSize;
+                int64_t last = std::min( first + chunkSize, end );
+                try {
+                    func( first, last );
+                }
+                catch ( ... ) {
+                    // an exception must not escape a pool thread, it is handed over
+                    // to the calling one instead
+                    QMutexLocker locker( & mutex );
+                    if ( ! error ) {
+                        error = std::current_exception();
+                    }
+                    failed = true;
+                }
+            }
+
+            QMutexLocker locker( & mutex );
+            doneChunks++;
+            if ( doneChunks == nChunks ) {
+                allDone.wakeAll();
+            }
+        }
+    }
+};
+
+/// runnable for the helper threads, it may start after all the work is done, in which
+/// case it just exits (which is why the state is shared)
+class Helper : public QRunnable
+{
+public:
+
+    Helper( std::shared_ptr < SharedState > state ) : m_state( state ) { }
+
+    virtual void
+    run() override
+    {
+        m_state-> work();
+    }
+
+private:
+
+    std::shared_ptr < SharedState > m_state;
+};
+}
+
+void
+parallelFor( int64_t begin, int64_t end, int64_t chunkSize,
+             std::function < void (int64_t, int64_t) > func,
+             int maxThreads )
+{
+    CARTA_ASSERT( chunkSize > 0 );
+    if ( end <= begin ) {
+        return;
+    }
+    int64_t nChunks = ( end - begin + chunkSize - 1 ) / chunkSize;
+
+    QThreadPool * pool = QThreadPool::globalInstance();
+    if ( maxThreads < 1 ) {
+        maxThreads = pool-> maxThreadCount();
+    }
+    int64_t nHelpers = std::min < int64_t > ( maxThreads, nChunks ) - 1;
+
+    // nothing to parallelize, don't bother with the pool
+    if ( nHelpers < 1 ) {
+        for ( int64_t first = begin ; first < end ; first += chunkSize ) {
+            func( first, std::min( first + chunkSize, end ) );
+        }
+        return;
+    }
+
+    auto state = std::make_shared < SharedState > ();
+    state-> begin = begin;
+    state-> end = end;
+    state-> chunkSize = chunkSize;
+    state-> nChunks = nChunks;
+    state-> func = func;
+    for ( int64_t i = 0 ; i < nHelpers ; ++i ) {
+        pool-> start( new Helper( state ) );
+    }
+
+    // help out, and then wait for the chunks still being processed by others, even
+    // if func threw, as they still refer to it
+    state-> work();
+    std::exception_ptr error;
+    {
+        QMutexLocker locker( & state-> mutex );
+        while ( state-> doneChunks < nChunks ) {
+            state-> allDone.wait( & state-> mutex );
+        }
+        error = state-> error;
+    }
+    if ( error ) {
+        std::rethrow_exception( error );
+    }
+} // parallelFor
+}
+}
+}
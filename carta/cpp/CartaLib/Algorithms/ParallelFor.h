@@ -0,0 +1,40 @@
+/**
+ * Simple data-parallel loop on top of the global QThreadPool.
+ **/
+
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+namespace Carta
+{
+namespace Lib
+{
+namespace Algorithms
+{
+/// Splits [begin,end) into chunks of at most chunkSize indices and calls func(first,last)
+/// for each chunk, on QThreadPool::globalInstance() and the calling thread.
+///
+/// Chunks are handed out one at a time to whichever thread asks for work next, so
+/// uneven chunks (e.g. rows with many NaNs) balance themselves out. The calling thread
+/// works on chunks too, which means this never deadlocks, even if it is called from
+/// a pool thread or all pool threads are busy. The function returns once all chunks
+/// have been processed.
+///
+/// If func throws, the chunks that have not been started are skipped, and the first
+/// exception is rethrown on the calling thread once no thread is running func anymore.
+///
+/// \param begin first index
+/// \param end one past the last index
+/// \param chunkSize how many indices to hand out at once
+/// \param func the work, it will be called concurrently from multiple threads
+/// \param maxThreads maximum number of threads to use (including the calling one),
+/// values < 1 mean QThreadPool::globalInstance()->maxThreadCount()
+void
+parallelFor( int64_t begin, int64_t end, int64_t chunkSize,
+             std::function < void (int64_t first, int64_t last) > func,
+             int maxThreads = - 1 );
+}
+}
+}
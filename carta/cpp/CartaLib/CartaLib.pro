@@ -45,6 +45,7 @@ SOURCES += \
     IWcsGridRenderService.cpp \
     ContourSet.cpp \
     Algorithms/LineCombiner.cpp \
+    Algorithms/ParallelFor.cpp \
     IImageRenderService.cpp \
     IRemoteVGView.cpp \
     Hooks/GetProfileExtractor.cpp \
@@ -103,12 +104,14 @@ HEADERS += \
     IContourGeneratorService.h \
     ContourSet.h \
     Algorithms/LineCombiner.h \
+    Algorithms/ParallelFor.h \
     Hooks/GetInitialFileList.h \
     Hooks/Initialize.h \
     IImageRenderService.h \
     Hooks/GetImageRenderService.h \
     IRemoteVGView.h \
     Hooks/GetProfileExtractor.h \
+    Hooks/GetPersistentCache.h \
     Regions/IRegion.h \
     InputEvents.h \
     Regions/ICoordSystem.h \
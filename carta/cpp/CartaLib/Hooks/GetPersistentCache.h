@@ -0,0 +1,48 @@
+/**
+ * Hook for obtaining a persistent cache.
+ *
+ **/
+
+#pragma once
+
+#include "CartaLib/CartaLib.h"
+#include "CartaLib/IPlugin.h"
+#include "CartaLib/IPCache.h"
+
+namespace Carta
+{
+namespace Lib
+{
+namespace Hooks
+{
+class GetPersistentCache : public BaseHook
+{
+    CARTA_HOOK_BOILER1( GetPersistentCache );
+
+public:
+
+    /**
+     * @brief Result is the persistent cache.
+     */
+    typedef IPCache::SharedPtr ResultType;
+
+    /**
+     * @brief No input
+     */
+    struct Params { };
+
+    /**
+     * @brief constructor
+     * @param pptr pointer to the input parameters
+     */
+    GetPersistentCache( Params * pptr ) : BaseHook( staticId ), paramsPtr( pptr )
+    {
+        CARTA_ASSERT( is < Me > () );
+    }
+
+    ResultType result;
+    Params * paramsPtr;
+};
+}
+}
+}
@@ -105,9 +105,19 @@ public:
     /// The address of the returned reference will remain the same throughout the
     /// traversal, so for maximum efficiency you only need to call this once
     /// before the traversal starts and store the pointer (or reference)
+    ///
+    /// During block traversal (forEach() with a buffer size) this is the coordinate
+    /// of the first pixel of the current block, see also currentBlockDims()
     virtual const VI &
     currentPos() = 0;
 
+    /// returns the dimensions of the block currently visited by the buffered forEach().
+    /// Each block is a box starting at currentPos(), and its pixels are stored
+    /// in sequential order. With Traversal::Optimal the blocks follow the storage
+    /// layout of the image (e.g. tiles), so they are not necessarily whole rows.
+    virtual const VI &
+    currentBlockDims() = 0;
+
     /// return a unique ID for this instance
     /// \todo motivation for this is a cheap comparison, but maybe we could implement
     /// a real comparison as well?
@@ -146,6 +156,7 @@ public:
           Traversal traversal = Traversal::Sequential ) = 0;
 
     /// reset the position for the next read()
+    /// \param ind index of the pixel (not byte) where the next read() starts
     virtual void
     seek( int64_t ind = 0 ) = 0;
 
@@ -161,6 +172,9 @@ public:
     /// but the supplied function gets called with multiple pixel data
     /// (however many fit into the buffer)
     ///
+    /// With Traversal::Optimal the blocks are visited in the order that is cheapest
+    /// to read, use currentPos()/currentBlockDims() to find out where each block is.
+    ///
     /// I think I like this one the most.
     virtual void
     forEach( int64_t buffSize,
@@ -190,6 +204,7 @@ public:
 
         // figure out which converter to use
         m_converterFunc = getConverter < Type > ( rawView->pixelType() );
+        m_blockConverterFunc = getBlockConverter < Type > ( rawView->pixelType() );
     }
 
     /// get the max. dimensions allowed in this accessor
@@ -216,13 +231,52 @@ public:
         std::function < void (const Type &) > func,
         RawViewInterface::Traversal traversal = RawViewInterface::Traversal::Sequential )
     {
-        auto wrapper = [this, & func] ( const char * ptr )->void
+        auto wrapper = [& func] ( const Type * data, int64_t count )->void
         {
-            func( m_converterFunc( ptr ) );
+            for ( int64_t i = 0 ; i < count ; ++i ) {
+                func( data[i] );
+            }
         };
-        m_rawView->forEach( wrapper, traversal );
+        forEachBlock( wrapper, traversal );
     }
 
+    /// block version of forEach(), the function is invoked with a contiguous array
+    /// of converted values and its length. This is the preferred way to read large
+    /// amounts of data, as the conversion is done once per block.
+    /// \param func function to invoke on each block
+    /// \param traversal order of traversal (for Optimal, use rawView()->currentPos()
+    /// and rawView()->currentBlockDims() to find out where the block is)
+    /// \param blockSize maximum number of elements per block
+    void
+    forEachBlock(
+        std::function < void (const Type *, int64_t) > func,
+        RawViewInterface::Traversal traversal = RawViewInterface::Traversal::Sequential,
+        int64_t blockSize = DefaultBlockSize )
+    {
+        RawViewInterface::PixelType srcType = m_rawView-> pixelType();
+        int64_t srcBlockBytes = blockSize * Image::pixelType2size( srcType );
+
+        // no conversion needed, hand out the raw view's own storage
+        if ( srcType == Image::CType2PixelType < Type >::type ) {
+            auto wrapper = [& func] ( const char * ptr, int64_t count )->void
+            {
+                func( reinterpret_cast < const Type * > ( ptr ), count );
+            };
+            m_rawView-> forEach( srcBlockBytes, wrapper, nullptr, traversal );
+            return;
+        }
+
+        CARTA_ASSERT( m_blockConverterFunc );
+        m_blockBuffer.resize( blockSize );
+        Type * dst = & m_blockBuffer[0];
+        auto wrapper = [this, & func, dst] ( const char * ptr, int64_t count )->void
+        {
+            m_blockConverterFunc( ptr, count, dst );
+            func( dst, count );
+        };
+        m_rawView-> forEach( srcBlockBytes, wrapper, nullptr, traversal );
+    } // forEachBlock
+
     ~TypedView()
     {
         if ( m_keepOwnership ) {
@@ -249,6 +303,15 @@ protected:
     /// classic c-style function pointer to the converter
     /// \todo is this faster than std::function?
     const Type & ( * m_converterFunc )(const char *);
+
+    /// converter for whole blocks
+    void ( * m_blockConverterFunc )( const char *, int64_t, Type * );
+
+    /// buffer for converted blocks
+    std::vector < Type > m_blockBuffer;
+
+    /// default number of elements per block in forEachBlock()
+    static constexpr int64_t DefaultBlockSize = 64 * 1024;
 };
 
 /// convenience types
@@ -475,6 +538,13 @@ test_apis()
                          }
                          );
 
+    // iterate over all pixels, a block at a time
+    doubleReader.forEachBlock([& sum] ( const double * data, int64_t count ) {
+                                  for ( int64_t i = 0 ; i < count ; ++i ) { sum += data[i];
+                                  }
+                              }
+                              );
+
     // META DATA API tests:
     // ===========================
 
@@ -4,6 +4,7 @@
 
 #pragma once
 
+#include "CartaLib/CartaLib.h"
 #include <QJsonObject>
 #include <QByteArray>
 #include <QString>
@@ -13,8 +14,16 @@ namespace Carta
 {
 namespace Lib
 {
+/// persistent cache, its entries survive restarts of the application
+///
+/// entries with a higher priority are kept longer, among entries with the same
+/// priority the least recently used ones are removed first, when the cache is full
+///
+/// implementations must be thread safe
 class IPCache
 {
+    CLASS_BOILERPLATE( IPCache );
+
 public:
 
     /// return maximum storage in bytes
@@ -44,6 +53,9 @@ public:
     setEntry( const QByteArray & key,
               const QByteArray & val,
               int64_t priority ) = 0;
+
+    virtual
+    ~IPCache() { }
 };
 }
 }
@@ -152,11 +152,23 @@ public:
     }
 
     double
-    param()
+    param() const
     {
         return m_a;
     }
 
+    double
+    gamma() const
+    {
+        return m_gamma;
+    }
+
+    ScaleType
+    type() const
+    {
+        return m_scaleType;
+    }
+
     void
     setType( ScaleType stype )
     {
@@ -294,6 +306,7 @@ public:
     void
     setColormap( IColormapNamed::SharedPtr colormap )
     {
+        m_cmap = colormap;
         m_cmapName = colormap-> name();
         m_pipe-> setStage3( colormap );
     }
@@ -332,6 +345,25 @@ public:
         max = m_clipMax;
     }
 
+    /// the copy shares the colormap with this pipeline, colormaps are not modified
+    /// after they are created
+    virtual IClippedPixelPipeline::SharedPtr
+    clone() const override
+    {
+        auto copy = std::make_shared < CustomizablePixelPipeline > ();
+        copy-> setScale( m_scaleStage-> type() );
+        copy-> setScaleParam( m_scaleStage-> param() );
+        copy-> setGamma( m_scaleStage-> gamma() );
+        copy-> setRgbMax( m_maxRgb );
+        copy-> setInvert( m_invertFlag );
+        copy-> setReverse( m_reverseFlag );
+        if ( m_cmap ) {
+            copy-> setColormap( m_cmap );
+        }
+        copy-> setMinMax( m_clipMin, m_clipMax );
+        return copy;
+    }
+
     QString
     cacheId()
     {
@@ -354,6 +386,7 @@ private:
     double m_clipMin = 0, m_clipMax = 1;
     NormRgb m_maxRgb {{ 1.0, 1.0, 1.0}};
 
+    IColormapNamed::SharedPtr m_cmap = nullptr;
     QString m_cmapName;
     bool m_invertFlag = false, m_reverseFlag = false;
 };
@@ -5,6 +5,9 @@
 #include <stdexcept>
 #include <cmath>
 #include <array>
+#include <algorithm>
+#include <cstdint>
+#include <vector>
 
 namespace Carta
 {
@@ -166,6 +169,22 @@ public:
     virtual void
     convertq( double val, QRgb & result ) = 0;
 
+    /// batch version of convertq(), NaNs are converted to nanColor
+    /// \note the default implementation simply calls convertq() on every value, but
+    /// it at least saves the caller the NaN test and one virtual call per pixel
+    virtual void
+    convertqBatch( const double * vals, int64_t count, QRgb * result, QRgb nanColor )
+    {
+        _convertqLoop( vals, count, result, nanColor );
+    }
+
+    /// float version of the above
+    virtual void
+    convertqBatch( const float * vals, int64_t count, QRgb * result, QRgb nanColor )
+    {
+        _convertqLoop( vals, count, result, nanColor );
+    }
+
     /// returns the input clip range
     /// \note this is not strictly necessary for minimalist interface, but we do use
     /// this just about everywhere where we need IPixelPipeline for caching, so I stuck
@@ -174,6 +193,22 @@ public:
 
     virtual
     ~IPixelPipeline() { }
+
+protected:
+
+    template < typename Scalar >
+    void
+    _convertqLoop( const Scalar * vals, int64_t count, QRgb * result, QRgb nanColor )
+    {
+        for ( int64_t i = 0 ; i < count ; ++i ) {
+            if ( Q_LIKELY( ! std::isnan( vals[i] ) ) ) {
+                convertq( vals[i], result[i] );
+            }
+            else {
+                result[i] = nanColor;
+            }
+        }
+    }
 };
 
 class IClippedPixelPipeline : public IPixelPipeline
@@ -183,6 +218,14 @@ class IClippedPixelPipeline : public IPixelPipeline
 public:
 
     virtual void getClips( double & min, double & max) = 0;
+
+    /// returns an independent copy of this pipeline, which can be used on another
+    /// thread while this one is being modified, or nullptr if copying is not supported
+    virtual SharedPtr
+    clone() const
+    {
+        return nullptr;
+    }
 };
 
 /// composite function for converting pixels to rgb
@@ -347,6 +390,12 @@ public:
         m_n1 = m_cache.size() - 1;
         m_d = ( m_max - m_min ) / m_n1;
         m_dInvN1 = 1 / m_d;
+
+        // 8 bit version of the cache for convertqBatch()
+        m_qcache.resize( nSegments );
+        for ( int64_t i = 0 ; i < nSegments ; i++ ) {
+            normRgb2QRgb( m_cache[i], m_qcache[i] );
+        }
     }
 
     void
@@ -360,9 +409,65 @@ public:
         normRgb2QRgb( drgb, result );
     }
 
+    /// batch version of convertq(), NaNs are converted to nanColor
+    ///
+    /// The values are processed in chunks, in two passes. The first pass computes
+    /// the lookup table indices (with clamping and NaN handling done by selects
+    /// rather than branches, so the compiler can vectorize it), the second one
+    /// does the lookups.
+    template < typename Scalar >
+    void
+    convertqBatch( const Scalar * vals, int64_t count, QRgb * result, QRgb nanColor )
+    {
+        const int64_t chunkSize = 256;
+        int32_t inds[chunkSize];
+        double fracs[chunkSize];
+        const int32_t maxInd = interpolated ? int32_t( m_n1 ) - 1 : int32_t( m_n1 );
+        for ( int64_t c = 0 ; c < count ; c += chunkSize ) {
+            const Scalar * src = vals + c;
+            QRgb * dst = result + c;
+            int64_t n = std::min( chunkSize, count - c );
+
+            // pass 1: indices (-1 for NaN) and interpolation fractions
+            for ( int64_t i = 0 ; i < n ; ++i ) {
+                double x = src[i];
+                bool isNan = x != x;
+                double dind = ( x - m_min ) * m_dInvN1;
+                dind = isNan ? 0.0 : std::min( std::max( dind, 0.0 ), m_n1 );
+                int32_t ind = interpolated ? int32_t( dind ) : int32_t( dind + 0.5 );
+                ind = std::min( ind, maxInd );
+                fracs[i] = dind - ind;
+                inds[i] = isNan ? - 1 : ind;
+            }
+
+            // pass 2: lookups
+            if ( interpolated ) {
+                for ( int64_t i = 0 ; i < n ; ++i ) {
+                    if ( Q_UNLIKELY( inds[i] < 0 ) ) {
+                        dst[i] = nanColor;
+                        continue;
+                    }
+                    const NormRgb & a = m_cache[inds[i]];
+                    const NormRgb & b = m_cache[inds[i] + 1];
+                    double f = fracs[i];
+                    dst[i] = qRgb( int( ( a[0] * ( 1 - f ) + b[0] * f ) * 255 + 0.5 ),
+                                   int( ( a[1] * ( 1 - f ) + b[1] * f ) * 255 + 0.5 ),
+                                   int( ( a[2] * ( 1 - f ) + b[2] * f ) * 255 + 0.5 ) );
+                }
+            }
+            else {
+                const QRgb * lut = & m_qcache[0];
+                for ( int64_t i = 0 ; i < n ; ++i ) {
+                    dst[i] = inds[i] < 0 ? nanColor : lut[inds[i]];
+                }
+            }
+        }
+    } // convertqBatch
+
 private:
 
     std::vector < NormRgb > m_cache;
+    std::vector < QRgb > m_qcache;
 //    NormRgb m_nanColor { { 1.0, 0.0, 0.0 } };
     double m_min = 0, m_max = 1;
     double m_d, m_dInvN1, m_n1;
@@ -6,6 +6,7 @@
 
 #include <QString>
 #include <cstdint>
+#include <cstring>
 #include <type_traits>
 
 namespace Carta {
@@ -133,6 +134,11 @@ struct TypedConverters < SrcType, SrcType > {
     static const SrcType & cvt( const char * ptr) {
         return * reinterpret_cast<const SrcType *>( ptr);
     }
+
+    /// block version of cvt(), converts count consecutive values into dst
+    static void cvtBlock( const char * ptr, int64_t count, SrcType * dst) {
+        std::memcpy( dst, ptr, count * sizeof( SrcType));
+    }
 };
 
 /// general case
@@ -143,6 +149,17 @@ struct TypedConverters {
         buffer = static_cast<DstType>(* reinterpret_cast<const SrcType *>( ptr));
         return buffer;
     }
+
+    /// block version of cvt(), converts count consecutive values into dst
+    /// \note this is a plain loop over restrict pointers so that the compiler
+    /// can vectorize it
+    static void cvtBlock( const char * ptr, int64_t count, DstType * dst) {
+        const SrcType * __restrict__ src = reinterpret_cast<const SrcType *>( ptr);
+        DstType * __restrict__ out = dst;
+        for( int64_t i = 0 ; i < count ; ++ i) {
+            out[i] = static_cast<DstType>( src[i]);
+        }
+    }
 };
 
 
@@ -176,6 +193,41 @@ typename Type2CvtFunc<DstType>::Type getConverter( Carta::Lib::Image::PixelType
     }
 }
 
+template < typename DstType>
+struct Type2BlockCvtFunc{
+    typedef void ( * Type)( const char *, int64_t, DstType *);
+};
+
+/// same as getConverter(), but the returned function converts a whole block of
+/// values at once
+template < typename DstType>
+typename Type2BlockCvtFunc<DstType>::Type getBlockConverter( Carta::Lib::Image::PixelType srcType)
+{
+    switch (srcType) {
+    case Image::PixelType::Byte:
+        return & TypedConverters< uint8_t, DstType>::cvtBlock;
+        break;
+    case Image::PixelType::Int16:
+        return & TypedConverters< int16_t, DstType>::cvtBlock;
+        break;
+    case Image::PixelType::Int32:
+        return & TypedConverters< int32_t, DstType>::cvtBlock;
+        break;
+    case Image::PixelType::Int64:
+        return & TypedConverters< int64_t, DstType>::cvtBlock;
+        break;
+    case Image::PixelType::Real32:
+        return & TypedConverters< float, DstType>::cvtBlock;
+        break;
+    case Image::PixelType::Real64:
+        return & TypedConverters< double, DstType>::cvtBlock;
+        break;
+    default:
+        return nullptr;
+        break;
+    }
+}
+
 /// convenience function to convert a type to a string
 QString toStr( Image::PixelType t);
 
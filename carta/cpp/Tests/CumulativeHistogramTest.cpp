@@ -0,0 +1,126 @@
+#include "catch.h"
+#include "core/Algorithms/CumulativeHistogram.h"
+#include "VectorView.h"
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+using namespace Carta::Core::Algorithms;
+namespace NdArray = Carta::Lib::NdArray;
+
+TEST_CASE( "Cumulative histogram with point masses", "[quantiles]" ) {
+
+    // half zeros, then two more point masses, a continuous tail and some NaNs
+    std::vector<double> vals;
+    std::srand( 1);
+    for( int i = 0 ; i < 100000 ; i ++ ) {
+        double x = double( std::rand()) / RAND_MAX;
+        double v;
+        if( i % 100 == 0 ) v = std::numeric_limits<double>::quiet_NaN();
+        else if( x < 0.5 ) v = 0;
+        else if( x < 0.7 ) v = 1;
+        else if( x < 0.9 ) v = 2.5;
+        else v = 3 + x;
+        vals.push_back( v);
+    }
+    std::vector<double> sorted;
+    for( double v : vals) {
+        if( ! std::isnan( v)) sorted.push_back( v);
+    }
+    std::sort( sorted.begin(), sorted.end());
+    double n = sorted.size();
+
+    // fraction of values <= v
+    auto fractionUpTo = [&] ( double v) {
+        return ( std::upper_bound( sorted.begin(), sorted.end(), v) - sorted.begin()) / n;
+    };
+    // fraction of values < v
+    auto fractionBelow = [&] ( double v) {
+        return ( std::lower_bound( sorted.begin(), sorted.end(), v) - sorted.begin()) / n;
+    };
+
+    // few bins, so that each point mass spans many of them
+    NdArray::Double view( new VectorView( vals), true);
+    CumulativeHistogram::SharedPtr hist = CumulativeHistogram::build( view, 64);
+    REQUIRE( hist-> count() == int64_t( sorted.size()));
+
+    SECTION( "Percentiles of the point masses are exact") {
+        for( double v : { 0.0, 1.0, 2.5 }) {
+            REQUIRE( hist-> percentile( v) == Approx( fractionUpTo( v)));
+        }
+        REQUIRE( hist-> percentile( - 1) == 0);
+        REQUIRE( hist-> percentile( 0.5) == Approx( fractionUpTo( 0.5)));
+        REQUIRE( hist-> percentile( 2) == Approx( fractionUpTo( 2)));
+        REQUIRE( hist-> percentile( sorted.back()) == 1);
+    }
+
+    SECTION( "Intensities are values of the data") {
+        for( int i = 0 ; i <= 100 ; i ++ ) {
+            double p = i / 100.0;
+            int64_t rank = std::min<int64_t>( sorted.size() * p, sorted.size() - 1);
+            double v = hist-> intensity( p).value;
+            REQUIRE( v >= sorted.front());
+            REQUIRE( v <= sorted.back());
+            if( sorted[rank] < 3 ) {
+                REQUIRE( v == sorted[rank]);
+            }
+            CumulativeHistogram::Intensity exact = hist-> exactIntensity( view, p);
+            REQUIRE( exact.value == sorted[rank]);
+            REQUIRE( vals[exact.index] == exact.value);
+        }
+    }
+
+    SECTION( "Exact lookups over slices") {
+        // the same data, in four slices
+        int sliceSize = vals.size() / 4;
+        auto sliceView = [&] ( int slice) -> NdArray::RawViewInterface * {
+            return new VectorView( std::vector<double>(
+                vals.begin() + slice * sliceSize, vals.begin() + ( slice + 1) * sliceSize));
+        };
+        CumulativeHistogram::SharedPtr sliced = CumulativeHistogram::build<double>( 4, sliceView, 64);
+        REQUIRE( sliced-> count() == hist-> count());
+        for( int i = 0 ; i <= 100 ; i ++ ) {
+            double p = i / 100.0;
+            int64_t rank = std::min<int64_t>( sorted.size() * p, sorted.size() - 1);
+            CumulativeHistogram::Intensity exact = sliced-> exactIntensity<double>( 4, sliceView, p);
+            REQUIRE( exact.value == sorted[rank]);
+            REQUIRE( vals[exact.slice * sliceSize + exact.index] == exact.value);
+            REQUIRE( sliced-> exactPercentile<double>( 4, sliceView, exact.value)
+                     == Approx( fractionUpTo( exact.value)));
+        }
+    }
+
+    SECTION( "Round trips") {
+        // the smallest percentile of a point mass leads back to it
+        for( double v : { 0.0, 1.0, 2.5 }) {
+            CumulativeHistogram::Intensity intensity = hist-> intensity( fractionBelow( v) + 0.5 / n);
+            REQUIRE( intensity.value == v);
+            REQUIRE( vals[intensity.index] == v);
+            REQUIRE( hist-> intensity( hist-> percentile( v) - 1 / n).value == v);
+        }
+        // and the intensity of a percentile has at least that many values below it
+        for( int i = 0 ; i < 100 ; i ++ ) {
+            double p = i / 100.0;
+            double v = hist-> intensity( p).value;
+            REQUIRE( hist-> percentile( v) >= p);
+            REQUIRE( hist-> exactPercentile( view, v) == Approx( fractionUpTo( v)));
+        }
+    }
+
+    SECTION( "Serialization") {
+        CumulativeHistogram::SharedPtr copy = CumulativeHistogram::deserialize( hist-> serialize());
+        REQUIRE( copy);
+        REQUIRE( copy-> count() == hist-> count());
+        for( int i = 0 ; i <= 100 ; i ++ ) {
+            double p = i / 100.0;
+            REQUIRE( copy-> intensity( p).value == hist-> intensity( p).value);
+            REQUIRE( copy-> intensity( p).index == hist-> intensity( p).index);
+            REQUIRE( copy-> percentile( 4 * p) == hist-> percentile( 4 * p));
+        }
+        // damaged data is rejected
+        QByteArray data = hist-> serialize();
+        REQUIRE_FALSE( CumulativeHistogram::deserialize( data.left( data.size() / 2)));
+        REQUIRE_FALSE( CumulativeHistogram::deserialize( QByteArray()));
+    }
+}
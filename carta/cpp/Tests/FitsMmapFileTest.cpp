@@ -0,0 +1,200 @@
+#include "catch.h"
+#include "plugins/CasaImageLoader/FitsMmapFile.h"
+#include <QDir>
+#include <QFile>
+#include <QList>
+#include <QString>
+#include <QTemporaryDir>
+#include <QtEndian>
+#include <cmath>
+#include <cstring>
+#include <vector>
+
+namespace
+{
+const int BlockSize = 2880;
+
+// a header card with a value
+QByteArray
+card( const QString & key, const QString & value )
+{
+    QString text = key.leftJustified( 8, ' ' ) + "= " + value.rightJustified( 20, ' ' );
+    return text.toLatin1().leftJustified( 80, ' ' );
+}
+
+// a header card without a value
+QByteArray
+commentCard( const QString & key, const QString & text )
+{
+    return ( key.leftJustified( 8, ' ' ) + text ).toLatin1().leftJustified( 80, ' ' );
+}
+
+// values in big-endian byte order, Raw is stored as UInt
+template < typename Raw, typename UInt >
+QByteArray
+bigEndian( const std::vector < Raw > & values )
+{
+    QByteArray data( int( values.size() * sizeof( Raw )), '\0' );
+    for( size_t i = 0 ; i < values.size() ; i ++ ) {
+        UInt bits;
+        std::memcpy( & bits, & values[i], sizeof( bits));
+        qToBigEndian( bits, reinterpret_cast<uchar *>( data.data() + i * sizeof( Raw)));
+    }
+    return data;
+}
+
+// write a FITS file with the given header cards (END is added) and data
+void
+writeFits( const QString & path, const QList<QByteArray> & cards, const QByteArray & data )
+{
+    QByteArray header;
+    for( const QByteArray & c : cards ) {
+        header += c;
+    }
+    header += commentCard( "END", "");
+    header = header.leftJustified( ( header.size() + BlockSize - 1) / BlockSize * BlockSize, ' ');
+    QByteArray body = data;
+    body = body.leftJustified( ( body.size() + BlockSize - 1) / BlockSize * BlockSize, '\0');
+    QFile file( path);
+    REQUIRE( file.open( QIODevice::WriteOnly));
+    REQUIRE( file.write( header + body) == header.size() + body.size());
+}
+
+std::vector<float>
+pixels( const FitsMmapFile & fits, int64_t count )
+{
+    std::vector<float> result( count);
+    fits.convert( fits.data(), count, 1, result.data());
+    return result;
+}
+}
+
+TEST_CASE( "Memory mapped FITS", "[fits]" ) {
+
+    QTemporaryDir tmpDir;
+    REQUIRE( tmpDir.isValid());
+    QString path = QDir( tmpDir.path()).filePath( "test.fits");
+
+    SECTION( "Header and floats") {
+        std::vector<float> values;
+        for( int i = 0 ; i < 4 * 3 * 2 ; i ++ ) {
+            values.push_back( i * 0.5f - 3);
+        }
+        writeFits( path, {
+            card( "SIMPLE", "T"),
+            card( "BITPIX", "-32"),
+            card( "NAXIS", "3"),
+            card( "NAXIS1", "4"),
+            card( "NAXIS2", "3"),
+            card( "NAXIS3", "2 / channels"),
+            commentCard( "COMMENT", "not a keyword = 5"),
+            card( "OBJECT", "'test'")
+        }, bigEndian<float, quint32>( values));
+
+        FitsMmapFile::SharedPtr fits = FitsMmapFile::open( path);
+        REQUIRE( fits);
+        REQUIRE( fits-> dims() == std::vector<int>( { 4, 3, 2 }));
+        REQUIRE( fits-> bitpix() == -32);
+        REQUIRE( fits-> pixelSize() == 4);
+        REQUIRE( pixels( * fits, values.size()) == values);
+
+        // every other pixel
+        std::vector<float> strided( values.size() / 2);
+        fits-> convert( fits-> data(), strided.size(), 2, strided.data());
+        for( size_t i = 0 ; i < strided.size() ; i ++ ) {
+            REQUIRE( strided[i] == values[2 * i]);
+        }
+    }
+
+    SECTION( "Scaled 16 bit integers with blanks") {
+        std::vector<qint16> values = { -32768, -1, 0, 1, 7, 32767 };
+        writeFits( path, {
+            card( "SIMPLE", "T"),
+            card( "BITPIX", "16"),
+            card( "NAXIS", "2"),
+            card( "NAXIS1", "3"),
+            card( "NAXIS2", "2"),
+            card( "BSCALE", "2.5D0"),
+            card( "BZERO", "10"),
+            card( "BLANK", "-32768")
+        }, bigEndian<qint16, quint16>( values));
+
+        FitsMmapFile::SharedPtr fits = FitsMmapFile::open( path);
+        REQUIRE( fits);
+        REQUIRE( fits-> bitpix() == 16);
+        REQUIRE( fits-> pixelSize() == 2);
+        REQUIRE_FALSE( fits-> isNative());
+        std::vector<float> result = pixels( * fits, values.size());
+        REQUIRE( std::isnan( result[0]));
+        for( size_t i = 1 ; i < values.size() ; i ++ ) {
+            REQUIRE( result[i] == Approx( 10 + 2.5 * values[i]));
+        }
+    }
+
+    SECTION( "32 bit integers with an offset") {
+        std::vector<qint32> values = { -2147483647 - 1, -5, 0, 100000, 2147483647, 42 };
+        writeFits( path, {
+            card( "SIMPLE", "T"),
+            card( "BITPIX", "32"),
+            card( "NAXIS", "1"),
+            card( "NAXIS1", "6"),
+            card( "BZERO", "2147483648")
+        }, bigEndian<qint32, quint32>( values));
+
+        FitsMmapFile::SharedPtr fits = FitsMmapFile::open( path);
+        REQUIRE( fits);
+        REQUIRE( fits-> dims() == std::vector<int>( { 6 }));
+        std::vector<float> result = pixels( * fits, values.size());
+        for( size_t i = 0 ; i < values.size() ; i ++ ) {
+            REQUIRE( result[i] == float( 2147483648.0 + values[i]));
+        }
+    }
+
+    SECTION( "Header spanning several blocks") {
+        // the axes are only known after the first two blocks
+        QList<QByteArray> cards = {
+            card( "SIMPLE", "T"),
+            card( "BITPIX", "-32"),
+            card( "NAXIS", "2")
+        };
+        for( int i = 0 ; i < 80 ; i ++ ) {
+            cards.append( commentCard( "HISTORY", QString( "step %1").arg( i)));
+        }
+        cards.append( card( "NAXIS1", "5"));
+        cards.append( card( "NAXIS2", "2"));
+        std::vector<float> values = { 1, 2, 3, 4, 5, -1, -2, -3, -4, -5 };
+        writeFits( path, cards, bigEndian<float, quint32>( values));
+
+        FitsMmapFile::SharedPtr fits = FitsMmapFile::open( path);
+        REQUIRE( fits);
+        REQUIRE( fits-> dims() == std::vector<int>( { 5, 2 }));
+        REQUIRE( pixels( * fits, values.size()) == values);
+    }
+
+    SECTION( "Files that cannot be mapped") {
+        // not FITS
+        {
+            QFile file( path);
+            REQUIRE( file.open( QIODevice::WriteOnly));
+            file.write( QByteArray( BlockSize, 'x'));
+        }
+        REQUIRE_FALSE( FitsMmapFile::open( path));
+
+        // no data array
+        writeFits( path, { card( "SIMPLE", "T"), card( "BITPIX", "8"), card( "NAXIS", "0") },
+                   QByteArray());
+        REQUIRE_FALSE( FitsMmapFile::open( path));
+
+        // unsupported BITPIX
+        writeFits( path, { card( "SIMPLE", "T"), card( "BITPIX", "12"), card( "NAXIS", "1"),
+                           card( "NAXIS1", "4") }, QByteArray( 8, '\0'));
+        REQUIRE_FALSE( FitsMmapFile::open( path));
+
+        // data cut short
+        writeFits( path, { card( "SIMPLE", "T"), card( "BITPIX", "16"), card( "NAXIS", "1"),
+                           card( "NAXIS1", "4") }, QByteArray( 8, '\0'));
+        REQUIRE( FitsMmapFile::open( path));
+        REQUIRE( QFile::resize( path, BlockSize + 4));
+        REQUIRE_FALSE( FitsMmapFile::open( path));
+    }
+}
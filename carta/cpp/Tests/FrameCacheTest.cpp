@@ -0,0 +1,68 @@
+#include "catch.h"
+#include "core/FrameCache.h"
+
+using namespace Carta::Core::ImageRenderService;
+
+static FrameCacheKey makeKey( double zoom)
+{
+    FrameCacheKey key;
+    key.viewId = "view";
+    key.pipelineId = "pipeline";
+    key.outputSize = QSize( 10, 10);
+    key.zoom = zoom;
+    return key;
+}
+
+TEST_CASE( "Frame cache", "[framecache]" ) {
+
+    QImage img( 10, 10, QImage::Format_ARGB32);
+    img.fill( Qt::red);
+
+    SECTION( "Hits and misses") {
+        FrameCache cache( 1024 * 1024);
+        QImage out;
+        REQUIRE( ! cache.find( makeKey( 1), out));
+        cache.insert( makeKey( 1), img);
+        REQUIRE( cache.find( makeKey( 1), out));
+        REQUIRE( out == img);
+        REQUIRE( ! cache.find( makeKey( 2), out));
+
+        FrameCache::Stats stats = cache.stats();
+        REQUIRE( stats.hits == 1);
+        REQUIRE( stats.misses == 2);
+        REQUIRE( stats.insertions == 1);
+        REQUIRE( stats.count == 1);
+        REQUIRE( stats.bytes >= img.bytesPerLine() * img.height());
+    }
+
+    SECTION( "Least recently used frames are evicted first") {
+        // room for two frames, but not for three
+        FrameCache probe( 1024 * 1024);
+        probe.insert( makeKey( 1), img);
+        int64_t frameBytes = probe.stats().bytes;
+        FrameCache cache( frameBytes * 2 + frameBytes / 2);
+
+        QImage out;
+        cache.insert( makeKey( 1), img);
+        cache.insert( makeKey( 2), img);
+        REQUIRE( cache.find( makeKey( 1), out));
+        cache.insert( makeKey( 3), img);
+        REQUIRE( cache.find( makeKey( 1), out));
+        REQUIRE( ! cache.find( makeKey( 2), out));
+        REQUIRE( cache.find( makeKey( 3), out));
+        REQUIRE( cache.stats().evictions == 1);
+
+        // shrinking the cache evicts too
+        cache.setMaxBytes( frameBytes);
+        REQUIRE( cache.stats().count == 1);
+        REQUIRE( cache.find( makeKey( 3), out));
+    }
+
+    SECTION( "Frames larger than the cache are not inserted") {
+        FrameCache cache( 100);
+        QImage out;
+        cache.insert( makeKey( 1), img);
+        REQUIRE( ! cache.find( makeKey( 1), out));
+        REQUIRE( cache.stats().bytes == 0);
+    }
+}
@@ -13,6 +13,7 @@
 #include <QString>
 #include <QTextStream>
 #include <QLineF>
+#include <QElapsedTimer>
 #include <string>
 #include <algorithm>
 
@@ -180,6 +181,15 @@ TEST_CASE( "Line combiner testing", "[polyline]" ) {
         REQUIRE( ! res[0].isClosed());
     }
 
+    SECTION( "ends in neighbouring cells") {
+        LineCombiner lc( rect1, 10, 10, 0.001);
+        lc.add( { 1.0004, 5 }, { 3, 5 });
+        lc.add( { 0, 5 }, { 0.9998, 5 });
+        std::vector<QPolygonF> res = lc.getPolygons();
+        REQUIRE( res.size() == 1);
+        REQUIRE( res[0].size() == 3);
+    }
+
     SECTION( "circle") {
         QPolygonF poly;
         double rad = 10;
@@ -209,3 +219,51 @@ TEST_CASE( "Line combiner testing", "[polyline]" ) {
 
 
 }
+
+// segments of nCircles circles of 1000 segments each, laid out on a grid
+static std::vector<QLineF> circleSegments( int nCircles, QRectF & rect)
+{
+    const int perCircle = 1000;
+    const int perRow = 100;
+    std::vector<QLineF> lines;
+    lines.reserve( nCircles * perCircle);
+    for( int c = 0 ; c < nCircles ; ++ c) {
+        QPointF centre( ( c % perRow) * 30 + 15, ( c / perRow) * 30 + 15);
+        for( int i = 0 ; i < perCircle ; ++ i) {
+            double a1 = M_PI * 2 * i / perCircle;
+            double a2 = M_PI * 2 * ( i + 1) / perCircle;
+            QPointF p1 = centre + QPointF( sin( a1), cos( a1)) * 10;
+            QPointF p2 = centre + QPointF( sin( a2), cos( a2)) * 10;
+            if( drand48() < 0.5 )
+                lines.push_back( QLineF( p1, p2));
+            else
+                lines.push_back( QLineF( p2, p1));
+        }
+    }
+    rect = QRectF( 0, 0, perRow * 30, ( nCircles + perRow - 1) / perRow * 30);
+    return lines;
+}
+
+// run with: Tests "[benchmark]"
+TEST_CASE( "Line combiner benchmark", "[.][benchmark]" ) {
+
+    for( int nCircles : { 100, 1000, 4000 }) {
+        QRectF rect;
+        std::vector<QLineF> lines = circleSegments( nCircles, rect);
+        for( bool shuffled : { false, true }) {
+            if( shuffled) {
+                std::random_shuffle( lines.begin(), lines.end());
+            }
+            QElapsedTimer timer;
+            timer.start();
+            LineCombiner lc( rect, rect.height() * 10, rect.width() * 10, 1e-9);
+            for( auto & line : lines) {
+                lc.add( line.p1(), line.p2());
+            }
+            std::vector<QPolygonF> res = lc.getPolygons();
+            WARN( lines.size() << " segments" << ( shuffled ? " (shuffled)" : "")
+                  << ": " << timer.elapsed() << " ms");
+            REQUIRE( res.size() == size_t( nCircles));
+        }
+    }
+}
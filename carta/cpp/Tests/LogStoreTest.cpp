@@ -0,0 +1,127 @@
+#include "catch.h"
+#include "plugins/DiskCache/LogStore.h"
+#include <QDir>
+#include <QFile>
+#include <QTemporaryDir>
+#include <memory>
+#include <stdexcept>
+
+namespace
+{
+QByteArray
+value( char c, int size = 30 )
+{
+    return QByteArray( size, c );
+}
+
+bool
+has( LogStore & store, const QByteArray & key )
+{
+    QByteArray val;
+    return store.read( key, val );
+}
+}
+
+TEST_CASE( "Log store", "[pcache]" ) {
+
+    QTemporaryDir tmpDir;
+    REQUIRE( tmpDir.isValid());
+    QString dirPath = tmpDir.path();
+    QString logPath = QDir( dirPath).filePath( "pcache.log");
+
+    SECTION( "Damaged tail is cut off") {
+        uint64_t goodBytes = 0;
+        {
+            LogStore store( dirPath, 1024 * 1024);
+            store.write( "a", value( 'a'), 0);
+            store.write( "b", value( 'b'), 0);
+            goodBytes = store.fileBytes();
+        }
+
+        // junk after the last record, as if a write was interrupted
+        {
+            QFile file( logPath);
+            REQUIRE( file.open( QIODevice::Append));
+            file.write( QByteArray( 10, 'x'));
+        }
+        {
+            LogStore store( dirPath, 1024 * 1024);
+            REQUIRE( store.count() == 2);
+            REQUIRE( store.fileBytes() == goodBytes);
+            REQUIRE( QFile( logPath).size() == qint64( goodBytes));
+            QByteArray val;
+            REQUIRE( store.read( "b", val));
+            REQUIRE( val == value( 'b'));
+            store.write( "c", value( 'c'), 0);
+        }
+
+        // the last record only made it in part
+        REQUIRE( QFile::resize( logPath, QFile( logPath).size() - 5));
+        {
+            LogStore store( dirPath, 1024 * 1024);
+            REQUIRE( store.count() == 2);
+            REQUIRE( has( store, "a"));
+            REQUIRE( has( store, "b"));
+            REQUIRE_FALSE( has( store, "c"));
+        }
+    }
+
+    SECTION( "Eviction goes by priority, then least recently used") {
+        // room for 10 records of 64 bytes
+        uint64_t recordBytes = LogStore::HeaderBytes + 2 + 30;
+        LogStore store( dirPath, 10 * recordBytes);
+        for( int i = 0 ; i < 10 ; i ++ ) {
+            store.write( QByteArray( "k") + char( '0' + i), value( 'v'), i < 5 ? 1 : 2);
+        }
+        REQUIRE( store.count() == 10);
+        REQUIRE( has( store, "k0"));
+
+        // one more, evicts down to 90% of the limit, i.e. two records
+        store.write( "kA", value( 'v'), 2);
+        REQUIRE( store.count() == 9);
+        REQUIRE( store.usedBytes() <= 9 * recordBytes);
+        REQUIRE_FALSE( has( store, "k1"));
+        REQUIRE_FALSE( has( store, "k2"));
+        for( const char * key : { "k0", "k3", "k4", "k5", "k9", "kA" }) {
+            REQUIRE( has( store, key));
+        }
+    }
+
+    SECTION( "Compaction keeps the values and their order") {
+        uint64_t recordBytes = LogStore::HeaderBytes + 1 + 30;
+        {
+            LogStore store( dirPath, 1024 * 1024);
+            for( int round = 0 ; round < 3 ; round ++ ) {
+                for( char c : { 'a', 'b', 'c', 'd', 'e' }) {
+                    store.write( QByteArray( 1, c), value( c + round), 0);
+                }
+            }
+            REQUIRE( has( store, "a"));
+            REQUIRE( store.fileBytes() == 15 * recordBytes);
+            store.compact();
+            REQUIRE( store.fileBytes() == store.usedBytes());
+            REQUIRE( store.fileBytes() == 5 * recordBytes);
+            QByteArray val;
+            REQUIRE( store.read( "c", val));
+            REQUIRE( val == value( 'c' + 2));
+        }
+
+        // "b" is the least recently used, so it goes first when the limit shrinks
+        {
+            LogStore store( dirPath, 4 * recordBytes);
+            REQUIRE( store.count() == 4);
+            REQUIRE_FALSE( has( store, "b"));
+            QByteArray val;
+            REQUIRE( store.read( "a", val));
+            REQUIRE( val == value( 'a' + 2));
+        }
+    }
+
+    SECTION( "Only one store can have the directory open") {
+        std::unique_ptr < LogStore > store( new LogStore( dirPath, 1024 * 1024));
+        REQUIRE_THROWS_AS( LogStore( dirPath, 1024 * 1024), std::runtime_error);
+        store.reset();
+        LogStore other( dirPath, 1024 * 1024);
+        REQUIRE( other.count() == 0);
+    }
+}
@@ -0,0 +1,47 @@
+#include "catch.h"
+#include "CartaLib/Algorithms/ParallelFor.h"
+#include <atomic>
+#include <stdexcept>
+#include <vector>
+
+using Carta::Lib::Algorithms::parallelFor;
+
+TEST_CASE( "Parallel for", "[parallel]" ) {
+
+    SECTION( "Every index is visited once") {
+        std::vector<std::atomic<int> > visits( 10000);
+        for( auto & v : visits) v = 0;
+        parallelFor( 0, visits.size(), 7, [&] ( int64_t first, int64_t last) {
+            for( int64_t i = first ; i < last ; i ++ ) visits[i]++;
+        }, 4);
+        for( auto & v : visits) {
+            REQUIRE( v == 1);
+        }
+    }
+
+    SECTION( "Exceptions reach the calling thread") {
+        std::atomic<int> running( 0);
+        std::atomic<int> calls( 0);
+        bool caught = false;
+        try {
+            parallelFor( 0, 1000, 1, [&] ( int64_t first, int64_t) {
+                running++;
+                calls++;
+                if( first % 10 == 3 ) {
+                    running--;
+                    throw std::runtime_error( "chunk failed");
+                }
+                running--;
+            }, 4);
+        }
+        catch( const std::runtime_error & error ) {
+            caught = std::string( error.what()) == "chunk failed";
+        }
+        REQUIRE( caught);
+
+        // nobody is still working when the exception arrives, and the chunks after
+        // the first failure were skipped
+        REQUIRE( running == 0);
+        REQUIRE( calls < 1000);
+    }
+}
@@ -0,0 +1,84 @@
+#include "catch.h"
+#include "core/Algorithms/QuantileSketch.h"
+#include "core/Algorithms/quantileAlgorithms.h"
+#include "VectorView.h"
+#include <algorithm>
+#include <cstdlib>
+#include <limits>
+#include <vector>
+
+using namespace Carta::Core::Algorithms;
+
+TEST_CASE( "Quantile sketch", "[quantiles]" ) {
+
+    // skewed data with some NaNs
+    std::vector<double> vals;
+    std::srand( 1);
+    for( int i = 0 ; i < 200000 ; i ++ ) {
+        double x = double( std::rand()) / RAND_MAX;
+        vals.push_back( i % 100 == 0 ? std::numeric_limits<double>::quiet_NaN() : x * x * x);
+    }
+    std::vector<double> sorted;
+    for( double v : vals) {
+        if( ! std::isnan( v)) sorted.push_back( v);
+    }
+    std::sort( sorted.begin(), sorted.end());
+
+    // fraction of values smaller than v
+    auto rankOf = [&] ( double v) {
+        return double( std::lower_bound( sorted.begin(), sorted.end(), v) - sorted.begin())
+                / sorted.size();
+    };
+
+    SECTION( "Single sketch") {
+        QuantileSketch sketch;
+        sketch.add( & vals[0], vals.size());
+        REQUIRE( sketch.count() == int64_t( sorted.size()));
+        REQUIRE( sketch.storedCount() < int64_t( sorted.size() / 10));
+        REQUIRE( sketch.quantile( 0) == sorted.front());
+        REQUIRE( sketch.quantile( 1) == sorted.back());
+        for( double q : { 0.001, 0.025, 0.5, 0.975, 0.999 }) {
+            REQUIRE( std::abs( rankOf( sketch.quantile( q)) - q) <= sketch.rankError());
+        }
+    }
+
+    SECTION( "Merged sketches") {
+        QuantileSketch a, b;
+        a.add( & vals[0], vals.size() / 3);
+        b.add( & vals[vals.size() / 3], vals.size() - vals.size() / 3);
+        a.merge( b);
+        REQUIRE( a.count() == int64_t( sorted.size()));
+        for( double q : { 0.001, 0.025, 0.5, 0.975, 0.999 }) {
+            REQUIRE( std::abs( rankOf( a.quantile( q)) - q) <= a.rankError());
+        }
+    }
+
+    SECTION( "Empty sketch") {
+        QuantileSketch sketch;
+        sketch.add( std::numeric_limits<double>::quiet_NaN());
+        REQUIRE( sketch.count() == 0);
+        REQUIRE( std::isnan( sketch.quantile( 0.5)));
+    }
+}
+
+TEST_CASE( "Exact quantiles with ties", "[quantiles]" ) {
+
+    // mostly zeros and ones, so the values near most ranks are tied
+    std::vector<double> vals;
+    std::srand( 2);
+    for( int i = 0 ; i < 200000 ; i ++ ) {
+        double x = double( std::rand()) / RAND_MAX;
+        vals.push_back( x < 0.6 ? 0 : ( x < 0.9 ? 1 : x));
+    }
+    std::vector<double> sorted = vals;
+    std::sort( sorted.begin(), sorted.end());
+
+    Carta::Lib::NdArray::Double view( new VectorView( vals), true);
+    std::vector<double> quant = { 0, 0.001, 0.3, 0.599, 0.6, 0.75, 0.9, 0.95, 0.999, 1 };
+    std::vector<double> result = quantiles2pixels( view, quant);
+    REQUIRE( result.size() == quant.size());
+    for( size_t i = 0 ; i < quant.size() ; i ++ ) {
+        size_t rank = std::min<size_t>( sorted.size() * quant[i], sorted.size() - 1);
+        REQUIRE( result[i] == sorted[rank]);
+    }
+}
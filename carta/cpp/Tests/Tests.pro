@@ -3,7 +3,10 @@
 }
 
 QT      +=  core
-HEADERS += catch.h
+HEADERS += catch.h \
+    VectorView.h \
+    ../plugins/DiskCache/LogStore.h \
+    ../plugins/CasaImageLoader/FitsMmapFile.h
 
 SOURCES += \
     TopoSortTest.cpp \
@@ -11,7 +14,15 @@ SOURCES += \
     SliceTester.cpp \
     StateTester.cpp \
     pixelPipelineTest.cpp \
-    LineCombinerTest.cpp
+    LineCombinerTest.cpp \
+    FrameCacheTest.cpp \
+    QuantileSketchTest.cpp \
+    CumulativeHistogramTest.cpp \
+    ParallelForTest.cpp \
+    LogStoreTest.cpp \
+    ../plugins/DiskCache/LogStore.cpp \
+    FitsMmapFileTest.cpp \
+    ../plugins/CasaImageLoader/FitsMmapFile.cpp
 
 #CONFIG += precompile_header
 #PRECOMPILED_HEADER = catch.h
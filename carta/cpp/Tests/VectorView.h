@@ -0,0 +1,48 @@
+/**
+ * A raw view of a vector of doubles, for testing algorithms that read views.
+ **/
+
+#pragma once
+
+#include "CartaLib/IImage.h"
+#include <algorithm>
+#include <vector>
+
+// 1D view of a vector of doubles, only what the algorithms use is implemented
+class VectorView : public Carta::Lib::NdArray::RawViewInterface
+{
+public:
+
+    explicit VectorView( const std::vector<double> & data )
+        : m_data( data ), m_dims( 1, int( data.size())), m_pos( 1, 0) { }
+
+    virtual PixelType pixelType() override { return PixelType::Real64; }
+    virtual const VI & dims() override { return m_dims; }
+    virtual const char * get( const VI & pos ) override {
+        return reinterpret_cast<const char *>( & m_data[pos[0]]);
+    }
+    virtual void forEach( std::function<void(const char *)> func, Traversal ) override {
+        for( const double & v : m_data) func( reinterpret_cast<const char *>( & v));
+    }
+    virtual const VI & currentPos() override { return m_pos; }
+    virtual const VI & currentBlockDims() override { return m_blockDims; }
+    virtual RawViewInterface * getView( const SliceND & ) override { return nullptr; }
+    virtual int64_t read( int64_t, char *, Traversal ) override { return 0; }
+    virtual void seek( int64_t ) override { }
+    virtual int64_t read( int64_t, int64_t, char *, Traversal ) override { return 0; }
+    virtual void forEach( int64_t buffSize, std::function<void(const char *, int64_t)> func,
+                          char *, Traversal ) override {
+        int64_t blockSize = std::max<int64_t>( buffSize / sizeof( double), 1);
+        for( int64_t first = 0 ; first < int64_t( m_data.size()) ; first += blockSize ) {
+            int64_t count = std::min<int64_t>( blockSize, m_data.size() - first);
+            m_pos[0] = first;
+            m_blockDims = VI( 1, count);
+            func( reinterpret_cast<const char *>( & m_data[first]), count);
+        }
+    }
+
+private:
+
+    std::vector<double> m_data;
+    VI m_dims, m_pos, m_blockDims;
+};
@@ -2,6 +2,8 @@
 #include "CartaLib/PixelPipeline/CustomizablePixelPipeline.h"
 #include "core/GrayColormap.h"
 #include <QColor>
+#include <limits>
+#include <vector>
 
 using namespace Carta;
 
@@ -31,4 +33,41 @@ TEST_CASE( "Cached Pixel Pipeline testing", "[pp]" ) {
         REQUIRE( ok);
     }
 
+    SECTION( "Batch conversion") {
+        Core::GrayColormap::SharedPtr grayCmap = std::make_shared<Core::GrayColormap>();
+        Lib::PixelPipeline::CustomizablePixelPipeline pp;
+        pp.setColormap( grayCmap);
+        pp.setMinMax( -2, 2);
+        Lib::PixelPipeline::CachedPipeline<true> cppi;
+        cppi.cache( pp, 10, -2, 2);
+        Lib::PixelPipeline::CachedPipeline<false> cpp;
+        cpp.cache( pp, 10, -2, 2);
+
+        // values below, inside and above the clip range, and a NaN
+        std::vector<float> vals;
+        for( double x = -3 ; x < 3 ; x += 0.01) {
+            vals.push_back( x);
+        }
+        vals.push_back( std::numeric_limits<float>::quiet_NaN());
+        QRgb nanColor = qRgb( 255, 0, 0);
+
+        std::vector<QRgb> batch( vals.size()), batchInterp( vals.size()), batchRaw( vals.size());
+        cpp.convertqBatch( & vals[0], vals.size(), & batch[0], nanColor);
+        cppi.convertqBatch( & vals[0], vals.size(), & batchInterp[0], nanColor);
+        pp.convertqBatch( & vals[0], vals.size(), & batchRaw[0], nanColor);
+        for( size_t i = 0 ; i + 1 < vals.size() ; i ++ ) {
+            QRgb v1, v2, v3;
+            cpp.convertq( vals[i], v1);
+            cppi.convertq( vals[i], v2);
+            pp.convertq( vals[i], v3);
+            INFO( "x = " << vals[i]);
+            REQUIRE( batch[i] == v1);
+            REQUIRE( batchInterp[i] == v2);
+            REQUIRE( batchRaw[i] == v3);
+        }
+        REQUIRE( batch.back() == nanColor);
+        REQUIRE( batchInterp.back() == nanColor);
+        REQUIRE( batchRaw.back() == nanColor);
+    }
+
 }
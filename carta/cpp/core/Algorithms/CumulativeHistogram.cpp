@@ -0,0 +1,286 @@
+/**
+ *
+ **/
+
+#include "CumulativeHistogram.h"
+#include <QDataStream>
+
+namespace Carta
+{
+namespace Core
+{
+namespace Algorithms
+{
+constexpr int CumulativeHistogram::DefaultBinCount;
+constexpr int CumulativeHistogram::SketchK;
+constexpr quint32 CumulativeHistogram::SerialVersion;
+
+void
+CumulativeHistogram::Counts::merge( int chunkSlice, const Counts & chunk )
+{
+    QMutexLocker locker( & mutex );
+    for ( size_t b = 0 ; b < counts.size() ; ++b ) {
+        // keep a value equal to the lower edge if there is one, and the first one in
+        // (slice, index) order among those
+        bool low = lowCounts[b] > 0;
+        bool chunkLow = chunk.lowCounts[b] > 0;
+        if ( chunk.index[b] >= 0
+             && ( index[b] < 0 || ( chunkLow && ! low )
+                  || ( chunkLow == low
+                       && ( chunkSlice < slice[b]
+                            || ( chunkSlice == slice[b] && chunk.index[b] < index[b] ) ) ) ) ) {
+            index[b] = chunk.index[b];
+            slice[b] = chunkSlice;
+        }
+        counts[b] += chunk.counts[b];
+        lowCounts[b] += chunk.lowCounts[b];
+        innerMin[b] = std::min( innerMin[b], chunk.innerMin[b] );
+        innerMax[b] = std::max( innerMax[b], chunk.innerMax[b] );
+    }
+}
+
+bool
+CumulativeHistogram::_setEdges( const QuantileSketch & sketch, int binCount )
+{
+    m_count = sketch.count();
+    if ( m_count == 0 ) {
+        return false;
+    }
+    std::vector < double > qs( binCount + 1 );
+    for ( int i = 0 ; i <= binCount ; ++i ) {
+        qs[i] = double (i) / binCount;
+    }
+    m_edges = sketch.quantiles( qs );
+
+    // _binOf() needs the number of bins before the counts are in
+    m_counts.assign( binCount, 0 );
+    return true;
+}
+
+void
+CumulativeHistogram::_setCounts( Counts & counts )
+{
+    int binCount = _binCount();
+    m_counts = std::move( counts.counts );
+    m_lowCounts = std::move( counts.lowCounts );
+    m_innerMin = std::move( counts.innerMin );
+    m_innerMax = std::move( counts.innerMax );
+    m_binIndex = std::move( counts.index );
+    m_binSlice = std::move( counts.slice );
+    m_cumulative.resize( binCount + 1 );
+    int64_t sum = 0;
+    for ( int b = 0 ; b < binCount ; ++b ) {
+        m_cumulative[b] = sum;
+        sum += m_counts[b];
+    }
+    m_cumulative[binCount] = sum;
+    CARTA_ASSERT( sum == m_count );
+}
+
+int
+CumulativeHistogram::_binOfRank( int64_t rank ) const
+{
+    // last bin whose cumulative count is <= rank, i.e. the one that has the value
+    auto it = std::upper_bound( m_cumulative.begin(), m_cumulative.end() - 1, rank );
+    return Carta::Lib::clamp < int > ( it - m_cumulative.begin() - 1, 0, _binCount() - 1 );
+}
+
+double
+CumulativeHistogram::percentile( double intensity ) const
+{
+    if ( m_count == 0 || intensity < m_edges.front() ) {
+        return 0.0;
+    }
+    if ( intensity >= m_edges.back() ) {
+        return 1.0;
+    }
+    int bin = _binOf( intensity );
+
+    // the values equal to the lower edge are all <= intensity, the others are
+    // assumed to be spread evenly between the smallest and the largest one
+    double countBelow = m_cumulative[bin] + m_lowCounts[bin];
+    int64_t inner = m_counts[bin] - m_lowCounts[bin];
+    double innerMin = m_innerMin[bin];
+    double innerMax = m_innerMax[bin];
+    if ( inner > 0 && intensity >= innerMax ) {
+        countBelow += inner;
+    }
+    else if ( inner > 0 && intensity >= innerMin ) {
+        // at least the smallest one, and not the largest one
+        double frac = ( intensity - innerMin ) / ( innerMax - innerMin );
+        countBelow += 1 + frac * ( inner - 2 );
+    }
+    return countBelow / m_count;
+}
+
+CumulativeHistogram::Intensity
+CumulativeHistogram::intensity( double percentile ) const
+{
+    Intensity result;
+    if ( m_count == 0 ) {
+        return result;
+    }
+    int64_t rank = _rank( percentile );
+    int bin = _binOfRank( rank );
+
+    // the values equal to the lower edge come first, the others are assumed to be
+    // spread evenly between the smallest and the largest one
+    int64_t offset = rank - m_cumulative[bin];
+    int64_t inner = m_counts[bin] - m_lowCounts[bin];
+    if ( offset < m_lowCounts[bin] ) {
+        result.value = m_edges[bin];
+    }
+    else if ( inner <= 1 ) {
+        result.value = m_innerMin[bin];
+    }
+    else {
+        double frac = double (offset - m_lowCounts[bin]) / ( inner - 1 );
+        result.value = m_innerMin[bin] + frac * ( m_innerMax[bin] - m_innerMin[bin] );
+    }
+    result.index = m_binIndex[bin];
+    result.slice = m_binSlice[bin];
+    return result;
+}
+
+int
+CumulativeHistogram::_exactPercentileBin( double intensity, int64_t & countBelow ) const
+{
+    if ( m_count == 0 || intensity < m_edges.front() ) {
+        countBelow = 0;
+        return - 1;
+    }
+    if ( intensity >= m_edges.back() ) {
+        countBelow = m_count;
+        return - 1;
+    }
+
+    // everything below the bin is counted already, and so are the values equal to its
+    // lower edge, the others only need to be looked at if some of them are <= intensity
+    int bin = _binOf( intensity );
+    countBelow = m_cumulative[bin] + m_lowCounts[bin];
+    if ( m_counts[bin] == m_lowCounts[bin] || intensity < m_innerMin[bin] ) {
+        return - 1;
+    }
+    if ( intensity >= m_innerMax[bin] ) {
+        countBelow = m_cumulative[bin + 1];
+        return - 1;
+    }
+    return bin;
+}
+
+int
+CumulativeHistogram::_exactIntensityBin( double percentile, Intensity & result,
+                                         int64_t & innerRank ) const
+{
+    result = Intensity();
+    if ( m_count == 0 ) {
+        return - 1;
+    }
+    int64_t rank = _rank( percentile );
+    int bin = _binOfRank( rank );
+
+    // the values equal to the lower edge come first, they are counted already (and
+    // there may be a lot of them)
+    int64_t offset = rank - m_cumulative[bin];
+    if ( offset < m_lowCounts[bin] ) {
+        result.value = m_edges[bin];
+        result.index = m_binIndex[bin];
+        result.slice = m_binSlice[bin];
+        return - 1;
+    }
+    innerRank = offset - m_lowCounts[bin];
+    return bin;
+}
+
+CumulativeHistogram::Intensity
+CumulativeHistogram::_pickInner( int bin, int64_t innerRank, std::vector < BinValue > & values ) const
+{
+    // the counts are exact, so the value we are after is among them
+    CARTA_ASSERT( int64_t( values.size() ) == m_counts[bin] - m_lowCounts[bin] );
+    Q_UNUSED( bin );
+    Intensity result;
+    if ( values.empty() ) {
+        return result;
+    }
+    int64_t r = Carta::Lib::clamp < int64_t > ( innerRank, 0, values.size() - 1 );
+    std::nth_element( values.begin(), values.begin() + r, values.end() );
+    result.value = values[r].value;
+    result.index = values[r].index;
+    result.slice = values[r].slice;
+    return result;
+}
+
+int64_t
+CumulativeHistogram::byteSize() const
+{
+    return ( m_edges.size() + m_innerMin.size() + m_innerMax.size() ) * sizeof( double )
+           + ( m_counts.size() + m_lowCounts.size() + m_cumulative.size() + m_binIndex.size() )
+           * sizeof( int64_t )
+           + m_binSlice.size() * sizeof( int );
+}
+
+QByteArray
+CumulativeHistogram::serialize() const
+{
+    QByteArray data;
+    QDataStream out( & data, QIODevice::WriteOnly );
+    out << SerialVersion << qint64( m_count ) << quint32( _binCount() )
+        << quint32( m_edges.size() );
+    for ( double edge : m_edges ) {
+        out << edge;
+    }
+    for ( int b = 0 ; b < _binCount() ; ++b ) {
+        out << qint64( m_counts[b] ) << qint64( m_lowCounts[b] )
+            << m_innerMin[b] << m_innerMax[b]
+            << qint64( m_binIndex[b] ) << qint32( m_binSlice[b] );
+    }
+    return data;
+}
+
+CumulativeHistogram::SharedPtr
+CumulativeHistogram::deserialize( const QByteArray & data )
+{
+    QDataStream in( data );
+    quint32 version = 0;
+    qint64 count = 0;
+    quint32 binCount = 0;
+    quint32 edgeCount = 0;
+    in >> version >> count >> binCount >> edgeCount;
+
+    // the bytes come from the disk, so check the sizes before allocating anything
+    const int binBytes = 3 * sizeof( qint64 ) + 2 * sizeof( double ) + sizeof( qint32 );
+    if ( in.status() != QDataStream::Ok || version != SerialVersion || count < 0
+         || edgeCount != ( binCount > 0 ? binCount + 1 : 0 )
+         || uint64_t( data.size() ) < uint64_t( edgeCount ) * sizeof( double )
+                                      + uint64_t( binCount ) * binBytes ) {
+        return nullptr;
+    }
+    SharedPtr result( new CumulativeHistogram() );
+    result-> m_count = count;
+    result-> m_edges.resize( edgeCount );
+    for ( double & edge : result-> m_edges ) {
+        in >> edge;
+    }
+    Counts counts( binCount );
+    int64_t sum = 0;
+    for ( quint32 b = 0 ; b < binCount ; ++b ) {
+        qint64 binTotal, lowCount, index;
+        qint32 slice;
+        in >> binTotal >> lowCount >> counts.innerMin[b] >> counts.innerMax[b]
+        >> index >> slice;
+        counts.counts[b] = binTotal;
+        counts.lowCounts[b] = lowCount;
+        counts.index[b] = index;
+        counts.slice[b] = slice;
+        sum += binTotal;
+    }
+    if ( in.status() != QDataStream::Ok || sum != count ) {
+        return nullptr;
+    }
+    result-> m_counts.assign( binCount, 0 );
+    result-> _setCounts( counts );
+    return result;
+}
+}
+}
+}
@@ -0,0 +1,578 @@
+/**
+ * Cumulative distribution of the values of a view, for fast lookups between
+ * percentiles and intensities.
+ **/
+
+#pragma once
+
+#include "CartaLib/CartaLib.h"
+#include "CartaLib/IImage.h"
+#include "CartaLib/Algorithms/ParallelFor.h"
+#include "quantileAlgorithms.h"
+#include <QByteArray>
+#include <QMutex>
+#include <QMutexLocker>
+#include <QThread>
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <limits>
+#include <vector>
+
+namespace Carta
+{
+namespace Core
+{
+namespace Algorithms
+{
+/// Fine grained cumulative histogram of the (non-NaN) values of a view.
+///
+/// The bins are equi-depth, their edges come from a QuantileSketch of the data, and
+/// the number of values in each bin is then counted exactly. Lookups in both directions
+/// are binary searches, with linear interpolation inside the bin. Because the counts are
+/// exact, the answers can be made exact by looking at the values of a single bin
+/// (see exactIntensity() and exactPercentile()), which takes a pass over the data, but
+/// only needs to keep the values of that one bin in memory.
+///
+/// Data often has point masses (e.g. many zeros, or clipped values), and the edges of
+/// the bins are values of the data, so each bin also counts the values equal to its
+/// lower edge, and keeps the smallest and largest of its other values. Lookups only
+/// interpolate between those, so a point mass is never smeared across its bin.
+///
+/// Every bin also remembers the (sequential) index of one of its values, so that
+/// callers can tell where in the view an intensity occurs.
+///
+/// The histogram can also be built from a list of slices (e.g. the channels of a cube),
+/// which are read and counted in parallel, one view at a time, so the size of the
+/// data is only limited by the time it takes to read it. Lookups then also report
+/// which slice an intensity was found in.
+class CumulativeHistogram
+{
+    CLASS_BOILERPLATE( CumulativeHistogram );
+
+public:
+
+    /// default number of bins
+    static constexpr int DefaultBinCount = 16 * 1024;
+
+    /// result of an intensity lookup
+    struct Intensity {
+        /// the intensity
+        double value = std::numeric_limits < double >::quiet_NaN();
+
+        /// sequential index (in the view, or the slice) of a value from the same bin,
+        /// of the value itself for exact lookups and point masses at the start of the
+        /// bin, -1 if there is no data
+        int64_t index = - 1;
+
+        /// the slice that index refers to, 0 for histograms built from a single view,
+        /// -1 if there is no data
+        int slice = - 1;
+    };
+
+    /// returns a new view of the given slice, the caller takes ownership of it,
+    /// nullptr if the slice has no data
+    typedef std::function < Carta::Lib::NdArray::RawViewInterface * (int slice) > SliceFactory;
+
+    /// build the histogram of a view, which is read twice
+    /// \param view the data
+    /// \param binCount number of bins
+    template < typename Scalar >
+    static SharedPtr
+    build( Carta::Lib::NdArray::TypedView < Scalar > & view, int binCount = DefaultBinCount );
+
+    /// build the histogram of the values of all slices, each slice is read twice,
+    /// different slices are read in parallel
+    /// \param sliceCount number of slices
+    /// \param sliceFactory creates the views of the slices, it is never called
+    /// concurrently, but may be called from any thread
+    /// \param binCount number of bins
+    template < typename Scalar >
+    static SharedPtr
+    build( int sliceCount, const SliceFactory & sliceFactory, int binCount = DefaultBinCount );
+
+    /// number of (non-NaN) values in the view
+    int64_t
+    count() const
+    {
+        return m_count;
+    }
+
+    /// returns the fraction of values that are less than or equal to the intensity,
+    /// 0 if there is no data. The answer is exact for the values the bins start with,
+    /// otherwise it is interpolated inside the bin.
+    double
+    percentile( double intensity ) const;
+
+    /// returns the intensity such that the given fraction of the values is smaller
+    /// (the value at sorted index floor(count*percentile)). The answer is exact if that
+    /// value is a point mass at the start of a bin, or the smallest or largest value of
+    /// the bin, otherwise it is interpolated between those.
+    /// \param percentile number in [0,1]
+    Intensity
+    intensity( double percentile ) const;
+
+    /// same as percentile(), but exact, at the cost of one pass over the view, unless
+    /// the bin of the intensity has no other values that could be larger
+    /// \param view the view the histogram was built from
+    template < typename Scalar >
+    double
+    exactPercentile( Carta::Lib::NdArray::TypedView < Scalar > & view, double intensity ) const;
+
+    /// exactPercentile() of a histogram built from slices
+    /// \param sliceCount number of slices
+    /// \param sliceFactory creates the views of the slices the histogram was built from
+    template < typename Scalar >
+    double
+    exactPercentile( int sliceCount, const SliceFactory & sliceFactory, double intensity ) const;
+
+    /// same as intensity(), but exact (the value at sorted index floor(count*percentile)),
+    /// at the cost of one pass over the view, unless the value is a point mass at the
+    /// start of a bin. Only the values of the bin that differ from its lower edge are
+    /// kept in memory.
+    /// \param view the view the histogram was built from
+    template < typename Scalar >
+    Intensity
+    exactIntensity( Carta::Lib::NdArray::TypedView < Scalar > & view, double percentile ) const;
+
+    /// exactIntensity() of a histogram built from slices, the slices are read in
+    /// parallel, and the result tells which slice the value was found in
+    /// \param sliceCount number of slices
+    /// \param sliceFactory creates the views of the slices the histogram was built from
+    template < typename Scalar >
+    Intensity
+    exactIntensity( int sliceCount, const SliceFactory & sliceFactory, double percentile ) const;
+
+    /// approximate memory used by the histogram, in bytes
+    int64_t
+    byteSize() const;
+
+    /// the histogram as bytes, e.g. for the persistent cache
+    QByteArray
+    serialize() const;
+
+    /// histogram from the bytes made by serialize(), nullptr if they are not valid
+    static SharedPtr
+    deserialize( const QByteArray & data );
+
+private:
+
+    /// accuracy of the sketch used for the bin edges
+    static constexpr int SketchK = 8 * QuantileSketch::DefaultK;
+
+    /// version of the format written by serialize()
+    static constexpr quint32 SerialVersion = 1;
+
+    /// counts of the bins (and the first value in each), shared by the threads that
+    /// count different parts of the data
+    struct Counts {
+        explicit
+        Counts( int binCount )
+            : counts( binCount, 0 )
+            , lowCounts( binCount, 0 )
+            , innerMin( binCount, std::numeric_limits < double >::infinity() )
+            , innerMax( binCount, - std::numeric_limits < double >::infinity() )
+            , index( binCount, - 1 )
+            , slice( binCount, - 1 )
+        { }
+
+        /// add the counts of one chunk of a slice (counted into its own Counts)
+        void
+        merge( int chunkSlice, const Counts & chunk );
+
+        std::vector < int64_t > counts;
+
+        /// number of values equal to the lower edge of the bin
+        std::vector < int64_t > lowCounts;
+
+        /// smallest and largest of the other values of the bin
+        std::vector < double > innerMin, innerMax;
+
+        std::vector < int64_t > index;
+        std::vector < int > slice;
+        QMutex mutex;
+    };
+
+    CumulativeHistogram() { }
+
+    /// set the bin edges from the sketch, returns false if there is no data
+    bool
+    _setEdges( const QuantileSketch & sketch, int binCount );
+
+    /// count the values of the view (slice number slice) into counts
+    template < typename Scalar >
+    void
+    _countView( Carta::Lib::NdArray::TypedView < Scalar > & view, int slice, Counts & counts ) const;
+
+    /// take over the counts, and compute the cumulative ones
+    void
+    _setCounts( Counts & counts );
+
+    /// a value of a bin, and where it was found
+    struct BinValue {
+        double value;
+        int slice;
+        int64_t index;
+
+        bool
+        operator<( const BinValue & other ) const
+        {
+            return value < other.value;
+        }
+    };
+
+    /// calls func( view, slice ) for the views of all slices, in parallel, the factory
+    /// is only called by one thread at a time
+    template < typename Scalar, typename Func >
+    static void
+    _forEachSlice( int sliceCount, const SliceFactory & sliceFactory, Func func );
+
+    /// sets countBelow to the number of values <= intensity that are known without
+    /// looking at the data, returns the bin whose other values need to be counted, or
+    /// -1 if there is no need to
+    int
+    _exactPercentileBin( double intensity, int64_t & countBelow ) const;
+
+    /// number of values of the view in (lower edge of the bin, intensity]
+    template < typename Scalar >
+    int64_t
+    _countInner( Carta::Lib::NdArray::TypedView < Scalar > & view, int bin, double intensity ) const;
+
+    /// sets result if the value at the percentile is known without looking at the data
+    /// and returns -1, otherwise returns its bin, and sets innerRank to its sorted index
+    /// among the values of the bin that differ from the lower edge
+    int
+    _exactIntensityBin( double percentile, Intensity & result, int64_t & innerRank ) const;
+
+    /// appends the values of the view (slice number slice) that are in the bin and
+    /// differ from its lower edge
+    template < typename Scalar >
+    void
+    _collectInner( Carta::Lib::NdArray::TypedView < Scalar > & view, int slice, int bin,
+                   std::vector < BinValue > & values ) const;
+
+    /// the value with the given sorted index among the collected ones
+    Intensity
+    _pickInner( int bin, int64_t innerRank, std::vector < BinValue > & values ) const;
+
+    /// number of bins
+    int
+    _binCount() const
+    {
+        return int (m_counts.size());
+    }
+
+    /// bin index for a value in [min,max]
+    int
+    _binOf( double value ) const
+    {
+        // number of interior edges <= value
+        auto it = std::upper_bound( m_edges.begin() + 1, m_edges.end() - 1, value );
+        return int (it - ( m_edges.begin() + 1 ) );
+    }
+
+    /// the bin that contains the value with the given sorted index
+    int
+    _binOfRank( int64_t rank ) const;
+
+    /// sorted index of the value at the given percentile
+    int64_t
+    _rank( double percentile ) const
+    {
+        return Carta::Lib::clamp < int64_t > ( m_count * percentile, 0, m_count - 1 );
+    }
+
+    /// bin edges, bin i holds values in [m_edges[i],m_edges[i+1]), the last one
+    /// includes the maximum as well
+    std::vector < double > m_edges;
+
+    /// number of values in each bin
+    std::vector < int64_t > m_counts;
+
+    /// number of values equal to the lower edge of each bin
+    std::vector < int64_t > m_lowCounts;
+
+    /// smallest and largest value of each bin that is not equal to its lower edge
+    std::vector < double > m_innerMin, m_innerMax;
+
+    /// m_cumulative[i] is the number of values in the bins before bin i
+    std::vector < int64_t > m_cumulative;
+
+    /// index of some value in each bin, one equal to its lower edge if there are any
+    /// (-1 for empty bins)
+    std::vector < int64_t > m_binIndex;
+
+    /// slice m_binIndex refers to (-1 for empty bins)
+    std::vector < int > m_binSlice;
+
+    int64_t m_count = 0;
+};
+
+template < typename Scalar >
+CumulativeHistogram::SharedPtr
+CumulativeHistogram::build( Carta::Lib::NdArray::TypedView < Scalar > & view, int binCount )
+{
+    CARTA_ASSERT( binCount > 0 );
+    SharedPtr result( new CumulativeHistogram() );
+
+    // pass 1: bin edges from a sketch
+    if ( ! result-> _setEdges( quantileSketch( view, SketchK ), binCount ) ) {
+        return result;
+    }
+
+    // pass 2: exact counts
+    Counts counts( binCount );
+    result-> _countView( view, 0, counts );
+    result-> _setCounts( counts );
+    return result;
+} // build
+
+template < typename Scalar >
+CumulativeHistogram::SharedPtr
+CumulativeHistogram::build( int sliceCount, const SliceFactory & sliceFactory, int binCount )
+{
+    CARTA_ASSERT( binCount > 0 );
+    SharedPtr result( new CumulativeHistogram() );
+    QMutex factoryMutex;
+    auto sliceView = [&] ( int slice ) -> Carta::Lib::NdArray::RawViewInterface * {
+        QMutexLocker locker( & factoryMutex );
+        return sliceFactory( slice );
+    };
+
+    // pass 1: sketch the slices in parallel, a batch at a time, so that only a few
+    // sketches are kept around, and merge them in order, so that the edges do not
+    // depend on the number of threads
+    QuantileSketch sketch( SketchK );
+    int batchSize = std::max( QThread::idealThreadCount(), 1 );
+    std::vector < QuantileSketch > sliceSketches;
+    for ( int batchStart = 0 ; batchStart < sliceCount ; batchStart += batchSize ) {
+        int batchEnd = std::min( batchStart + batchSize, sliceCount );
+        sliceSketches.assign( batchEnd - batchStart, QuantileSketch( SketchK ) );
+        Carta::Lib::Algorithms::parallelFor(
+            batchStart, batchEnd, 1,
+            [&] ( int64_t first, int64_t last ) {
+                for ( int64_t slice = first ; slice < last ; ++slice ) {
+                    Carta::Lib::NdArray::RawViewInterface * rawView = sliceView( slice );
+                    if ( ! rawView ) {
+                        continue;
+                    }
+                    Carta::Lib::NdArray::TypedView < Scalar > view( rawView, true );
+                    sliceSketches[slice - batchStart] = quantileSketch( view, SketchK );
+                }
+            }
+            );
+        for ( const auto & sliceSketch : sliceSketches ) {
+            sketch.merge( sliceSketch );
+        }
+    }
+    if ( ! result-> _setEdges( sketch, binCount ) ) {
+        return result;
+    }
+
+    // pass 2: exact counts, slice by slice in parallel
+    Counts counts( binCount );
+    _forEachSlice < Scalar > (
+        sliceCount, sliceFactory,
+        [&] ( Carta::Lib::NdArray::TypedView < Scalar > & view, int slice ) {
+            result-> _countView( view, slice, counts );
+        }
+        );
+    result-> _setCounts( counts );
+    return result;
+} // build
+
+template < typename Scalar >
+void
+CumulativeHistogram::_countView( Carta::Lib::NdArray::TypedView < Scalar > & view,
+                                 int slice,
+                                 Counts & counts ) const
+{
+    // blocks are read in order (so that we know the index of each value) and counted
+    // in parallel chunks
+    int binCount = _binCount();
+    int64_t blockStart = 0;
+    int64_t blockSize = 4 * 1024 * 1024;
+    int64_t chunkSize = 1024 * 1024;
+    auto countChunk = [&] ( const Scalar * data, int64_t first, int64_t last ) {
+        Counts local( binCount );
+        for ( int64_t i = first ; i < last ; ++i ) {
+            if ( Q_UNLIKELY( std::isnan( data[i] ) ) ) {
+                continue;
+            }
+            double value = data[i];
+            int bin = _binOf( value );
+            bool low = value == m_edges[bin];
+            if ( local.counts[bin]++ == 0 || ( low && local.lowCounts[bin] == 0 ) ) {
+                local.index[bin] = blockStart + i;
+            }
+            if ( low ) {
+                local.lowCounts[bin]++;
+            }
+            else {
+                local.innerMin[bin] = std::min( local.innerMin[bin], value );
+                local.innerMax[bin] = std::max( local.innerMax[bin], value );
+            }
+        }
+        counts.merge( slice, local );
+    };
+    view.forEachBlock(
+        [&] ( const Scalar * data, int64_t count ) {
+            Carta::Lib::Algorithms::parallelFor(
+                0, count, chunkSize,
+                [&] ( int64_t first, int64_t last ) {
+                    countChunk( data, first, last );
+                }
+                );
+            blockStart += count;
+        },
+        Carta::Lib::NdArray::RawViewInterface::Traversal::Sequential,
+        blockSize
+        );
+} // _countView
+
+template < typename Scalar >
+double
+CumulativeHistogram::exactPercentile( Carta::Lib::NdArray::TypedView < Scalar > & view,
+                                      double intensity ) const
+{
+    int64_t countBelow = 0;
+    int bin = _exactPercentileBin( intensity, countBelow );
+    if ( bin >= 0 ) {
+        countBelow += _countInner( view, bin, intensity );
+    }
+    return m_count > 0 ? double (countBelow) / m_count : 0.0;
+} // exactPercentile
+
+template < typename Scalar >
+double
+CumulativeHistogram::exactPercentile( int sliceCount, const SliceFactory & sliceFactory,
+                                      double intensity ) const
+{
+    int64_t countBelow = 0;
+    int bin = _exactPercentileBin( intensity, countBelow );
+    if ( bin >= 0 ) {
+        QMutex mutex;
+        _forEachSlice < Scalar > (
+            sliceCount, sliceFactory,
+            [&] ( Carta::Lib::NdArray::TypedView < Scalar > & view, int ) {
+                int64_t sliceCountBelow = _countInner( view, bin, intensity );
+                QMutexLocker locker( & mutex );
+                countBelow += sliceCountBelow;
+            }
+            );
+    }
+    return m_count > 0 ? double (countBelow) / m_count : 0.0;
+} // exactPercentile
+
+template < typename Scalar >
+CumulativeHistogram::Intensity
+CumulativeHistogram::exactIntensity( Carta::Lib::NdArray::TypedView < Scalar > & view,
+                                     double percentile ) const
+{
+    Intensity result;
+    int64_t innerRank = 0;
+    int bin = _exactIntensityBin( percentile, result, innerRank );
+    if ( bin >= 0 ) {
+        std::vector < BinValue > values;
+        values.reserve( m_counts[bin] - m_lowCounts[bin] );
+        _collectInner( view, 0, bin, values );
+        result = _pickInner( bin, innerRank, values );
+    }
+    return result;
+} // exactIntensity
+
+template < typename Scalar >
+CumulativeHistogram::Intensity
+CumulativeHistogram::exactIntensity( int sliceCount, const SliceFactory & sliceFactory,
+                                     double percentile ) const
+{
+    Intensity result;
+    int64_t innerRank = 0;
+    int bin = _exactIntensityBin( percentile, result, innerRank );
+    if ( bin >= 0 ) {
+        std::vector < BinValue > values;
+        values.reserve( m_counts[bin] - m_lowCounts[bin] );
+        QMutex mutex;
+        _forEachSlice < Scalar > (
+            sliceCount, sliceFactory,
+            [&] ( Carta::Lib::NdArray::TypedView < Scalar > & view, int slice ) {
+                std::vector < BinValue > sliceValues;
+                _collectInner( view, slice, bin, sliceValues );
+                QMutexLocker locker( & mutex );
+                values.insert( values.end(), sliceValues.begin(), sliceValues.end() );
+            }
+            );
+        result = _pickInner( bin, innerRank, values );
+    }
+    return result;
+} // exactIntensity
+
+template < typename Scalar, typename Func >
+void
+CumulativeHistogram::_forEachSlice( int sliceCount, const SliceFactory & sliceFactory, Func func )
+{
+    QMutex factoryMutex;
+    Carta::Lib::Algorithms::parallelFor(
+        0, sliceCount, 1,
+        [&] ( int64_t first, int64_t last ) {
+            for ( int64_t slice = first ; slice < last ; ++slice ) {
+                Carta::Lib::NdArray::RawViewInterface * rawView = nullptr;
+                {
+                    QMutexLocker locker( & factoryMutex );
+                    rawView = sliceFactory( slice );
+                }
+                if ( ! rawView ) {
+                    continue;
+                }
+                Carta::Lib::NdArray::TypedView < Scalar > view( rawView, true );
+                func( view, int (slice) );
+            }
+        }
+        );
+} // _forEachSlice
+
+template < typename Scalar >
+int64_t
+CumulativeHistogram::_countInner( Carta::Lib::NdArray::TypedView < Scalar > & view, int bin,
+                                  double intensity ) const
+{
+    double lo = m_edges[bin];
+    int64_t count = 0;
+    view.forEachBlock(
+        [&] ( const Scalar * data, int64_t n ) {
+            for ( int64_t i = 0 ; i < n ; ++i ) {
+                if ( data[i] > lo && data[i] <= intensity ) {
+                    count++;
+                }
+            }
+        },
+        Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal
+        );
+    return count;
+} // _countInner
+
+template < typename Scalar >
+void
+CumulativeHistogram::_collectInner( Carta::Lib::NdArray::TypedView < Scalar > & view, int slice,
+                                    int bin, std::vector < BinValue > & values ) const
+{
+    double lo = m_edges[bin];
+    double hi = m_edges[bin + 1];
+    bool last = bin == _binCount() - 1;
+    int64_t index = 0;
+    view.forEachBlock(
+        [&] ( const Scalar * data, int64_t count ) {
+            for ( int64_t i = 0 ; i < count ; ++i ) {
+                double v = data[i];
+                if ( v > lo && ( v < hi || ( last && v <= hi ) ) ) {
+                    values.push_back( BinValue { v, slice, index + i } );
+                }
+            }
+            index += count;
+        },
+        Carta::Lib::NdArray::RawViewInterface::Traversal::Sequential
+        );
+} // _collectInner
+}
+}
+}
@@ -0,0 +1,196 @@
+/**
+ *
+ **/
+
+#include "MipmapPyramid.h"
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Carta
+{
+namespace Core
+{
+namespace Algorithms
+{
+namespace
+{
+/// Accumulates rows of the source, and emits a row of the destination level for every
+/// two source rows. Rows have to be added in order, bottom to top.
+class RowDecimator
+{
+public:
+
+    RowDecimator( QSize srcSize, MipmapPyramid::Decimation decimation,
+                  MipmapPyramid::Level & dst )
+        : m_srcSize( srcSize ), m_decimation( decimation ), m_dst( dst )
+    {
+        m_dst.size = QSize( ( srcSize.width() + 1 ) / 2, ( srcSize.height() + 1 ) / 2 );
+        m_dst.data.resize( int64_t( m_dst.size.width() ) * m_dst.size.height() );
+        m_acc.resize( m_dst.size.width() );
+        m_counts.resize( m_dst.size.width() );
+        _reset();
+    }
+
+    void
+    addRow( const float * row )
+    {
+        int width = m_srcSize.width();
+        if ( m_decimation == MipmapPyramid::Decimation::Mean ) {
+            for ( int x = 0 ; x < width ; ++x ) {
+                if ( Q_LIKELY( ! std::isnan( row[x] ) ) ) {
+                    m_acc[x / 2] += row[x];
+                    m_counts[x / 2]++;
+                }
+            }
+        }
+        else {
+            for ( int x = 0 ; x < width ; ++x ) {
+                if ( Q_LIKELY( ! std::isnan( row[x] ) ) ) {
+                    m_acc[x / 2] = std::max < double > ( m_acc[x / 2], row[x] );
+                    m_counts[x / 2]++;
+                }
+            }
+        }
+        m_srcRow++;
+
+        // emit the output row after every second row, and after the last one
+        if ( m_srcRow % 2 == 0 || m_srcRow == m_srcSize.height() ) {
+            _flush();
+        }
+    } // addRow
+
+private:
+
+    void
+    _reset()
+    {
+        double init = m_decimation == MipmapPyramid::Decimation::Mean
+                      ? 0.0 : - std::numeric_limits < double >::infinity();
+        std::fill( m_acc.begin(), m_acc.end(), init );
+        std::fill( m_counts.begin(), m_counts.end(), 0 );
+    }
+
+    void
+    _flush()
+    {
+        int width = m_dst.size.width();
+        float * out = & m_dst.data[int64_t( width ) * ( ( m_srcRow - 1 ) / 2 )];
+        for ( int x = 0 ; x < width ; ++x ) {
+            if ( m_counts[x] == 0 ) {
+                out[x] = std::numeric_limits < float >::quiet_NaN();
+            }
+            else if ( m_decimation == MipmapPyramid::Decimation::Mean ) {
+                out[x] = m_acc[x] / m_counts[x];
+            }
+            else {
+                out[x] = m_acc[x];
+            }
+        }
+        _reset();
+    }
+
+    QSize m_srcSize;
+    MipmapPyramid::Decimation m_decimation;
+    MipmapPyramid::Level & m_dst;
+    std::vector < double > m_acc;
+    std::vector < int > m_counts;
+    int m_srcRow = 0;
+};
+}
+
+MipmapPyramid::MipmapPyramid( Carta::Lib::NdArray::RawViewInterface::SharedPtr view,
+                              Decimation decimation )
+{
+    CARTA_ASSERT( view && view-> dims().size() >= 2 );
+    m_view = view;
+    m_decimation = decimation;
+    m_size = QSize( view-> dims()[0], view-> dims()[1] );
+}
+
+int
+MipmapPyramid::factorForZoom( double zoom ) const
+{
+    // stop before the level would shrink to a single pixel
+    int factor = 1;
+    while ( factor * 2 * zoom <= 1.0
+            && ( m_size.width() > factor * 2 || m_size.height() > factor * 2 ) ) {
+        factor *= 2;
+    }
+    return factor;
+}
+
+const MipmapPyramid::Level &
+MipmapPyramid::level( int factor )
+{
+    CARTA_ASSERT( factor > 1 && ( factor & ( factor - 1 ) ) == 0 );
+    QMutexLocker locker( & m_mutex );
+    if ( m_levels.empty() ) {
+        _buildFromView();
+    }
+    while ( m_levels.back().factor < factor ) {
+        _buildFromLevel( m_levels.back() );
+    }
+
+    // levels are stored in order of factors 2, 4, 8...
+    int ind = 0;
+    while ( ( 2 << ind ) < factor ) {
+        ind++;
+    }
+    return m_levels[ind];
+} // level
+
+int64_t
+MipmapPyramid::maxByteSize() const
+{
+    // 1/4 + 1/16 + ... < 1/3
+    return int64_t( m_size.width() ) * m_size.height() * sizeof( float ) / 3 + 1;
+}
+
+void
+MipmapPyramid::_buildFromView()
+{
+    CARTA_ASSERT( m_view );
+    m_levels.emplace_back();
+    Level & dst = m_levels.back();
+    dst.factor = 2;
+    RowDecimator decimator( m_size, m_decimation, dst );
+
+    // blocks arrive in sequential order, but they do not need to line up with rows
+    std::vector < float > row( m_size.width() );
+    int x = 0;
+    Carta::Lib::NdArray::TypedView < float > typedView( m_view.get(), false );
+    typedView.forEachBlock( [&] ( const float * data, int64_t count ) {
+                                while ( count > 0 ) {
+                                    int n = std::min < int64_t > ( count, m_size.width() - x );
+                                    std::copy( data, data + n, & row[x] );
+                                    data += n;
+                                    count -= n;
+                                    x += n;
+                                    if ( x == m_size.width() ) {
+                                        decimator.addRow( & row[0] );
+                                        x = 0;
+                                    }
+                                }
+                            }
+                            );
+
+    // we don't need the view anymore
+    m_view = nullptr;
+} // _buildFromView
+
+void
+MipmapPyramid::_buildFromLevel( const Level & src )
+{
+    Level dst;
+    dst.factor = src.factor * 2;
+    RowDecimator decimator( src.size, m_decimation, dst );
+    for ( int y = 0 ; y < src.size.height() ; ++y ) {
+        decimator.addRow( & src.data[int64_t( src.size.width() ) * y] );
+    }
+    m_levels.push_back( std::move( dst ) );
+}
+}
+}
+}
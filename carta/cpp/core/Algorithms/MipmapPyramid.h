@@ -0,0 +1,110 @@
+/**
+ * Multi-resolution (mipmap) pyramid of a 2D image, used for rendering zoomed out views
+ * of large images.
+ **/
+
+#pragma once
+
+#include "CartaLib/CartaLib.h"
+#include "CartaLib/IImage.h"
+#include <QMutex>
+#include <QSize>
+#include <deque>
+#include <vector>
+
+namespace Carta
+{
+namespace Core
+{
+namespace Algorithms
+{
+/// Pyramid of downsampled copies of a 2D raw view.
+///
+/// Level 0 is the view itself and is never copied. Level k is 2^k times smaller
+/// along each axis, every pixel of it is computed from (up to) 2x2 pixels of level k-1.
+/// Levels are built lazily, the first time they are asked for, and level 1 is the only
+/// one that needs to read the view.
+///
+/// NaNs are ignored by the decimation, i.e. an output pixel is NaN only if all of
+/// its inputs are NaN.
+///
+/// level() can be called from several threads, levels are never modified once built.
+class MipmapPyramid
+{
+    CLASS_BOILERPLATE( MipmapPyramid );
+
+public:
+
+    /// how to combine the pixels of a lower level
+    enum class Decimation
+    {
+        Mean, ///< average of the finite pixels
+        Max ///< maximum of the finite pixels, keeps faint point sources visible
+    };
+
+    /// a single level of the pyramid
+    struct Level {
+        /// how many pixels of the view one pixel of this level represents (along each axis)
+        int factor = 1;
+
+        /// dimensions of this level
+        QSize size;
+
+        /// pixels in sequential order, i.e. bottom row first, same as in the view
+        std::vector < float > data;
+    };
+
+    /// \param view the 2D input, it must remain valid as long as level 1 is not built
+    /// \param decimation how pixels are combined
+    MipmapPyramid( Carta::Lib::NdArray::RawViewInterface::SharedPtr view,
+                   Decimation decimation = Decimation::Mean );
+
+    /// returns the largest power of two factor that is not more than 1/zoom, i.e.
+    /// the coarsest level that still has at least one of its pixels per screen pixel
+    /// \param zoom how many screen pixels does a data pixel occupy on screen
+    int
+    factorForZoom( double zoom ) const;
+
+    /// returns the level with the given factor (a power of two > 1), building it
+    /// (and the levels below it) if necessary, the reference remains valid for
+    /// the lifetime of the pyramid
+    const Level &
+    level( int factor );
+
+    /// approximate memory used by the pyramid if all levels are built, in bytes
+    int64_t
+    maxByteSize() const;
+
+    /// decimation used by this pyramid
+    Decimation
+    decimation() const
+    {
+        return m_decimation;
+    }
+
+private:
+
+    /// build level 1 from the view
+    void
+    _buildFromView();
+
+    /// build the next level from the last one
+    void
+    _buildFromLevel( const Level & src );
+
+    Carta::Lib::NdArray::RawViewInterface::SharedPtr m_view = nullptr;
+    Decimation m_decimation;
+
+    /// size of the view
+    QSize m_size;
+
+    /// levels built so far, m_levels[0] has factor 2 (deque, so that references
+    /// to built levels survive adding new ones)
+    std::deque < Level > m_levels;
+
+    /// protects m_levels and m_view
+    QMutex m_mutex;
+};
+}
+}
+}
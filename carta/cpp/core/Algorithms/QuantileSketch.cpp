@@ -0,0 +1,167 @@
+/**
+ *
+ **/
+
+#include "QuantileSketch.h"
+#include <algorithm>
+#include <limits>
+#include <utility>
+
+namespace Carta
+{
+namespace Core
+{
+namespace Algorithms
+{
+constexpr int QuantileSketch::DefaultK;
+constexpr int64_t QuantileSketch::MinLevelCapacity;
+
+QuantileSketch::QuantileSketch( int k )
+{
+    CARTA_ASSERT( k >= 8 );
+    m_k = std::max( k, 8 );
+    m_min = std::numeric_limits < double >::infinity();
+    m_max = - std::numeric_limits < double >::infinity();
+    m_levels.resize( 1 );
+    _updateCapacity();
+}
+
+void
+QuantileSketch::_updateCapacity()
+{
+    // the top level holds k values, the ones below it 2/3 as many as the one above
+    m_levelCapacities.resize( m_levels.size() );
+    m_capacity = 0;
+    for ( size_t h = 0 ; h < m_levels.size() ; ++h ) {
+        size_t depth = m_levels.size() - 1 - h;
+        int64_t cap = std::ceil( m_k * std::pow( 2.0 / 3.0, double (depth) ) );
+        m_levelCapacities[h] = std::max < int64_t > ( cap, MinLevelCapacity );
+        m_capacity += m_levelCapacities[h];
+    }
+}
+
+int
+QuantileSketch::_coin()
+{
+    m_random ^= m_random << 13;
+    m_random ^= m_random >> 17;
+    m_random ^= m_random << 5;
+    return m_random & 1;
+}
+
+void
+QuantileSketch::_compress()
+{
+    while ( m_size >= m_capacity ) {
+        // compact the lowest level that is over its capacity (there is always one)
+        size_t h = 0;
+        while ( h < m_levels.size() && int64_t( m_levels[h].size() ) < m_levelCapacities[h] ) {
+            h++;
+        }
+        CARTA_ASSERT( h < m_levels.size() );
+        if ( h + 1 == m_levels.size() ) {
+            m_levels.emplace_back();
+            _updateCapacity();
+        }
+
+        // sort the level and promote every other value, if the count is odd the
+        // smallest value stays behind
+        std::vector < double > & level = m_levels[h];
+        std::vector < double > & next = m_levels[h + 1];
+        std::sort( level.begin(), level.end() );
+        size_t first = level.size() % 2;
+        size_t offset = _coin();
+        size_t promoted = 0;
+        for ( size_t i = first + offset ; i < level.size() ; i += 2 ) {
+            next.push_back( level[i] );
+            promoted++;
+        }
+        level.resize( first );
+        m_size -= promoted;
+    }
+} // _compress
+
+void
+QuantileSketch::merge( const QuantileSketch & other )
+{
+    CARTA_ASSERT( m_k == other.m_k );
+    if ( other.m_count == 0 ) {
+        return;
+    }
+    m_count += other.m_count;
+    m_min = std::min( m_min, other.m_min );
+    m_max = std::max( m_max, other.m_max );
+    if ( other.m_levels.size() > m_levels.size() ) {
+        m_levels.resize( other.m_levels.size() );
+        _updateCapacity();
+    }
+    for ( size_t h = 0 ; h < other.m_levels.size() ; ++h ) {
+        const auto & src = other.m_levels[h];
+        m_levels[h].insert( m_levels[h].end(), src.begin(), src.end() );
+        m_size += src.size();
+    }
+    _compress();
+} // merge
+
+double
+QuantileSketch::quantile( double q ) const
+{
+    return quantiles( { q } )[0];
+}
+
+std::vector < double >
+QuantileSketch::quantiles( const std::vector < double > & qs ) const
+{
+    std::vector < double > result( qs.size(), std::numeric_limits < double >::quiet_NaN() );
+    if ( m_count == 0 ) {
+        return result;
+    }
+
+    // all values with their weights, sorted by value
+    std::vector < std::pair < double, int64_t > > weighted;
+    weighted.reserve( m_size );
+    for ( size_t h = 0 ; h < m_levels.size() ; ++h ) {
+        for ( double v : m_levels[h] ) {
+            weighted.push_back( std::make_pair( v, int64_t( 1 ) << h ) );
+        }
+    }
+    std::sort( weighted.begin(), weighted.end() );
+
+    // cumulative weights
+    std::vector < int64_t > cumulative( weighted.size() );
+    int64_t sum = 0;
+    for ( size_t i = 0 ; i < weighted.size() ; ++i ) {
+        sum += weighted[i].second;
+        cumulative[i] = sum;
+    }
+    CARTA_ASSERT( sum == m_count );
+
+    // same convention as quantiles2pixels(): the value at sorted index floor(q*count),
+    // the extremes are known exactly
+    for ( size_t i = 0 ; i < qs.size() ; ++i ) {
+        double q = qs[i];
+        if ( q <= 0.0 ) {
+            result[i] = m_min;
+            continue;
+        }
+        if ( q >= 1.0 ) {
+            result[i] = m_max;
+            continue;
+        }
+        int64_t rank = Carta::Lib::clamp < int64_t > ( m_count * q, 0, m_count - 1 );
+        auto it = std::upper_bound( cumulative.begin(), cumulative.end(), rank );
+        result[i] = weighted[std::min < size_t > ( it - cumulative.begin(),
+                                                   weighted.size() - 1 )].first;
+    }
+    return result;
+} // quantiles
+
+double
+QuantileSketch::rankError() const
+{
+    // empirical bound for KLL, see the paper
+    return 2.0 / m_k;
+}
+}
+}
+}
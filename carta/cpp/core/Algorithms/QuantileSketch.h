@@ -0,0 +1,174 @@
+/**
+ * Streaming approximate quantiles (KLL sketch) with bounded memory.
+ **/
+
+#pragma once
+
+#include "CartaLib/CartaLib.h"
+#include <algorithm>
+#include <cmath>
+#include <cstdint>
+#include <vector>
+
+namespace Carta
+{
+namespace Core
+{
+namespace Algorithms
+{
+/// Quantile sketch of a stream of values, based on the KLL algorithm (Karnin, Lang,
+/// Liberty: Optimal Quantile Approximation in Streams).
+///
+/// The sketch keeps a hierarchy of buffers, values in buffer h stand for 2^h input
+/// values. When the sketch gets full, a buffer is sorted and every other value of it is
+/// promoted to the next buffer. The memory used is O(k log(n/k)) values, independent of
+/// the size of the input, and the rank of the returned quantiles is off by roughly
+/// rankError() * count() at most (with high probability).
+///
+/// Sketches of different parts of the input can be computed separately (e.g. in
+/// different threads) and merged.
+///
+/// NaNs are ignored. The coin flips are pseudo random with a fixed seed, so the same
+/// input (added and merged in the same order) always gives the same results.
+class QuantileSketch
+{
+    CLASS_BOILERPLATE( QuantileSketch );
+
+public:
+
+    /// default accuracy parameter, good for ~0.2% rank error
+    static constexpr int DefaultK = 1024;
+
+    /// capacity of the lowest levels, larger values make adding faster, since fewer
+    /// (small) compactions are needed
+    static constexpr int64_t MinLevelCapacity = 64;
+
+    /// \param k accuracy parameter, the larger the more accurate (and bigger) the sketch
+    explicit
+    QuantileSketch( int k = DefaultK );
+
+    /// add a single value
+    void
+    add( double value )
+    {
+        if ( Q_UNLIKELY( std::isnan( value ) ) ) {
+            return;
+        }
+        _addFinite( value );
+    }
+
+    /// add count values
+    template < typename Scalar >
+    void
+    add( const Scalar * data, int64_t count )
+    {
+        for ( int64_t i = 0 ; i < count ; ++i ) {
+            if ( Q_LIKELY( ! std::isnan( data[i] ) ) ) {
+                _addFinite( data[i] );
+            }
+        }
+    }
+
+    /// add all values of the other sketch to this one, both must have the same k
+    void
+    merge( const QuantileSketch & other );
+
+    /// returns the value such that a fraction q of the input is smaller (or equal),
+    /// NaN if the sketch is empty
+    /// \param q quantile in [0,1]
+    double
+    quantile( double q ) const;
+
+    /// same as quantile(), but for several quantiles at once (more efficient)
+    std::vector < double >
+    quantiles( const std::vector < double > & qs ) const;
+
+    /// number of (non-NaN) values added so far
+    int64_t
+    count() const
+    {
+        return m_count;
+    }
+
+    /// smallest value added so far
+    double
+    min() const
+    {
+        return m_min;
+    }
+
+    /// largest value added so far
+    double
+    max() const
+    {
+        return m_max;
+    }
+
+    /// accuracy parameter
+    int
+    k() const
+    {
+        return m_k;
+    }
+
+    /// approximate bound on the normalized rank error of the returned quantiles
+    double
+    rankError() const;
+
+    /// number of values stored in the sketch
+    int64_t
+    storedCount() const
+    {
+        return m_size;
+    }
+
+private:
+
+    void
+    _addFinite( double value )
+    {
+        m_count++;
+        m_min = std::min( m_min, value );
+        m_max = std::max( m_max, value );
+        m_levels[0].push_back( value );
+        m_size++;
+        if ( Q_UNLIKELY( m_size >= m_capacity ) ) {
+            _compress();
+        }
+    }
+
+    /// recompute the capacities after the number of levels changed
+    void
+    _updateCapacity();
+
+    /// compact levels until the sketch fits its capacity
+    void
+    _compress();
+
+    /// next pseudo random bit
+    int
+    _coin();
+
+    int m_k;
+
+    /// m_levels[h] holds values of weight 2^h
+    std::vector < std::vector < double > > m_levels;
+
+    /// total number of values in m_levels
+    int64_t m_size = 0;
+
+    /// how many values each level can hold before it needs to be compacted
+    std::vector < int64_t > m_levelCapacities;
+
+    /// sum of capacities of all levels
+    int64_t m_capacity = 0;
+
+    int64_t m_count = 0;
+    double m_min, m_max;
+
+    /// state of the xorshift generator used for coin flips
+    uint32_t m_random = 2463534242u;
+};
+}
+}
+}
@@ -6,6 +6,8 @@
 
 #include "CartaLib/CartaLib.h"
 #include "CartaLib/IImage.h"
+#include "CartaLib/Algorithms/ParallelFor.h"
+#include "QuantileSketch.h"
 #include <QDebug>
 #include <limits>
 #include <algorithm>
@@ -18,27 +20,85 @@ namespace Core
 {
 namespace Algorithms
 {
+/// how quantiles2pixels() computes the quantiles
+enum class QuantileMethod
+{
+    /// single pass over the data with a QuantileSketch, the rank of the results is
+    /// only approximate (see QuantileSketch::rankError())
+    Sketch,
+
+    /// two passes, the first one builds a sketch, the second one collects the values
+    /// the sketch says are close to the requested ranks and finds the exact answer
+    /// among them (more passes are made in the unlikely case the sketch was off by
+    /// more than its error bound)
+    Exact
+};
+
+/// how many values are sketched by one task in quantileSketch()
+static constexpr int64_t QuantileSketchChunk = 64 * 1024;
+
+/// build a quantile sketch of the view, the view is read sequentially (views are not
+/// thread safe) but each block is sketched in parallel, in chunks whose sketches are then
+/// merged in order, so the result does not depend on the number of threads
+/// \param view the input dataset
+/// \param k accuracy of the sketch (see QuantileSketch)
+template < typename Scalar >
+static
+QuantileSketch
+quantileSketch( Carta::Lib::NdArray::TypedView < Scalar > & view,
+                int k = QuantileSketch::DefaultK )
+{
+    QuantileSketch sketch( k );
+    std::vector < QuantileSketch > chunkSketches;
+    view.forEachBlock(
+        [&] ( const Scalar * data, int64_t count ) {
+            int64_t chunkSize = QuantileSketchChunk;
+            if ( count < 2 * chunkSize ) {
+                sketch.add( data, count );
+                return;
+            }
+            int64_t nChunks = ( count + chunkSize - 1 ) / chunkSize;
+            chunkSketches.assign( nChunks, QuantileSketch( k ) );
+            Carta::Lib::Algorithms::parallelFor(
+                0, nChunks, 1,
+                [&] ( int64_t c1, int64_t c2 ) {
+                    for ( int64_t c = c1 ; c < c2 ; ++c ) {
+                        int64_t first = c * chunkSize;
+                        chunkSketches[c].add( data + first,
+                                              std::min( chunkSize, count - first ) );
+                    }
+                }
+                );
+            for ( const auto & chunkSketch : chunkSketches ) {
+                sketch.merge( chunkSketch );
+            }
+        },
+        Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal
+        );
+    return sketch;
+} // quantileSketch
+
 /// compute requested quantiles
 /// \param view the input dataset
 /// \param quant which quantiles to compute
+/// \param method exact or approximate
 /// \return the computed quantiles. If all inputs are nans, the result will also be nans.
 ///
 /// Example: [0.1] will compute a value such that 10% of all values are smaller than the returned
 /// value.
 ///
-/// \note this is a dumb algorithm using quickselect. It really only works on datasets that
-/// are small enough to store in memory. For really big datasets we need a lot more sophisticated
-/// algorithm.
+/// Memory use does not grow with the size of the dataset for the approximate method. The
+/// exact method keeps ~0.15% of the values per quantile (those near the requested ranks)
+/// in memory, values tied with the bounds of that range are only counted.
 ///
 /// \note NANs are treated as if they did not exist
-///
-/// \note for best performance, the supplied list of quantiles should be sorted small->large
 template < typename Scalar >
 static
 typename std::vector < Scalar >
 quantiles2pixels(
     Carta::Lib::NdArray::TypedView < Scalar > & view,
-    std::vector < double > quant
+    std::vector < double > quant,
+    QuantileMethod method = QuantileMethod::Exact
     )
 {
     qDebug() << "computeClips" << view.dims();
@@ -51,50 +111,110 @@ quantiles2pixels(
         }
     }
 
-    // read in all values from the view into memory so that we can do quickselect on it
-    std::vector < Scalar > allValues;
-    view.forEach(
-        [& allValues] ( const Scalar & val ) {
-            if ( ! std::isnan( val ) ) {
-                allValues.push_back( val );
-            }
-        }
-        );
+    // first pass, a more accurate sketch for the exact method means fewer values
+    // need to be kept in memory in the second pass
+    QuantileSketch sketch = quantileSketch(
+        view, method == QuantileMethod::Exact ? 8 * QuantileSketch::DefaultK
+                                              : QuantileSketch::DefaultK );
 
     // indicate bad clip if no finite numbers were found
-    if ( allValues.size() == 0 ) {
-        return std::vector < Scalar > ( std::numeric_limits < Scalar >::quiet_NaN(), quant.size() );
+    int64_t n = sketch.count();
+    if ( n == 0 ) {
+        return std::vector < Scalar > ( quant.size(), std::numeric_limits < Scalar >::quiet_NaN() );
     }
 
-    // for every input quantile, do quickselect and store the result
     std::vector < Scalar > result;
-    for ( double q : quant ) {
-        size_t x1 = Carta::Lib::clamp<size_t>( allValues.size() * q, 0, allValues.size()-1);
-        CARTA_ASSERT( 0 <= x1 && x1 < allValues.size() );
-        std::nth_element( allValues.begin(), allValues.begin() + x1, allValues.end() );
-        result.push_back( allValues[x1] );
+    for ( double v : sketch.quantiles( quant ) ) {
+        result.push_back( v );
     }
-    CARTA_ASSERT( result.size() == quant.size());
+    if ( method == QuantileMethod::Sketch ) {
+        return result;
+    }
+
+    // Exact method: the value at sorted index r lies between the sketch's answers for
+    // ranks r-margin and r+margin, so we count the values below that range and
+    // collect the ones inside it. The bounds are values of the data, and could be
+    // point masses (e.g. lots of zeros), so values equal to them are only counted. If
+    // the sketch was off by more than the margin, the count will say so, and we try
+    // again with a wider margin.
+    std::vector < int64_t > ranks;
+    std::vector < size_t > pending;
+    for ( size_t i = 0 ; i < quant.size() ; ++i ) {
+        ranks.push_back( Carta::Lib::clamp < int64_t > ( n * quant[i], 0, n - 1 ) );
+        pending.push_back( i );
+    }
+    int64_t margin = std::max < int64_t > ( 3 * sketch.rankError() * n, 16 );
+    while ( ! pending.empty() ) {
+        size_t np = pending.size();
+        std::vector < double > lo( np ), hi( np );
+        for ( size_t j = 0 ; j < np ; ++j ) {
+            int64_t r = ranks[pending[j]];
+            lo[j] = r - margin <= 0 ? - std::numeric_limits < double >::infinity()
+                                    : sketch.quantile( double (r - margin) / n );
+            hi[j] = r + margin >= n - 1 ? std::numeric_limits < double >::infinity()
+                                        : sketch.quantile( double (r + margin) / n );
+        }
+        std::vector < int64_t > below( np, 0 ), equalLo( np, 0 ), equalHi( np, 0 );
+        std::vector < std::vector < Scalar > > inside( np );
+        view.forEachBlock(
+            [&] ( const Scalar * data, int64_t count ) {
+                for ( int64_t i = 0 ; i < count ; ++i ) {
+                    Scalar v = data[i];
+                    if ( Q_UNLIKELY( std::isnan( v ) ) ) {
+                        continue;
+                    }
+                    for ( size_t j = 0 ; j < np ; ++j ) {
+                        if ( v < lo[j] ) {
+                            below[j]++;
+                        }
+                        else if ( v == lo[j] ) {
+                            equalLo[j]++;
+                        }
+                        else if ( v < hi[j] ) {
+                            inside[j].push_back( v );
+                        }
+                        else if ( v == hi[j] ) {
+                            equalHi[j]++;
+                        }
+                    }
+                }
+            },
+            Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal
+            );
 
-    // some extra debugging help:
-    if( CARTA_RUNTIME_CHECKS) {
-        qDebug() << "quantile quality check:";
-        for( size_t i = 0 ; i < quant.size() ; ++ i) {
-            double q = quant[i];
-            double v = result[i];
-            size_t cnt = 0;
-            for( auto inp : allValues) {
-                if( inp <= v) cnt ++;
+        std::vector < size_t > stillPending;
+        for ( size_t j = 0 ; j < np ; ++j ) {
+            // in sorted order: the values equal to lo, the ones inside, the ones
+            // equal to hi
+            int64_t r = ranks[pending[j]] - below[j];
+            auto & values = inside[j];
+            int64_t nInside = values.size();
+            if ( r < 0 || r >= equalLo[j] + nInside + equalHi[j] ) {
+                stillPending.push_back( pending[j] );
+                continue;
+            }
+            if ( r < equalLo[j] ) {
+                result[pending[j]] = lo[j];
+            }
+            else if ( r < equalLo[j] + nInside ) {
+                r -= equalLo[j];
+                std::nth_element( values.begin(), values.begin() + r, values.end() );
+                result[pending[j]] = values[r];
+            }
+            else {
+                result[pending[j]] = hi[j];
             }
-            double qq = double(cnt)/allValues.size();
-            qDebug() << "  " << q << "->" << v << qq << fabs(q-qq)
-                     << ((fabs(q-qq) > 0.01) ? "!!!" : "");
         }
-        qDebug() << "-----------------------------";
+        if ( ! stillPending.empty() ) {
+            qWarning() << "quantile sketch was off by more than" << margin << "ranks, retrying";
+        }
+        pending.swap( stillPending );
+        margin *= 4;
     }
+    CARTA_ASSERT( result.size() == quant.size());
 
     return result;
-} // computeClips
+} // quantiles2pixels
 
 /// algorithm for finding quantile from pixel value
 template < typename Scalar >
@@ -103,11 +223,14 @@ double pixel2quantile ( Carta::Lib::NdArray::TypedView < Scalar > & view, Scalar
 {
     u_int64_t totalCount = 0;
     u_int64_t countBelow = 0;
-    view.forEach([&](const Scalar & val) {
-        if( Q_UNLIKELY( std::isnan(val))) return;
-        totalCount ++;
-        if( val <= pixel) countBelow++;
-    });
+    view.forEachBlock([&](const Scalar * data, int64_t count) {
+        for( int64_t i = 0 ; i < count ; ++ i) {
+            const Scalar & val = data[i];
+            if( Q_UNLIKELY( std::isnan(val))) continue;
+            totalCount ++;
+            if( val <= pixel) countBelow++;
+        }
+    }, Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal );
     return double(countBelow) / totalCount;
 }
 
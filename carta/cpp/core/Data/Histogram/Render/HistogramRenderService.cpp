@@ -1,17 +1,32 @@
 #include "HistogramRenderService.h"
 #include "HistogramRenderWorker.h"
-#include "HistogramRenderThread.h"
-#include "CartaLib/Hooks/Histogram.h"
 #include "Data/Util.h"
+#include <QRunnable>
 
 namespace Carta {
 namespace Data {
 
+class HistogramRenderService::Runnable : public QRunnable {
+public:
+    Runnable( HistogramRenderService* service ) :
+        m_service( service ){
+    }
+
+    virtual void run() override {
+        m_service->m_result = m_service->m_worker->computeHist();
+        QMetaObject::invokeMethod( m_service, "_postResult", Qt::QueuedConnection );
+    }
+
+private:
+    HistogramRenderService* m_service;
+};
+
+
 HistogramRenderService::HistogramRenderService( QObject * parent ) :
         QObject( parent ),
-        m_worker( nullptr),
-        m_renderThread( nullptr ){
+        m_worker( nullptr){
     m_renderQueued = false;
+    m_pool.setMaxThreadCount( 1 );
 }
 
 
@@ -39,26 +54,11 @@ void HistogramRenderService::_scheduleRender( const HistogramRenderRequest& requ
 		m_worker = new HistogramRenderWorker();
 	}
 	m_worker->setParameters( request );
-	int pid = m_worker->computeHist();
-	if ( pid != -1 ){
-		if ( !m_renderThread ){
-			m_renderThread = new HistogramRenderThread( pid );
-			connect( m_renderThread, SIGNAL(finished()), this, SLOT( _postResult()));
-		}
-		else {
-			m_renderThread->setFileDescriptor( pid );
-		}
-		m_renderThread->start();
-	}
-	else {
-		qDebug() << "Bad file descriptor: "<<pid;
-		m_renderQueued = false;
-	}
-
+	m_pool.start( new Runnable( this ) );
 }
 
 void HistogramRenderService::_postResult( ){
-	Carta::Lib::Hooks::HistogramResult result = m_renderThread->getResult();
+	Carta::Lib::Hooks::HistogramResult result = m_result;
 	m_requests.dequeue();
 	emit histogramResult( result );
 	m_renderQueued = false;
@@ -70,10 +70,7 @@ void HistogramRenderService::_postResult( ){
 
 
 HistogramRenderService::~HistogramRenderService(){
-    if ( m_renderThread ){
-    	m_renderThread->wait();
-    	delete m_renderThread;
-    }
+    m_pool.waitForDone();
     delete m_worker;
 }
 }
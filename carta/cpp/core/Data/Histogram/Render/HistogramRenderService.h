@@ -8,6 +8,7 @@
 #include "CartaLib/Hooks/HistogramResult.h"
 
 #include <QQueue>
+#include <QThreadPool>
 #include <memory>
 
 namespace Carta {
@@ -26,7 +27,6 @@ namespace Carta{
 namespace Data{
 
 class HistogramRenderWorker;
-class HistogramRenderThread;
 
 class HistogramRenderService : public QObject {
     Q_OBJECT
@@ -61,9 +61,15 @@ private slots:
     void _postResult( );
 
 private:
+    class Runnable;
+
     void _scheduleRender( const HistogramRenderRequest& request );
     HistogramRenderWorker* m_worker;
-    HistogramRenderThread* m_renderThread;
+    //Result of the request being computed, written by the pool thread before
+    //_postResult() is invoked.
+    Carta::Lib::Hooks::HistogramResult m_result;
+    //Computes one request at a time, so that histograms do not hold up the global pool.
+    QThreadPool m_pool;
     bool m_renderQueued;
     QQueue<HistogramRenderRequest> m_requests;
 
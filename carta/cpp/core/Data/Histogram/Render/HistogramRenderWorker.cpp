@@ -2,92 +2,233 @@
 #include "Data/Util.h"
 #include "Globals.h"
 #include "PluginManager.h"
-#include "CartaLib/Hooks/Histogram.h"
+#include "CartaLib/AxisInfo.h"
+#include "CartaLib/IImage.h"
+#include "CartaLib/Algorithms/ParallelFor.h"
+#include "CartaLib/Hooks/ConversionSpectralHook.h"
 #include "CartaLib/Hooks/HistogramResult.h"
-#include <QFile>
-#include <QDataStream>
-#include <string.h>
-#include <unistd.h>
+#include <QDebug>
+#include <QFileInfo>
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+#include <stdexcept>
 
 namespace Carta
 {
 namespace Data
 {
 
-HistogramRenderWorker::HistogramRenderWorker(){
+const int64_t HistogramRenderWorker::BLOCK_SIZE = 1024 * 1024;
+const int64_t HistogramRenderWorker::CHUNK_SIZE = 16 * 1024;
+const double HistogramRenderWorker::ALL_INTENSITIES = -1;
+
+HistogramRenderWorker::HistogramRenderWorker() :
+    m_binCount( 0 ),
+    m_minFrequency( -1 ),
+    m_maxFrequency( -1 ),
+    m_minIntensity( ALL_INTENSITIES ),
+    m_maxIntensity( ALL_INTENSITIES ),
+    m_empty( false ){
 }
 
 
 void HistogramRenderWorker::setParameters( const HistogramRenderRequest& request ){
     m_binCount = request.getBinCount();
-    m_minChannel = request.getChannelMin();
-    m_maxChannel = request.getChannelMax();
-    m_minFrequency = request.getFrequencyMin();
-    m_maxFrequency = request.getFrequencyMax();
-    m_rangeUnits = request.getRangeUnits();
     m_minIntensity = request.getIntensityMin();
     m_maxIntensity = request.getIntensityMax();
     m_fileName = request.getFileName();
 
     m_dataSource = request.getImage();
-    m_region = request.getRegion();
     m_regionId = request.getRegionId();
 
+    m_slice = SliceND();
+    m_empty = false;
+    if ( m_dataSource ){
+        _resolveChannels( request );
+        //The region may change once the request is handed to a worker thread.
+        if ( !m_regionMask.setRegion( m_dataSource, request.getRegion() ) ){
+            m_empty = true;
+        }
+        m_regionMask.restrict( m_slice );
+    }
 }
 
 
-int HistogramRenderWorker::computeHist(){
-    //Note:  we compute the histogram in a separate process because casacore tables
-    //cannot be accessed by different threads at the same time.
-    int histogramPipes [2];
-    if (pipe (histogramPipes)){
-        qDebug() << "*** HistogramRenderWorker::run: pipe creation failed: " << strerror (errno);
-        return -1;
+std::vector<double> HistogramRenderWorker::_convertSpectral( const QString& oldUnits,
+        const QString& newUnits, const std::vector<double>& values ) const {
+    std::vector<double> converted;
+    auto result = Globals::instance()-> pluginManager()
+                         -> prepare <Carta::Lib::Hooks::ConversionSpectralHook>(m_dataSource,
+                                 oldUnits, newUnits, values );
+    auto lam = [&converted] ( const Carta::Lib::Hooks::ConversionSpectralHook::ResultType &data ) {
+        converted = data;
+    };
+    try {
+        result.forEach( lam );
+    }
+    catch( char*& error ){
+        qDebug() << "HistogramRenderWorker: could not convert spectral units: " << error;
+        converted.clear();
     }
+    return converted;
+}
 
-    int pid = fork ();
-    if (pid == -1){
-        // Failure
-        qDebug() << "*** HistogramRenderWorker::run: fork failed: " << strerror (errno);
-        return -1;
 
+void HistogramRenderWorker::_resolveChannels( const HistogramRenderRequest& request ){
+    m_minFrequency = request.getFrequencyMin();
+    m_maxFrequency = request.getFrequencyMax();
+    int spectralIndex = Util::getAxisIndex( m_dataSource, Carta::Lib::AxisInfo::KnownType::SPECTRAL );
+    if ( spectralIndex < 0 ){
+        //Without a spectral axis, the histogram is of the whole image.
+        return;
+    }
+    int channelCount = m_dataSource->dims()[spectralIndex];
+    int minChannel = request.getChannelMin();
+    int maxChannel = request.getChannelMax();
+    QString rangeUnits = request.getRangeUnits();
+    if ( m_minFrequency < 0 || m_maxFrequency < 0 ){
+        //Report the frequencies of the channel range.
+        std::vector<double> channels( 2 );
+        channels[0] = std::max( 0, minChannel );
+        channels[1] = maxChannel >= 0 ? std::min( channelCount - 1, maxChannel ) : channelCount - 1;
+        std::vector<double> frequencies = _convertSpectral( "", rangeUnits, channels );
+        if ( frequencies.size() == 2 ){
+            m_minFrequency = std::min( frequencies[0], frequencies[1] );
+            m_maxFrequency = std::max( frequencies[0], frequencies[1] );
+        }
+    }
+    else {
+        //The channels come from the frequency range.
+        std::vector<double> frequencies( 2 );
+        frequencies[0] = m_minFrequency;
+        frequencies[1] = m_maxFrequency;
+        std::vector<double> channels = _convertSpectral( rangeUnits, "", frequencies );
+        if ( channels.size() == 2 ){
+            int lowChannel = qRound( std::min( channels[0], channels[1] ) );
+            int highChannel = qRound( std::max( channels[0], channels[1] ) );
+            minChannel = Carta::Lib::clamp( lowChannel, 0, channelCount - 1 );
+            maxChannel = Carta::Lib::clamp( highChannel, 0, channelCount - 1 );
+        }
+        else {
+            minChannel = -1;
+            maxChannel = -1;
+        }
+    }
+
+    if ( minChannel >= 0 && maxChannel >= 0 ){
+        int endChannel = std::min( maxChannel, channelCount - 1 );
+        if ( minChannel > endChannel ){
+            m_empty = true;
+        }
+        else {
+            m_slice.slice( spectralIndex ).start( minChannel ).end( endChannel + 1 );
+        }
     }
-    else if (pid != 0){
-        // The original process comes here.
-        close (histogramPipes [1]); // close write end of the pipe
-        return histogramPipes [0]; // return the read end of the pipe
+}
+
+
+void HistogramRenderWorker::_forEachChunk( const ChunkFunc& func ){
+    Carta::Lib::NdArray::RawViewInterface* rawView = m_dataSource->getDataSlice( m_slice );
+    if ( rawView == nullptr ){
+        throw std::runtime_error( "could not read image data" );
     }
+    Carta::Lib::NdArray::Double view( rawView, true );
 
-    // We're our own process
-    // Close the read end of the pipe
-    close( histogramPipes[0] );
-    auto result = Globals::instance()-> pluginManager()
-                          -> prepare <Carta::Lib::Hooks::HistogramHook>(m_dataSource, m_binCount,
-                                  m_minChannel, m_maxChannel, m_minFrequency, m_maxFrequency, m_rangeUnits,
-                                  m_minIntensity, m_maxIntensity, m_region, m_regionId );
-    auto lam = [=] ( const Carta::Lib::Hooks::HistogramResult &data ) {
-        m_result = data;
+    //The blocks are read one after the other, which is all the image allows, but
+    //binning a block is spread over all cores.
+    auto blockFunc = [&]( const double* data, int64_t count ){
+        const std::vector<int>& blockPos = rawView->currentPos();
+        const std::vector<int>& blockDims = rawView->currentBlockDims();
+        Carta::Lib::Algorithms::parallelFor( 0, count, CHUNK_SIZE,
+                [&]( int64_t first, int64_t last ){
+            func( data, first, last, blockPos, blockDims );
+        });
     };
-    try {
-        result.forEach( lam );
-    }
-    catch( char*& error ){
-        qDebug() << "HistogramRenderWorker::run: caught error: " << error;
-        m_result.setName( Util::ERROR +": "+QString(error) );
+    view.forEachBlock( blockFunc, Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal,
+            BLOCK_SIZE );
+}
+
+
+Carta::Lib::Hooks::HistogramResult HistogramRenderWorker::computeHist(){
+    QString name = QFileInfo( m_fileName ).fileName() + m_regionId;
+    QString unitsY;
+    std::vector<std::pair<double,double> > data;
+    if ( m_dataSource ){
+        unitsY = m_dataSource->getPixelUnit().toStr();
     }
+    if ( m_dataSource && !m_empty && m_binCount > 0 ){
+        bool useRegion = !m_regionMask.isAll();
+        try {
+            QMutex mutex;
+            double minValue = m_minIntensity;
+            double maxValue = m_maxIntensity;
+            if ( m_minIntensity == ALL_INTENSITIES && m_maxIntensity == ALL_INTENSITIES ){
+                //No intensity range, so the bins cover the data, which takes an extra pass.
+                minValue = std::numeric_limits<double>::infinity();
+                maxValue = -std::numeric_limits<double>::infinity();
+                _forEachChunk( [&]( const double* values, int64_t first, int64_t last,
+                        const std::vector<int>& blockPos, const std::vector<int>& blockDims ){
+                    double chunkMin = std::numeric_limits<double>::infinity();
+                    double chunkMax = -std::numeric_limits<double>::infinity();
+                    for ( int64_t i = first; i < last; i++ ){
+                        double value = values[i];
+                        if ( std::isnan( value ) ||
+                                ( useRegion && !m_regionMask.contains( i, blockPos, blockDims ) ) ){
+                            continue;
+                        }
+                        chunkMin = std::min( chunkMin, value );
+                        chunkMax = std::max( chunkMax, value );
+                    }
+                    QMutexLocker locker( &mutex );
+                    minValue = std::min( minValue, chunkMin );
+                    maxValue = std::max( maxValue, chunkMax );
+                });
+            }
 
-    QFile file;
-    if ( !file.open( histogramPipes[1], QIODevice::WriteOnly, QFileDevice::AutoCloseHandle ) ){
-        qDebug() << "Could not write histogram results";
-        close( histogramPipes[1] );
-        exit(0);
-        return 0;
+            //Bins of equal size over [minValue,maxValue], pixels outside the range
+            //are left out.
+            if ( minValue <= maxValue ){
+                std::vector<int64_t> counts( m_binCount, 0 );
+                double binWidth = ( maxValue - minValue ) / m_binCount;
+                int binCount = m_binCount;
+                _forEachChunk( [&]( const double* values, int64_t first, int64_t last,
+                        const std::vector<int>& blockPos, const std::vector<int>& blockDims ){
+                    std::vector<int64_t> chunkCounts( binCount, 0 );
+                    for ( int64_t i = first; i < last; i++ ){
+                        double value = values[i];
+                        if ( std::isnan( value ) || value < minValue || value > maxValue ||
+                                ( useRegion && !m_regionMask.contains( i, blockPos, blockDims ) ) ){
+                            continue;
+                        }
+                        int bin = 0;
+                        if ( binWidth > 0 ){
+                            bin = std::min( static_cast<int>( ( value - minValue ) / binWidth ), binCount - 1 );
+                        }
+                        chunkCounts[bin]++;
+                    }
+                    QMutexLocker locker( &mutex );
+                    for ( int j = 0; j < binCount; j++ ){
+                        counts[j] += chunkCounts[j];
+                    }
+                });
+                data.resize( m_binCount );
+                for ( int i = 0; i < m_binCount; i++ ){
+                    data[i] = std::pair<double,double>( minValue + ( i + 0.5 ) * binWidth, counts[i] );
+                }
+            }
+        }
+        catch( const std::exception& error ){
+            qDebug() << "HistogramRenderWorker::computeHist: caught error: " << error.what();
+            name = Util::ERROR + ": " + QString( error.what() );
+            data.clear();
+        }
     }
-    QDataStream dataStream( &file );
-    dataStream << m_result;
-    file.close();
-    exit(0);
-    return 0;
+    Carta::Lib::Hooks::HistogramResult result( name, "pixels", unitsY, data );
+    result.setFrequencyBounds( m_minFrequency, m_maxFrequency );
+    return result;
 }
 
 
@@ -1,12 +1,16 @@
 /**
- * Initiates the work of computing the histogram in a separate process.
+ * Computes histogram data from an image cube in-process.
  **/
 
 #pragma once
 
+#include <functional>
 #include <memory>
+#include <vector>
 #include "HistogramRenderRequest.h"
 #include "CartaLib/Hooks/HistogramResult.h"
+#include "CartaLib/Slice.h"
+#include "Data/Region/RegionMask.h"
 
 namespace Carta {
 namespace Lib {
@@ -21,8 +25,6 @@ class RegionBase;
 
 namespace Data{
 
-class Region;
-
 class HistogramRenderWorker{
 
 public:
@@ -34,17 +36,25 @@ public:
 
     /**
      * Store the parameters needed for computing the histogram.
+     *
+     * This resolves the channel and frequency ranges and takes a snapshot of the
+     * region as a pixel mask, so that computeHist() does not need to touch anything
+     * but the pixel data. It should be called from the thread that owns the image
+     * and the region.
      * @param request - a collection of parameters specifying how the histogram
      * 	should be computed.
      */
     void setParameters( const HistogramRenderRequest& request );
 
     /**
-     * Performs the work of computing the histogram data in a separate process.
-     * @return - the file descriptor for the pipe that can be used to read the
-     *      histogram data.
+     * Computes the histogram data.
+     *
+     * Pixels are read block by block (reads of the image are serialized by the
+     * image itself) and each block is binned by all available cores, so this can
+     * run on a worker thread.
+     * @return - the histogram data.
      */
-    int computeHist();
+    Carta::Lib::Hooks::HistogramResult computeHist();
 
     /**
      * Destructor.
@@ -52,19 +62,44 @@ public:
     ~HistogramRenderWorker();
 
 private:
+
+    //Pixels per block read from the image, and per chunk of a block handed to a thread.
+    static const int64_t BLOCK_SIZE;
+    static const int64_t CHUNK_SIZE;
+
+    //Intensity bounds that mean the full intensity range of the data.
+    static const double ALL_INTENSITIES;
+
+    //Reads all selected pixels in blocks, each block is handed to func in chunks
+    //from several threads at once.  The chunk is given by the first and last (exclusive)
+    //index of its pixels in the block; the block's position and dimensions are needed
+    //to apply the region mask.
+    typedef std::function<void( const double* data, int64_t first, int64_t last,
+            const std::vector<int>& blockPos, const std::vector<int>& blockDims )> ChunkFunc;
+    void _forEachChunk( const ChunkFunc& func );
+
+    //Channel and frequency ranges of the request.
+    void _resolveChannels( const HistogramRenderRequest& request );
+
+    std::vector<double> _convertSpectral( const QString& oldUnits, const QString& newUnits,
+            const std::vector<double>& values ) const;
+
     std::shared_ptr<Carta::Lib::Image::ImageInterface> m_dataSource;
     int m_binCount;
-    int m_minChannel;
-    int m_maxChannel;
     double m_minFrequency;
     double m_maxFrequency;
-    QString m_rangeUnits;
     double m_minIntensity;
     double m_maxIntensity;
     QString m_fileName;
     QString m_regionId;
-    Carta::Lib::Hooks::HistogramResult m_result;
-    std::shared_ptr<Carta::Lib::Regions::RegionBase> m_region;
+
+    //The part of the image the histogram is made of.
+    SliceND m_slice;
+    //True if the request selects no pixels at all.
+    bool m_empty;
+
+    //Snapshot of the region.
+    RegionMask m_regionMask;
 
     HistogramRenderWorker( const HistogramRenderWorker& other);
     HistogramRenderWorker& operator=( const HistogramRenderWorker& other );
@@ -73,4 +108,3 @@ private:
 }
 
 
-
@@ -0,0 +1,185 @@
+#include "ChannelStatsIndex.h"
+#include "CartaLib/IImage.h"
+#include "../../Algorithms/quantileAlgorithms.h"
+#include <QDataStream>
+#include <QMutexLocker>
+#include <QRunnable>
+#include <algorithm>
+#include <cmath>
+#include <limits>
+
+namespace Carta {
+
+namespace Data {
+
+const std::vector<double> ChannelStatsIndex::PERCENTILES = {
+        0, 0.0005, 0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.25, 0.5,
+        0.75, 0.95, 0.975, 0.99, 0.995, 0.9975, 0.999, 0.9995, 1 };
+const int64_t ChannelStatsIndex::CACHE_PRIORITY = 10;
+
+class ChannelStatsIndex::Runnable : public QRunnable {
+public:
+    Runnable( ChannelStatsIndex* index, bool compute ) :
+        m_index( index ),
+        m_compute( compute ){
+    }
+
+    virtual void run() override {
+        m_index->_computeAll( m_compute );
+    }
+
+private:
+    ChannelStatsIndex* m_index;
+    bool m_compute;
+};
+
+
+ChannelStatsIndex::ChannelStatsIndex( int planeCount, const PlaneFactory& planeFactory,
+        Carta::Lib::IPCache::SharedPtr pcache, const QString& cacheKey, QObject* parent ) :
+    QObject( parent ),
+    m_planeCount( std::max( planeCount, 0 ) ),
+    m_planeFactory( planeFactory ),
+    m_pcache( pcache ),
+    m_cacheKey( cacheKey ),
+    m_cancelled( false ),
+    m_planes( m_planeCount ),
+    m_planeDone( m_planeCount, false ),
+    m_completedCount( 0 ){
+    m_pool.setMaxThreadCount( 1 );
+}
+
+void ChannelStatsIndex::start(){
+    m_pool.start( new Runnable( this, true ) );
+}
+
+void ChannelStatsIndex::load(){
+    m_pool.start( new Runnable( this, false ) );
+}
+
+void ChannelStatsIndex::setPercentiles( int plane, const std::vector<double>& values ){
+    if ( plane < 0 || plane >= m_planeCount || values.size() != PERCENTILES.size() ){
+        return;
+    }
+    _setPlane( plane, values );
+    if ( m_pcache ){
+        m_pcache->setEntry( _getPlaneKey( plane ), _serialize( values ), CACHE_PRIORITY );
+    }
+}
+
+void ChannelStatsIndex::_computeAll( bool compute ){
+    for ( int i = 0; i < m_planeCount; i++ ){
+        if ( m_cancelled ){
+            return;
+        }
+        {
+            //Skip planes stored by setPercentiles().
+            QMutexLocker locker( &m_mutex );
+            if ( m_planeDone[i] ){
+                continue;
+            }
+        }
+        std::vector<double> values( PERCENTILES.size(), std::numeric_limits<double>::quiet_NaN() );
+        QByteArray key = _getPlaneKey( i );
+        QByteArray cached;
+        if ( m_pcache ){
+            m_pcache->readEntry( key, cached );
+        }
+        if ( cached.isNull() || !_deserialize( cached, values ) ){
+            if ( !compute ){
+                continue;
+            }
+            Carta::Lib::NdArray::RawViewInterface* rawView = m_planeFactory( i );
+            if ( rawView != nullptr ){
+                values = _computePlane( rawView );
+            }
+            if ( m_pcache ){
+                m_pcache->setEntry( key, _serialize( values ), CACHE_PRIORITY );
+            }
+        }
+        int completed = _setPlane( i, values );
+        emit progress( completed, m_planeCount );
+    }
+}
+
+int ChannelStatsIndex::_setPlane( int plane, const std::vector<double>& values ){
+    QMutexLocker locker( &m_mutex );
+    m_planes[plane] = values;
+    if ( !m_planeDone[plane] ){
+        m_planeDone[plane] = true;
+        m_completedCount++;
+    }
+    return m_completedCount;
+}
+
+QByteArray ChannelStatsIndex::_getPlaneKey( int plane ) const {
+    return QString( "%1/%2" ).arg( m_cacheKey ).arg( plane ).toUtf8();
+}
+
+std::vector<double> ChannelStatsIndex::_computePlane( Carta::Lib::NdArray::RawViewInterface* rawView ){
+    Carta::Lib::NdArray::Double view( rawView, true );
+    return Carta::Core::Algorithms::quantiles2pixels( view, PERCENTILES );
+}
+
+QByteArray ChannelStatsIndex::_serialize( const std::vector<double>& values ){
+    QByteArray data;
+    QDataStream out( &data, QIODevice::WriteOnly );
+    out << static_cast<quint32>( values.size() );
+    for ( double value : values ){
+        out << value;
+    }
+    return data;
+}
+
+bool ChannelStatsIndex::_deserialize( const QByteArray& data, std::vector<double>& values ){
+    QDataStream in( data );
+    quint32 percentileCount = 0;
+    in >> percentileCount;
+    //The percentiles are part of the cache key, but do not trust the data blindly.
+    if ( in.status() != QDataStream::Ok || percentileCount != PERCENTILES.size() ){
+        return false;
+    }
+    values.resize( percentileCount );
+    for ( quint32 i = 0; i < percentileCount; i++ ){
+        in >> values[i];
+    }
+    return in.status() == QDataStream::Ok;
+}
+
+int ChannelStatsIndex::getPlaneCount() const {
+    return m_planeCount;
+}
+
+int ChannelStatsIndex::getCompletedCount() const {
+    QMutexLocker locker( &m_mutex );
+    return m_completedCount;
+}
+
+bool ChannelStatsIndex::isFinished() const {
+    return getCompletedCount() == m_planeCount;
+}
+
+bool ChannelStatsIndex::getPercentile( int plane, double percentile, double* value ) const {
+    bool available = false;
+    if ( 0 <= plane && plane < m_planeCount ){
+        const double ERROR_MARGIN = 0.000001;
+        int percentileCount = PERCENTILES.size();
+        for ( int i = 0; i < percentileCount; i++ ){
+            if ( std::fabs( PERCENTILES[i] - percentile ) < ERROR_MARGIN ){
+                QMutexLocker locker( &m_mutex );
+                if ( m_planeDone[plane] && !std::isnan( m_planes[plane][i] ) ){
+                    *value = m_planes[plane][i];
+                    available = true;
+                }
+                break;
+            }
+        }
+    }
+    return available;
+}
+
+ChannelStatsIndex::~ChannelStatsIndex(){
+    m_cancelled = true;
+    m_pool.waitForDone();
+}
+}
+}
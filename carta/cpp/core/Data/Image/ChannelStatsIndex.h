@@ -0,0 +1,172 @@
+/***
+ * Per-plane percentiles of an image, computed in the background.
+ */
+
+#pragma once
+
+#include "CartaLib/IPCache.h"
+#include <QObject>
+#include <QMutex>
+#include <QThreadPool>
+#include <atomic>
+#include <cstdint>
+#include <functional>
+#include <memory>
+#include <vector>
+
+namespace Carta {
+namespace Lib {
+namespace NdArray {
+class RawViewInterface;
+}
+}
+
+namespace Data {
+
+/**
+ * Computes the percentiles of every plane of an image (all combinations of the
+ * indices of the non-display axes) on a background thread, one plane at a time,
+ * so that the clips of a plane are available without reading it again.
+ *
+ * If a persistent cache is given, the percentiles of each plane are stored in it,
+ * and taken from it the next time the same image is opened. Images that are too
+ * big to scan can be indexed one plane at a time instead, as the planes are read
+ * for other reasons (see load() and setPercentiles()).
+ */
+class ChannelStatsIndex : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    /**
+     * Returns a new view of a plane, the caller takes ownership, nullptr if the
+     * plane has no data.
+     */
+    typedef std::function<Carta::Lib::NdArray::RawViewInterface* (int plane)> PlaneFactory;
+
+    /**
+     * Constructor.
+     * @param planeCount - the number of planes.
+     * @param planeFactory - creates the views of the planes, it is only called from
+     *      the background thread.
+     * @param pcache - persistent cache for the statistics, or nullptr.
+     * @param cacheKey - identifies the image (and its version) in the persistent cache.
+     * @param parent - the parent object.
+     */
+    ChannelStatsIndex( int planeCount, const PlaneFactory& planeFactory,
+            Carta::Lib::IPCache::SharedPtr pcache = nullptr, const QString& cacheKey = "",
+            QObject* parent = nullptr );
+
+    /**
+     * Start computing the percentiles in the background.
+     */
+    void start();
+
+    /**
+     * Start taking the percentiles from the persistent cache in the background,
+     * without computing those that are not there (for images too big to scan,
+     * whose planes are only indexed as they are shown, see setPercentiles()).
+     */
+    void load();
+
+    /**
+     * Store the percentiles of a plane that were computed elsewhere, they are
+     * also written to the persistent cache.
+     * @param plane - the index of the plane.
+     * @param values - the values at PERCENTILES.
+     */
+    void setPercentiles( int plane, const std::vector<double>& values );
+
+    /**
+     * Returns the number of planes.
+     * @return - the number of planes in the image.
+     */
+    int getPlaneCount() const;
+
+    /**
+     * Returns the number of planes whose percentiles are available.
+     * @return - the number of planes done so far.
+     */
+    int getCompletedCount() const;
+
+    /**
+     * Returns true if the percentiles of all planes are available.
+     * @return - true if the index is complete; false otherwise.
+     */
+    bool isFinished() const;
+
+    /**
+     * Returns the value at one of the stored percentiles of a plane.
+     * @param plane - the index of the plane.
+     * @param percentile - a number in [0,1], it must be one of PERCENTILES.
+     * @param value - set to the value at the percentile.
+     * @return - true if the value is available; false if the plane is not done yet,
+     *      has no data, or the percentile is not stored.
+     */
+    bool getPercentile( int plane, double percentile, double* value ) const;
+
+    /**
+     * Stop the computation and wait for the background thread.
+     */
+    virtual ~ChannelStatsIndex();
+
+    /// the percentiles stored for every plane, they include the clips offered by
+    /// default and their complements
+    static const std::vector<double> PERCENTILES;
+
+signals:
+
+    /**
+     * Emitted (from the background thread) after each plane, the index is finished
+     * when completed reaches planeCount.
+     * @param completed - the number of planes done so far.
+     * @param planeCount - the number of planes.
+     */
+    void progress( int completed, int planeCount );
+
+private:
+
+    class Runnable;
+
+    //Takes the percentiles of all planes from the persistent cache, computes the
+    //missing ones if compute is true, runs on m_pool.
+    void _computeAll( bool compute );
+
+    //Stores the percentiles of a plane, returns the number of planes done.
+    int _setPlane( int plane, const std::vector<double>& values );
+
+    //The key of a plane in the persistent cache.
+    QByteArray _getPlaneKey( int plane ) const;
+
+    //Computes the percentiles of a single plane, NaN if it has no data.
+    static std::vector<double> _computePlane( Carta::Lib::NdArray::RawViewInterface* rawView );
+
+    //Conversion of plane percentiles for the persistent cache.
+    static QByteArray _serialize( const std::vector<double>& values );
+    static bool _deserialize( const QByteArray& data, std::vector<double>& values );
+
+    //Priority of the entries in the persistent cache, plane percentiles are small
+    //and take a full read of the plane to recompute.
+    static const int64_t CACHE_PRIORITY;
+
+    int m_planeCount;
+    PlaneFactory m_planeFactory;
+    Carta::Lib::IPCache::SharedPtr m_pcache;
+    QString m_cacheKey;
+    std::atomic<bool> m_cancelled;
+
+    mutable QMutex m_mutex;
+    //The values at PERCENTILES of each plane.
+    std::vector<std::vector<double> > m_planes;
+    std::vector<bool> m_planeDone;
+    int m_completedCount;
+
+    //Runs _computeAll() so that it does not hold up the global pool.
+    QThreadPool m_pool;
+
+    ChannelStatsIndex( const ChannelStatsIndex& other);
+    ChannelStatsIndex& operator=( const ChannelStatsIndex& other );
+};
+}
+}
@@ -1298,6 +1298,16 @@ void Controller::_updateCursor( int mouseX, int mouseY ){
         m_stateMouse.setValue<int>( ImageView::MOUSE_Y, mouseY );
         _updateCursorText( false );
         m_stateMouse.flushState();
+
+        //Only tell listeners about the cursor once it is over another image pixel.
+        bool valid = false;
+        QPointF imagePt = getImagePt( &valid );
+        QPoint pixel( qRound( imagePt.x() ), qRound( imagePt.y() ) );
+        if ( valid != m_cursorPixelValid || ( valid && pixel != m_cursorPixel ) ){
+            m_cursorPixel = pixel;
+            m_cursorPixelValid = valid;
+            emit cursorChanged( this );
+        }
     }
 }
 
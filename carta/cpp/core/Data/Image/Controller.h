@@ -13,6 +13,7 @@
 #include <QString>
 #include <QList>
 #include <QObject>
+#include <QPoint>
 
 #include <set>
 
@@ -594,6 +595,12 @@ signals:
      */
     void zoomChanged();
 
+    /**
+     * Notification that the cursor has moved to another pixel of the image.
+     * @param controller this Controller.
+     */
+    void cursorChanged( Controller* controller );
+
     /// Return the result of SaveFullImage() after the image has been rendered
     /// and a save attempt made.
     void saveImageResult( bool result );
@@ -709,6 +716,10 @@ private:
 	//everyone wants to listen to them.
 	Carta::State::StateInterface m_stateMouse;
 
+	//Image pixel under the cursor when cursorChanged was last emitted.
+	QPoint m_cursorPixel;
+	bool m_cursorPixelValid = false;
+
 	Controller(const Controller& other);
 	Controller& operator=(const Controller& other);
 
@@ -1,7 +1,10 @@
 #include "DataSource.h"
+#include "ChannelStatsIndex.h"
+#include "TransposedCube.h"
 #include "CoordinateSystems.h"
 #include "Data/Colormap/Colormaps.h"
 #include "Globals.h"
+#include "MainConfig.h"
 #include "PluginManager.h"
 #include "GrayColormap.h"
 #include "CartaLib/IImage.h"
@@ -11,7 +14,9 @@
 #include "CartaLib/PixelPipeline/CustomizablePixelPipeline.h"
 #include "../../ImageRenderService.h"
 #include "../../Algorithms/quantileAlgorithms.h"
+#include <QDateTime>
 #include <QDebug>
+#include <QFileInfo>
 #include <sys/time.h>
 
 using Carta::Lib::AxisInfo;
@@ -29,16 +34,18 @@ const int DataSource::INDEX_INTENSITY = 1;
 const int DataSource::INDEX_PERCENTILE = 2;
 const int DataSource::INDEX_FRAME_LOW = 3;
 const int DataSource::INDEX_FRAME_HIGH = 4;
+const int64_t DataSource::PLANE_STATS_BYTES_MAX = int64_t( 2048 ) * 1024 * 1024;
+const int64_t DataSource::CUBE_HISTOGRAM_PRIORITY = 10;
 
 CoordinateSystems* DataSource::m_coords = nullptr;
 
 DataSource::DataSource() :
     m_image( nullptr ),
     m_permuteImage( nullptr),
-    m_cachedPercentiles(100),
     m_axisIndexX( 0 ),
     m_axisIndexY( 1 ){
         m_cmapCacheSize = 1000;
+        m_cumulativeHistograms.setMaxCost( 64 * 1024 ); // 64 megs (cost is in kilobytes)
 
         _initializeSingletons();
 
@@ -57,35 +64,6 @@ DataSource::DataSource() :
         m_renderService-> setPixelPipeline( m_pixelPipeline, m_pixelPipeline-> cacheId());
 }
 
-void DataSource::_copyData( int frameLow, int frameHigh, int spectralIndex,
-        std::vector<int>& allIndices, std::vector<double>& allValues ){
-    Carta::Lib::NdArray::RawViewInterface* rawData = _getRawData( frameLow, frameHigh, spectralIndex );
-    if ( rawData != nullptr ){
-        Carta::Lib::NdArray::TypedView<double> view( rawData, false );
-
-        // read in all values from the view into an array
-        // we need our own copy because we'll do quickselect on it...
-        int index = 0;
-    
-        // Preallocate space for both of these copies to avoid 
-        // running out of memory unnecessarily through dynamic allocation
-        std::vector<int> dims = rawData->dims();
-        int total_size = std::accumulate(dims.begin(), dims.end(), 1, std::multiplies<int>());
-        allIndices.reserve(total_size);
-        allValues.reserve(total_size);
-
-        view.forEach( [& allValues, &allIndices, &index] ( const double  val ) {
-            if ( std::isfinite( val ) ) {
-                allValues.push_back( val );
-                allIndices.push_back( index );
-            }
-            index++;
-        }
-        );
-    }
-}
-
-
 int DataSource::_getFrameIndex( int sourceFrameIndex, const std::vector<int>& sourceFrames ) const {
     int frameIndex = 0;
     if (m_image ){
@@ -361,63 +339,87 @@ std::shared_ptr<Carta::Core::ImageRenderService::Service> DataSource::_getRender
     return m_renderService;
 }
 
+std::shared_ptr<TransposedCube> DataSource::_getTransposedCube() const {
+    return m_transposedCube;
+}
 
-std::vector<std::pair<int,double> > DataSource::_getIntensityCache( int frameLow, int frameHigh,
-        const std::vector<double>& percentiles ){
-    //See if it is in the cached percentiles first.
-    int percentileCount = percentiles.size();
-    std::vector<std::pair<int,double> > intensities(percentileCount,std::pair<int,double>(-1,0));
-    //Find all the intensities we can in the cache.
-    int foundCount = 0;
-    for ( int i = 0; i < percentileCount; i++ ){
-        std::pair<int,double> val = m_cachedPercentiles.getIntensity( frameLow, frameHigh, percentiles[i]);
-        if ( val.first>= 0 ){
-            intensities[i] = val;
-            foundCount++;
-        }
-    }
 
-    //Not all percentiles were in the cache.  We are going to have to look some up.
-    if ( foundCount < percentileCount ){
-        std::vector < int > allIndices;
-        std::vector < double > allValues;
+Carta::Core::Algorithms::CumulativeHistogram::SharedPtr DataSource::_getCumulativeHistogram(
+        int frameLow, int frameHigh ) const {
+    QString key = QString( "%1/%2" ).arg( frameLow ).arg( frameHigh );
+    Carta::Core::Algorithms::CumulativeHistogram::SharedPtr * cached = m_cumulativeHistograms.object( key );
+    if ( cached ){
+        return *cached;
+    }
+    Carta::Core::Algorithms::CumulativeHistogram::SharedPtr histogram = nullptr;
+    if ( m_image ){
+        //Read the cube one channel at a time, so that only one channel per thread
+        //needs to be in memory.
         int spectralIndex = Util::getAxisIndex( m_image, AxisInfo::KnownType::SPECTRAL );
-        _copyData( frameLow, frameHigh, spectralIndex, allIndices, allValues );
-        if ( allValues.size() > 0 ){
-            for ( int i = 0; i < percentileCount; i++ ){
-                //Missing intensity
-                if ( intensities[i].first < 0 ){
-                    int locationIndex = allValues.size() * percentiles[i] - 1;
-                    if ( locationIndex < 0 ){
-                        locationIndex = 0;
-                    }
-                    std::nth_element( allValues.begin(), allValues.begin()+locationIndex, allValues.end() );
-                    intensities[i].second = allValues[locationIndex];
-                    int divisor = 1;
-                    std::vector<int> dims = m_image->dims();
-                    int endIndex = spectralIndex;
-                    if ( spectralIndex < 0 ){
-                    	endIndex = dims.size();
-                    }
-                    for ( int i = 0; i < endIndex; i++ ){
-                        divisor = divisor * dims[i];
-                    }
-                    int specIndex = allIndices[locationIndex ]/divisor;
-                    intensities[i].first = specIndex;
-                    //Store the found intensity in the cache.
-                    m_cachedPercentiles.put( frameLow, frameHigh, intensities[i].first, percentiles[i], intensities[i].second );
-                }
+        int channelStart = 0;
+        int channelCount = 1;
+        if ( spectralIndex >= 0 ){
+            int frameCount = m_image->dims()[spectralIndex];
+            if ( 0 <= frameLow && frameLow <= frameHigh && frameHigh < frameCount ){
+                channelStart = frameLow;
+                channelCount = frameHigh - frameLow + 1;
+            }
+            else {
+                channelCount = frameCount;
+            }
+        }
+        auto channelView = [=]( int slice ) -> Carta::Lib::NdArray::RawViewInterface* {
+            int channel = channelStart + slice;
+            return _getRawData( channel, channel, spectralIndex );
+        };
+        //Building the histogram takes a full read of the channels, so it is kept in
+        //the persistent cache as well.
+        Carta::Lib::IPCache::SharedPtr pcache = Globals::instance()->pcache();
+        QByteArray pcacheKey = QString( "cubeHistogram/v1/%1/%2,%3" )
+                .arg( _getPersistentId() ).arg( channelStart ).arg( channelCount ).toUtf8();
+        if ( pcache ){
+            QByteArray data;
+            pcache->readEntry( pcacheKey, data );
+            if ( !data.isNull() ){
+                histogram = Carta::Core::Algorithms::CumulativeHistogram::deserialize( data );
             }
         }
+        if ( !histogram ){
+            histogram = Carta::Core::Algorithms::CumulativeHistogram::build<double>(
+                    channelCount, channelView );
+            if ( pcache ){
+                pcache->setEntry( pcacheKey, histogram->serialize(), CUBE_HISTOGRAM_PRIORITY );
+            }
+        }
+        m_cumulativeHistograms.insert( key,
+                new Carta::Core::Algorithms::CumulativeHistogram::SharedPtr( histogram ),
+                histogram->byteSize() / 1024 + 1 );
     }
-    return intensities;
+    return histogram;
 }
 
 std::vector<std::pair<int,double> > DataSource::_getIntensity( int frameLow, int frameHigh,
         const std::vector<double>& percentiles){
-   //See if we can find it in the least recently used cache; otherwise, look it up.
-    std::vector<std::pair<int,double> > intensities = _getIntensityCache( frameLow,
-            frameHigh, percentiles );
+    int percentileCount = percentiles.size();
+    std::vector<std::pair<int,double> > intensities(percentileCount,std::pair<int,double>(-1,0));
+    Carta::Core::Algorithms::CumulativeHistogram::SharedPtr histogram =
+            _getCumulativeHistogram( frameLow, frameHigh );
+    if ( histogram && histogram->count() > 0 ){
+        //The histogram is built one channel at a time, so the slice a value was
+        //found in is its channel.
+        int spectralIndex = Util::getAxisIndex( m_image, AxisInfo::KnownType::SPECTRAL );
+        int channelStart = 0;
+        if ( spectralIndex >= 0 && 0 <= frameLow && frameLow <= frameHigh &&
+                frameHigh < m_image->dims()[spectralIndex] ){
+            channelStart = frameLow;
+        }
+        for ( int i = 0; i < percentileCount; i++ ){
+            Carta::Core::Algorithms::CumulativeHistogram::Intensity intensity =
+                    histogram->intensity( percentiles[i] );
+            intensities[i].first = channelStart + intensity.slice;
+            intensities[i].second = intensity.value;
+        }
+    }
     return intensities;
 }
 
@@ -428,26 +430,10 @@ QColor DataSource::_getNanColor() const {
 
 double DataSource::_getPercentile( int frameLow, int frameHigh, double intensity ) const {
     double percentile = 0;
-    int spectralIndex = Util::getAxisIndex( m_image, AxisInfo::KnownType::SPECTRAL);
-    Carta::Lib::NdArray::RawViewInterface* rawData = _getRawData( frameLow, frameHigh, spectralIndex );
-    if ( rawData != nullptr ){
-        u_int64_t totalCount = 0;
-        u_int64_t countBelow = 0;
-        Carta::Lib::NdArray::TypedView<double> view( rawData, false );
-        view.forEach([&](const double& val) {
-            if( Q_UNLIKELY( std::isnan(val))){
-                return;
-            }
-            totalCount ++;
-            if( val <= intensity){
-                countBelow++;
-            }
-            return;
-        });
-
-        if ( totalCount > 0 ){
-            percentile = double(countBelow) / totalCount;
-        }
+    Carta::Core::Algorithms::CumulativeHistogram::SharedPtr histogram =
+            _getCumulativeHistogram( frameLow, frameHigh );
+    if ( histogram ){
+        percentile = histogram->percentile( intensity );
     }
     return percentile;
 }
@@ -730,6 +716,7 @@ void DataSource::_resetPan(){
 
 void DataSource::_resizeQuantileCache(){
     m_quantileCache.resize(0);
+    m_cumulativeHistograms.clear();
     int nf = 1;
     int imageSize = m_image->dims().size();
     for ( int i = 0; i < imageSize; i++ ){
@@ -738,6 +725,102 @@ void DataSource::_resizeQuantileCache(){
         }
     }
     m_quantileCache.resize( nf);
+
+    //Start computing the percentiles of all planes in the background, unless reading
+    //the whole image would take too long, then only the planes already in the
+    //persistent cache are loaded and the others are added as they are shown. The
+    //planes are numbered as in _getQuantileCacheIndex (the last axis varies fastest).
+    m_statsIndex.reset();
+    int64_t imageBytes = Carta::Lib::Image::pixelType2size( m_image->pixelType() );
+    for ( int i = 0; i < imageSize; i++ ){
+        imageBytes = imageBytes * m_image->dims()[i];
+    }
+    int64_t imageBytesMax = PLANE_STATS_BYTES_MAX;
+    int sizeMaxMB = Globals::instance()-> mainConfig()-> getPlaneStatsSizeMaxMB();
+    if ( sizeMaxMB > 0 ){
+        imageBytesMax = int64_t( sizeMaxMB ) * 1024 * 1024;
+    }
+    std::vector<int> dims = m_image->dims();
+    std::vector<int> planeAxes;
+    for ( int i = 0; i < imageSize; i++ ){
+        if ( i != m_axisIndexX && i != m_axisIndexY ){
+            planeAxes.push_back( i );
+        }
+    }
+    std::shared_ptr<Carta::Lib::Image::ImageInterface> permuteImage = m_permuteImage;
+    auto planeView = [permuteImage, dims, planeAxes]( int plane ) -> Carta::Lib::NdArray::RawViewInterface* {
+        int planeAxisCount = planeAxes.size();
+        std::vector<int> frames( planeAxisCount );
+        for ( int j = planeAxisCount - 1; j >= 0; j-- ){
+            int frameCount = dims[planeAxes[j]];
+            frames[j] = plane % frameCount;
+            plane = plane / frameCount;
+        }
+        //The permuted image has the display axes first, followed by the others
+        //in their original order.
+        int imageDim = permuteImage->dims().size();
+        SliceND planeSlice = SliceND();
+        for ( int i = 0; i < imageDim; i++ ){
+            if ( i >= 2 ){
+                planeSlice.start( frames[i-2] );
+                planeSlice.end( frames[i-2] + 1 );
+            }
+            if ( i < imageDim - 1 ){
+                planeSlice.next();
+            }
+        }
+        return permuteImage->getDataSlice( planeSlice );
+    };
+    //The persistent cache key identifies the file, its version and the display axes.
+    QString cacheKey = QString( "planeStats/v1/%1/%2,%3" )
+            .arg( _getPersistentId() )
+            .arg( m_axisIndexX ).arg( m_axisIndexY );
+    m_statsIndex.reset( new ChannelStatsIndex( nf, planeView,
+            Globals::instance()->pcache(), cacheKey ) );
+    if ( imageBytes > imageBytesMax ){
+        emit statsProgress( 0, 0 );
+        m_statsIndex->load();
+        return;
+    }
+    connect( m_statsIndex.get(), SIGNAL(progress(int,int)), this, SLOT(_statsProgressed()));
+    emit statsProgress( 0, nf );
+    m_statsIndex->start();
+}
+
+QString DataSource::_getPersistentId() const {
+    QFileInfo fileInfo( m_fileName );
+    return QString( "%1/%2/%3" )
+            .arg( fileInfo.absoluteFilePath() )
+            .arg( fileInfo.lastModified().toMSecsSinceEpoch() )
+            .arg( fileInfo.size() );
+}
+
+void DataSource::_statsProgressed(){
+    //The notification is queued, so it could come from an index that has been
+    //replaced since, the current one is reported instead.
+    if ( m_statsIndex ){
+        emit statsProgress( m_statsIndex->getCompletedCount(), m_statsIndex->getPlaneCount() );
+    }
+}
+
+void DataSource::_startTransposedCube(){
+    m_transposedCube.reset();
+    int channelsMin = Globals::instance()-> mainConfig()-> getTransposeChannelsMin();
+    int spectralIndex = Util::getAxisIndex( m_image, AxisInfo::KnownType::SPECTRAL );
+    if ( channelsMin <= 0 || spectralIndex < 0 || m_image->dims()[spectralIndex] < channelsMin ){
+        return;
+    }
+    //The axes of the image as loaded, which are the ones regions of profiles refer to.
+    int xIndex = Util::getAxisIndex( m_image, AxisInfo::KnownType::DIRECTION_LON );
+    int yIndex = Util::getAxisIndex( m_image, AxisInfo::KnownType::DIRECTION_LAT );
+    if ( xIndex < 0 || yIndex < 0 ){
+        xIndex = 0;
+        yIndex = 1;
+    }
+    if ( TransposedCube::isSupported( m_image, xIndex, yIndex, spectralIndex ) ){
+        m_transposedCube.reset( new TransposedCube( m_image, xIndex, yIndex, spectralIndex ) );
+        m_transposedCube->start();
+    }
 }
 
 QString DataSource::_setFileName( const QString& fileName, bool* success ){
@@ -753,13 +836,14 @@ QString DataSource::_setFileName( const QString& fileName, bool* success ){
                 if (!res.isNull()){
                     m_image = res.val();
                     m_permuteImage = m_image;
+                    m_fileName = file;
                     // reset zoom/pan
                     _resetZoom();
                     _resetPan();
 
                     // clear quantile cache
                     _resizeQuantileCache();
-                    m_fileName = file;
+                    _startTransposedCube();
                 }
                 else {
                     result = "Could not find any plugin to load image";
@@ -898,9 +982,29 @@ void DataSource::_updateClips( std::shared_ptr<Carta::Lib::NdArray::RawViewInter
     if ( clips.size() < 2  ||
     		m_quantileCache[quantileIndex].m_minPercentile != minClipPercentile  ||
 			m_quantileCache[quantileIndex].m_maxPercentile != maxClipPercentile ) {
-    	Carta::Lib::NdArray::Double doubleView( view.get(), false );
-    	clips = Carta::Core::Algorithms::quantiles2pixels(
-    			doubleView, { minClipPercentile, maxClipPercentile });
+    	//Use the plane statistics if they are in already, otherwise read the plane.
+    	double clipMin = 0;
+    	double clipMax = 0;
+    	if ( m_statsIndex &&
+    			m_statsIndex->getPercentile( quantileIndex, minClipPercentile, &clipMin ) &&
+    			m_statsIndex->getPercentile( quantileIndex, maxClipPercentile, &clipMax ) ){
+    		clips = { clipMin, clipMax };
+    	}
+    	else {
+    		//The plane is read anyway, so its percentiles are stored in the index
+    		//as well, for planes it does not get to by itself.
+    		std::vector<double> percentiles = ChannelStatsIndex::PERCENTILES;
+    		percentiles.push_back( minClipPercentile );
+    		percentiles.push_back( maxClipPercentile );
+    		Carta::Lib::NdArray::Double doubleView( view.get(), false );
+    		std::vector<double> values = Carta::Core::Algorithms::quantiles2pixels(
+    				doubleView, percentiles );
+    		clips = { values[values.size() - 2], values[values.size() - 1] };
+    		if ( m_statsIndex ){
+    			values.resize( ChannelStatsIndex::PERCENTILES.size() );
+    			m_statsIndex->setPercentiles( quantileIndex, values );
+    		}
+    	}
     	m_quantileCache[quantileIndex].m_clips = clips;
     	m_quantileCache[quantileIndex].m_minPercentile = minClipPercentile;
     	m_quantileCache[quantileIndex].m_maxPercentile = maxClipPercentile;
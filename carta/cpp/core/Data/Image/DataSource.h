@@ -8,8 +8,9 @@
 #include "CartaLib/AxisDisplayInfo.h"
 #include "CartaLib/CartaLib.h"
 #include "CartaLib/AxisInfo.h"
-#include "LeastRecentlyUsedCache.h"
+#include "../../Algorithms/CumulativeHistogram.h"
 
+#include <QCache>
 #include <memory>
 
 class CoordinateFormatterInterface;
@@ -39,6 +40,8 @@ class Service;
 namespace Data {
 
 class CoordinateSystems;
+class ChannelStatsIndex;
+class TransposedCube;
 
 class DataSource : public QObject {
 
@@ -46,6 +49,7 @@ class DataSource : public QObject {
     friend class DataFactory;
     friend class Histogram;
     friend class Profiler;
+    friend class ProfileRenderService;
     friend class Colormap;
 
     Q_OBJECT
@@ -59,20 +63,22 @@ public:
 
     virtual ~DataSource();
 
-
-private:
+signals:
 
     /**
-     * Creates a copy of image data that can later be modified by a selection
-     * sort.
-     * @param frameLow - lower frame boundary.
-     * @param frameHigh - upper frame boundary.
-     * @param spectralIndex  - the spectral index.
-     * @param allIndices - the indices of the spectral values in the image.
-     * @param allValues - the intensities of the values in the image.
+     * Notification that the statistics of more planes are available.
+     * @param completed - the number of planes whose statistics are available.
+     * @param planeCount - the number of planes, 0 if the statistics are not computed
+     *      in the background (e.g. the image is too big).
      */
-    void _copyData( int frameLow, int frameHigh, int spectralIndex,
-            std::vector<int>& allIndices, std::vector<double>& allValues );
+    void statsProgress( int completed, int planeCount );
+
+private slots:
+
+    //Notification from the statistics index that it finished another plane.
+    void _statsProgressed();
+
+private:
 
     /**
      * Resizes the frame indices to fit the current image.
@@ -220,14 +226,21 @@ private:
             const std::vector<double>& percentiles);
 
     /**
-     * Returns the intensities corresponding to a given percentiles.
+     * Returns the cumulative histogram of the given channel range, computing it
+     * if it is not cached yet.
      * @param frameLow - a lower bound for the image channels or -1 if there is no lower bound.
      * @param frameHigh - an upper bound for the image channels or -1 if there is no upper bound.
-     * @param percentiles - a list of numbers in [0,1] for which an intensity is desired.
-     * @return - a list of corresponding (location,intensity) pairs.
+     * @return - the cumulative histogram or nullptr if there is no data.
+     */
+    Carta::Core::Algorithms::CumulativeHistogram::SharedPtr _getCumulativeHistogram(
+            int frameLow, int frameHigh ) const;
+
+    /**
+     * Returns an identifier of the image file and its version, for the keys of
+     * the persistent cache.
+     * @return - the path of the file, its modification time and its size.
      */
-    std::vector<std::pair<int,double> > _getIntensityCache( int frameLow, int frameHigh,
-        const std::vector<double>& percentiles );
+    QString _getPersistentId() const;
 
     /**
      * Returns the color used to draw nan pixels.
@@ -254,6 +267,13 @@ private:
      */
     std::shared_ptr<Carta::Lib::PixelPipeline::CustomizablePixelPipeline> _getPipeline() const;
 
+    /**
+     * Returns the spectral-major copy of the image, which is written in the background
+     * after a cube with enough channels is loaded.
+     * @return - the copy of the image, or nullptr if the image is not copied.
+     */
+    std::shared_ptr<TransposedCube> _getTransposedCube() const;
+
     /**
      * Return the pixel coordinates corresponding to the given world coordinates.
      * @param ra - the right ascension (in radians) of the world coordinates.
@@ -365,6 +385,12 @@ private:
 
     void _resizeQuantileCache();
 
+    /**
+     * Start writing a spectral-major copy of the image if it is a cube with at least
+     * as many channels as set in the main config.
+     */
+    void _startTransposedCube();
+
     /**
      * Sets a new color map.
      * @param name the identifier for the color map.
@@ -506,8 +532,14 @@ private:
     /// unnecessary clips.
     std::vector<QuantileCacheEntry> m_quantileCache;
 
-    ///Percentile/Intensity cache
-    LeastRecentlyUsedCache m_cachedPercentiles;
+    ///Percentile/Intensity lookup tables, by channel range
+    mutable QCache<QString,Carta::Core::Algorithms::CumulativeHistogram::SharedPtr> m_cumulativeHistograms;
+
+    ///Percentiles of every plane, computed in the background.
+    std::shared_ptr<ChannelStatsIndex> m_statsIndex;
+
+    ///Spectral-major copy of the image for profiles.
+    std::shared_ptr<TransposedCube> m_transposedCube;
 
     /// the rendering service
     std::shared_ptr<Carta::Core::ImageRenderService::Service> m_renderService;
@@ -525,6 +557,14 @@ private:
     const static int INDEX_FRAME_LOW;
     const static int INDEX_FRAME_HIGH;
 
+    //Size of the largest image whose plane statistics are computed in the background,
+    //unless "planeStatsSizeMaxMB" is set in the main config.
+    const static int64_t PLANE_STATS_BYTES_MAX;
+
+    //Priority of the cumulative histograms in the persistent cache, they take a
+    //full read of the cube to rebuild.
+    const static int64_t CUBE_HISTOGRAM_PRIORITY;
+
     DataSource(const DataSource& other);
     DataSource& operator=(const DataSource& other);
 };
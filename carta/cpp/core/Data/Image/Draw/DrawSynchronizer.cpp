@@ -5,6 +5,7 @@
 #include "DefaultContourGeneratorService.h"
 #include "Data/Image/Contour/DataContours.h"
 #include <QDebug>
+#include <QStringList>
 
 namespace Carta {
 
@@ -38,6 +39,7 @@ DrawSynchronizer::DrawSynchronizer( std::shared_ptr<Carta::Core::ImageRenderServ
 
     m_irs = imageRendererService;
     m_grs = gridRendererService;
+    m_contourCache.setMaxCost( 128 * 1024 ); // 128 megs (cost is in kilobytes)
 }
 
 void DrawSynchronizer::_checkAndEmit(){
@@ -57,23 +59,51 @@ void DrawSynchronizer::_contourDone( const Result & result,
             return;
         }
 
-        // convert the raw contours into VG
-        Carta::Lib::VectorGraphics::VGComposer vgc;
-        const auto & contourSet = result.contours();
-        for ( size_t k = 0 ; k < contourSet.size() ; ++k ) {
-            const auto & con = contourSet[k].polylines();
-            vgc.append< Carta::Lib::VectorGraphics::Entries::SetPen >( m_pens[k]);
-            for ( size_t i = 0 ; i < con.size() ; ++i ) {
-                const QPolygonF & poly = con[i];
-                vgc.append < Carta::Lib::VectorGraphics::Entries::DrawPolyline > ( poly );
+        if ( !m_cecKey.isEmpty() ){
+            int64_t byteSize = 0;
+            const auto & contourSet = result.contours();
+            for ( size_t k = 0 ; k < contourSet.size() ; ++k ) {
+                const auto & con = contourSet[k].polylines();
+                for ( size_t i = 0 ; i < con.size() ; ++i ) {
+                    byteSize += con[i].size() * sizeof( QPointF );
+                }
             }
+            m_contourCache.insert( m_cecKey, new Result( result ), byteSize / 1024 + 1 );
         }
-        m_cecVGList = vgc.vgList();
+        m_cecVGList = _makeContourGraphics( result );
         m_cecDone = true;
         _checkAndEmit();
     }
 }
 
+QString DrawSynchronizer::_getContourKey() const {
+    QString key;
+    if ( !m_inputViewId.isEmpty() ){
+        QStringList levelList;
+        int levelCount = m_levels.size();
+        for ( int i = 0; i < levelCount; i++ ){
+            levelList.append( QString::number( m_levels[i], 'g', 17 ) );
+        }
+        key = m_inputViewId + "/" + m_cec->detailId() + "/" + levelList.join( ",");
+    }
+    return key;
+}
+
+Carta::Lib::VectorGraphics::VGList DrawSynchronizer::_makeContourGraphics( const Result& result ) const {
+    // convert the raw contours into VG
+    Carta::Lib::VectorGraphics::VGComposer vgc;
+    const auto & contourSet = result.contours();
+    for ( size_t k = 0 ; k < contourSet.size() ; ++k ) {
+        const auto & con = contourSet[k].polylines();
+        vgc.append< Carta::Lib::VectorGraphics::Entries::SetPen >( m_pens[k]);
+        for ( size_t i = 0 ; i < con.size() ; ++i ) {
+            const QPolygonF & poly = con[i];
+            vgc.append < Carta::Lib::VectorGraphics::Entries::DrawPolyline > ( poly );
+        }
+    }
+    return vgc.vgList();
+}
+
 void DrawSynchronizer::_irsDone( QImage img, int64_t jobId ){
     // if this is not the expected job, do nothing
     if ( jobId == m_irsJobId ) {
@@ -83,8 +113,14 @@ void DrawSynchronizer::_irsDone( QImage img, int64_t jobId ){
     }
 }
 
-void DrawSynchronizer::setInput( std::shared_ptr<Carta::Lib::NdArray::RawViewInterface> rawView ){
-    m_cec->setInput( rawView );
+void DrawSynchronizer::setInput( std::shared_ptr<Carta::Lib::NdArray::RawViewInterface> rawView,
+        const QString& viewId ){
+    m_cec->setInput( rawView, viewId );
+    m_inputViewId = viewId;
+}
+
+void DrawSynchronizer::setViewport( const QRectF& imageRect, double zoom ){
+    m_cec->setViewport( imageRect, zoom );
 }
 
 
@@ -104,6 +140,7 @@ void DrawSynchronizer::setContours( const std::set<std::shared_ptr<DataContours>
     }
     if ( drawing ){
         m_cec->setLevels( levels );
+        m_levels = levels;
     }
 }
 
@@ -133,8 +170,21 @@ int64_t DrawSynchronizer::start( bool contourDraw, bool gridDraw, int64_t jobId
         m_grsVGList = emptyList;
     }
     if ( contourDraw ){
-        m_cecJobId = m_cec->start();
-        m_jobId++;
+        //Contours of the same data and levels only need new pens.
+        m_cecKey = _getContourKey();
+        Result* cached = nullptr;
+        if ( !m_cecKey.isEmpty() ){
+            cached = m_contourCache.object( m_cecKey );
+        }
+        if ( cached != nullptr && cached->contours().size() == m_pens.size() ){
+            m_cecJobId = -1;
+            m_cecVGList = _makeContourGraphics( *cached );
+            m_cecDone = true;
+        }
+        else {
+            m_cecJobId = m_cec->start();
+            m_jobId++;
+        }
     }
     else {
         //Empty the contour list
@@ -4,6 +4,9 @@
 
 #pragma once
 #include <CartaLib/VectorGraphics/VGList.h>
+#include "CartaLib/ContourSet.h"
+#include <QCache>
+#include <QRectF>
 #include <set>
 
 
@@ -24,6 +27,7 @@ namespace Core {
     namespace ImageRenderService {
         class Service;
     }
+    class DefaultContourGeneratorService;
 }
 
 namespace Data {
@@ -42,8 +46,19 @@ public:
     /**
      * Sets the data to be used in calculating contours.
      * @param rawView - the data for calculating contours.
+     * @param viewId - an identifier for the image and frame of the data, used to look
+     *      up contours computed before; contours of data without an identifier are not cached.
      */
-    void setInput( std::shared_ptr<Carta::Lib::NdArray::RawViewInterface> rawView );
+    void setInput( std::shared_ptr<Carta::Lib::NdArray::RawViewInterface> rawView,
+            const QString& viewId = QString() );
+
+    /**
+     * Sets the part of the image that is visible, so contours can be computed at the
+     * resolution of the screen.
+     * @param imageRect - the visible part of the image in pixel coordinates.
+     * @param zoom - the number of screen pixels an image pixel occupies.
+     */
+    void setViewport( const QRectF& imageRect, double zoom );
 
     /**
      * Sets the contour set(s) to be drawn.
@@ -86,6 +101,12 @@ private:
 
     void _checkAndEmit();
 
+    //Identifier of the contours of the current data and levels in the cache.
+    QString _getContourKey() const;
+
+    //Convert the contours into graphics using the current pens.
+    Carta::Lib::VectorGraphics::VGList _makeContourGraphics( const Result& result ) const;
+
     int64_t m_irsJobId = - 1;
     int64_t m_grsJobId = - 1;
     int64_t m_cecJobId = -1;
@@ -103,8 +124,15 @@ private:
 
     std::shared_ptr<Carta::Core::ImageRenderService::Service> m_irs;
     std::shared_ptr<Carta::Lib::IWcsGridRenderService> m_grs;
-    std::shared_ptr<Carta::Lib::IContourGeneratorService> m_cec;
+    std::shared_ptr<Carta::Core::DefaultContourGeneratorService> m_cec;
     std::vector<QPen> m_pens;
+    std::vector<double> m_levels;
+
+    //Contours that were computed before, so changing the pens or going back to a
+    //frame does not compute them again.
+    QString m_inputViewId;
+    QString m_cecKey;
+    QCache<QString,Result> m_contourCache;
 
     DrawSynchronizer( const DrawSynchronizer& other);
     DrawSynchronizer& operator=( const DrawSynchronizer& other );
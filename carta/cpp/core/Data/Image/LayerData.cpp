@@ -31,6 +31,7 @@ const QString LayerData::LAYER_COLOR="colorSupport";
 const QString LayerData::LAYER_ALPHA="alphaSupport";
 
 const QString LayerData::PAN = "pan";
+const QString LayerData::STATS_PROGRESS = "statsProgress";
 
 
 class LayerData::Factory : public Carta::State::CartaObjectFactory {
@@ -61,6 +62,7 @@ LayerData::LayerData(const QString& path, const QString& id) :
         ColorState* colorObj = objMan->createObject<ColorState>();
         m_stateColor.reset( colorObj );
         connect( m_stateColor.get(), SIGNAL( colorStateChanged()), this, SLOT(_colorChanged()));
+        connect( m_dataSource.get(), SIGNAL(statsProgress(int,int)), this, SLOT(_statsProgress(int,int)));
 
 
         DataGrid* gridObj = objMan->createObject<DataGrid>();
@@ -623,6 +625,10 @@ void LayerData::_initializeState() {
     QString panYKey = Carta::State::UtilState::getLookup( PAN, Util::YCOORD );
     m_state.insertValue<double>( panXKey, 0 );
     m_state.insertValue<double>( panYKey, 0 );
+
+    //Percentage of the planes whose statistics are computed, -1 if they are not
+    //computed in the background.
+    m_state.insertValue<int>( STATS_PROGRESS, -1 );
 }
 
 bool LayerData::_isContourDraw() const {
@@ -666,7 +672,7 @@ void LayerData::_load(std::vector<int> frames, bool recomputeClipsOnNewFrame,
         }
         if ( m_drawSync ){
         	std::shared_ptr<Carta::Lib::NdArray::RawViewInterface> rawData( m_dataSource->_getRawData( frames ));
-        	m_drawSync->setInput( rawData );
+        	m_drawSync->setInput( rawData, m_dataSource->_getViewIdCurrent( frames ) );
         }
     }
 }
@@ -792,6 +798,7 @@ void LayerData::_renderStart(){
     //Only draw contours and grid for main image.
     if ( request->isRequestMain() ){
         m_drawSync->setContours( m_dataContours );
+        m_drawSync->setViewport( inputRect, zoom );
     }
 
     //Which display axes will be drawn.
@@ -1028,6 +1035,18 @@ void LayerData::_setZoom( double zoomAmount){
 }
 
 
+void LayerData::_statsProgress( int completed, int planeCount ){
+    int percent = -1;
+    if ( planeCount > 0 ){
+        percent = static_cast<int>( int64_t( completed ) * 100 / planeCount );
+    }
+    if ( percent != m_state.getValue<int>( STATS_PROGRESS ) ){
+        m_state.setValue<int>( STATS_PROGRESS, percent );
+        m_state.flushState();
+    }
+}
+
+
 void LayerData::_updateClips( std::shared_ptr<Carta::Lib::NdArray::RawViewInterface>& view,
         double minClipPercentile, double maxClipPercentile, const std::vector<int>& frames ){
     if ( m_dataSource ){
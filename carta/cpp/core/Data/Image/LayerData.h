@@ -476,6 +476,9 @@ private slots:
 						  Carta::Lib::VectorGraphics::VGList regionList,
                           int64_t jobId );
 
+    //Notification from the data source that the statistics of more planes are in.
+    void _statsProgress( int completed, int planeCount );
+
 private:
 
     /**
@@ -510,6 +513,7 @@ private:
     static const QString LAYER_ALPHA;
     static const QString MASK;
     static const QString PAN;
+    static const QString STATS_PROGRESS;
 
 
     std::unique_ptr<DataGrid> m_dataGrid;
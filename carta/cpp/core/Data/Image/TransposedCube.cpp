@@ -0,0 +1,207 @@
+#include "TransposedCube.h"
+#include "CartaLib/IImage.h"
+#include "CartaLib/Algorithms/ParallelFor.h"
+#include <QDebug>
+#include <QDir>
+#include <QFile>
+#include <QRunnable>
+#include <QStorageInfo>
+#include <algorithm>
+#include <limits>
+
+namespace Carta {
+
+namespace Data {
+
+const int64_t TransposedCube::BAND_SIZE = 32 * 1024 * 1024;
+const int64_t TransposedCube::CHUNK_SIZE = 16 * 1024;
+const int64_t TransposedCube::FREE_SPACE_MARGIN = 1024 * 1024 * 1024;
+
+class TransposedCube::Runnable : public QRunnable {
+public:
+    Runnable( TransposedCube* cube ) :
+        m_cube( cube ){
+    }
+
+    virtual void run() override {
+        m_cube->_transpose();
+    }
+
+private:
+    TransposedCube* m_cube;
+};
+
+
+TransposedCube::TransposedCube( std::shared_ptr<Carta::Lib::Image::ImageInterface> image,
+        int xAxis, int yAxis, int spectralAxis, QObject* parent ) :
+    QObject( parent ),
+    m_image( image ),
+    m_xAxis( xAxis ),
+    m_yAxis( yAxis ),
+    m_spectralAxis( spectralAxis ),
+    m_width( 0 ),
+    m_height( 0 ),
+    m_channelCount( 0 ),
+    m_file( QDir::tempPath() + "/carta-transposed-XXXXXX" ),
+    m_cancelled( false ),
+    m_finished( false ){
+    if ( isSupported( m_image, m_xAxis, m_yAxis, m_spectralAxis ) ){
+        const std::vector<int>& dims = m_image->dims();
+        m_width = dims[m_xAxis];
+        m_height = dims[m_yAxis];
+        m_channelCount = dims[m_spectralAxis];
+    }
+    m_pool.setMaxThreadCount( 1 );
+}
+
+bool TransposedCube::isSupported( std::shared_ptr<Carta::Lib::Image::ImageInterface> image,
+        int xAxis, int yAxis, int spectralAxis ){
+    if ( !image ){
+        return false;
+    }
+    const std::vector<int>& dims = image->dims();
+    int dimCount = dims.size();
+    if ( xAxis < 0 || yAxis < 0 || spectralAxis < 0 || xAxis >= dimCount ||
+            yAxis >= dimCount || spectralAxis >= dimCount || xAxis == yAxis ||
+            xAxis == spectralAxis || yAxis == spectralAxis ){
+        return false;
+    }
+    for ( int i = 0; i < dimCount; i++ ){
+        if ( i != xAxis && i != yAxis && i != spectralAxis && dims[i] != 1 ){
+            return false;
+        }
+    }
+    return true;
+}
+
+void TransposedCube::start(){
+    if ( m_channelCount <= 0 ){
+        return;
+    }
+    //Without room for the copy, profiles keep reading the image itself.
+    int64_t fileSize = static_cast<int64_t>( m_width ) * m_height * m_channelCount * sizeof( float );
+    QStorageInfo storage( QDir::tempPath() );
+    if ( !storage.isValid() || storage.bytesAvailable() < fileSize + FREE_SPACE_MARGIN ){
+        qWarning() << "TransposedCube: not enough space in "<<QDir::tempPath()<<" for "<<fileSize<<" bytes";
+        return;
+    }
+    //Create the file here, so that its name is known before the copy starts.
+    if ( !m_file.open() ){
+        qWarning() << "TransposedCube: could not create "<<m_file.fileTemplate();
+        return;
+    }
+    m_filePath = m_file.fileName();
+    m_pool.start( new Runnable( this ) );
+}
+
+bool TransposedCube::isFinished() const {
+    return m_finished;
+}
+
+int TransposedCube::getXAxis() const {
+    return m_xAxis;
+}
+
+int TransposedCube::getYAxis() const {
+    return m_yAxis;
+}
+
+int TransposedCube::getSpectralAxis() const {
+    return m_spectralAxis;
+}
+
+int TransposedCube::getChannelCount() const {
+    return m_channelCount;
+}
+
+void TransposedCube::_transpose(){
+    int64_t rowSize = static_cast<int64_t>( m_width ) * m_channelCount;
+    int bandRows = static_cast<int>( std::max( static_cast<int64_t>( 1 ), BAND_SIZE / rowSize ) );
+    std::vector<float> band;
+    for ( int firstRow = 0; firstRow < m_height; firstRow += bandRows ){
+        if ( m_cancelled ){
+            return;
+        }
+        int rowCount = std::min( bandRows, m_height - firstRow );
+        band.assign( rowSize * rowCount, std::numeric_limits<float>::quiet_NaN() );
+        SliceND slice;
+        slice.slice( m_yAxis ).start( firstRow ).end( firstRow + rowCount );
+        Carta::Lib::NdArray::RawViewInterface* rawView = m_image->getDataSlice( slice );
+        if ( rawView == nullptr ){
+            qWarning() << "TransposedCube: could not read rows "<<firstRow;
+            return;
+        }
+        Carta::Lib::NdArray::Double view( rawView, true );
+
+        //Each value of a block goes to its own place in the band, so the block can be
+        //spread over all cores.
+        view.forEachBlock( [&]( const double* data, int64_t count ){
+            const std::vector<int>& blockPos = rawView->currentPos();
+            const std::vector<int>& blockDims = rawView->currentBlockDims();
+            int64_t xStride = 1;
+            int64_t yStride = 1;
+            int64_t channelStride = 1;
+            int64_t stride = 1;
+            for ( int i = 0; i < static_cast<int>( blockDims.size() ); i++ ){
+                if ( i == m_xAxis ){
+                    xStride = stride;
+                }
+                else if ( i == m_yAxis ){
+                    yStride = stride;
+                }
+                else if ( i == m_spectralAxis ){
+                    channelStride = stride;
+                }
+                stride = stride * blockDims[i];
+            }
+            Carta::Lib::Algorithms::parallelFor( 0, count, CHUNK_SIZE,
+                    [&]( int64_t first, int64_t last ){
+                for ( int64_t i = first; i < last; i++ ){
+                    int64_t x = blockPos[m_xAxis] + ( i / xStride ) % blockDims[m_xAxis];
+                    int64_t y = blockPos[m_yAxis] + ( i / yStride ) % blockDims[m_yAxis];
+                    int64_t channel = blockPos[m_spectralAxis] +
+                            ( i / channelStride ) % blockDims[m_spectralAxis];
+                    band[ ( y * m_width + x ) * m_channelCount + channel ] = data[i];
+                }
+            });
+        }, Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal );
+
+        //Bands are written in order, so the file is written sequentially.
+        qint64 byteCount = static_cast<qint64>( band.size() * sizeof( float ) );
+        if ( m_file.write( reinterpret_cast<const char*>( band.data() ), byteCount ) != byteCount ){
+            qWarning() << "TransposedCube: could not write "<<m_filePath<<": "<<m_file.errorString();
+            return;
+        }
+    }
+    if ( !m_file.flush() ){
+        qWarning() << "TransposedCube: could not write "<<m_filePath<<": "<<m_file.errorString();
+        return;
+    }
+    m_finished = true;
+}
+
+bool TransposedCube::readSpectra( int x, int y, int count, std::vector<float>& values ) const {
+    if ( !m_finished || x < 0 || y < 0 || count <= 0 || x + count > m_width || y >= m_height ){
+        return false;
+    }
+    QFile file( m_filePath );
+    if ( !file.open( QIODevice::ReadOnly ) ){
+        return false;
+    }
+    int64_t offset = ( static_cast<int64_t>( y ) * m_width + x ) * m_channelCount;
+    values.resize( static_cast<size_t>( count ) * m_channelCount );
+    qint64 byteCount = static_cast<qint64>( values.size() * sizeof( float ) );
+    if ( !file.seek( offset * sizeof( float ) ) ||
+            file.read( reinterpret_cast<char*>( values.data() ), byteCount ) != byteCount ){
+        values.clear();
+        return false;
+    }
+    return true;
+}
+
+TransposedCube::~TransposedCube(){
+    m_cancelled = true;
+    m_pool.waitForDone();
+}
+}
+}
@@ -0,0 +1,151 @@
+/***
+ * Spectral-major copy of an image cube, written in the background.
+ */
+
+#pragma once
+
+#include <QObject>
+#include <QString>
+#include <QTemporaryFile>
+#include <QThreadPool>
+#include <atomic>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Carta {
+namespace Lib {
+namespace Image {
+class ImageInterface;
+}
+}
+
+namespace Data {
+
+/**
+ * Copies an image cube to a temporary file in which the channels of each pixel are
+ * contiguous, so that the spectrum of a pixel (or of a row of pixels) is a single
+ * read instead of one read per channel.
+ *
+ * The copy is written on a background thread, band of rows by band of rows, and
+ * values are stored as floats.  Only cubes whose axes other than x, y and the
+ * spectral axis have a single pixel are supported.
+ */
+class TransposedCube : public QObject {
+
+    Q_OBJECT
+
+public:
+
+    /**
+     * Constructor.
+     * @param image - the image to copy.
+     * @param xAxis - the index of the x axis of the image.
+     * @param yAxis - the index of the y axis of the image.
+     * @param spectralAxis - the index of the spectral axis of the image.
+     * @param parent - the parent object.
+     */
+    TransposedCube( std::shared_ptr<Carta::Lib::Image::ImageInterface> image,
+            int xAxis, int yAxis, int spectralAxis, QObject* parent = nullptr );
+
+    /**
+     * Returns whether or not an image can be copied.
+     * @param image - the image to copy.
+     * @param xAxis - the index of the x axis of the image.
+     * @param yAxis - the index of the y axis of the image.
+     * @param spectralAxis - the index of the spectral axis of the image.
+     * @return - true if the axes are distinct and all other axes have a single pixel;
+     *      false otherwise.
+     */
+    static bool isSupported( std::shared_ptr<Carta::Lib::Image::ImageInterface> image,
+            int xAxis, int yAxis, int spectralAxis );
+
+    /**
+     * Start writing the copy in the background, unless the temporary directory
+     * does not have room for it, in which case the copy is never finished.
+     */
+    void start();
+
+    /**
+     * Returns true if the copy has been written completely.
+     * @return - true if spectra can be read; false otherwise.
+     */
+    bool isFinished() const;
+
+    /**
+     * Returns the index of the x axis.
+     * @return - the index of the x axis in the image.
+     */
+    int getXAxis() const;
+
+    /**
+     * Returns the index of the y axis.
+     * @return - the index of the y axis in the image.
+     */
+    int getYAxis() const;
+
+    /**
+     * Returns the index of the spectral axis.
+     * @return - the index of the spectral axis in the image.
+     */
+    int getSpectralAxis() const;
+
+    /**
+     * Returns the number of channels in each spectrum.
+     * @return - the size of the spectral axis.
+     */
+    int getChannelCount() const;
+
+    /**
+     * Read the spectra of consecutive pixels of a row; this can be called from any thread
+     * once the copy is finished.
+     * @param x - the x coordinate of the first pixel.
+     * @param y - the y coordinate of the row.
+     * @param count - the number of pixels.
+     * @param values - set to the spectra, one after the other.
+     * @return - true if the spectra could be read; false otherwise.
+     */
+    bool readSpectra( int x, int y, int count, std::vector<float>& values ) const;
+
+    /**
+     * Stop the copy and wait for the background thread; the file is removed.
+     */
+    virtual ~TransposedCube();
+
+private:
+
+    class Runnable;
+
+    //Writes the copy, runs on m_pool.
+    void _transpose();
+
+    //Number of values read from the image and transposed in memory at a time.
+    static const int64_t BAND_SIZE;
+
+    //Pixels of a block transposed by one thread.
+    static const int64_t CHUNK_SIZE;
+
+    //Space left free in the temporary directory after the copy.
+    static const int64_t FREE_SPACE_MARGIN;
+
+    std::shared_ptr<Carta::Lib::Image::ImageInterface> m_image;
+    int m_xAxis;
+    int m_yAxis;
+    int m_spectralAxis;
+    int m_width;
+    int m_height;
+    int m_channelCount;
+
+    //Written by the background thread only; readers open the file by name.
+    QTemporaryFile m_file;
+    QString m_filePath;
+    std::atomic<bool> m_cancelled;
+    std::atomic<bool> m_finished;
+
+    QThreadPool m_pool;
+
+    TransposedCube( const TransposedCube& other);
+    TransposedCube& operator=( const TransposedCube& other );
+};
+}
+}
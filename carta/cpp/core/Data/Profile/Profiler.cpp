@@ -56,6 +56,8 @@ const QString Profiler::HEURISTICS = "heuristics";
 const QString Profiler::IMAGE_SELECT = "imageSelect";
 const QString Profiler::LEGEND_LOCATION = "legendLocation";
 const QString Profiler::LEGEND_EXTERNAL = "legendExternal";
+const QString Profiler::LIVE_CURVE = "Cursor";
+const QString Profiler::LIVE_PROFILE = "liveProfile";
 const QString Profiler::LEGEND_SHOW = "legendShow";
 const QString Profiler::LEGEND_LINE = "legendLine";
 const QString Profiler::MANUAL_GUESS = "manualGuess";
@@ -134,6 +136,12 @@ Profiler::Profiler( const QString& path, const QString& id):
             this,
             SLOT(_profileRendered(const Carta::Lib::Hooks::ProfileResult&,
                     std::shared_ptr<Layer>, std::shared_ptr<Region>, bool )));
+    connect( m_renderService.get(),
+            SIGNAL(liveProfileResult(const Carta::Lib::Hooks::ProfileResult&,
+                    std::shared_ptr<Layer>, const QPointF& )),
+            this,
+            SLOT(_liveProfileRendered(const Carta::Lib::Hooks::ProfileResult&,
+                    std::shared_ptr<Layer>, const QPointF& )));
     connect( m_fitService.get(),
                SIGNAL(fitResult(const std::vector<Carta::Lib::Hooks::FitResult>&)),
                this,
@@ -179,6 +187,8 @@ QString Profiler::addLink( CartaObject*  target){
                         this, SLOT( _updateChannel(Controller*, Carta::Lib::AxisInfo::KnownType)));
                 connect(controller, SIGNAL(dataChangedRegion(Controller*)),
                         this, SLOT( _loadProfile( Controller*)));
+                connect(controller, SIGNAL(cursorChanged(Controller*)),
+                        this, SLOT( _updateLiveProfile( Controller*)));
                 m_controllerLinked = true;
                 _loadProfile( controller);
             }
@@ -481,6 +491,32 @@ bool Profiler::_generateCurve( std::shared_ptr<Layer> layer, std::shared_ptr<Reg
 
 
 
+bool Profiler::_generateCurves( std::shared_ptr<Layer> layer,
+        const std::vector<std::shared_ptr<Region> >& regions ){
+    std::vector<std::shared_ptr<Region> > newRegions;
+    if ( layer ){
+        int regionCount = regions.size();
+        for ( int i = 0; i < regionCount; i++ ){
+            QString curveId = CurveData::_generateName( layer, regions[i] );
+            int profileIndex = _findCurveIndex( curveId );
+            if ( profileIndex < 0 ){
+                newRegions.push_back( regions[i] );
+            }
+            else {
+                //Set the curve active
+                m_plotCurves[profileIndex]->setActive( true );
+            }
+        }
+        if ( !newRegions.empty() ){
+            //The curves are new, so they all get the current settings.
+            Carta::Lib::ProfileInfo profInfo = _getProfileInfoDefault();
+            m_renderService->renderProfiles( layer, newRegions, profInfo, false );
+        }
+    }
+    return !newRegions.empty();
+}
+
+
 void Profiler::_generateData( std::shared_ptr<Layer> layer, std::shared_ptr<Region> region,
         bool createNew ){
     QString id = CurveData::_generateName( layer, region );
@@ -488,18 +524,31 @@ void Profiler::_generateData( std::shared_ptr<Layer> layer, std::shared_ptr<Regi
     Carta::Lib::ProfileInfo profInfo;
     if ( curveIndex >= 0 ){
         profInfo = m_plotCurves[curveIndex]->getProfileInfo();
+        profInfo.setSpectralUnit( getSpectralUnits() );
+        profInfo.setSpectralType( getSpectralType() );
     }
     else {
-    	//Provide profile info based on the current settings.
-    	profInfo.setRestFrequency( getRestFrequency( ""));
-    	QString stat = getStatistic( "" );
-    	Carta::Lib::ProfileInfo::AggregateType aggType = this->m_stats->getTypeFor( stat );
-    	profInfo.setAggregateType( aggType );
-    	profInfo.setRestUnit( getRestUnits("") );
+    	profInfo = _getProfileInfoDefault();
     }
+    m_renderService->renderProfile(layer, region, profInfo, createNew );
+}
+
+
+Carta::Lib::ProfileInfo Profiler::_getProfileInfoDefault() const {
+    //Provide profile info based on the current settings.
+    Carta::Lib::ProfileInfo profInfo;
+    profInfo.setRestFrequency( getRestFrequency( ""));
+    QString stat = getStatistic( "" );
+    Carta::Lib::ProfileInfo::AggregateType aggType = this->m_stats->getTypeFor( stat );
+    profInfo.setAggregateType( aggType );
+    profInfo.setRestUnit( getRestUnits("") );
     profInfo.setSpectralUnit( getSpectralUnits() );
     profInfo.setSpectralType( getSpectralType() );
-    m_renderService->renderProfile(layer, region, profInfo, createNew );
+    return profInfo;
+}
+
+QString Profiler::_getLiveCurveName( std::shared_ptr<Layer> layer ) const {
+    return CurveData::_generateName( layer, nullptr ) + "[" + LIVE_CURVE + "]";
 }
 
 QString Profiler::getSpectralUnits() const {
@@ -914,6 +963,7 @@ void Profiler::_initializeDefaultState(){
     QString unitType = _getUnitType( bottomUnit );
     m_plotManager->setTitleAxisX( unitType );
     m_state.insertValue<bool>(AUTO_GENERATE, true );
+    m_state.insertValue<bool>(LIVE_PROFILE, false );
     m_state.insertValue<QString>( AXIS_UNITS_BOTTOM, bottomUnit );
     m_state.insertValue<QString>( AXIS_UNITS_LEFT, m_intensityUnits->getDefault());
     m_state.insertValue<QString>(GEN_MODE, m_generateModes->getDefault());
@@ -1542,6 +1592,24 @@ void Profiler::_initializeCallbacks(){
         return result;
     });
 
+    addCommandCallback( "setLiveProfile", [=] (const QString & /*cmd*/,
+            const QString & params, const QString & /*sessionId*/) -> QString {
+        std::set<QString> keys = {LIVE_PROFILE};
+        std::map<QString,QString> dataValues = Carta::State::UtilState::parseParamMap( params, keys );
+        QString liveStr = dataValues[LIVE_PROFILE];
+        bool validBool = false;
+        bool live = Util::toBool( liveStr, &validBool );
+        QString result;
+        if ( validBool ){
+            setLiveProfile( live );
+        }
+        else {
+            result = "Whether or not the profile should follow the cursor must be true/false: "+params;
+        }
+        Util::commandPostProcess( result );
+        return result;
+    });
+
     addCommandCallback( "setLegendLine", [=] (const QString & /*cmd*/,
             const QString & params, const QString & /*sessionId*/) -> QString {
         std::set<QString> keys = {LEGEND_LINE};
@@ -1744,6 +1812,20 @@ bool Profiler::isFitManualGuess( ) const {
 }
 
 
+bool Profiler::_isLiveCurve( std::shared_ptr<CurveData> curve ) const {
+    bool liveCurve = false;
+    if ( curve && !curve->getRegion() ){
+        liveCurve = curve->getName() == _getLiveCurveName( curve->getLayer() );
+    }
+    return liveCurve;
+}
+
+
+bool Profiler::isLiveProfile() const {
+    return m_state.getValue<bool>( LIVE_PROFILE );
+}
+
+
 bool Profiler::isLinked( const QString& linkId ) const {
     bool linked = false;
     CartaObject* obj = m_linkImpl->searchLinks( linkId );
@@ -1989,6 +2071,52 @@ void Profiler::_profileRendered(const Carta::Lib::Hooks::ProfileResult& result,
     }
 }
 
+void Profiler::_liveProfileRendered(const Carta::Lib::Hooks::ProfileResult& result,
+        std::shared_ptr<Layer> layer, const QPointF& /*pixel*/ ){
+    //Errors are not reported, the next move of the cursor would report them again.
+    if ( !isLiveProfile() || !result.getError().isEmpty() ){
+        return;
+    }
+    std::vector< std::pair<double,double> > data = result.getData();
+    int dataCount = data.size();
+    if ( dataCount == 0 ){
+        return;
+    }
+    std::vector<double> plotDataX( dataCount );
+    std::vector<double> plotDataY( dataCount );
+    for( int i = 0 ; i < dataCount; i ++ ){
+        plotDataX[i] = data[i].first;
+        plotDataY[i] = data[i].second;
+    }
+
+    //The curve is reused as the cursor moves, so only the data changes.
+    QString curveName = _getLiveCurveName( layer );
+    int curveIndex = _findCurveIndex( curveName );
+    std::shared_ptr<CurveData> profileCurve( nullptr );
+    if ( curveIndex < 0 ){
+        Carta::State::ObjectManager* objMan = Carta::State::ObjectManager::objectManager();
+        profileCurve.reset( objMan->createObject<CurveData>() );
+        double restFrequency = result.getRestFrequency();
+        int significantDigits = m_state.getValue<int>( Util::SIGNIFICANT_DIGITS );
+        double restRounded = Util::roundToDigits( restFrequency, significantDigits );
+        profileCurve->setRestQuantity( restRounded, result.getRestUnits() );
+        profileCurve->setSpectralInfo( getSpectralType(), getSpectralUnits() );
+        _assignColor( profileCurve );
+        profileCurve->setLayer( layer );
+        profileCurve->setName( curveName );
+        m_plotCurves.append( profileCurve );
+    }
+    else {
+        profileCurve = m_plotCurves[curveIndex];
+    }
+    profileCurve->setData( plotDataX, plotDataY );
+    if ( curveIndex < 0 ){
+        _saveCurveState();
+    }
+    _updatePlotBounds();
+    _updatePlotData();
+}
+
 void Profiler::refreshState(){
 	CartaObject::refreshState();
 	m_stateData.refreshState();
@@ -2669,6 +2797,26 @@ void Profiler::setLegendShow( bool showLegend ){
     }
 }
 
+void Profiler::setLiveProfile( bool liveProfile ){
+    bool oldLiveProfile = m_state.getValue<bool>( LIVE_PROFILE );
+    if ( oldLiveProfile != liveProfile ){
+        m_state.setValue<bool>( LIVE_PROFILE, liveProfile );
+        m_state.flushState();
+        if ( liveProfile ){
+            _updateLiveProfile( _getControllerSelected() );
+        }
+        else {
+            //Remove the curves that followed the cursor.
+            int curveCount = m_plotCurves.size();
+            for ( int i = curveCount - 1; i >= 0; i-- ){
+                if ( _isLiveCurve( m_plotCurves[i] ) ){
+                    profileRemove( m_plotCurves[i]->getName() );
+                }
+            }
+        }
+    }
+}
+
 QString Profiler::setPlotStyle( const QString& name, const QString& plotStyle ){
     QString result;
     int index = _findCurveIndex( name );
@@ -3429,6 +3577,28 @@ void Profiler::_updateSelectedCurve(){
 	}
 }
 
+void Profiler::_updateLiveProfile( Controller* controller ){
+    if ( !isLiveProfile() || controller == nullptr ){
+        return;
+    }
+    std::shared_ptr<Layer> layer = controller->getLayer( "" );
+    if ( !layer ){
+        return;
+    }
+    bool valid = false;
+    QPointF imagePt = controller->getImagePt( &valid );
+    if ( valid ){
+        //The profile of a single pixel, so the statistic does not matter.
+        Carta::Lib::ProfileInfo profInfo;
+        profInfo.setRestFrequency( getRestFrequency( "" ) );
+        profInfo.setRestUnit( getRestUnits( "" ) );
+        profInfo.setAggregateType( Carta::Lib::ProfileInfo::AggregateType::MEAN );
+        profInfo.setSpectralUnit( getSpectralUnits() );
+        profInfo.setSpectralType( getSpectralType() );
+        m_renderService->renderLiveProfile( layer, imagePt, profInfo );
+    }
+}
+
 void Profiler::_updateZoomRangeBasedOnPercent(){
     std::pair<double,double> range = _getCurveRangeX();
     double curveSpan = range.second - range.first;
@@ -3508,6 +3678,9 @@ bool Profiler::_updateProfiles( Controller* controller ){
 		int regionCount = regions.size();
 		bool curveStatusChange = false;
 		for ( int i = 0; i < curveCount; i++ ){
+			if ( _isLiveCurve( m_plotCurves[i] ) ){
+				continue;
+			}
 			QString curveId = m_plotCurves[i]->getName();
 			bool layerFound = false;
 			for ( int j = 0; j < dataCount; j++ ){
@@ -3537,14 +3710,13 @@ bool Profiler::_updateProfiles( Controller* controller ){
 			}
 		}
 
-		//Make profiles for any new data that has been loaded.
+		//Make profiles for any new data that has been loaded, the profiles of all
+		//regions of an image are computed together.
 		for ( int i = 0; i < dataCount; i++ ) {
 			if ( regionCount > 0 ){
-				for ( int j = 0; j < regionCount; j++ ){
-					bool curveGenerated = _generateCurve( layers[i], regions[j] );
-					if ( curveGenerated ){
-						profileChanged = true;
-					}
+				bool curveGenerated = _generateCurves( layers[i], regions );
+				if ( curveGenerated ){
+					profileChanged = true;
 				}
 			}
 			else {
@@ -15,6 +15,7 @@
 #include "CartaLib/Hooks/FitResult.h"
 
 #include <QObject>
+#include <QPointF>
 
 namespace Carta {
 namespace Lib {
@@ -199,6 +200,12 @@ public:
      */
     virtual bool isLinked( const QString& linkId ) const Q_DECL_OVERRIDE;
 
+    /**
+     * Returns whether or not a profile of the pixel under the image cursor is shown.
+     * @return - true if the profile follows the cursor; false, otherwise.
+     */
+    bool isLiveProfile() const;
+
     /**
      * Return whether or not random heuristics will be used for the initial fit
      * guesses when performing a fit.
@@ -387,6 +394,13 @@ public:
      */
     void setLegendShow( bool showLegend );
 
+    /**
+     * Set whether or not to show a profile of the pixel under the image cursor, which
+     * is updated as the cursor moves.
+     * @param liveProfile - true to show a profile following the cursor; false otherwise.
+     */
+    void setLiveProfile( bool liveProfile );
+
     /**
      * Set the line style to use for the fit curve.
      * @param lineStyleFit - the line style to use for the fit curve.
@@ -588,6 +602,8 @@ protected:
 private slots:
     void _cursorUpdate( double x, double y );
     void _fitFinished(const std::vector<Carta::Lib::Hooks::FitResult>& result);
+    void _liveProfileRendered(const Carta::Lib::Hooks::ProfileResult& result,
+            std::shared_ptr<Layer> layer, const QPointF& pixel );
     void _loadProfile( Controller* controller);
     void _movieFrame();
     void _plotSizeChanged();
@@ -596,6 +612,7 @@ private slots:
     void _removeUnsupportedCurves();
     void _resetFitGuessPixels();
     void _updateChannel( Controller* controller, Carta::Lib::AxisInfo::KnownType type );
+    void _updateLiveProfile( Controller* controller );
     void _updateZoomRangeBasedOnPercent();
     QString _zoomToSelection();
 
@@ -615,6 +632,8 @@ private:
     const static QString LEGEND_LINE;
     const static QString LEGEND_LOCATION;
     const static QString LEGEND_EXTERNAL;
+    const static QString LIVE_CURVE;
+    const static QString LIVE_PROFILE;
     const static QString MANUAL_GUESS;
     const static QString NO_REGION;
     const static QString PLOT_HEIGHT;
@@ -667,8 +686,17 @@ private:
 
     int _findCurveIndex( const QString& curveId ) const;
 
+    //Name of the curve following the cursor on an image.
+    QString _getLiveCurveName( std::shared_ptr<Layer> layer ) const;
+    bool _isLiveCurve( std::shared_ptr<CurveData> curve ) const;
+
     bool _generateCurve( std::shared_ptr<Layer> layer, std::shared_ptr<Region> region );
 
+    //Generate the missing curves of several regions of a layer together; returns true if
+    //any curve is being generated.
+    bool _generateCurves( std::shared_ptr<Layer> layer,
+            const std::vector<std::shared_ptr<Region> >& regions );
+
     void _generateData( std::shared_ptr<Layer> layer, std::shared_ptr<Region> region,
             bool createNew = false);
 
@@ -679,6 +707,8 @@ private:
     std::pair<double,double> _getCurveRangeX() const;
     std::vector<std::shared_ptr<Layer> > _getDataForGenerateMode( Controller* controller) const;
     int _getExtractionAxisIndex( std::shared_ptr<Carta::Lib::Image::ImageInterface> image ) const;
+    //Profile information based on the current settings, for new curves.
+    Carta::Lib::ProfileInfo _getProfileInfoDefault() const;
 
     QString _getFitStatusMessage( Carta::Lib::Fit1DInfo::StatusType statType) const;
     QString _getLegendLocationsId() const;
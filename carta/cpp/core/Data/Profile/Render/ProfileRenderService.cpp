@@ -1,31 +1,119 @@
 #include "ProfileRenderService.h"
 #include "ProfileRenderWorker.h"
-#include "ProfileRenderThread.h"
 #include "ProfileRenderRequest.h"
+#include "SpectralTileCache.h"
+#include "Data/Util.h"
+#include "Data/Image/DataSource.h"
 #include "Data/Image/Layer.h"
+#include "Data/Image/TransposedCube.h"
 #include "Data/Region/Region.h"
-#include "CartaLib/Hooks/ProfileHook.h"
+#include "Data/Region/RegionMask.h"
+#include "CartaLib/AxisInfo.h"
+#include "CartaLib/Regions/Point.h"
+#include <QMutexLocker>
+#include <QRunnable>
 
 namespace Carta {
 namespace Data {
 
+class ProfileRenderService::Job {
+public:
+    Job( const std::vector<ProfileRenderRequest>& requests, const QPointF& point = QPointF() ) :
+        m_requests( requests ),
+        m_point( point ),
+        m_done( false ){
+    }
+
+    //Requests for the same layer and profile information, computed together.
+    std::vector<ProfileRenderRequest> m_requests;
+    //The pixel of a live profile.
+    QPointF m_point;
+    ProfileRenderWorker m_worker;
+    std::vector<Carta::Lib::Hooks::ProfileResult> m_results;
+    bool m_done;
+};
+
+
+class ProfileRenderService::Runnable : public QRunnable {
+public:
+    Runnable( ProfileRenderService* service, Job* job, const char* slot ) :
+        m_service( service ),
+        m_job( job ),
+        m_slot( slot ){
+    }
+
+    virtual void run() override {
+        std::vector<Carta::Lib::Hooks::ProfileResult> results = m_job->m_worker.computeProfiles();
+        {
+            QMutexLocker locker( &m_service->m_jobMutex );
+            m_job->m_results = results;
+            m_job->m_done = true;
+        }
+        QMetaObject::invokeMethod( m_service, m_slot, Qt::QueuedConnection );
+    }
+
+private:
+    ProfileRenderService* m_service;
+    Job* m_job;
+    const char* m_slot;
+};
+
+
 ProfileRenderService::ProfileRenderService( QObject * parent ) :
         QObject( parent ),
-        m_worker( nullptr),
-        m_renderThread( nullptr ){
-    m_renderQueued = false;
+        m_liveJob( nullptr ),
+        m_livePending( nullptr ){
+    m_livePool.setMaxThreadCount( 1 );
 }
 
 
 bool ProfileRenderService::renderProfile(std::shared_ptr<Layer> layer,
         std::shared_ptr<Region> region, const Carta::Lib::ProfileInfo& profInfo,
         bool createNew ){
+    std::vector<std::shared_ptr<Region> > regions( 1, region );
+    return renderProfiles( layer, regions, profInfo, createNew );
+}
+
+
+bool ProfileRenderService::renderProfiles(std::shared_ptr<Layer> layer,
+        const std::vector<std::shared_ptr<Region> >& regions,
+        const Carta::Lib::ProfileInfo& profInfo, bool createNew ){
     bool profileRender = true;
-    ProfileRenderRequest request( layer, region, profInfo, createNew );
     if ( layer ){
-    	if ( ! m_requests.contains( request ) ){
-    		m_requests.enqueue( request );
-    		_scheduleRender( layer, region, profInfo );
+        std::vector<ProfileRenderRequest> requests;
+        std::vector<std::shared_ptr<Carta::Lib::Regions::RegionBase> > regionInfos;
+        for ( std::shared_ptr<Region> region : regions ){
+            ProfileRenderRequest request( layer, region, profInfo, createNew );
+            bool pending = false;
+            for ( Job* job : m_jobs ){
+                for ( ProfileRenderRequest& jobRequest : job->m_requests ){
+                    if ( jobRequest == request ){
+                        pending = true;
+                        break;
+                    }
+                }
+            }
+            if ( !pending ){
+                requests.push_back( request );
+                std::shared_ptr<Carta::Lib::Regions::RegionBase> regionInfo(nullptr);
+                if ( region ){
+                    regionInfo = region->getModel();
+                }
+                regionInfos.push_back( regionInfo );
+            }
+        }
+    	if ( !requests.empty() ){
+    	    //The worker takes what it needs from the layer and the regions here, on the
+    	    //GUI thread, and then computes the profiles on the pool.
+    	    Job* job = new Job( requests );
+    	    std::shared_ptr<TransposedCube> transposedCube( nullptr );
+    	    std::shared_ptr<DataSource> dataSource = layer->_getDataSource();
+    	    if ( dataSource ){
+    	        transposedCube = dataSource->_getTransposedCube();
+    	    }
+    	    job->m_worker.setParameters( layer->_getImage(), regionInfos, profInfo, transposedCube );
+    	    m_jobs.enqueue( job );
+    	    m_pool.start( new Runnable( this, job, "_postResults" ) );
     	}
     }
     else {
@@ -35,56 +123,103 @@ bool ProfileRenderService::renderProfile(std::shared_ptr<Layer> layer,
 }
 
 
-void ProfileRenderService::_scheduleRender( std::shared_ptr<Layer> layer,
-        std::shared_ptr<Region> region, const Carta::Lib::ProfileInfo& profInfo){
-    if ( m_renderQueued ) {
-        return;
+bool ProfileRenderService::renderLiveProfile( std::shared_ptr<Layer> layer, const QPointF& pixel,
+        const Carta::Lib::ProfileInfo& profInfo ){
+    if ( !layer ){
+        return false;
     }
-    m_renderQueued = true;
+    //Mouse moves come faster than profiles, so only the last one is kept.
+    delete m_livePending;
+    std::vector<ProfileRenderRequest> requests( 1, ProfileRenderRequest( layer, nullptr, profInfo, false ) );
+    m_livePending = new Job( requests, pixel );
+    if ( m_liveJob == nullptr ){
+        _startLive();
+    }
+    else {
+        m_liveJob->m_worker.cancel();
+    }
+    return true;
+}
 
 
-    //Create a worker if we don't have one.
-    if ( !m_worker ){
-        m_worker = new ProfileRenderWorker();
+void ProfileRenderService::_startLive(){
+    m_liveJob = m_livePending;
+    m_livePending = nullptr;
+    std::shared_ptr<Layer> layer = m_liveJob->m_requests[0].getLayer();
+    std::shared_ptr<Carta::Lib::Image::ImageInterface> image = layer->_getImage();
+    std::shared_ptr<TransposedCube> transposedCube( nullptr );
+    std::shared_ptr<DataSource> dataSource = layer->_getDataSource();
+    if ( dataSource ){
+        transposedCube = dataSource->_getTransposedCube();
     }
-
-    if ( !m_renderThread ){
-        m_renderThread = new ProfileRenderThread();
-        connect( m_renderThread, SIGNAL(finished()),
-                this, SLOT( _postResult()));
+    if ( image && ( !m_tileCache || m_tileCache->getImage() != image ) ){
+        //Use the axes regions are given in.
+        RegionMask imageMask;
+        imageMask.setRegion( image, nullptr );
+        int spectralAxis = Util::getAxisIndex( image, Carta::Lib::AxisInfo::KnownType::SPECTRAL );
+        //Spectra can only be cached for cubes without other (non-singleton) axes, the
+        //others are read from the image.
+        m_tileCache.reset();
+        if ( TransposedCube::isSupported( image, imageMask.getXAxis(), imageMask.getYAxis(),
+                spectralAxis ) ){
+            m_tileCache.reset( new SpectralTileCache( image, imageMask.getXAxis(),
+                    imageMask.getYAxis(), spectralAxis ) );
+        }
     }
-    std::shared_ptr<Carta::Lib::Regions::RegionBase> regionInfo(nullptr);
-    if ( region ){
-        regionInfo = region->getModel();
+    std::shared_ptr<Carta::Lib::Regions::Point> point( new Carta::Lib::Regions::Point() );
+    point->setPoint( m_liveJob->m_point );
+    std::vector<std::shared_ptr<Carta::Lib::Regions::RegionBase> > regionInfos( 1, point );
+    m_liveJob->m_worker.setParameters( image, regionInfos, m_liveJob->m_requests[0].getProfileInfo(),
+            transposedCube, m_tileCache );
+    m_livePool.start( new Runnable( this, m_liveJob, "_postLiveResult" ) );
+}
+
+
+void ProfileRenderService::_postLiveResult(){
+    Job* job = m_liveJob;
+    m_liveJob = nullptr;
+    if ( job == nullptr ){
+        return;
     }
-    std::shared_ptr<Carta::Lib::Image::ImageInterface> dataSource = layer->_getImage();
-    m_worker->setParameters( dataSource, regionInfo, profInfo );
-    int pid = m_worker->computeProfile();
-    if ( pid != -1 ){
-        m_renderThread->setFileDescriptor( pid );
-        m_renderThread->start();
+    //A result is stale if the cursor has moved on in the meantime.
+    if ( m_livePending == nullptr ){
+        emit liveProfileResult( job->m_results[0], job->m_requests[0].getLayer(), job->m_point );
     }
-    else {
-        m_renderQueued = false;
+    delete job;
+    if ( m_livePending != nullptr ){
+        _startLive();
     }
 }
 
-void ProfileRenderService::_postResult(  ){
-    Lib::Hooks::ProfileResult result = m_renderThread->getResult();
-    ProfileRenderRequest request = m_requests.dequeue();
-    emit profileResult(result, request.getLayer(), request.getRegion(), request.isCreateNew() );
-    m_renderQueued = false;
-    if ( m_requests.size() > 0 ){
-        ProfileRenderRequest& head = m_requests.head();
-         _scheduleRender( head.getLayer(), head.getRegion(), head.getProfileInfo() );
+
+void ProfileRenderService::_postResults(  ){
+    while ( m_jobs.size() > 0 ){
+        {
+            QMutexLocker locker( &m_jobMutex );
+            if ( !m_jobs.head()->m_done ){
+                break;
+            }
+        }
+        Job* job = m_jobs.dequeue();
+        int requestCount = job->m_requests.size();
+        for ( int i = 0; i < requestCount; i++ ){
+            const ProfileRenderRequest& request = job->m_requests[i];
+            emit profileResult(job->m_results[i], request.getLayer(), request.getRegion(), request.isCreateNew() );
+        }
+        delete job;
     }
 }
 
 
 ProfileRenderService::~ProfileRenderService(){
-    delete m_worker;
-    delete m_renderThread;
+    if ( m_liveJob != nullptr ){
+        m_liveJob->m_worker.cancel();
+    }
+    m_livePool.waitForDone();
+    m_pool.waitForDone();
+    qDeleteAll( m_jobs );
+    delete m_liveJob;
+    delete m_livePending;
 }
 }
 }
-
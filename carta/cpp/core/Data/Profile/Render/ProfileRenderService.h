@@ -8,19 +8,22 @@
 #include "CartaLib/CartaLib.h"
 #include "CartaLib/Hooks/ProfileResult.h"
 
+#include <QMutex>
 #include <QObject>
+#include <QPointF>
 #include <QQueue>
+#include <QThreadPool>
 #include <memory>
+#include <vector>
 
 
 namespace Carta{
 namespace Data{
 
 class Layer;
-class ProfileRenderWorker;
-class ProfileRenderThread;
 class ProfileRenderRequest;
 class Region;
+class SpectralTileCache;
 
 class ProfileRenderService : public QObject {
     Q_OBJECT
@@ -44,6 +47,39 @@ public:
     bool renderProfile(std::shared_ptr<Layer> layer, std::shared_ptr<Region> region,
             const Carta::Lib::ProfileInfo& profInfo, bool createNew );
 
+    /**
+     * Initiates the process of rendering the profiles of several regions of an image.
+     *
+     * The masks of all the regions are made once and the profiles are accumulated
+     * together, so the image is read once rather than once per region.  A profile
+     * result is posted for each region, in order.
+     * @param layer - the image that will be the source of the profiles.
+     * @param regions - the regions within the image that will be profiled, a nullptr
+     *      region stands for the whole image.
+     * @param profInfo - information about the profiles to be rendered such as rest frequency.
+     * @param createNew - whether these are new profiles or replacements for existing ones.
+     * @return - whether or not the profiles are being rendered.
+     */
+    bool renderProfiles(std::shared_ptr<Layer> layer,
+            const std::vector<std::shared_ptr<Region> >& regions,
+            const Carta::Lib::ProfileInfo& profInfo, bool createNew );
+
+    /**
+     * Initiates the process of rendering the profile of a single pixel that follows
+     * the cursor.
+     *
+     * Only the latest pixel matters: a request that has not started yet is replaced by
+     * a newer one, and one in progress is cancelled.  Spectra are read from the
+     * spectral-major copy of the image if it is finished, or from a cache of the tiles
+     * around the recent pixels.
+     * @param layer - the image that will be the source of the profile.
+     * @param pixel - the pixel in image coordinates.
+     * @param profInfo - information about the profile to be rendered such as rest frequency.
+     * @return - whether or not the profile is being rendered.
+     */
+    bool renderLiveProfile( std::shared_ptr<Layer> layer, const QPointF& pixel,
+            const Carta::Lib::ProfileInfo& profInfo );
+
     /**
      * Destructor.
      */
@@ -59,17 +95,37 @@ signals:
             std::shared_ptr<Region> region,
             bool createNew);
 
+    /**
+     * Notification that the profile of the pixel under the cursor has been computed.
+     */
+    void liveProfileResult( const Carta::Lib::Hooks::ProfileResult&,
+            std::shared_ptr<Layer> layer, const QPointF& pixel );
+
 private slots:
 
-    void _postResult( );
+    void _postResults( );
+    void _postLiveResult( );
 
 private:
-    void _scheduleRender( std::shared_ptr<Layer> layer,
-            std::shared_ptr<Region> region, const Carta::Lib::ProfileInfo& profInfo );
-    ProfileRenderWorker* m_worker;
-    ProfileRenderThread* m_renderThread;
-    bool m_renderQueued;
-    QQueue<ProfileRenderRequest> m_requests;
+    class Job;
+    class Runnable;
+
+    //Start computing the pending live profile.
+    void _startLive();
+
+    //Requests are computed in parallel, but their results are posted in the order
+    //of the requests.
+    QQueue<Job*> m_jobs;
+    //Guards the completion of jobs, which happens on the pool threads.
+    QMutex m_jobMutex;
+    QThreadPool m_pool;
+
+    //The live profile in progress and the one waiting for it, only the latest request
+    //waits.  They have their own thread so they are not held up by other profiles.
+    Job* m_liveJob;
+    Job* m_livePending;
+    QThreadPool m_livePool;
+    std::shared_ptr<SpectralTileCache> m_tileCache;
 
     ProfileRenderService( const ProfileRenderService& other);
     ProfileRenderService& operator=( const ProfileRenderService& other );
@@ -1,27 +1,86 @@
 #include "ProfileRenderWorker.h"
+#include "SpectralTileCache.h"
 #include "Globals.h"
 #include "PluginManager.h"
+#include "Data/Util.h"
+#include "Data/Image/TransposedCube.h"
+#include "Data/Units/UnitsSpectral.h"
+#include "CartaLib/AxisInfo.h"
+#include "CartaLib/IImage.h"
+#include "CartaLib/Algorithms/ParallelFor.h"
+#include "CartaLib/Hooks/ConversionSpectralHook.h"
 #include "CartaLib/Hooks/ProfileHook.h"
-#include <QFile>
-#include <QDataStream>
-#include <string.h>
-#include <unistd.h>
+#include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
+#include <algorithm>
+#include <cmath>
+#include <stdexcept>
 
 namespace Carta
 {
 namespace Data
 {
 
-ProfileRenderWorker::ProfileRenderWorker(){
+namespace
+{
+//Serializes the profiles computed by the plugin, which reads the image through casacore.
+//The plugin also holds the image's own casacore lock, which the views of the image
+//take, so hook profiles don't race with pixels read on other threads.
+QMutex casaProfileMutex;
+}
+
+const int64_t ProfileRenderWorker::BLOCK_SIZE = 1024 * 1024;
+const int64_t ProfileRenderWorker::CHUNK_SIZE = 16 * 1024;
+
+void ProfileRenderWorker::Accumulator::add( double value ){
+    if ( count == 0 ){
+        min = value;
+        max = value;
+    }
+    else {
+        min = std::min( min, value );
+        max = std::max( max, value );
+    }
+    count++;
+    sum += value;
+    sumSquares += value * value;
+}
+
+void ProfileRenderWorker::Accumulator::merge( const Accumulator& other ){
+    if ( other.count == 0 ){
+        return;
+    }
+    if ( count == 0 ){
+        min = other.min;
+        max = other.max;
+    }
+    else {
+        min = std::min( min, other.min );
+        max = std::max( max, other.max );
+    }
+    count += other.count;
+    sum += other.sum;
+    sumSquares += other.sumSquares;
+}
+
+
+ProfileRenderWorker::ProfileRenderWorker() :
+    m_native( false ),
+    m_cancelled( false ),
+    m_spectralAxis( -1 ),
+    m_restFrequency( 0 ){
 }
 
 
 bool ProfileRenderWorker::setParameters(std::shared_ptr<Carta::Lib::Image::ImageInterface> dataSource,
-       std::shared_ptr<Carta::Lib::Regions::RegionBase> regionInfo,
-       const Carta::Lib::ProfileInfo& profInfo  ){
+       const std::vector<std::shared_ptr<Carta::Lib::Regions::RegionBase> >& regionInfos,
+       const Carta::Lib::ProfileInfo& profInfo,
+       std::shared_ptr<TransposedCube> transposedCube,
+       std::shared_ptr<SpectralTileCache> tileCache ){
     bool paramsChanged = false;
-    if ( m_regionInfo != regionInfo ){
-        m_regionInfo = regionInfo;
+    if ( m_regionInfos != regionInfos ){
+        m_regionInfos = regionInfos;
         paramsChanged = true;
     }
     if ( m_profileInfo != profInfo ){
@@ -32,57 +91,426 @@ bool ProfileRenderWorker::setParameters(std::shared_ptr<Carta::Lib::Image::Image
         m_dataSource = dataSource;
         //paramsChanged = true;
     //}
+
+    //Work out whether the profiles can be computed from the pixels alone.
+    m_native = false;
+    m_regionMasks.clear();
+    m_transposedCube.reset();
+    m_tileCache.reset();
+    m_xValues.clear();
+    m_restFrequency = 0;
+    m_restUnits = "";
+    if ( !m_dataSource ){
+        return paramsChanged;
+    }
+    m_spectralAxis = Util::getAxisIndex( m_dataSource, Carta::Lib::AxisInfo::KnownType::SPECTRAL );
+    Carta::Lib::ProfileInfo::AggregateType aggType = m_profileInfo.getAggregateType();
+    bool nativeType = aggType != Carta::Lib::ProfileInfo::AggregateType::FLUX_DENSITY &&
+            aggType != Carta::Lib::ProfileInfo::AggregateType::OTHER;
+    if ( m_spectralAxis >= 0 && nativeType ){
+        int regionCount = m_regionInfos.size();
+        m_regionMasks.resize( regionCount );
+        bool wholeImage = false;
+        for ( int i = 0; i < regionCount; i++ ){
+            m_regionMasks[i].setRegion( m_dataSource, m_regionInfos[i] );
+            wholeImage = wholeImage || m_regionMasks[i].isAll();
+        }
+        int channelCount = m_dataSource->dims()[m_spectralAxis];
+        m_xValues = _getChannelCoordinates( channelCount );
+        m_native = regionCount > 0 && static_cast<int>( m_xValues.size() ) == channelCount;
+
+        //Reading spectra is only worth it if no region covers the whole image, which
+        //is as fast to read from the image itself.
+        if ( m_native && !wholeImage ){
+            int xAxis = m_regionMasks[0].getXAxis();
+            int yAxis = m_regionMasks[0].getYAxis();
+            if ( transposedCube && transposedCube->isFinished() &&
+                    transposedCube->getSpectralAxis() == m_spectralAxis &&
+                    transposedCube->getXAxis() == xAxis && transposedCube->getYAxis() == yAxis ){
+                m_transposedCube = transposedCube;
+            }
+            else if ( tileCache && tileCache->getImage() == m_dataSource &&
+                    tileCache->getSpectralAxis() == m_spectralAxis &&
+                    tileCache->getXAxis() == xAxis && tileCache->getYAxis() == yAxis &&
+                    TransposedCube::isSupported( m_dataSource, xAxis, yAxis, m_spectralAxis ) ){
+                m_tileCache = tileCache;
+            }
+        }
+    }
+    if ( m_native && m_profileInfo.getRestUnit().trimmed().isEmpty() ){
+        //No rest frequency was specified so report the one of the image.
+        std::pair<double,QString> restFrequency = m_dataSource->metaData()->getRestFrequency();
+        if ( restFrequency.first >= 0 ){
+            m_restFrequency = restFrequency.first;
+            m_restUnits = restFrequency.second;
+        }
+    }
     return paramsChanged;
 }
 
 
-int ProfileRenderWorker::computeProfile(){
-    //Note:  we compute the Profile in a separate process because casacore tables
-    //cannot be accessed by different threads at the same time.
-    int ProfilePipes [2];
-    if (pipe (ProfilePipes)){
-        qDebug() << "*** ProfileRenderWorker::run: pipe creation failed: " << strerror (errno);
-        return -1;
+std::vector<double> ProfileRenderWorker::_getChannelCoordinates( int channelCount ) const {
+    std::vector<double> channels( channelCount );
+    for ( int i = 0; i < channelCount; i++ ){
+        channels[i] = i;
+    }
+    QString spectralType = m_profileInfo.getSpectralType().trimmed();
+    if ( spectralType == UnitsSpectral::NAME_CHANNEL ){
+        return channels;
+    }
+
+    //Frequencies do not depend on the rest frequency or the velocity definition, so the
+    //spectral coordinate of the image is all that is needed.  The profiler leaves the
+    //type blank for frequencies.
+    std::vector<double> coordinates;
+    if ( spectralType.isEmpty() || spectralType == UnitsSpectral::NAME_FREQUENCY ){
+        auto result = Globals::instance()-> pluginManager()
+                             -> prepare <Carta::Lib::Hooks::ConversionSpectralHook>(m_dataSource,
+                                     "", m_profileInfo.getSpectralUnit(), channels );
+        auto lam = [&coordinates] ( const Carta::Lib::Hooks::ConversionSpectralHook::ResultType &data ) {
+            coordinates = data;
+        };
+        try {
+            result.forEach( lam );
+        }
+        catch( char*& error ){
+            qDebug() << "ProfileRenderWorker: could not convert channels: " << error;
+            coordinates.clear();
+        }
+    }
+    return coordinates;
+}
+
+
+void ProfileRenderWorker::cancel(){
+    m_cancelled = true;
+}
+
+
+std::vector<Carta::Lib::Hooks::ProfileResult> ProfileRenderWorker::computeProfiles(){
+    std::vector<Carta::Lib::Hooks::ProfileResult> results;
+    if ( m_native ){
+        try {
+            results = _computeNative();
+        }
+        catch( const std::exception& error ){
+            qDebug() << "ProfileRenderWorker::computeProfiles: caught error: " << error.what();
+            Carta::Lib::Hooks::ProfileResult result;
+            result.setError( QString( error.what() ) );
+            results.assign( m_regionInfos.size(), result );
+        }
+    }
+    else {
+        int regionCount = m_regionInfos.size();
+        for ( int i = 0; i < regionCount && !m_cancelled; i++ ){
+            results.push_back( _computeHook( m_regionInfos[i] ) );
+        }
+        results.resize( regionCount );
+    }
+    return results;
+}
+
+
+std::vector<Carta::Lib::Hooks::ProfileResult> ProfileRenderWorker::_computeNative(){
+    int regionCount = m_regionMasks.size();
+    std::vector<Carta::Lib::Hooks::ProfileResult> results( regionCount,
+            Carta::Lib::Hooks::ProfileResult( m_restFrequency, m_restUnits ) );
+    bool anySelected = false;
+    for ( int i = 0; i < regionCount; i++ ){
+        anySelected = anySelected || !m_regionMasks[i].isEmpty();
+    }
+    if ( !anySelected ){
+        return results;
+    }
+    int channelCount = m_xValues.size();
+    std::vector<double> aggregates( regionCount * channelCount, 0 );
+    if ( m_profileInfo.getAggregateType() == Carta::Lib::ProfileInfo::AggregateType::MEDIAN ){
+        //A median needs all the values of a channel, so the channels are read from
+        //the image one at a time, rather than spectrum by spectrum, and only the
+        //values of one channel are kept in memory.
+        _medianImage( aggregates );
+    }
+    else {
+        std::vector<Accumulator> accumulators( regionCount * channelCount );
+        if ( m_transposedCube ){
+            std::shared_ptr<TransposedCube> cube = m_transposedCube;
+            _accumulateSpectra( [cube]( int x, int y, int count, std::vector<float>& spectra ){
+                return cube->readSpectra( x, y, count, spectra );
+            }, accumulators );
+        }
+        else if ( m_tileCache ){
+            std::shared_ptr<SpectralTileCache> cache = m_tileCache;
+            _accumulateSpectra( [cache]( int x, int y, int count, std::vector<float>& spectra ){
+                return cache->readSpectra( x, y, count, spectra );
+            }, accumulators );
+        }
+        else {
+            _accumulateImage( accumulators );
+        }
+        int accumulatorCount = accumulators.size();
+        for ( int i = 0; i < accumulatorCount; i++ ){
+            aggregates[i] = _aggregate( accumulators[i] );
+        }
+    }
+    if ( m_cancelled ){
+        return results;
+    }
+
+    for ( int r = 0; r < regionCount; r++ ){
+        if ( m_regionMasks[r].isEmpty() ){
+            continue;
+        }
+        std::vector<std::pair<double,double> > profileData( channelCount );
+        for ( int i = 0; i < channelCount; i++ ){
+            profileData[i] = std::pair<double,double>( m_xValues[i], aggregates[r * channelCount + i] );
+        }
+        results[r].setData( profileData );
+    }
+    return results;
+}
+
+
+void ProfileRenderWorker::_accumulateImage( std::vector<Accumulator>& accumulators ){
+    int regionCount = m_regionMasks.size();
+    int channelCount = m_xValues.size();
+    int xAxis = m_regionMasks[0].getXAxis();
+    int yAxis = m_regionMasks[0].getYAxis();
+    QMutex mutex;
+
+    //One read of the pixels all the regions may cover.
+    QRect bounds;
+    for ( int r = 0; r < regionCount; r++ ){
+        bounds = bounds.united( m_regionMasks[r].getBounds() );
+    }
+    SliceND slice;
+    slice.slice( xAxis ).start( bounds.left() ).end( bounds.right() + 1 );
+    slice.slice( yAxis ).start( bounds.top() ).end( bounds.bottom() + 1 );
+    Carta::Lib::NdArray::RawViewInterface* rawView = m_dataSource->getDataSlice( slice );
+    if ( rawView == nullptr ){
+        throw std::runtime_error( "could not read image data" );
+    }
+    Carta::Lib::NdArray::Double view( rawView, true );
+
+    //The blocks are read one after the other, which is all the image allows, but
+    //aggregating a block is spread over all cores.
+    auto blockFunc = [&]( const double* data, int64_t count ){
+        if ( m_cancelled ){
+            return;
+        }
+        const std::vector<int>& blockPos = rawView->currentPos();
+        const std::vector<int>& blockDims = rawView->currentBlockDims();
+        int firstChannel = blockPos[m_spectralAxis];
+        int blockChannels = blockDims[m_spectralAxis];
+        int64_t xStride = 1;
+        int64_t yStride = 1;
+        int64_t channelStride = 1;
+        int64_t stride = 1;
+        for ( int i = 0; i < static_cast<int>( blockDims.size() ); i++ ){
+            if ( i == xAxis ){
+                xStride = stride;
+            }
+            else if ( i == yAxis ){
+                yStride = stride;
+            }
+            else if ( i == m_spectralAxis ){
+                channelStride = stride;
+            }
+            stride = stride * blockDims[i];
+        }
+        int xOrigin = bounds.left() + blockPos[xAxis];
+        int yOrigin = bounds.top() + blockPos[yAxis];
+        Carta::Lib::Algorithms::parallelFor( 0, count, CHUNK_SIZE,
+                [&]( int64_t first, int64_t last ){
+            std::vector<Accumulator> chunkAccumulators( regionCount * blockChannels );
+            for ( int64_t i = first; i < last; i++ ){
+                double value = data[i];
+                if ( std::isnan( value ) ){
+                    continue;
+                }
+                int x = xOrigin + static_cast<int>( ( i / xStride ) % blockDims[xAxis] );
+                int y = yOrigin + static_cast<int>( ( i / yStride ) % blockDims[yAxis] );
+                int channel = static_cast<int>( ( i / channelStride ) % blockChannels );
+                for ( int r = 0; r < regionCount; r++ ){
+                    if ( m_regionMasks[r].containsPixel( x, y ) ){
+                        chunkAccumulators[r * blockChannels + channel].add( value );
+                    }
+                }
+            }
+            QMutexLocker locker( &mutex );
+            for ( int r = 0; r < regionCount; r++ ){
+                for ( int j = 0; j < blockChannels; j++ ){
+                    int index = r * channelCount + firstChannel + j;
+                    accumulators[index].merge( chunkAccumulators[r * blockChannels + j] );
+                }
+            }
+        });
+    };
+    view.forEachBlock( blockFunc, Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal,
+            BLOCK_SIZE );
+}
+
+
+void ProfileRenderWorker::_accumulateSpectra( const SpectraReader& reader,
+        std::vector<Accumulator>& accumulators ){
+    int regionCount = m_regionMasks.size();
+    int channelCount = m_xValues.size();
+    std::vector<float> spectra;
+
+    //The spectra of a row of the bounding box of a region are read at once.
+    for ( int r = 0; r < regionCount; r++ ){
+        QRect bounds = m_regionMasks[r].getBounds();
+        for ( int y = bounds.top(); y <= bounds.bottom() && !m_cancelled; y++ ){
+            if ( !reader( bounds.left(), y, bounds.width(), spectra ) ){
+                throw std::runtime_error( "could not read the spectra of the image" );
+            }
+            for ( int x = bounds.left(); x <= bounds.right(); x++ ){
+                if ( !m_regionMasks[r].containsPixel( x, y ) ){
+                    continue;
+                }
+                const float* spectrum = spectra.data() +
+                        static_cast<size_t>( x - bounds.left() ) * channelCount;
+                for ( int j = 0; j < channelCount; j++ ){
+                    double value = spectrum[j];
+                    if ( std::isnan( value ) ){
+                        continue;
+                    }
+                    accumulators[r * channelCount + j].add( value );
+                }
+            }
+        }
+    }
+}
+
+
+void ProfileRenderWorker::_medianImage( std::vector<double>& medians ){
+    int regionCount = m_regionMasks.size();
+    int channelCount = m_xValues.size();
+    int xAxis = m_regionMasks[0].getXAxis();
+    int yAxis = m_regionMasks[0].getYAxis();
+    QRect bounds;
+    for ( int r = 0; r < regionCount; r++ ){
+        bounds = bounds.united( m_regionMasks[r].getBounds() );
     }
 
-    int pid = fork ();
-    if (pid == -1){
-        // Failure
-        qDebug() << "*** ProfileRenderWorker::run: fork failed: " << strerror (errno);
-        return -1;
+    //The buffers keep their capacity from one channel to the next.
+    std::vector<std::vector<double> > values( regionCount );
+    for ( int channel = 0; channel < channelCount && !m_cancelled; channel++ ){
+        SliceND slice;
+        slice.slice( xAxis ).start( bounds.left() ).end( bounds.right() + 1 );
+        slice.slice( yAxis ).start( bounds.top() ).end( bounds.bottom() + 1 );
+        slice.slice( m_spectralAxis ).start( channel ).end( channel + 1 );
+        Carta::Lib::NdArray::RawViewInterface* rawView = m_dataSource->getDataSlice( slice );
+        if ( rawView == nullptr ){
+            throw std::runtime_error( "could not read image data" );
+        }
+        Carta::Lib::NdArray::Double view( rawView, true );
+        for ( int r = 0; r < regionCount; r++ ){
+            values[r].clear();
+        }
+        auto blockFunc = [&]( const double* data, int64_t count ){
+            const std::vector<int>& blockPos = rawView->currentPos();
+            const std::vector<int>& blockDims = rawView->currentBlockDims();
+            int64_t xStride = 1;
+            int64_t yStride = 1;
+            int64_t stride = 1;
+            for ( int i = 0; i < static_cast<int>( blockDims.size() ); i++ ){
+                if ( i == xAxis ){
+                    xStride = stride;
+                }
+                else if ( i == yAxis ){
+                    yStride = stride;
+                }
+                stride = stride * blockDims[i];
+            }
+            int xOrigin = bounds.left() + blockPos[xAxis];
+            int yOrigin = bounds.top() + blockPos[yAxis];
+            for ( int64_t i = 0; i < count; i++ ){
+                double value = data[i];
+                if ( std::isnan( value ) ){
+                    continue;
+                }
+                int x = xOrigin + static_cast<int>( ( i / xStride ) % blockDims[xAxis] );
+                int y = yOrigin + static_cast<int>( ( i / yStride ) % blockDims[yAxis] );
+                for ( int r = 0; r < regionCount; r++ ){
+                    if ( m_regionMasks[r].containsPixel( x, y ) ){
+                        values[r].push_back( value );
+                    }
+                }
+            }
+        };
+        view.forEachBlock( blockFunc, Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal,
+                BLOCK_SIZE );
+        for ( int r = 0; r < regionCount; r++ ){
+            medians[r * channelCount + channel] = _median( values[r] );
+        }
+    }
+}
+
 
+double ProfileRenderWorker::_median( std::vector<double>& values ){
+    //Channels without data are reported as zero.
+    if ( values.empty() ){
+        return 0;
     }
-    else if (pid != 0){
-        // The original process comes here.
-        close (ProfilePipes [1]); // close write end of the pipe
-        return ProfilePipes [0]; // return the read end of the pipe
+    size_t middle = values.size() / 2;
+    std::nth_element( values.begin(), values.begin() + middle, values.end() );
+    double median = values[middle];
+    if ( values.size() % 2 == 0 ){
+        double below = *std::max_element( values.begin(), values.begin() + middle );
+        median = ( median + below ) / 2;
     }
+    return median;
+}
 
-    // We're our own process
+
+double ProfileRenderWorker::_aggregate( const Accumulator& acc ) const {
+    //Channels without data are reported as zero.
+    if ( acc.count == 0 ){
+        return 0;
+    }
+    double aggregate = acc.sum / acc.count;
+    Carta::Lib::ProfileInfo::AggregateType aggType = m_profileInfo.getAggregateType();
+    if ( aggType == Carta::Lib::ProfileInfo::AggregateType::SUM ){
+        aggregate = acc.sum;
+    }
+    else if ( aggType == Carta::Lib::ProfileInfo::AggregateType::MIN ){
+        aggregate = acc.min;
+    }
+    else if ( aggType == Carta::Lib::ProfileInfo::AggregateType::MAX ){
+        aggregate = acc.max;
+    }
+    else if ( aggType == Carta::Lib::ProfileInfo::AggregateType::RMS ){
+        aggregate = std::sqrt( acc.sumSquares / acc.count );
+    }
+    else if ( aggType == Carta::Lib::ProfileInfo::AggregateType::VARIANCE ){
+        aggregate = 0;
+        if ( acc.count > 1 ){
+            aggregate = ( acc.sumSquares - acc.sum * acc.sum / acc.count ) / ( acc.count - 1 );
+            aggregate = std::max( aggregate, 0.0 );
+        }
+    }
+    return aggregate;
+}
+
+
+Carta::Lib::Hooks::ProfileResult ProfileRenderWorker::_computeHook(
+        std::shared_ptr<Carta::Lib::Regions::RegionBase> regionInfo ){
+    Carta::Lib::Hooks::ProfileResult profileResult;
+    QMutexLocker locker( &casaProfileMutex );
     auto result = Globals::instance()-> pluginManager()
-                          -> prepare <Carta::Lib::Hooks::ProfileHook>(m_dataSource, m_regionInfo,
+                          -> prepare <Carta::Lib::Hooks::ProfileHook>(m_dataSource, regionInfo,
                                   m_profileInfo);
-    auto lam = [=] ( const Carta::Lib::Hooks::ProfileResult &data ) {
-        m_result = data;
+    auto lam = [&profileResult] ( const Carta::Lib::Hooks::ProfileResult &data ) {
+        profileResult = data;
     };
     try {
         result.forEach( lam );
     }
     catch( char*& error ){
         qDebug() << "ProfileRenderWorker::run: caught error: " << error;
-        m_result.setError( QString(error) );
-    }
-
-    QFile file;
-    if ( !file.open( ProfilePipes[1], QIODevice::WriteOnly, QFileDevice::AutoCloseHandle ) ){
-        qDebug() << "Could not write Profile results";
-        return 0;
+        profileResult.setError( QString(error) );
     }
-    QDataStream dataStream( &file );
-    dataStream << m_result;
-    file.close();
-    exit(0);
-    return 0;
+    return profileResult;
 }
 
 
@@ -1,14 +1,18 @@
 /**
- * Initiates the work of computing the Profile in a separate process.
+ * Computes the profiles of regions through an image cube in-process.
  **/
 
 #pragma once
 
+#include <atomic>
+#include <functional>
 #include <memory>
+#include <vector>
 
 #include "CartaLib/Regions/IRegion.h"
 #include "CartaLib/Hooks/ProfileResult.h"
 #include "CartaLib/ProfileInfo.h"
+#include "Data/Region/RegionMask.h"
 
 namespace Carta {
 namespace Lib {
@@ -23,6 +27,9 @@ class ImageInterface;
 namespace Carta{
 namespace Data{
 
+class SpectralTileCache;
+class TransposedCube;
+
 class ProfileRenderWorker{
 
 public:
@@ -33,23 +40,49 @@ public:
     ProfileRenderWorker();
 
     /**
-     * Store the parameters needed for computing the Profile.
-     * @param dataSource - the image that will be the source of the Profile.
-     * @param regionInfo - information about the region used to generate the profile.
-     * @param profInfo - information about the profile to be generated.
+     * Store the parameters needed for computing the profiles.
+     *
+     * This takes a snapshot of the regions and works out the spectral coordinates of
+     * the channels, so it should be called from the thread that owns the image and the
+     * regions; computeProfiles() can then run on any thread.
+     * @param dataSource - the image that will be the source of the profiles.
+     * @param regionInfos - the regions to profile, a nullptr region stands for the
+     *      whole image.
+     * @param profInfo - information about the profiles to be generated.
+     * @param transposedCube - a spectral-major copy of the image to read spectra from
+     *      when it is finished, or nullptr.
+     * @param tileCache - a cache of the spectra of the image to read from if there is
+     *      no finished copy, or nullptr.
      * @return - true if the parameters have changed since the last computation; false,
      *      otherwise.
      */
     bool setParameters(std::shared_ptr<Carta::Lib::Image::ImageInterface> dataSource,
-        std::shared_ptr<Carta::Lib::Regions::RegionBase> regionInfo,
-        const Carta::Lib::ProfileInfo& profInfo );
+        const std::vector<std::shared_ptr<Carta::Lib::Regions::RegionBase> >& regionInfos,
+        const Carta::Lib::ProfileInfo& profInfo,
+        std::shared_ptr<TransposedCube> transposedCube = nullptr,
+        std::shared_ptr<SpectralTileCache> tileCache = nullptr );
+
+    /**
+     * Ask a computation in progress to stop; it then returns empty profiles.  This
+     * can be called from any thread.
+     */
+    void cancel();
 
     /**
-     * Performs the work of computing the Profile data in a separate process.
-     * @return - the file descriptor for the pipe that can be used to read the
-     *      Profile data.
+     * Computes the profiles, one for each region, in the order of the regions.
+     *
+     * Channel and frequency profiles with the mean, median, sum, rms, variance, minimum
+     * or maximum are computed from the pixel data of the regions.  They are read from
+     * the spectral-major copy of the image or the tile cache if there is one, and
+     * otherwise block by block from the image, once for all the regions, and
+     * aggregated on all cores; medians are read one channel at a time from the
+     * image, so that only the pixels of one channel are kept.  Other profiles (flux density, velocities and
+     * wavelengths, which depend on the beam and the rest frequency) are left to the
+     * profile plugin one region at a time; as casacore cannot be used from several
+     * threads at once, those are computed one at a time.
+     * @return - the profile data of the regions.
      */
-    int computeProfile();
+    std::vector<Carta::Lib::Hooks::ProfileResult> computeProfiles();
 
     /**
      * Destructor.
@@ -57,10 +90,63 @@ public:
     ~ProfileRenderWorker();
 
 private:
+
+    //Aggregated values of one channel.
+    struct Accumulator {
+        int64_t count = 0;
+        double sum = 0;
+        double sumSquares = 0;
+        double min = 0;
+        double max = 0;
+
+        void add( double value );
+        void merge( const Accumulator& other );
+    };
+
+    std::vector<Carta::Lib::Hooks::ProfileResult> _computeNative();
+    Carta::Lib::Hooks::ProfileResult _computeHook( std::shared_ptr<Carta::Lib::Regions::RegionBase> regionInfo );
+
+    //Reads the spectra of consecutive pixels of a row (x, y, count, values).
+    typedef std::function<bool(int,int,int,std::vector<float>&)> SpectraReader;
+
+    //Aggregate the pixels of the regions channel by channel, reading them from the
+    //image or spectrum by spectrum.  The accumulators of a region are at index
+    //region * channelCount + channel.
+    void _accumulateImage( std::vector<Accumulator>& accumulators );
+    void _accumulateSpectra( const SpectraReader& reader, std::vector<Accumulator>& accumulators );
+
+    //Medians of the pixels of the regions, reading the image one channel at a time,
+    //at the same indices as the accumulators.
+    void _medianImage( std::vector<double>& medians );
+
+    //The median of the values of a channel, which are reordered.
+    static double _median( std::vector<double>& values );
+
+    //The aggregate of a channel, other than the median.
+    double _aggregate( const Accumulator& acc ) const;
+
+    //Spectral coordinates of the channels in the units of the profile, empty if they
+    //cannot be computed in-process.
+    std::vector<double> _getChannelCoordinates( int channelCount ) const;
+
     std::shared_ptr<Carta::Lib::Image::ImageInterface> m_dataSource;
-    std::shared_ptr<Carta::Lib::Regions::RegionBase> m_regionInfo;
+    std::vector<std::shared_ptr<Carta::Lib::Regions::RegionBase> > m_regionInfos;
     Carta::Lib::ProfileInfo m_profileInfo;
-    Carta::Lib::Hooks::ProfileResult m_result;
+
+    //Whether the profiles are computed in-process.
+    bool m_native;
+    std::vector<RegionMask> m_regionMasks;
+    std::shared_ptr<TransposedCube> m_transposedCube;
+    std::shared_ptr<SpectralTileCache> m_tileCache;
+    std::atomic<bool> m_cancelled;
+    int m_spectralAxis;
+    std::vector<double> m_xValues;
+    double m_restFrequency;
+    QString m_restUnits;
+
+    //Pixels per block read from the image, and per chunk of a block handed to a thread.
+    static const int64_t BLOCK_SIZE;
+    static const int64_t CHUNK_SIZE;
 
     ProfileRenderWorker( const ProfileRenderWorker& other);
     ProfileRenderWorker& operator=( const ProfileRenderWorker& other );
@@ -69,4 +155,3 @@ private:
 }
 
 
-
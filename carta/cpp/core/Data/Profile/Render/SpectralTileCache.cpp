@@ -0,0 +1,134 @@
+#include "SpectralTileCache.h"
+#include "Data/Image/TransposedCube.h"
+#include "CartaLib/IImage.h"
+#include <QDebug>
+#include <QMutexLocker>
+#include <algorithm>
+#include <limits>
+
+namespace Carta {
+
+namespace Data {
+
+const int SpectralTileCache::TILE_SIZE = 16;
+const int SpectralTileCache::MAX_BYTES = 128 * 1024 * 1024;
+
+SpectralTileCache::SpectralTileCache( std::shared_ptr<Carta::Lib::Image::ImageInterface> image,
+        int xAxis, int yAxis, int spectralAxis ) :
+    m_image( image ),
+    m_xAxis( xAxis ),
+    m_yAxis( yAxis ),
+    m_spectralAxis( spectralAxis ),
+    m_width( 0 ),
+    m_height( 0 ),
+    m_channelCount( 0 ),
+    m_tiles( MAX_BYTES ){
+    if ( TransposedCube::isSupported( m_image, m_xAxis, m_yAxis, m_spectralAxis ) ){
+        const std::vector<int>& dims = m_image->dims();
+        m_width = dims[m_xAxis];
+        m_height = dims[m_yAxis];
+        m_channelCount = dims[m_spectralAxis];
+    }
+}
+
+std::shared_ptr<Carta::Lib::Image::ImageInterface> SpectralTileCache::getImage() const {
+    return m_image;
+}
+
+int SpectralTileCache::getXAxis() const {
+    return m_xAxis;
+}
+
+int SpectralTileCache::getYAxis() const {
+    return m_yAxis;
+}
+
+int SpectralTileCache::getSpectralAxis() const {
+    return m_spectralAxis;
+}
+
+bool SpectralTileCache::readSpectra( int x, int y, int count, std::vector<float>& values ){
+    if ( m_channelCount <= 0 || x < 0 || y < 0 || count <= 0 || x + count > m_width || y >= m_height ){
+        return false;
+    }
+    values.resize( static_cast<size_t>( count ) * m_channelCount );
+    int tileY = y / TILE_SIZE;
+    int tileRow = y - tileY * TILE_SIZE;
+    int tileColumns = ( m_width + TILE_SIZE - 1 ) / TILE_SIZE;
+    QMutexLocker locker( &m_mutex );
+    int pixel = x;
+    while ( pixel < x + count ){
+        int tileX = pixel / TILE_SIZE;
+        qint64 key = static_cast<qint64>( tileY ) * tileColumns + tileX;
+        Tile* tile = m_tiles.object( key );
+        if ( tile == nullptr ){
+            tile = _readTile( tileX, tileY );
+            if ( tile == nullptr ){
+                values.clear();
+                return false;
+            }
+            //A tile bigger than the cache pushes out all the others, but is kept.
+            int cost = static_cast<int>( std::min( tile->size() * sizeof( float ),
+                    static_cast<size_t>( MAX_BYTES ) ) );
+            m_tiles.insert( key, tile, cost );
+        }
+        int tileWidth = std::min( TILE_SIZE, m_width - tileX * TILE_SIZE );
+        int last = std::min( x + count, ( tileX + 1 ) * TILE_SIZE );
+        const float* source = tile->data() +
+                ( static_cast<size_t>( tileRow ) * tileWidth + pixel - tileX * TILE_SIZE ) * m_channelCount;
+        std::copy( source, source + static_cast<size_t>( last - pixel ) * m_channelCount,
+                values.begin() + static_cast<size_t>( pixel - x ) * m_channelCount );
+        pixel = last;
+    }
+    return true;
+}
+
+SpectralTileCache::Tile* SpectralTileCache::_readTile( int tileX, int tileY ) const {
+    int firstX = tileX * TILE_SIZE;
+    int firstY = tileY * TILE_SIZE;
+    int tileWidth = std::min( TILE_SIZE, m_width - firstX );
+    int tileHeight = std::min( TILE_SIZE, m_height - firstY );
+    SliceND slice;
+    slice.slice( m_xAxis ).start( firstX ).end( firstX + tileWidth );
+    slice.slice( m_yAxis ).start( firstY ).end( firstY + tileHeight );
+    Carta::Lib::NdArray::RawViewInterface* rawView = m_image->getDataSlice( slice );
+    if ( rawView == nullptr ){
+        qWarning() << "SpectralTileCache: could not read tile "<<tileX<<","<<tileY;
+        return nullptr;
+    }
+    Carta::Lib::NdArray::Double view( rawView, true );
+    Tile* tile = new Tile( static_cast<size_t>( tileWidth ) * tileHeight * m_channelCount,
+            std::numeric_limits<float>::quiet_NaN() );
+    view.forEachBlock( [&]( const double* data, int64_t count ){
+        const std::vector<int>& blockPos = rawView->currentPos();
+        const std::vector<int>& blockDims = rawView->currentBlockDims();
+        int64_t xStride = 1;
+        int64_t yStride = 1;
+        int64_t channelStride = 1;
+        int64_t stride = 1;
+        for ( int i = 0; i < static_cast<int>( blockDims.size() ); i++ ){
+            if ( i == m_xAxis ){
+                xStride = stride;
+            }
+            else if ( i == m_yAxis ){
+                yStride = stride;
+            }
+            else if ( i == m_spectralAxis ){
+                channelStride = stride;
+            }
+            stride = stride * blockDims[i];
+        }
+        for ( int64_t i = 0; i < count; i++ ){
+            int64_t x = blockPos[m_xAxis] + ( i / xStride ) % blockDims[m_xAxis];
+            int64_t y = blockPos[m_yAxis] + ( i / yStride ) % blockDims[m_yAxis];
+            int64_t channel = blockPos[m_spectralAxis] + ( i / channelStride ) % blockDims[m_spectralAxis];
+            (*tile)[ ( y * tileWidth + x ) * m_channelCount + channel ] = data[i];
+        }
+    }, Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal );
+    return tile;
+}
+
+SpectralTileCache::~SpectralTileCache(){
+}
+}
+}
@@ -0,0 +1,113 @@
+/***
+ * Recently used spectra of small tiles of an image cube.
+ */
+
+#pragma once
+
+#include <QCache>
+#include <QMutex>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+namespace Carta {
+namespace Lib {
+namespace Image {
+class ImageInterface;
+}
+}
+
+namespace Data {
+
+/**
+ * Keeps the spectra of the most recently used tiles of an image cube in memory.
+ *
+ * A tile is TILE_SIZE x TILE_SIZE pixels with all of their channels; it is read from
+ * the image at once, the first time one of its pixels is asked for, so that following
+ * the cursor around a spot only reads the image when the cursor enters a new tile.
+ * Only cubes whose axes other than x, y and the spectral axis have a single pixel
+ * are supported.
+ */
+class SpectralTileCache {
+
+public:
+
+    /**
+     * Constructor.
+     * @param image - the image cube.
+     * @param xAxis - the index of the x axis of the image.
+     * @param yAxis - the index of the y axis of the image.
+     * @param spectralAxis - the index of the spectral axis of the image.
+     */
+    SpectralTileCache( std::shared_ptr<Carta::Lib::Image::ImageInterface> image,
+            int xAxis, int yAxis, int spectralAxis );
+
+    /**
+     * Returns the image whose spectra are cached.
+     * @return - the image cube.
+     */
+    std::shared_ptr<Carta::Lib::Image::ImageInterface> getImage() const;
+
+    /**
+     * Returns the index of the x axis.
+     * @return - the index of the x axis in the image.
+     */
+    int getXAxis() const;
+
+    /**
+     * Returns the index of the y axis.
+     * @return - the index of the y axis in the image.
+     */
+    int getYAxis() const;
+
+    /**
+     * Returns the index of the spectral axis.
+     * @return - the index of the spectral axis in the image.
+     */
+    int getSpectralAxis() const;
+
+    /**
+     * Read the spectra of consecutive pixels of a row; this can be called from any thread.
+     * @param x - the x coordinate of the first pixel.
+     * @param y - the y coordinate of the row.
+     * @param count - the number of pixels.
+     * @param values - set to the spectra, one after the other.
+     * @return - true if the spectra could be read; false otherwise.
+     */
+    bool readSpectra( int x, int y, int count, std::vector<float>& values );
+
+    /**
+     * Destructor.
+     */
+    ~SpectralTileCache();
+
+    /// the number of pixels along each side of a tile
+    static const int TILE_SIZE;
+
+private:
+
+    //Spectra of the pixels of a tile, row by row, the channels of a pixel are contiguous.
+    typedef std::vector<float> Tile;
+
+    //Read a tile from the image.
+    Tile* _readTile( int tileX, int tileY ) const;
+
+    //Memory for the cached tiles.
+    static const int MAX_BYTES;
+
+    std::shared_ptr<Carta::Lib::Image::ImageInterface> m_image;
+    int m_xAxis;
+    int m_yAxis;
+    int m_spectralAxis;
+    int m_width;
+    int m_height;
+    int m_channelCount;
+
+    QMutex m_mutex;
+    QCache<qint64,Tile> m_tiles;
+
+    SpectralTileCache( const SpectralTileCache& other);
+    SpectralTileCache& operator=( const SpectralTileCache& other );
+};
+}
+}
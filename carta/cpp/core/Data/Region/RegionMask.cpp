@@ -0,0 +1,166 @@
+#include "RegionMask.h"
+#include "Data/Util.h"
+#include "CartaLib/AxisInfo.h"
+#include "CartaLib/IImage.h"
+#include "CartaLib/Regions/IRegion.h"
+#include "CartaLib/Regions/Point.h"
+#include <QtGlobal>
+#include <algorithm>
+#include <cmath>
+
+namespace Carta {
+
+namespace Data {
+
+RegionMask::RegionMask() :
+    m_empty( false ),
+    m_xAxis( 0 ),
+    m_yAxis( 1 ),
+    m_xMin( 0 ),
+    m_xMax( -1 ),
+    m_yMin( 0 ),
+    m_yMax( -1 ){
+}
+
+bool RegionMask::setRegion( std::shared_ptr<Carta::Lib::Image::ImageInterface> image,
+        std::shared_ptr<Carta::Lib::Regions::RegionBase> region ){
+    m_mask.clear();
+    m_empty = false;
+    if ( !image ){
+        m_empty = true;
+        return false;
+    }
+    const std::vector<int>& dims = image->dims();
+    if ( dims.size() < 2 ){
+        m_xMin = 0;
+        m_xMax = -1;
+        m_yMin = 0;
+        m_yMax = -1;
+        return true;
+    }
+    m_xAxis = Util::getAxisIndex( image, Carta::Lib::AxisInfo::KnownType::DIRECTION_LON );
+    m_yAxis = Util::getAxisIndex( image, Carta::Lib::AxisInfo::KnownType::DIRECTION_LAT );
+    if ( m_xAxis < 0 || m_yAxis < 0 ){
+        m_xAxis = 0;
+        m_yAxis = 1;
+    }
+    if ( !region ){
+        m_xMin = 0;
+        m_xMax = dims[m_xAxis] - 1;
+        m_yMin = 0;
+        m_yMax = dims[m_yAxis] - 1;
+        return true;
+    }
+
+    QRectF box = region->outlineBox().normalized();
+    bool point = region->typeName() == Carta::Lib::Regions::Point::TypeName;
+    if ( point ){
+        //The box of a point only gives it a size on the screen.
+        m_xMin = qRound( box.center().x() );
+        m_xMax = m_xMin;
+        m_yMin = qRound( box.center().y() );
+        m_yMax = m_yMin;
+    }
+    else {
+        //Only the pixels whose centers lie in the bounding box can be in the region.
+        m_xMin = static_cast<int>( std::ceil( box.left() ) );
+        m_xMax = static_cast<int>( std::floor( box.right() ) );
+        m_yMin = static_cast<int>( std::ceil( box.top() ) );
+        m_yMax = static_cast<int>( std::floor( box.bottom() ) );
+    }
+    m_xMin = std::max( 0, m_xMin );
+    m_xMax = std::min( dims[m_xAxis] - 1, m_xMax );
+    m_yMin = std::max( 0, m_yMin );
+    m_yMax = std::min( dims[m_yAxis] - 1, m_yMax );
+    if ( m_xMin > m_xMax || m_yMin > m_yMax ){
+        m_empty = true;
+        return false;
+    }
+
+    int width = m_xMax - m_xMin + 1;
+    int height = m_yMax - m_yMin + 1;
+    if ( point ){
+        m_mask.assign( 1, 1 );
+        return true;
+    }
+    m_mask.assign( static_cast<size_t>( width ) * height, 0 );
+    Carta::Lib::Regions::RegionPointV pts( region->csId() + 1 );
+    bool inside = false;
+    for ( int y = 0; y < height; y++ ){
+        for ( int x = 0; x < width; x++ ){
+            std::fill( pts.begin(), pts.end(), QPointF( m_xMin + x, m_yMin + y ) );
+            if ( region->isPointInsideUnion( pts ) ){
+                m_mask[ static_cast<size_t>( y ) * width + x ] = 1;
+                inside = true;
+            }
+        }
+    }
+    m_empty = !inside;
+    return inside;
+}
+
+bool RegionMask::isAll() const {
+    return !m_empty && m_mask.empty();
+}
+
+bool RegionMask::isEmpty() const {
+    return m_empty;
+}
+
+void RegionMask::restrict( SliceND& slice ) const {
+    if ( !m_mask.empty() ){
+        slice.slice( m_xAxis ).start( m_xMin ).end( m_xMax + 1 );
+        slice.slice( m_yAxis ).start( m_yMin ).end( m_yMax + 1 );
+    }
+}
+
+bool RegionMask::contains( int64_t index, const std::vector<int>& blockPos,
+        const std::vector<int>& blockDims ) const {
+    if ( m_mask.empty() ){
+        return !m_empty;
+    }
+    int x = 0;
+    int y = 0;
+    int64_t stride = 1;
+    int lastAxis = std::max( m_xAxis, m_yAxis );
+    for ( int i = 0; i <= lastAxis; i++ ){
+        int coord = static_cast<int>( ( index / stride ) % blockDims[i] );
+        if ( i == m_xAxis ){
+            x = blockPos[i] + coord;
+        }
+        else if ( i == m_yAxis ){
+            y = blockPos[i] + coord;
+        }
+        stride = stride * blockDims[i];
+    }
+    int width = m_xMax - m_xMin + 1;
+    return m_mask[ static_cast<size_t>( y ) * width + x ] != 0;
+}
+
+bool RegionMask::containsPixel( int x, int y ) const {
+    if ( m_empty || x < m_xMin || x > m_xMax || y < m_yMin || y > m_yMax ){
+        return false;
+    }
+    if ( m_mask.empty() ){
+        return true;
+    }
+    int width = m_xMax - m_xMin + 1;
+    return m_mask[ static_cast<size_t>( y - m_yMin ) * width + x - m_xMin ] != 0;
+}
+
+QRect RegionMask::getBounds() const {
+    if ( m_empty ){
+        return QRect();
+    }
+    return QRect( QPoint( m_xMin, m_yMin ), QPoint( m_xMax, m_yMax ) );
+}
+
+int RegionMask::getXAxis() const {
+    return m_xAxis;
+}
+
+int RegionMask::getYAxis() const {
+    return m_yAxis;
+}
+}
+}
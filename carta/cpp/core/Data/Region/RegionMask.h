@@ -0,0 +1,123 @@
+/***
+ * Snapshot of the pixels of an image that lie in a region.
+ */
+
+#pragma once
+
+#include "CartaLib/Slice.h"
+#include <QRect>
+#include <memory>
+#include <vector>
+
+namespace Carta {
+namespace Lib {
+namespace Image {
+class ImageInterface;
+}
+namespace Regions {
+class RegionBase;
+}
+}
+
+namespace Data {
+
+/**
+ * The pixels of an image that lie in a region, stored as a mask over the bounding
+ * box of the region.
+ *
+ * Regions are edited on the GUI thread, so computations on worker threads should take
+ * a snapshot of the region with this class when they are scheduled, and only use the
+ * snapshot afterwards.  A pixel is in the region if its center is; a point region
+ * selects the pixel nearest to it.
+ */
+class RegionMask {
+
+public:
+
+    /**
+     * Constructor.
+     */
+    RegionMask();
+
+    /**
+     * Take a snapshot of a region.
+     * @param image - the image whose pixels are selected.
+     * @param region - the region in pixel coordinates of the image, or nullptr to
+     *      select the whole image.
+     * @return - true if the region selects at least one pixel; false otherwise.
+     */
+    bool setRegion( std::shared_ptr<Carta::Lib::Image::ImageInterface> image,
+            std::shared_ptr<Carta::Lib::Regions::RegionBase> region );
+
+    /**
+     * Returns whether or not the whole image is selected.
+     * @return - true if there is no region; false otherwise.
+     */
+    bool isAll() const;
+
+    /**
+     * Returns whether or not no pixel is selected.
+     * @return - true if the region misses the image; false otherwise.
+     */
+    bool isEmpty() const;
+
+    /**
+     * Restrict a slice to the bounding box of the region.
+     * @param slice - the slice to restrict, only the slices of the x and y axes are set.
+     */
+    void restrict( SliceND& slice ) const;
+
+    /**
+     * Returns whether or not a pixel of a block read from a view made with restrict()
+     * is in the region.
+     * @param index - the index of the pixel in the block, the first axis varies fastest.
+     * @param blockPos - the position of the block in the view.
+     * @param blockDims - the dimensions of the block.
+     * @return - true if the pixel is in the region; false otherwise.
+     */
+    bool contains( int64_t index, const std::vector<int>& blockPos,
+            const std::vector<int>& blockDims ) const;
+
+    /**
+     * Returns whether or not a pixel of the image is in the region.
+     * @param x - the x coordinate of the pixel in the image.
+     * @param y - the y coordinate of the pixel in the image.
+     * @return - true if the pixel is in the region; false otherwise.
+     */
+    bool containsPixel( int x, int y ) const;
+
+    /**
+     * Returns the pixels of the image that may be in the region.
+     * @return - the bounding box of the region in the image, which is the whole image
+     *      if there is no region, or an empty rectangle if no pixel is selected.
+     */
+    QRect getBounds() const;
+
+    /**
+     * Returns the index of the x (direction longitude) axis.
+     * @return - the index of the x axis in the image.
+     */
+    int getXAxis() const;
+
+    /**
+     * Returns the index of the y (direction latitude) axis.
+     * @return - the index of the y axis in the image.
+     */
+    int getYAxis() const;
+
+private:
+
+    //Mask over the bounding box, which is where restricted slices start on the x and
+    //y axes, so view coordinates index it directly.  It is empty if there is no region,
+    //in which case the box is the whole image.
+    std::vector<char> m_mask;
+    bool m_empty;
+    int m_xAxis;
+    int m_yAxis;
+    int m_xMin;
+    int m_xMax;
+    int m_yMin;
+    int m_yMax;
+};
+}
+}
@@ -4,12 +4,18 @@
 
 #include "DefaultContourGeneratorService.h"
 #include "CartaLib/Algorithms/ContourConrec.h"
+#include <cmath>
+#include <memory>
 #include <utility>
 
 namespace Carta
 {
 namespace Core
 {
+/// the visible part of the input is widened to multiples of this many pixels, so that
+/// small pans contour the same region
+static const int REGION_TILE = 256;
+
 DefaultContourGeneratorService::DefaultContourGeneratorService( QObject * parent )
     : Lib::IContourGeneratorService( parent )
 {
@@ -26,8 +32,80 @@ DefaultContourGeneratorService::setLevels( const std::vector < double > & levels
 
 void
 DefaultContourGeneratorService::setInput( Carta::Lib::NdArray::RawViewInterface::SharedPtr rawView )
+{
+    setInput( rawView, QString() );
+}
+
+void
+DefaultContourGeneratorService::setInput( Carta::Lib::NdArray::RawViewInterface::SharedPtr rawView,
+                                          const QString & viewId )
 {
     m_rawView = rawView;
+    if ( viewId.isEmpty() || viewId != m_viewId || ! m_pyramid ) {
+        m_pyramid = nullptr;
+        if ( m_rawView && m_rawView-> dims().size() >= 2 ) {
+            m_pyramid = std::make_shared < Algorithms::MipmapPyramid > ( m_rawView );
+        }
+    }
+    m_viewId = viewId;
+}
+
+void
+DefaultContourGeneratorService::setViewport( const QRectF & imageRect, double zoom )
+{
+    m_viewRect = imageRect.normalized();
+    m_zoom = zoom;
+}
+
+QRect
+DefaultContourGeneratorService::_getFrameRect() const
+{
+    QRect frame;
+    if ( m_rawView && m_rawView-> dims().size() >= 2 ) {
+        frame = QRect( 0, 0, m_rawView-> dims()[0], m_rawView-> dims()[1] );
+    }
+    return frame;
+}
+
+void
+DefaultContourGeneratorService::_getDetail( int & factor, QRect & region ) const
+{
+    factor = 1;
+    region = _getFrameRect();
+    if ( ! m_pyramid || m_zoom <= 0 ) {
+        return;
+    }
+
+    // zoomed out, one pixel of the downsampled copy per screen pixel is enough
+    factor = m_pyramid-> factorForZoom( m_zoom );
+    if ( factor > 1 || ! m_viewRect.isValid() ) {
+        return;
+    }
+
+    // zoomed in, only the visible part (plus the pixels around it, whose cells reach
+    // into it) is needed
+    int left = std::floor( ( m_viewRect.left() - 1 ) / REGION_TILE ) * REGION_TILE;
+    int top = std::floor( ( m_viewRect.top() - 1 ) / REGION_TILE ) * REGION_TILE;
+    int right = std::ceil( ( m_viewRect.right() + 2 ) / REGION_TILE ) * REGION_TILE;
+    int bottom = std::ceil( ( m_viewRect.bottom() + 2 ) / REGION_TILE ) * REGION_TILE;
+    region = region.intersected( QRect( QPoint( left, top ), QPoint( right - 1, bottom - 1 ) ) );
+}
+
+QString
+DefaultContourGeneratorService::detailId() const
+{
+    int factor;
+    QRect region;
+    _getDetail( factor, region );
+    QString id;
+    if ( factor > 1 ) {
+        id = QString( "f%1" ).arg( factor );
+    }
+    else if ( region != _getFrameRect() ) {
+        id = QString( "r%1,%2,%3,%4" ).arg( region.left() ).arg( region.top() )
+                 .arg( region.width() ).arg( region.height() );
+    }
+    return id;
 }
 
 Lib::IContourGeneratorService::JobId
@@ -48,10 +126,37 @@ DefaultContourGeneratorService::start( Lib::IContourGeneratorService::JobId jobI
 void
 DefaultContourGeneratorService::timerCB()
 {
-    // run the contour algorithm
+    // run the contour algorithm, at the resolution and on the part of the input that
+    // is visible
+    int factor;
+    QRect region;
+    _getDetail( factor, region );
     Carta::Lib::Algorithms::ContourConrec cc;
     cc.setLevels( m_levels);
-    auto rawContours = cc.compute( m_rawView.get() );
+    Carta::Lib::Algorithms::ContourConrec::Result rawContours;
+    if ( factor > 1 ) {
+        // a pixel of the copy is centred on the pixels it was computed from
+        const Algorithms::MipmapPyramid::Level & level = m_pyramid-> level( factor );
+        cc.setTransform( QPointF( ( factor - 1 ) / 2.0, ( factor - 1 ) / 2.0 ), factor );
+        rawContours = cc.compute( & level.data[0], level.size.width(), level.size.height() );
+    }
+    else if ( region != _getFrameRect() ) {
+        if ( region.isEmpty() ) {
+            rawContours.resize( m_levels.size() );
+        }
+        else {
+            SliceND slice;
+            slice.slice( 0 ).start( region.left() ).end( region.right() + 1 );
+            slice.slice( 1 ).start( region.top() ).end( region.bottom() + 1 );
+            std::unique_ptr < Carta::Lib::NdArray::RawViewInterface > view(
+                m_rawView-> getView( slice ) );
+            cc.setTransform( QPointF( region.left(), region.top() ), 1 );
+            rawContours = cc.compute( view.get() );
+        }
+    }
+    else {
+        rawContours = cc.compute( m_rawView.get() );
+    }
 
     // build the result
     Result result;
@@ -4,8 +4,11 @@
 
 #pragma once
 #include "CartaLib/IContourGeneratorService.h"
+#include "Algorithms/MipmapPyramid.h"
 
 #include <QObject>
+#include <QRect>
+#include <QRectF>
 #include <QTimer>
 
 namespace Carta
@@ -29,6 +32,25 @@ public:
     virtual void
     setInput( Carta::Lib::NdArray::RawViewInterface::SharedPtr rawView ) override;
 
+    /// set the input, the downsampled copies made for an earlier input with the same
+    /// (non-empty) id are kept
+    void
+    setInput( Carta::Lib::NdArray::RawViewInterface::SharedPtr rawView, const QString & viewId );
+
+    /// set the part of the input that is on screen and how much it is zoomed, so that
+    /// contours match the screen resolution: when zoomed out they are computed on a
+    /// downsampled copy of the whole input, when zoomed in only for the visible part
+    /// \param imageRect the visible part of the input, in pixel coordinates
+    /// \param zoom how many screen pixels a pixel of the input occupies, <= 0 for the
+    /// whole input at full resolution
+    void
+    setViewport( const QRectF & imageRect, double zoom );
+
+    /// returns an identifier of the resolution and the part of the input that the next
+    /// job will contour, it is empty for the whole input at full resolution
+    QString
+    detailId() const;
+
     virtual JobId
     start( JobId jobId ) override;
 
@@ -40,11 +62,28 @@ private slots:
 
 private:
 
+    /// works out the downsampling factor (a power of 2) and the part of the input that
+    /// will be contoured (all of it unless the factor is 1)
+    void
+    _getDetail( int & factor, QRect & region ) const;
+
+    /// whole input region
+    QRect
+    _getFrameRect() const;
+
     std::vector < double > m_levels;
     JobId m_lastJobId = - 1;
     Carta::Lib::NdArray::RawViewInterface::SharedPtr m_rawView = nullptr;
+    QString m_viewId;
     QTimer m_timer;
 
+    /// visible part of the input and its zoom
+    QRectF m_viewRect;
+    double m_zoom = 0;
+
+    /// downsampled copies of the input
+    Algorithms::MipmapPyramid::SharedPtr m_pyramid = nullptr;
+
 };
 }
 }
@@ -0,0 +1,183 @@
+/**
+ *
+ **/
+
+#include "FrameCache.h"
+#include <algorithm>
+
+namespace Carta
+{
+namespace Core
+{
+namespace ImageRenderService
+{
+namespace
+{
+/// mix hash h into seed
+inline uint
+combineHash( uint seed, uint h )
+{
+    return seed ^ ( h + 0x9e3779b9 + ( seed << 6 ) + ( seed >> 2 ) );
+}
+}
+
+bool
+FrameCacheKey::operator== ( const FrameCacheKey & other ) const
+{
+    return viewId == other.viewId
+           && pipelineId == other.pipelineId
+           && outputSize == other.outputSize
+           && pan.x() == other.pan.x()
+           && pan.y() == other.pan.y()
+           && zoom == other.zoom
+           && nanColor == other.nanColor
+           && mipmapDecimation == other.mipmapDecimation
+           && pipelineCacheSize == other.pipelineCacheSize
+           && pipelineCacheInterpolated == other.pipelineCacheInterpolated;
+}
+
+uint
+qHash( const FrameCacheKey & key, uint seed )
+{
+    // the global qHash() overloads are hidden by this one, hence the ::
+    uint h = seed;
+    h = combineHash( h, ::qHash( key.viewId ) );
+    h = combineHash( h, ::qHash( key.pipelineId ) );
+    h = combineHash( h, ::qHash( key.outputSize.width() ) );
+    h = combineHash( h, ::qHash( key.outputSize.height() ) );
+    h = combineHash( h, ::qHash( key.pan.x() ) );
+    h = combineHash( h, ::qHash( key.pan.y() ) );
+    h = combineHash( h, ::qHash( key.zoom ) );
+    h = combineHash( h, ::qHash( key.nanColor ) );
+    h = combineHash( h, ::qHash( key.mipmapDecimation ) );
+    h = combineHash( h, ::qHash( key.pipelineCacheSize ) );
+    h = combineHash( h, ::qHash( int (key.pipelineCacheInterpolated) ) );
+    return h;
+}
+
+double
+FrameCache::Stats::hitRatio() const
+{
+    int64_t lookups = hits + misses;
+    return lookups > 0 ? double (hits) / lookups : 0.0;
+}
+
+QString
+FrameCache::Stats::toString() const
+{
+    return QString( "frames=%1 MB=%2/%3 hits=%4 misses=%5 hitRatio=%6 insertions=%7 evictions=%8" )
+               .arg( count )
+               .arg( bytes / double (1024 * 1024), 0, 'f', 1 )
+               .arg( maxBytes / double (1024 * 1024), 0, 'f', 1 )
+               .arg( hits )
+               .arg( misses )
+               .arg( hitRatio(), 0, 'f', 3 )
+               .arg( insertions )
+               .arg( evictions );
+}
+
+FrameCache::FrameCache( int64_t maxBytes )
+{
+    m_maxBytes = std::max < int64_t > ( maxBytes, 0 );
+}
+
+void
+FrameCache::setMaxBytes( int64_t maxBytes )
+{
+    m_maxBytes = std::max < int64_t > ( maxBytes, 0 );
+    _evict( m_maxBytes );
+}
+
+int64_t
+FrameCache::maxBytes() const
+{
+    return m_maxBytes;
+}
+
+bool
+FrameCache::find( const FrameCacheKey & key, QImage & image )
+{
+    auto it = m_index.find( key );
+    if ( it == m_index.end() ) {
+        m_stats.misses++;
+        return false;
+    }
+    m_stats.hits++;
+
+    // move the entry to the front
+    m_entries.splice( m_entries.begin(), m_entries, it.value() );
+    image = it.value()-> image;
+    return true;
+}
+
+void
+FrameCache::insert( const FrameCacheKey & key, const QImage & image )
+{
+    auto it = m_index.find( key );
+    if ( it != m_index.end() ) {
+        m_bytes -= it.value()-> bytes;
+        m_entries.erase( it.value() );
+        m_index.erase( it );
+    }
+
+    int64_t bytes = _cost( key, image );
+    if ( bytes > m_maxBytes ) {
+        return;
+    }
+    _evict( m_maxBytes - bytes );
+    m_entries.push_front( Entry { key, image, bytes } );
+    m_index.insert( key, m_entries.begin() );
+    m_bytes += bytes;
+    m_stats.insertions++;
+}
+
+void
+FrameCache::clear()
+{
+    m_entries.clear();
+    m_index.clear();
+    m_bytes = 0;
+}
+
+FrameCache::Stats
+FrameCache::stats() const
+{
+    Stats result = m_stats;
+    result.count = m_entries.size();
+    result.bytes = m_bytes;
+    result.maxBytes = m_maxBytes;
+    return result;
+}
+
+void
+FrameCache::resetStats()
+{
+    m_stats = Stats();
+}
+
+void
+FrameCache::_evict( int64_t maxBytes )
+{
+    while ( m_bytes > maxBytes && ! m_entries.empty() ) {
+        const Entry & entry = m_entries.back();
+        m_bytes -= entry.bytes;
+        m_index.remove( entry.key );
+        m_entries.pop_back();
+        m_stats.evictions++;
+    }
+}
+
+int64_t
+FrameCache::_cost( const FrameCacheKey & key, const QImage & image )
+{
+    int64_t bytes = int64_t( image.bytesPerLine() ) * image.height();
+
+    // the key is stored twice (in the entry and in the index)
+    bytes += 2 * ( sizeof( FrameCacheKey )
+                   + ( key.viewId.size() + key.pipelineId.size() ) * sizeof( QChar ) );
+    bytes += sizeof( Entry );
+    return bytes;
+}
+}
+}
+}
@@ -0,0 +1,159 @@
+/**
+ * Cache of rendered frames used by the image render service.
+ **/
+
+#pragma once
+
+#include "CartaLib/CartaLib.h"
+#include <QHash>
+#include <QImage>
+#include <QPointF>
+#include <QSize>
+#include <QString>
+#include <cstdint>
+#include <list>
+
+namespace Carta
+{
+namespace Core
+{
+namespace ImageRenderService
+{
+/// everything that determines the contents of a rendered frame
+struct FrameCacheKey {
+    /// cache id of the input view
+    QString viewId;
+
+    /// cache id of the pixel pipeline
+    QString pipelineId;
+
+    QSize outputSize;
+    QPointF pan;
+    double zoom = 1.0;
+    QRgb nanColor = 0;
+
+    /// MipmapPyramid::Decimation used for zoomed out frames
+    int mipmapDecimation = 0;
+
+    /// pixel pipeline cache settings (size is 0 if the pipeline cache is disabled)
+    int pipelineCacheSize = 0;
+    bool pipelineCacheInterpolated = false;
+
+    bool
+    operator== ( const FrameCacheKey & other ) const;
+
+    bool
+    operator!= ( const FrameCacheKey & other ) const
+    {
+        return ! ( * this == other );
+    }
+};
+
+/// hash for FrameCacheKey, so that it can be used in QHash
+uint
+qHash( const FrameCacheKey & key, uint seed = 0 );
+
+/// Least recently used cache of rendered frames, limited by the number of bytes the
+/// frames occupy (unlike QCache, whose int costs overflow at 2GB).
+///
+/// It counts hits, misses and evictions, so that the size can be tuned (see
+/// "frameCacheSizeMB" in the main config).
+///
+/// \note not thread safe, it is meant to be used from the thread the service lives in
+class FrameCache
+{
+    CLASS_BOILERPLATE( FrameCache );
+
+public:
+
+    /// counters and current usage of the cache
+    struct Stats {
+        int64_t hits = 0;
+        int64_t misses = 0;
+        int64_t insertions = 0;
+        int64_t evictions = 0;
+
+        /// number of frames in the cache
+        int64_t count = 0;
+
+        /// bytes used by the frames in the cache
+        int64_t bytes = 0;
+        int64_t maxBytes = 0;
+
+        /// hits / ( hits + misses ), 0 if there were no lookups
+        double
+        hitRatio() const;
+
+        /// human readable summary, for logging
+        QString
+        toString() const;
+    };
+
+    /// \param maxBytes the most bytes the cached frames can occupy
+    explicit
+    FrameCache( int64_t maxBytes );
+
+    /// change the size of the cache, evicting frames if necessary
+    void
+    setMaxBytes( int64_t maxBytes );
+
+    /// returns the size of the cache in bytes
+    int64_t
+    maxBytes() const;
+
+    /// looks up the frame and marks it as the most recently used one
+    /// \param key what to look for
+    /// \param[out] image the frame, if found
+    /// \return whether the frame was found (counted as a hit or a miss)
+    bool
+    find( const FrameCacheKey & key, QImage & image );
+
+    /// inserts the frame (replacing any frame with the same key), evicting the least
+    /// recently used frames to make room for it. Frames that would not fit into an
+    /// empty cache are not inserted.
+    void
+    insert( const FrameCacheKey & key, const QImage & image );
+
+    /// removes all frames, the counters are kept
+    void
+    clear();
+
+    /// returns the counters and current usage
+    Stats
+    stats() const;
+
+    /// zero the hit/miss/insertion/eviction counters
+    void
+    resetStats();
+
+private:
+
+    struct Entry {
+        FrameCacheKey key;
+        QImage image;
+        int64_t bytes;
+    };
+
+    typedef std::list < Entry > EntryList;
+
+    /// evict least recently used frames until at most maxBytes are used
+    void
+    _evict( int64_t maxBytes );
+
+    /// bytes occupied by an entry
+    static int64_t
+    _cost( const FrameCacheKey & key, const QImage & image );
+
+    /// entries, most recently used first
+    EntryList m_entries;
+
+    /// where to find the entry for a key in m_entries
+    QHash < FrameCacheKey, EntryList::iterator > m_index;
+
+    int64_t m_bytes = 0;
+    int64_t m_maxBytes = 0;
+    Stats m_stats;
+};
+}
+}
+}
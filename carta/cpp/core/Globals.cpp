@@ -6,6 +6,7 @@
 #include "IConnector.h"
 #include "IPlatform.h"
 #include "PluginManager.h"
+#include "CartaLib/Hooks/GetPersistentCache.h"
 
 Globals * Globals::m_instance = nullptr;
 
@@ -64,6 +65,21 @@ void Globals::setMainConfig(const MainConfig::ParsedInfo * mainConfig)
     m_mainConfig = mainConfig;
 }
 
+Carta::Lib::IPCache::SharedPtr Globals::pcache()
+{
+    // plugins are only asked once
+    if( ! m_pcacheQueried) {
+        m_pcacheQueried = true;
+        auto res = pluginManager()-> prepare < Carta::Lib::Hooks::GetPersistentCache > ().first();
+        if( ! res.isNull()) {
+            m_pcache = res.val();
+        }
+        if( ! m_pcache) {
+            qWarning( "No persistent cache available" );
+        }
+    }
+    return m_pcache;
+}
 
 Globals::Globals()
 {
@@ -13,6 +13,7 @@
 #pragma once
 
 #include "PluginManager.h"
+#include "CartaLib/IPCache.h"
 
 class IConnector;
 class IPlatform;
@@ -55,6 +56,10 @@ public:
     const MainConfig::ParsedInfo * mainConfig() const;
     void setMainConfig(const MainConfig::ParsedInfo * mainConfig);
 
+    /// get the persistent cache (from the first plugin that provides one),
+    /// nullptr if no plugin does
+    Carta::Lib::IPCache::SharedPtr pcache();
+
 protected:
 
 //    PluginManager * m_pluginManager = nullptr;
@@ -63,6 +68,8 @@ protected:
     IConnector * m_connector = nullptr;
     const CmdLine::ParsedInfo * m_cmdLineInfo = nullptr;
     const MainConfig::ParsedInfo * m_mainConfig = nullptr;
+    Carta::Lib::IPCache::SharedPtr m_pcache = nullptr;
+    bool m_pcacheQueried = false;
 
     static Globals * m_instance;
 
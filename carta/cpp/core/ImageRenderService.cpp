@@ -3,9 +3,20 @@
  **/
 
 #include "ImageRenderService.h"
+#include "Globals.h"
+#include "MainConfig.h"
 #include "CartaLib/LinearMap.h"
+#include "CartaLib/Algorithms/ParallelFor.h"
 #include <QColor>
 #include <QPainter>
+#include <QRunnable>
+#include <QMutexLocker>
+#include <algorithm>
+#include <atomic>
+#include <cmath>
+#include <memory>
+#include <functional>
+#include <type_traits>
 
 namespace NdArray = Carta::Lib::NdArray;
 
@@ -19,23 +30,19 @@ static constexpr QImage::Format OptimalQImageFormat = QImage::Format_ARGB32_Prem
 /// \todo check if the bug is still there in Qt5.4+, it definitely is there in Qt5.3
 static constexpr bool QtPremultipliedBugStillExists = true;
 
-/// internal algorithm for converting an instance of image interface to qimage
-/// using the pixel pipeline
-///
-/// \tparam Pipeline
-/// \param m_rawView
-/// \param pipe
-/// \param m_qImage
-template < class Pipeline >
-static void
-iView2qImage( NdArray::RawViewInterface * rawView, Pipeline & pipe, QImage & qImage,
-        QRgb nanColor)
-{
-    //qDebug() << "rv2qi2" << rawView-> dims();
-    typedef double Scalar;
+/// size of the frame cache, unless "frameCacheSizeMB" is set in the main config
+static constexpr int64_t DefaultFrameCacheBytes = int64_t( 1024 ) * 1024 * 1024;
 
-    QSize size( rawView->dims()[0], rawView->dims()[1] );
+/// thrown from inside the render loops when the job was superseded by a newer one
+struct RenderCancelled { };
 
+/// flag set by the service when a render job is no longer needed
+typedef std::atomic < bool > CancelFlag;
+
+/// make sure qImage has the given size and the format we render into
+static void
+prepareQImage( QSize size, QImage & qImage )
+{
     QImage::Format desiredFormat = OptimalQImageFormat;
     if ( QtPremultipliedBugStillExists ) {
         desiredFormat = QImage::Format_ARGB32;
@@ -49,63 +56,494 @@ iView2qImage( NdArray::RawViewInterface * rawView, Pipeline & pipe, QImage & qIm
     auto bytesPerLine = qImage.bytesPerLine();
     CARTA_ASSERT( bytesPerLine == size.width() * 4 );
     Q_UNUSED( bytesPerLine );
+}
+
+/// pipelines that can be used from several threads at once: the cached pipelines are
+/// read-only lookup tables, so all workers can share one, but we don't know anything
+/// about the raw pipelines, so those are only used from a single thread
+template < class Pipeline >
+struct IsThreadSafePipeline : std::false_type { };
+
+template < bool interpolated >
+struct IsThreadSafePipeline < Carta::Lib::PixelPipeline::CachedPipeline < interpolated > >
+    : std::true_type { };
+
+/// how many pixels are colormapped by a single task at least
+static constexpr int64_t PixelsPerTask = 64 * 1024;
+
+/// how many pixels are read from the view at once
+static constexpr int64_t PixelsPerBand = 4 * 1024 * 1024;
+
+/// colormap nRows rows of data (in sequential order, i.e. bottom row first),
+/// starting at image row firstRow
+template < class Pipeline, typename Scalar >
+static void
+colormapRows( const Scalar * data, int width, int height, int64_t firstRow, int64_t nRows,
+              Pipeline & pipe, uchar * bits, int bytesPerLine, QRgb nanColor )
+{
+    for ( int64_t r = 0 ; r < nRows ; ++r ) {
+        const Scalar * src = data + r * width;
 
-    // start with a pointer to the beginning of last row (we are constructing image
-    // bottom-up)
-    QRgb * outPtr = reinterpret_cast < QRgb * > (
-        qImage.bits() + size.width() * ( size.height() - 1 ) * 4 );
+        // build the image bottom-up
+        QRgb * outPtr = reinterpret_cast < QRgb * > (
+            bits + ( height - 1 - firstRow - r ) * bytesPerLine );
+        pipe.convertqBatch( src, width, outPtr, nanColor );
+    }
+} // colormapRows
 
-    if( 0) {
-        CARTA_ASSERT( qImage.bits() + size.width() * (size.height() - 1) * 4 == qImage.scanLine( size.height() - 1));
-        // sanity check
-        for( int y = 0 ; y < size.height() ; y ++ ) {
-            CARTA_ASSERT( qImage.bits() + size.width() * 4 * y == qImage.scanLine(y) );
+/// colormapRows() split into tasks for the thread pool, each task writes its own
+/// scanlines of the image
+template < class Pipeline, typename Scalar >
+static void
+colormapRowsParallel( const Scalar * data, int width, int height, int64_t firstRow,
+                      int64_t nRows, Pipeline & pipe, uchar * bits, int bytesPerLine,
+                      QRgb nanColor, std::true_type )
+{
+    int64_t rowsPerTask = PixelsPerTask;
+    rowsPerTask = std::max < int64_t > ( 1, rowsPerTask / width );
+    Carta::Lib::Algorithms::parallelFor(
+        0, nRows, rowsPerTask,
+        [&] ( int64_t r1, int64_t r2 ) {
+            colormapRows( data + r1 * width, width, height, firstRow + r1, r2 - r1,
+                          pipe, bits, bytesPerLine, nanColor );
         }
+        );
+}
+
+/// single threaded version of the above for pipelines that are not thread safe
+template < class Pipeline, typename Scalar >
+static void
+colormapRowsParallel( const Scalar * data, int width, int height, int64_t firstRow,
+                      int64_t nRows, Pipeline & pipe, uchar * bits, int bytesPerLine,
+                      QRgb nanColor, std::false_type )
+{
+    colormapRows( data, width, height, firstRow, nRows, pipe, bits, bytesPerLine, nanColor );
+}
+
+/// internal algorithm for converting an instance of image interface to qimage
+/// using the pixel pipeline
+///
+/// \tparam Pipeline
+/// \param rawView
+/// \param pipe
+/// \param qImage
+/// \param cancelled if set (checked once per band), RenderCancelled is thrown
+template < class Pipeline >
+static void
+iView2qImage( NdArray::RawViewInterface * rawView, Pipeline & pipe, QImage & qImage,
+        QRgb nanColor, const CancelFlag & cancelled )
+{
+    //qDebug() << "rv2qi2" << rawView-> dims();
+    typedef double Scalar;
+
+    QSize size( rawView->dims()[0], rawView->dims()[1] );
+    prepareQImage( size, qImage );
+    int width = size.width();
+    int height = size.height();
+    if ( width < 1 || height < 1 ) {
+        return;
     }
 
+    // get the pointer once, scanLine() is not something to call from several threads
+    uchar * bits = qImage.bits();
+    int bytesPerLine = qImage.bytesPerLine();
+
     // make a double view
     NdArray::TypedView < Scalar > typedView( rawView, false );
 
-    /// @todo for more efficiency, instead of forEach() we should switch to one of the
-    /// higher performance APIs and maybe even sprinkle it with some openmp/cilk magic :)
-    int64_t counter = 0;
-
+    // The view is read sequentially (views are not thread safe), one band of rows at
+    // a time, and then the rows of each band are colormapped in parallel.
+    int64_t bandRows = PixelsPerBand;
+    bandRows = std::max < int64_t > ( 1, bandRows / width );
+    std::vector < Scalar > band;
+    int64_t bandFill = 0;
+    int64_t row = 0;
+    auto processRows = [&] ( const Scalar * data, int64_t nRows ) {
+        if ( cancelled ) {
+            throw RenderCancelled();
+        }
+        colormapRowsParallel( data, width, height, row, nRows, pipe, bits, bytesPerLine,
+                              nanColor, IsThreadSafePipeline < Pipeline > () );
+        row += nRows;
+    };
 
-    auto lambda = [&] ( const Scalar & ival )
+    // blocks arrive in sequential order, but they do not need to line up with rows
+    auto lambda = [&] ( const Scalar * data, int64_t count )
     {
-        if ( Q_LIKELY( ! std::isnan( ival ) ) ) {
-            pipe.convertq( ival, * outPtr );
+        // blocks of whole rows are colormapped where they are
+        if ( bandFill == 0 && count % width == 0 ) {
+            processRows( data, count / width );
+            return;
         }
-        else {
-            * outPtr = nanColor;
-        }
-        outPtr++;
-        counter++;
 
-        // build the image bottom-up
-        if ( counter % size.width() == 0 ) {
-            outPtr -= size.width() * 2;
+        // anything else is collected into a band first
+        if ( band.empty() ) {
+            band.resize( bandRows * width );
+        }
+        while ( count > 0 ) {
+            int64_t n = std::min < int64_t > ( count, band.size() - bandFill );
+            std::copy( data, data + n, & band[bandFill] );
+            data += n;
+            count -= n;
+            bandFill += n;
+            if ( bandFill == int64_t( band.size() ) ) {
+                processRows( & band[0], bandRows );
+                bandFill = 0;
+            }
         }
     };
-    typedView.forEach( lambda );
+    typedView.forEachBlock( lambda, NdArray::RawViewInterface::Traversal::Sequential,
+                            bandRows * width );
+    if ( bandFill > 0 ) {
+        CARTA_ASSERT( bandFill % width == 0 );
+        processRows( & band[0], bandFill / width );
+    }
 
-    CARTA_ASSERT( counter == size.width() * size.height());
+    CARTA_ASSERT( row == height );
 
 } // rawView2QImage
 
+/// same as iView2qImage(), but for a level of the mipmap pyramid
+template < class Pipeline >
+static void
+mipmap2qImage( const Carta::Core::Algorithms::MipmapPyramid::Level & level, Pipeline & pipe,
+               QImage & qImage, QRgb nanColor )
+{
+    prepareQImage( level.size, qImage );
+    if ( level.data.empty() ) {
+        return;
+    }
+    colormapRowsParallel( & level.data[0], level.size.width(), level.size.height(), 0,
+                          level.size.height(), pipe, qImage.bits(), qImage.bytesPerLine(),
+                          nanColor, IsThreadSafePipeline < Pipeline > () );
+} // mipmap2qImage
+
+/// render the frame either from the view, or if level is not null, from the level
+template < class Pipeline >
+static void
+renderFrame( NdArray::RawViewInterface * rawView,
+             const Carta::Core::Algorithms::MipmapPyramid::Level * level,
+             Pipeline & pipe, QImage & qImage, QRgb nanColor, const CancelFlag & cancelled )
+{
+    if ( level ) {
+        mipmap2qImage( * level, pipe, qImage, nanColor );
+    }
+    else {
+        iView2qImage( rawView, pipe, qImage, nanColor, cancelled );
+    }
+}
+
+/// image to screen coordinates for the given pan/zoom/output size
+static QPointF
+image2screenImpl( const QPointF & p, const QPointF & pan, double zoom, const QSize & outputSize )
+{
+    double icx = pan.x();
+    double scx = outputSize.width() / 2.0;
+    double icy = pan.y();
+    double scy = outputSize.height() / 2.0;
+
+    /// \todo cache xmap/ymap, update with zoom/pan/resize
+    Carta::Lib::LinearMap1D xmap( scx, scx + zoom, icx, icx + 1 );
+    Carta::Lib::LinearMap1D ymap( scy, scy + zoom, icy, icy - 1 );
+    QPointF res;
+    res.rx() = xmap.inv( p.x() );
+    res.ry() = ymap.inv( p.y() );
+    return res;
+}
+
+/// inverse of image2screenImpl()
+static QPointF
+screen2imageImpl( const QPointF & p, const QPointF & pan, double zoom, const QSize & outputSize )
+{
+    double icx = pan.x();
+    double scx = outputSize.width() / 2.0;
+    double icy = pan.y();
+    double scy = outputSize.height() / 2.0;
+
+    /// \todo cache xmap/ymap, update with zoom/pan/resize
+    Carta::Lib::LinearMap1D xmap( scx, scx + zoom, icx, icx + 1 );
+    Carta::Lib::LinearMap1D ymap( scy, scy + zoom, icy, icy - 1 );
+    QPointF res;
+    res.rx() = xmap.apply( p.x() );
+    res.ry() = ymap.apply( p.y() );
+    return res;
+}
+
 namespace Carta
 {
 namespace Core
 {
 namespace ImageRenderService
 {
+/// The full frame rendered for one combination of input view, pixel pipeline and mipmap
+/// level. It is shared by the render jobs, so that a job can reuse the frame rendered
+/// by the job before it. The service starts a new one whenever the inputs change.
+struct FrameStore {
+    QMutex mutex;
+
+    /// the frame, null if not rendered yet
+    QImage image;
+
+    /// factor of the mipmap level the image was rendered from (1 = full resolution)
+    int mipmapFactor = 1;
+};
+
+/// Snapshot of everything needed to render one output image. It is filled in by the
+/// service and then rendered on the render thread, so it must not refer to anything
+/// the service modifies in the meantime.
+struct RenderJob {
+    JobId jobId = - 1;
+
+    /// frame cache key of the result
+    FrameCacheKey cacheKey;
+
+    /// the service's render view, jobs run one at a time, so they can share it
+    NdArray::RawViewInterface::SharedPtr view = nullptr;
+
+    /// the pipeline to use, the cached ones take precedence over the raw one
+    IClippedPixelPipeline::SharedPtr pipelineRaw = nullptr;
+    Lib::PixelPipeline::CachedPipeline < true >::SharedPtr cachedPPinterp = nullptr;
+    Lib::PixelPipeline::CachedPipeline < false >::SharedPtr cachedPP = nullptr;
+
+    /// where to render the frame from when mipmapFactor > 1
+    Algorithms::MipmapPyramid::SharedPtr pyramid = nullptr;
+    int mipmapFactor = 1;
+
+    std::shared_ptr < FrameStore > frame = nullptr;
+
+    QSize outputSize;
+    QPointF pan;
+    double zoom = 1.0;
+    QRgb nanColor = 0;
+
+    /// set by the service when the job is superseded by a newer one
+    CancelFlag cancelled { false };
+
+    /// set by the render thread once it starts working on the job
+    std::atomic < bool > started { false };
+
+    /// the rendered image
+    QImage result;
+};
+
+/// colormap the view (or the mipmap level, if not null) into qImage using the
+/// pipeline of the job
+static void
+renderJobView( RenderJob & job, NdArray::RawViewInterface * view,
+               const Algorithms::MipmapPyramid::Level * level, QImage & qImage )
+{
+    if ( job.cachedPPinterp ) {
+        ::renderFrame( view, level, * job.cachedPPinterp, qImage, job.nanColor, job.cancelled );
+    }
+    else if ( job.cachedPP ) {
+        ::renderFrame( view, level, * job.cachedPP, qImage, job.nanColor, job.cancelled );
+    }
+    else {
+        ::renderFrame( view, level, * job.pipelineRaw, qImage, job.nanColor, job.cancelled );
+    }
+} // renderJobView
+
+/// returns the pixels of the view that are visible with the pan/zoom/output size
+/// of the job (in image pixel indices), null if none are visible
+static QRect
+visibleImageRect( const RenderJob & job )
+{
+    // image pixel (x,y) covers [x-1/2,x+1/2] x [y-1/2,y+1/2]
+    QPointF tl = screen2imageImpl( QPointF( 0, 0 ), job.pan, job.zoom, job.outputSize );
+    QPointF br = screen2imageImpl( QPointF( job.outputSize.width(), job.outputSize.height() ),
+                                   job.pan, job.zoom, job.outputSize );
+    int x1 = std::floor( tl.x() + 0.5 );
+    int x2 = std::floor( br.x() + 0.5 );
+    int y1 = std::floor( br.y() + 0.5 );
+    int y2 = std::floor( tl.y() + 0.5 );
+
+    // clamp to the image
+    x1 = std::max( x1, 0 );
+    y1 = std::max( y1, 0 );
+    x2 = std::min( x2, job.view-> dims()[0] - 1 );
+    y2 = std::min( y2, job.view-> dims()[1] - 1 );
+
+    // null rectangle if we are not looking at the image at all
+    if ( x1 > x2 || y1 > y2 ) {
+        return QRect();
+    }
+    return QRect( QPoint( x1, y1 ), QPoint( x2, y2 ) );
+} // visibleImageRect
+
+/// render the job into job.result, throws RenderCancelled if the job gets cancelled
+/// before it is finished
+static void
+runRenderJob( RenderJob & job )
+{
+    auto img2screen = [&job] ( const QPointF & p ) {
+        return image2screenImpl( p, job.pan, job.zoom, job.outputSize );
+    };
+    auto screen2img = [&job] ( const QPointF & p ) {
+        return screen2imageImpl( p, job.pan, job.zoom, job.outputSize );
+    };
+
+    // reuse the frame rendered by a previous job, if there is one
+    QImage frameImage;
+    {
+        QMutexLocker locker( & job.frame-> mutex );
+        if ( job.frame-> mipmapFactor == job.mipmapFactor ) {
+            frameImage = job.frame-> image;
+        }
+    }
+    const Algorithms::MipmapPyramid::Level * mipmapLevel = nullptr;
+    if ( frameImage.isNull() && job.mipmapFactor > 1 ) {
+        mipmapLevel = & job.pyramid-> level( job.mipmapFactor );
+    }
+
+    // When zoomed in on a small part of a large image, we only colormap the visible
+    // pixels. The full frame is not worth rendering in that case, since it would take
+    // time proportional to the size of the image.
+    int imageWidth = job.view-> dims()[0];
+    int imageHeight = job.view-> dims()[1];
+    QRect visibleRect = visibleImageRect( job );
+    bool viewportOnly = frameImage.isNull() && job.mipmapFactor == 1
+                        && int64_t( visibleRect.width() ) * visibleRect.height() * 4
+                        < int64_t( imageWidth ) * imageHeight;
+
+    // render the frame (or just the visible part of it) if needed
+    QImage viewportImage;
+    if ( viewportOnly ) {
+        if ( ! visibleRect.isEmpty() ) {
+            SliceND slice( { Slice1D().start( visibleRect.left() ).end( visibleRect.right() + 1 ),
+                             Slice1D().start( visibleRect.top() ).end( visibleRect.bottom() + 1 ) } );
+            std::unique_ptr < NdArray::RawViewInterface > viewportView(
+                job.view-> getView( slice ) );
+            renderJobView( job, viewportView.get(), nullptr, viewportImage );
+        }
+    }
+    else if ( frameImage.isNull() ) {
+        renderJobView( job, job.view.get(), mipmapLevel, frameImage );
+        QMutexLocker locker( & job.frame-> mutex );
+        job.frame-> image = frameImage;
+        job.frame-> mipmapFactor = job.mipmapFactor;
+    }
+    if ( job.cancelled ) {
+        throw RenderCancelled();
+    }
+
+    // prepare output
+    QSize outputSize = job.outputSize;
+    QImage img( outputSize, OptimalQImageFormat );
+    if ( outputSize.width() > 0 && outputSize.height() > 0 ){
+
+        //    img.fill( QColor( "blue" ) );
+        img.fill( QColor( 50, 50, 50 ) );
+        QPainter p( & img );
+
+        // draw the frame image to satisfy zoom/pan
+        //    QPointF p1 = img2screen( QPointF( -0.5, -0.5 ) );
+        //    QPointF p2 = img2screen( QPointF( m_frameImage.width()-0.5, m_frameImage.height()-0.5));
+
+        // the frame could be a mipmap level, so we use the dimensions of the
+        // input view for this
+        QPointF p1 = img2screen( QPointF( - 0.5, imageHeight - 0.5 ) );
+        QPointF p2 = img2screen( QPointF( imageWidth - 0.5, - 0.5 ) );
+        if ( viewportOnly ) {
+            p1 = img2screen( QPointF( visibleRect.left() - 0.5, visibleRect.bottom() + 0.5 ) );
+            p2 = img2screen( QPointF( visibleRect.right() + 0.5, visibleRect.top() - 0.5 ) );
+        }
+
+        QRectF rectf( p1, p2 );
+        p.setRenderHint( QPainter::SmoothPixmapTransform, false );
+
+        //    rectf = rectf.normalized();
+        p.drawImage( rectf, viewportOnly ? viewportImage : frameImage );
+
+        //    qDebug() << "m_frameImage" << m_frameImage.size();
+        //    qDebug() << "m_frameImage" << zoom() << rectf.width() / m_frameImage.width()
+        //             << rectf.height() / m_frameImage.height();
+
+        // debugging rectangle
+        if ( 0 ) {
+            p.setPen( QPen( QColor( "yellow" ), 3 ) );
+            p.setBrush( Qt::NoBrush );
+            p.drawRect( rectf );
+        }
+
+        // more debugging - draw pixel grid
+        // \todo need to add clipping if we want to expose this as a functionality
+        if ( true && job.zoom > 5 ) {
+            p.setRenderHint( QPainter::Antialiasing, true );
+            double alpha = Carta::Lib::linMap( job.zoom, 5, 32, 0.01, 0.2 );
+            //qDebug() << "alpha="<<alpha;
+            alpha = Carta::Lib::clamp( alpha, 0.0, 1.0 );
+            p.setPen( QPen( QColor( 255, 255, 255, 255 ), alpha ) );
+            QPointF tl = screen2img( QPointF( 0, 0 ) );
+            QPointF br = screen2img( QPointF( outputSize.width(), outputSize.height() ) );
+            int x1 = std::floor( tl.x() );
+            int x2 = std::ceil( br.x() );
+            //qDebug() << "x1="<<x1<<" x2="<<x2;
+            for ( double x = x1 ; x <= x2 ; ++x ) {
+                QPointF pt = img2screen( QPointF( x - 0.5, 0 ) );
+                p.drawLine( QPointF( pt.x(), 0 ), QPointF( pt.x(), outputSize.height() ) );
+            }
+            int y1 = std::ceil( tl.y() );
+            int y2 = std::floor( br.y() );
+            std::swap( y1, y2 );
+            for ( double y = y1 ; y <= y2 ; ++y ) {
+                QPointF pt = img2screen( QPointF( 0, y - 0.5 ) );
+                p.drawLine( QPointF( 0, pt.y() ), QPointF( outputSize.width(), pt.y() ) );
+            }
+        }
+        // debuggin: put a yellow stamp on the image, so that next time it's recalled
+        // it'll have 'cached' stamped on it
+        if ( CARTA_RUNTIME_CHECKS ) {
+            p.setPen( QColor( "yellow" ) );
+            p.drawText( img.rect(), Qt::AlignRight | Qt::AlignBottom, "Cached" );
+        }
+    }
+    job.result = img;
+} // runRenderJob
+
+/// runs a render job on the render thread, and hands it to the callback when finished
+/// (cancelled jobs are dropped)
+class RenderRunnable : public QRunnable
+{
+public:
+
+    RenderRunnable( std::shared_ptr < RenderJob > job,
+                    std::function < void (std::shared_ptr < RenderJob >) > finished )
+        : m_job( job ), m_finished( finished ) { }
+
+    virtual void
+    run() override
+    {
+        m_job-> started = true;
+        if ( m_job-> cancelled ) {
+            return;
+        }
+        try {
+            runRenderJob( * m_job );
+        }
+        catch ( const RenderCancelled & ) {
+            return;
+        }
+        m_finished( m_job );
+    }
+
+private:
+
+    std::shared_ptr < RenderJob > m_job;
+    std::function < void (std::shared_ptr < RenderJob >) > m_finished;
+};
+
 void
 Service::setInputView( NdArray::RawViewInterface::SharedPtr view, QString cacheId )
 {
     m_inputView = view;
 
+    // views keep their iteration state in members, so the render thread iterates a
+    // view of its own, the caller may keep using the one it gave us
+    m_renderView.reset( view ? view-> getView( SliceND() ) : nullptr );
+
     m_inputViewCacheId = cacheId;
-    m_frameImage = QImage(); // indicate a need to recompute
+    _invalidateFrame(); // indicate a need to recompute
+    m_pyramid = nullptr;
 }
 
 void
@@ -140,6 +578,54 @@ void Service::setDefaultNan( bool useNanDefault){
     m_defaultNan = useNanDefault;
 }
 
+void
+Service::setMipmapDecimation( Algorithms::MipmapPyramid::Decimation decimation )
+{
+    if ( decimation != m_mipmapDecimation ) {
+        m_mipmapDecimation = decimation;
+        m_pyramid = nullptr;
+        m_pyramidCache.clear();
+        _invalidateFrame();
+    }
+}
+
+Algorithms::MipmapPyramid::Decimation
+Service::mipmapDecimation() const
+{
+    return m_mipmapDecimation;
+}
+
+Algorithms::MipmapPyramid::SharedPtr
+Service::_pyramid()
+{
+    if ( m_pyramid ) {
+        return m_pyramid;
+    }
+
+    // views without cache id are never cached
+    if ( ! m_inputViewCacheId.isEmpty() ) {
+        Algorithms::MipmapPyramid::SharedPtr * cached = m_pyramidCache.object( m_inputViewCacheId );
+        if ( cached ) {
+            m_pyramid = * cached;
+            return m_pyramid;
+        }
+    }
+    m_pyramid = std::make_shared < Algorithms::MipmapPyramid > ( m_renderView, m_mipmapDecimation );
+    if ( ! m_inputViewCacheId.isEmpty() ) {
+        m_pyramidCache.insert( m_inputViewCacheId,
+                               new Algorithms::MipmapPyramid::SharedPtr( m_pyramid ),
+                               m_pyramid-> maxByteSize() / 1024 + 1 );
+    }
+    return m_pyramid;
+} // _pyramid
+
+void
+Service::_invalidateFrame()
+{
+    // jobs still running keep the old store, so they cannot overwrite the new frame
+    m_frame = std::make_shared < FrameStore > ();
+}
+
 void
 Service::setPan( QPointF pt )
 {
@@ -175,7 +661,7 @@ Service::setPixelPipeline( IClippedPixelPipeline::SharedPtr pixelPipeline,
     m_pixelPipelineCacheId = cacheId;
 
     // invalidate frame cache
-    m_frameImage = QImage();
+    _invalidateFrame();
 
     // invalidate pixel pipeline cache
     m_cachedPP = nullptr;
@@ -188,7 +674,7 @@ Service::setPixelPipelineCacheSettings( const PixelPipelineCacheSettings & param
     m_pixelPipelineCacheSettings = params;
 
     // invalidate frame cache
-    m_frameImage = QImage();
+    _invalidateFrame();
 
     // invalidate pixel pipeline cache
     m_cachedPP = nullptr;
@@ -217,6 +703,7 @@ Service::render( JobId jobId )
 }
 
 Service::Service( QObject * parent ) : Carta::Lib::IImageRenderService( parent ),
+        m_frameCache( DefaultFrameCacheBytes ),
         m_defaultNan( true ),
         m_nanColor( 255, 0, 0 )
 {
@@ -230,11 +717,25 @@ Service::Service( QObject * parent ) : Carta::Lib::IImageRenderService( parent )
     m_renderTimer.setInterval( 1 );
     connect( & m_renderTimer, & QTimer::timeout, this, & Me::internalRenderSlot );
 
-    m_frameCache.setMaxCost( 1 * 1024 * 1024 * 1024 ); // 1 gig
+    int frameCacheSizeMB = Globals::instance()-> mainConfig()-> getFrameCacheSizeMB();
+    if ( frameCacheSizeMB > 0 ) {
+        m_frameCache.setMaxBytes( int64_t( frameCacheSizeMB ) * 1024 * 1024 );
+    }
+    m_pyramidCache.setMaxCost( 512 * 1024 ); // 512 megs (cost is in kilobytes)
+
+    // jobs are rendered one at a time, the colormapping inside a job is parallel
+    m_renderPool.setMaxThreadCount( 1 );
+    _invalidateFrame();
 }
 
 Service::~Service()
-{ }
+{
+    // the render thread calls back into us when a job is finished
+    if ( m_lastJob ) {
+        m_lastJob-> cancelled = true;
+    }
+    m_renderPool.waitForDone();
+}
 
 QPointF
 Service::img2screen( const QPointF & p )
@@ -245,18 +746,7 @@ Service::img2screen( const QPointF & p )
 QPointF
 Service::image2screen( const QPointF& p, const QPointF& pan,
         double zoom, const QSize& outputSize ) const {
-    double icx = pan.x();
-    double scx = outputSize.width() / 2.0;
-    double icy = pan.y();
-    double scy = outputSize.height() / 2.0;
-
-    /// \todo cache xmap/ymap, update with zoom/pan/resize
-    Carta::Lib::LinearMap1D xmap( scx, scx + zoom, icx, icx + 1 );
-    Carta::Lib::LinearMap1D ymap( scy, scy + zoom, icy, icy - 1 );
-    QPointF res;
-    res.rx() = xmap.inv( p.x() );
-    res.ry() = ymap.inv( p.y() );
-    return res;
+    return image2screenImpl( p, pan, zoom, outputSize );
 }
 
 QPointF
@@ -268,19 +758,13 @@ Service::screen2img( const QPointF & p )
 QPointF
 Service::screen2image( const QPointF & p, const QPointF& pan, double zoom,
         const QSize& outputSize ) const {
-    double icx = pan.x();
-    double scx = outputSize.width() / 2.0;
-    double icy = pan.y();
-    double scy = outputSize.height() / 2.0;
-
-    /// \todo cache xmap/ymap, update with zoom/pan/resize
+    return screen2imageImpl( p, pan, zoom, outputSize );
+}
 
-    Carta::Lib::LinearMap1D xmap( scx, scx + zoom, icx, icx + 1 );
-    Carta::Lib::LinearMap1D ymap( scy, scy + zoom, icy, icy - 1 );
-    QPointF res;
-    res.rx() = xmap.apply( p.x() );
-    res.ry() = ymap.apply( p.y() );
-    return res;
+FrameCache::Stats
+Service::frameCacheStats() const
+{
+    return m_frameCache.stats();
 }
 
 void
@@ -289,10 +773,16 @@ Service::internalRenderSlot()
     //static int renderCount = 0;
     //qDebug() << "Image render" << renderCount++ << "xyz";
 
-    // raw double to base64 converter
-    auto d2hex = [] (double x) -> QString {
-        return QByteArray( (char *) ( & x ), sizeof( x ) ).toBase64();
-    };
+    if ( ! m_inputView ) {
+        qCritical() << "input view not set";
+        qDebug() << "xyz internal renderslot" << m_inputView.get() << this;
+        return;
+    }
+
+    if ( ! m_pixelPipelineRaw ) {
+        qCritical() << "pixel pipeline not set";
+        return;
+    }
 
     double clipMin, clipMax;
     m_pixelPipelineRaw-> getClips( clipMin, clipMax );
@@ -302,165 +792,129 @@ Service::internalRenderSlot()
         m_pixelPipelineRaw->convertq( clipMin, nanColor );
     }
 
-    // cache id will be concatenation of:
-    // view id
-    // pipeline id
-    // output size
-    // pan
-    // zoom
-    // nan
-    // pixel pipeline cache settings
-    // Floats are binary-encoded (base64)
-    QString cacheId = QString( "%1/%2/%3x%4/%5,%6/%7/%8" )
-                          .arg( m_inputViewCacheId )
-                          .arg( m_pixelPipelineCacheId )
-                          .arg( m_outputSize.width() )
-                          .arg( m_outputSize.height() )
-                          .arg( d2hex( m_pan.x() ) )
-                          .arg( d2hex( m_pan.y() ) )
-                          .arg( d2hex( m_zoom ) )
-                          .arg( QString::number(nanColor) );
-
-
+    // everything that affects the rendered image goes into the cache key
+    FrameCacheKey cacheKey;
+    cacheKey.viewId = m_inputViewCacheId;
+    cacheKey.pipelineId = m_pixelPipelineCacheId;
+    cacheKey.outputSize = m_outputSize;
+    cacheKey.pan = m_pan;
+    cacheKey.zoom = m_zoom;
+    cacheKey.nanColor = nanColor;
+    cacheKey.mipmapDecimation = int (m_mipmapDecimation);
     if ( m_pixelPipelineCacheSettings.enabled ) {
-        cacheId += QString( "/1/%1/%2" )
-                       .arg( int (m_pixelPipelineCacheSettings.interpolated) )
-                       .arg( m_pixelPipelineCacheSettings.size );
+        cacheKey.pipelineCacheSize = m_pixelPipelineCacheSettings.size;
+        cacheKey.pipelineCacheInterpolated = m_pixelPipelineCacheSettings.interpolated;
     }
-    else {
-        cacheId += "/0";
-    }
-
-//    qDebug() << "internalRenderSlot... cache size: "
-//             << m_frameCache.totalCost() * 100.0 / m_frameCache.maxCost() << "% "
-//             << m_frameCache.size() << "entries";
-//    qDebug() << "id:" << cacheId;
-    struct Scope {
-        ~Scope() { /*qDebug() << "internalRenderSlot done";*/ } }
-    debugScopeGuard;
 
-    auto cachedImage = m_frameCache.object( cacheId );
-    if ( cachedImage ) {
+    QImage cachedImage;
+    if ( m_frameCache.find( cacheKey, cachedImage ) ) {
         //qDebug() << "frame cache hit";
-        emit done( * cachedImage, m_lastSubmittedJobId );
+        emit done( cachedImage, m_lastSubmittedJobId );
         return;
     }
     //qDebug() << "frame cache miss";
 
-    if ( ! m_inputView ) {
-        qCritical() << "input view not set";
-        qDebug() << "xyz internal renderslot" << m_inputView.get() << this;
-        return;
-    }
-
-    if ( ! m_pixelPipelineRaw ) {
-        qCritical() << "pixel pipeline not set";
-        return;
+    // take a snapshot of the inputs, so that they can be changed while the job runs
+    auto job = std::make_shared < RenderJob > ();
+    job-> jobId = m_lastSubmittedJobId;
+    job-> cacheKey = cacheKey;
+    job-> view = m_renderView;
+    job-> outputSize = m_outputSize;
+    job-> pan = m_pan;
+    job-> zoom = m_zoom;
+    job-> nanColor = nanColor;
+    job-> frame = m_frame;
+
+    // when zoomed out, render the frame from the matching level of the mipmap
+    // pyramid, there is no point in colormapping pixels QPainter will skip anyways
+    if ( m_zoom <= 0.5 ) {
+        job-> pyramid = _pyramid();
+        job-> mipmapFactor = job-> pyramid-> factorForZoom( m_zoom );
     }
 
-
-
-    // render the frame if needed
-    if ( m_frameImage.isNull() ) {
-
-        if ( pixelPipelineCacheSettings().enabled ) {
-            if ( pixelPipelineCacheSettings().interpolated ) {
-                if ( ! m_cachedPPinterp ) {
-                    m_cachedPPinterp.reset( new Lib::PixelPipeline::CachedPipeline < true > () );
-                    m_cachedPPinterp-> cache( * m_pixelPipelineRaw,
-                            pixelPipelineCacheSettings().size, clipMin, clipMax );
-                }
-                ::iView2qImage( m_inputView.get(), * m_cachedPPinterp, m_frameImage, nanColor );
-            }
-            else {
-                if ( ! m_cachedPP ) {
-                    m_cachedPP.reset( new Lib::PixelPipeline::CachedPipeline < false > () );
-                    m_cachedPP-> cache( * m_pixelPipelineRaw,
-                            pixelPipelineCacheSettings().size, clipMin, clipMax );
-                }
-                ::iView2qImage( m_inputView.get(), * m_cachedPP, m_frameImage, nanColor );
+    // the cached pipelines are cheap to build, so that happens here, the raw pipeline
+    // is only used when caching is disabled
+    if ( m_pixelPipelineCacheSettings.enabled ) {
+        if ( m_pixelPipelineCacheSettings.interpolated ) {
+            if ( ! m_cachedPPinterp ) {
+                m_cachedPPinterp = std::make_shared < Lib::PixelPipeline::CachedPipeline < true > > ();
+                m_cachedPPinterp-> cache( * m_pixelPipelineRaw,
+                        m_pixelPipelineCacheSettings.size, clipMin, clipMax );
             }
+            job-> cachedPPinterp = m_cachedPPinterp;
         }
         else {
-            ::iView2qImage( m_inputView.get(), * m_pixelPipelineRaw, m_frameImage, nanColor );
-        }
-    }
-
-    // prepare output
-    QImage img( m_outputSize, OptimalQImageFormat );
-    if ( m_outputSize.width() > 0 && m_outputSize.height() > 0 ){
-
-        //    img.fill( QColor( "blue" ) );
-        img.fill( QColor( 50, 50, 50 ) );
-        QPainter p( & img );
-
-        // draw the frame image to satisfy zoom/pan
-        //    QPointF p1 = img2screen( QPointF( -0.5, -0.5 ) );
-        //    QPointF p2 = img2screen( QPointF( m_frameImage.width()-0.5, m_frameImage.height()-0.5));
-
-        int imageHeight = m_frameImage.height();
-        QPointF p1 = img2screen( QPointF( - 0.5, imageHeight - 0.5 ) );
-        QPointF p2 = img2screen( QPointF( m_frameImage.width() - 0.5, - 0.5 ) );
-
-        QRectF rectf( p1, p2 );
-        p.setRenderHint( QPainter::SmoothPixmapTransform, false );
-
-        //    rectf = rectf.normalized();
-        p.drawImage( rectf, m_frameImage );
-
-        //    qDebug() << "m_frameImage" << m_frameImage.size();
-        //    qDebug() << "m_frameImage" << zoom() << rectf.width() / m_frameImage.width()
-        //             << rectf.height() / m_frameImage.height();
-
-        // debugging rectangle
-        if ( 0 ) {
-            p.setPen( QPen( QColor( "yellow" ), 3 ) );
-            p.setBrush( Qt::NoBrush );
-            p.drawRect( rectf );
-        }
-
-        // more debugging - draw pixel grid
-        // \todo need to add clipping if we want to expose this as a functionality
-        if ( true && zoom() > 5 ) {
-            p.setRenderHint( QPainter::Antialiasing, true );
-            double alpha = Carta::Lib::linMap( zoom(), 5, 32, 0.01, 0.2 );
-            //qDebug() << "alpha="<<alpha;
-            alpha = Carta::Lib::clamp( alpha, 0.0, 1.0 );
-            p.setPen( QPen( QColor( 255, 255, 255, 255 ), alpha ) );
-            QPointF tl = screen2img( QPointF( 0, 0 ) );
-            QPointF br = screen2img( QPointF( outputSize().width(), outputSize().height() ) );
-            int x1 = std::floor( tl.x() );
-            int x2 = std::ceil( br.x() );
-            //qDebug() << "x1="<<x1<<" x2="<<x2;
-            for ( double x = x1 ; x <= x2 ; ++x ) {
-                QPointF pt = img2screen( QPointF( x - 0.5, 0 ) );
-                p.drawLine( QPointF( pt.x(), 0 ), QPointF( pt.x(), outputSize().height() ) );
-            }
-            int y1 = std::ceil( tl.y() );
-            int y2 = std::floor( br.y() );
-            std::swap( y1, y2 );
-            for ( double y = y1 ; y <= y2 ; ++y ) {
-                QPointF pt = img2screen( QPointF( 0, y - 0.5 ) );
-                p.drawLine( QPointF( 0, pt.y() ), QPointF( outputSize().width(), pt.y() ) );
+            if ( ! m_cachedPP ) {
+                m_cachedPP = std::make_shared < Lib::PixelPipeline::CachedPipeline < false > > ();
+                m_cachedPP-> cache( * m_pixelPipelineRaw,
+                        m_pixelPipelineCacheSettings.size, clipMin, clipMax );
             }
+            job-> cachedPP = m_cachedPP;
         }
-        // debuggin: put a yellow stamp on the image, so that next time it's recalled
-        // it'll have 'cached' stamped on it
-        if ( CARTA_RUNTIME_CHECKS ) {
-            p.setPen( QColor( "yellow" ) );
-            p.drawText( img.rect(), Qt::AlignRight | Qt::AlignBottom, "Cached" );
-        }
+    }
+    else {
+        // the raw pipeline is modified in place by its owner, so the job gets a copy
+        job-> pipelineRaw = m_pixelPipelineRaw-> clone();
     }
 
-    // report result
-    emit done( img, m_lastSubmittedJobId );
+    // pipelines that cannot be copied are only used on this thread
+    bool renderHere = false;
+    if ( ! m_pixelPipelineCacheSettings.enabled && ! job-> pipelineRaw ) {
+        job-> pipelineRaw = m_pixelPipelineRaw;
+        renderHere = true;
+    }
 
+    // Cancel the previous job, unless it is rendering the frame this one needs (the
+    // frame is the expensive part, this job would have to start it all over again).
+    if ( m_lastJob && ( ! m_lastJob-> started || m_lastJob-> frame != job-> frame
+                        || m_lastJob-> mipmapFactor != job-> mipmapFactor ) ) {
+        m_lastJob-> cancelled = true;
+    }
+    m_lastJob = job;
+
+    // When the job has to be rendered on this thread, we wait for the render thread
+    // first, because views are not thread safe.
+    if ( ! renderHere ) {
+        // called on the render thread
+        auto finished = [this] ( std::shared_ptr < RenderJob > finishedJob ) {
+            QMutexLocker locker( & m_finishedJobsMutex );
+            m_finishedJobs.push_back( finishedJob );
+            QMetaObject::invokeMethod( this, "jobFinishedSlot", Qt::QueuedConnection );
+        };
+        m_renderPool.start( new RenderRunnable( job, finished ) );
+    }
+    else {
+        m_renderPool.waitForDone();
+        runRenderJob( * job );
+        _jobFinished( job );
+    }
+} // internalRenderSlot
 
+void
+Service::jobFinishedSlot()
+{
+    std::vector < std::shared_ptr < RenderJob > > jobs;
+    {
+        QMutexLocker locker( & m_finishedJobsMutex );
+        jobs.swap( m_finishedJobs );
+    }
+    for ( auto & job : jobs ) {
+        _jobFinished( job );
+    }
+}
 
-    // insert this image into frame cache
-    m_frameCache.insert( cacheId, new QImage( img ), img.byteCount() );
+void
+Service::_jobFinished( std::shared_ptr < RenderJob > job )
+{
+    // insert this image into frame cache, even if it is not the latest one, we
+    // might be asked for it again
+    m_frameCache.insert( job-> cacheKey, job-> result );
 
-} // internalRenderSlot
+    // report result, but only for the latest request
+    if ( job-> jobId == m_lastSubmittedJobId ) {
+        emit done( job-> result, job-> jobId );
+    }
+} // _jobFinished
 
 }
 }
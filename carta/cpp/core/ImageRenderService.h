@@ -2,6 +2,9 @@
  * The ImageRenderService::Service is responsible for rendering astro images.
  * Esentially it converts raw astro data -> RGB image, using an asynchronous API.
  *
+ * When zoomed in on a small part of a large image, only the visible pixels are
+ * rendered (the whole frame is not kept in that case).
+ *
  * Inputs:
  *   - raw data (view)
  *   - instance of pixel pipeline (can be slow, service will cache it)
@@ -15,10 +18,12 @@
  * caching considerations (internal notes)
  *   eg. when zooming/panning there is no need to re-apply colormap
  *   or when switching between frames, maybe we can cache some frames to make this faster
- *   or when looking at really large 2d data, we could use mipmaps (future optimization)
+ *   or when looking at really large 2d data, we use mipmaps (see Algorithms::MipmapPyramid)
  *
  * asynchronous result reporting
- *   the render service might possibly live in a separate thread
+ *   the rendering itself is done on a separate render thread, and a job that is
+ *   superseded by a newer one before it is finished is cancelled (pixel pipelines that
+ *   are not cached are the exception, those are rendered on the calling thread)
  *
  * Note that the rendering service does not have any convenience APIs for manipulating
  * colormaps/pixel pipelines. It is up to the caller to set this up. The reason is to keep
@@ -33,12 +38,18 @@
 #include "CartaLib/PixelPipeline/IPixelPipeline.h"
 #include "CartaLib/Nullable.h"
 #include "CartaLib/IImageRenderService.h"
+#include "Algorithms/MipmapPyramid.h"
+#include "FrameCache.h"
 #include <QImage>
 #include <QObject>
 #include <QColor>
 #include <QStringList>
 #include <QCache>
 #include <QTimer>
+#include <QThreadPool>
+#include <QMutex>
+#include <memory>
+#include <vector>
 
 namespace Carta
 {
@@ -54,6 +65,10 @@ typedef Lib::PixelPipeline::IClippedPixelPipeline IClippedPixelPipeline;
 /// job id
 typedef int64_t JobId;
 
+/// internal types used by the render thread
+struct RenderJob;
+struct FrameStore;
+
 /// Implementation of the rendering service
 /// \warning this object could potentially live it a separate thread, so make all connections
 /// to it as explicitly queued
@@ -127,6 +142,15 @@ public:
     void
     setDefaultNan( bool useDefaultNan );
 
+    /// set how the levels of the mipmap pyramid are computed, the levels are used
+    /// instead of the full resolution data when zoomed out
+    void
+    setMipmapDecimation( Algorithms::MipmapPyramid::Decimation decimation );
+
+    /// getter for mipmap decimation (see setMipmapDecimation())
+    Algorithms::MipmapPyramid::Decimation
+    mipmapDecimation() const;
+
     /// set coordinates of the data pixel to be centered in the generated
     /// image, in zero-based image coordinates, e.g. (0,0) is bottom left corner of pixel
     /// (0,0), while (1,1) is it's right-top corner, and (1/2,1/2) is it's center
@@ -200,6 +224,10 @@ public:
     virtual QPointF
     screen2image( const QPointF & p, const QPointF& pan, double zoom, const QSize& size ) const override;
 
+    /// returns the hit/miss/eviction counters and the memory usage of the frame cache
+    FrameCache::Stats
+    frameCacheStats() const;
+
 public slots:
 
     /// ask the service to render using the current settings and use the given
@@ -224,10 +252,30 @@ protected slots:
     void
     internalRenderSlot();
 
+    /// picks up the jobs finished by the render thread
+    void
+    jobFinishedSlot();
+
 private:
 
+    /// returns the mipmap pyramid of the current input view, creating it if necessary
+    Algorithms::MipmapPyramid::SharedPtr
+    _pyramid();
+
+    /// forget the frame, it will be rendered again by the next job
+    void
+    _invalidateFrame();
+
+    /// cache the result of the job, and report it if it is the latest one
+    void
+    _jobFinished( std::shared_ptr < RenderJob > job );
+
     // the following are rendering parameters
     Carta::Lib::NdArray::RawViewInterface::SharedPtr m_inputView = nullptr;
+
+    /// view of the same data as m_inputView, only iterated by the render jobs (and
+    /// the mipmap pyramid they read)
+    Carta::Lib::NdArray::RawViewInterface::SharedPtr m_renderView = nullptr;
     QString m_inputViewCacheId;
     QString m_pixelPipelineCacheId;
     QSize m_outputSize = QSize( 10, 10 );
@@ -241,17 +289,27 @@ private:
     /// current pan (coordinates of the image pixel that is to be centered on the screen)
     QPointF m_pan = QPointF( 0, 0 );
 
-    // cached pipelines
-    Lib::PixelPipeline::CachedPipeline < true >::UniquePtr m_cachedPPinterp = nullptr;
-    Lib::PixelPipeline::CachedPipeline < false >::UniquePtr m_cachedPP = nullptr;
+    // cached pipelines (shared with the render jobs using them)
+    Lib::PixelPipeline::CachedPipeline < true >::SharedPtr m_cachedPPinterp = nullptr;
+    Lib::PixelPipeline::CachedPipeline < false >::SharedPtr m_cachedPP = nullptr;
     PixelPipelineCacheSettings m_pixelPipelineCacheSettings;
 
     /// here we store the whole frame rendered, it is essentially a cache to make
-    /// pan/zoom to work faster
-    QImage m_frameImage;
+    /// pan/zoom to work faster (the render jobs fill it in)
+    std::shared_ptr < FrameStore > m_frame = nullptr;
 
     /// cache for individual frames (to make movie playing little bit faster)
-    QCache < QString, QImage > m_frameCache;
+    FrameCache m_frameCache;
+
+    /// mipmap pyramid of the current input view (levels are built lazily)
+    Algorithms::MipmapPyramid::SharedPtr m_pyramid = nullptr;
+
+    /// pyramids of recently seen input views, by their cache id
+    QCache < QString, Algorithms::MipmapPyramid::SharedPtr > m_pyramidCache;
+
+    /// how the mipmap levels are computed
+    Algorithms::MipmapPyramid::Decimation m_mipmapDecimation =
+        Algorithms::MipmapPyramid::Decimation::Mean;
 
     /// last requested job id
     JobId m_lastSubmittedJobId = - 1;
@@ -265,6 +323,15 @@ private:
     /// are submitted
     QTimer m_renderTimer;
 
+    /// the render thread
+    QThreadPool m_renderPool;
+
+    /// the most recently submitted job
+    std::shared_ptr < RenderJob > m_lastJob = nullptr;
+
+    /// jobs finished by the render thread, waiting for jobFinishedSlot()
+    std::vector < std::shared_ptr < RenderJob > > m_finishedJobs;
+    QMutex m_finishedJobsMutex;
 };
 }
 }
@@ -90,6 +90,9 @@ ParsedInfo parse(const QString & filePath)
 
     _storePositiveInt( json["histogramBinCountMax"], &info.m_histogramBinCountMax, "histogram bin count max");
     _storePositiveInt( json["contourLevelCountMax"], &info.m_contourLevelCountMax, "contour level count max");
+    _storePositiveInt( json["frameCacheSizeMB"], &info.m_frameCacheSizeMB, "frame cache size");
+    _storePositiveInt( json["transposeChannelsMin"], &info.m_transposeChannelsMin, "transpose channels min");
+    _storePositiveInt( json["planeStatsSizeMaxMB"], &info.m_planeStatsSizeMaxMB, "plane stats size max");
 
     return info;
 }
@@ -118,6 +121,18 @@ int ParsedInfo::getContourLevelCountMax() const {
     return m_contourLevelCountMax;
 }
 
+int ParsedInfo::getFrameCacheSizeMB() const {
+    return m_frameCacheSizeMB;
+}
+
+int ParsedInfo::getTransposeChannelsMin() const {
+    return m_transposeChannelsMin;
+}
+
+int ParsedInfo::getPlaneStatsSizeMaxMB() const {
+    return m_planeStatsSizeMaxMB;
+}
+
 int ParsedInfo::getHistogramBinCountMax() const {
     return m_histogramBinCountMax;
 }
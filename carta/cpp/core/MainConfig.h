@@ -40,6 +40,31 @@ public:
      */
     int getContourLevelCountMax() const;
 
+    /**
+     * Returns any valid user set size of the rendered frame cache in megabytes or
+     * -1 if no valid user supplied value has been provided.
+     * @return the size of the frame cache of each image render service or -1 if
+     *   no valid value has been specified.
+     */
+    int getFrameCacheSizeMB() const;
+
+    /**
+     * Returns any valid user set minimum number of channels for which a spectral-major
+     * copy of a cube is made, or -1 if no valid user supplied value has been provided.
+     * @return the number of channels from which cubes are transposed for profiles or
+     *   -1 if cubes should not be transposed.
+     */
+    int getTransposeChannelsMin() const;
+
+    /**
+     * Returns any valid user set size in megabytes of the largest image whose plane
+     * statistics are computed in the background, or -1 if no valid user supplied value
+     * has been provided.
+     * @return the size limit for the background plane statistics or -1 if the
+     *   default limit should be used.
+     */
+    int getPlaneStatsSizeMaxMB() const;
+
     /// whether hacks are enabled or not
     bool hacksEnabled() const;
 
@@ -88,6 +113,9 @@ protected:
     bool m_developerLayout = false;
     int m_histogramBinCountMax = -1;
     int m_contourLevelCountMax = -1;
+    int m_frameCacheSizeMB = -1;
+    int m_transposeChannelsMin = -1;
+    int m_planeStatsSizeMaxMB = -1;
 
     QJsonObject m_json;
 
@@ -42,7 +42,6 @@ HEADERS += \
     Data/Histogram/ChannelUnits.h \
     Data/Histogram/PlotStyles.h \
     Data/Histogram/Render/HistogramRenderService.h \
-    Data/Histogram/Render/HistogramRenderThread.h \
     Data/Histogram/Render/HistogramRenderWorker.h \
     Data/Histogram/Render/HistogramRenderRequest.h \
     Data/ILinkable.h \
@@ -62,6 +61,8 @@ HEADERS += \
     Data/Image/Contour/GeneratorState.h \
     Data/Image/CoordinateSystems.h \
     Data/Image/DataSource.h \
+    Data/Image/ChannelStatsIndex.h \
+    Data/Image/TransposedCube.h \
     Data/Image/Draw/DrawGroupSynchronizer.h \
     Data/Image/Draw/DrawImageViewsSynchronizer.h \
     Data/Image/Draw/DrawSynchronizer.h \
@@ -76,8 +77,6 @@ HEADERS += \
     Data/Image/ImageZoom.h \
     Data/Image/IPercentIntensityMap.h \
     Data/Image/LayerCompositionModes.h \
-    Data/Image/LeastRecentlyUsedCache.h \
-    Data/Image/LeastRecentlyUsedCacheEntry.h \
     Data/Image/Render/RenderRequest.h \
     Data/Image/Render/RenderResponse.h \
     Data/Image/Save/SaveService.h \
@@ -102,8 +101,8 @@ HEADERS += \
     Data/Profile/ProfilePlotStyles.h \
     Data/Profile/Render/ProfileRenderRequest.h \
     Data/Profile/Render/ProfileRenderService.h \
-    Data/Profile/Render/ProfileRenderThread.h \
     Data/Profile/Render/ProfileRenderWorker.h \
+    Data/Profile/Render/SpectralTileCache.h \
     Data/Profile/ProfileStatistics.h \
     Data/Profile/GenerateModes.h \
     Data/Region/Region.h \
@@ -113,6 +112,7 @@ HEADERS += \
     Data/Region/RegionPoint.h \
     Data/Region/RegionRectangle.h \
     Data/Region/RegionFactory.h \
+    Data/Region/RegionMask.h \
     Data/Region/RegionTypes.h \
     Data/Snapshot/ISnapshotsImplementation.h \
     Data/Snapshot/Snapshots.h \
@@ -128,6 +128,7 @@ HEADERS += \
     Data/ViewPlugins.h \
     GrayColormap.h \
     ImageRenderService.h \
+    FrameCache.h \
     Plot2D/Plot.h \
     Plot2D/Plot2DGenerator.h \
     Plot2D/Plot2DRangeMarker.h \
@@ -150,6 +151,9 @@ HEADERS += \
     ScriptedClient/ScriptedCommandListener.h \
     ScriptedClient/ScriptFacade.h \
     Algorithms/quantileAlgorithms.h \
+    Algorithms/QuantileSketch.h \
+    Algorithms/CumulativeHistogram.h \
+    Algorithms/MipmapPyramid.h \
     ScriptedClient/Listener.h \
     ScriptedClient/ScriptedCommandInterpreter.h \
     ScriptedClient/VarLengthMessage.h \
@@ -209,6 +213,8 @@ SOURCES += \
     Data/Image/Contour/GeneratorState.cpp \
     Data/Image/CoordinateSystems.cpp \
     Data/Image/DataSource.cpp \
+    Data/Image/ChannelStatsIndex.cpp \
+    Data/Image/TransposedCube.cpp \
     Data/Image/Grid/AxisMapper.cpp \
     Data/Image/Grid/DataGrid.cpp \
     Data/Image/Grid/Fonts.cpp \
@@ -222,8 +228,6 @@ SOURCES += \
     Data/Image/ImageContext.cpp \
     Data/Image/ImageZoom.cpp \
     Data/Image/LayerCompositionModes.cpp \
-    Data/Image/LeastRecentlyUsedCache.cpp \
-    Data/Image/LeastRecentlyUsedCacheEntry.cpp \
     Data/Image/Render/RenderRequest.cpp \
     Data/Image/Render/RenderResponse.cpp \
     Data/Image/Save/SaveService.cpp \
@@ -236,7 +240,6 @@ SOURCES += \
     Data/Histogram/Histogram.cpp \
     Data/Histogram/ChannelUnits.cpp \
     Data/Histogram/Render/HistogramRenderService.cpp \
-    Data/Histogram/Render/HistogramRenderThread.cpp \
     Data/Histogram/Render/HistogramRenderWorker.cpp \
     Data/Histogram/Render/HistogramRenderRequest.cpp \
     Data/Histogram/PlotStyles.cpp \
@@ -259,8 +262,8 @@ SOURCES += \
     Data/Profile/ProfilePlotStyles.cpp \
     Data/Profile/Render/ProfileRenderRequest.cpp \
     Data/Profile/Render/ProfileRenderService.cpp \
-    Data/Profile/Render/ProfileRenderThread.cpp \
     Data/Profile/Render/ProfileRenderWorker.cpp \
+    Data/Profile/Render/SpectralTileCache.cpp \
     Data/Profile/ProfileStatistics.cpp \
     Data/Profile/GenerateModes.cpp \
     Data/Region/Region.cpp \
@@ -269,6 +272,7 @@ SOURCES += \
     Data/Region/RegionPolygon.cpp \
     Data/Region/RegionEllipse.cpp \
     Data/Region/RegionFactory.cpp \
+    Data/Region/RegionMask.cpp \
     Data/Region/RegionRectangle.cpp \
     Data/Region/RegionTypes.cpp \
     Data/Snapshot/Snapshots.cpp \
@@ -305,7 +309,11 @@ SOURCES += \
     Shape/ShapePolygon.cpp \
     Shape/ShapeRectangle.cpp \
     ImageRenderService.cpp \
+    FrameCache.cpp \
     Algorithms/quantileAlgorithms.cpp \
+    Algorithms/QuantileSketch.cpp \
+    Algorithms/CumulativeHistogram.cpp \
+    Algorithms/MipmapPyramid.cpp \
     ScriptedClient/Listener.cpp \
     ScriptedClient/ScriptedCommandInterpreter.cpp \
     ScriptedClient/VarLengthMessage.cpp \
@@ -8,12 +8,15 @@
 #include "CartaLib/IImage.h"
 #include "CartaLib/AxisInfo.h"
 #include "CCRawView.h"
+#include "FitsMmapRawView.h"
 #include "CCMetaDataInterface.h"
 #include "casacore/images/Images/ImageInterface.h"
 #include "casacore/images/Images/ImageUtilities.h"
 #include "casacore/images/Images/TempImage.h"
 
 #include <QDebug>
+#include <QMutex>
+#include <QMutexLocker>
 #include <memory>
 #include <set>
 
@@ -42,6 +45,14 @@ public:
 
     virtual casa::ImageInfo getImageInfo() const = 0;
 
+    /**
+     * Returns the mutex that serializes casacore reads of this image. Anything that
+     * reads the image returned by getCasaImage() (e.g. plugins computing profiles on
+     * a worker thread) has to hold it, views of the image lock it too.
+     * @return QMutex &
+     */
+    virtual QMutex & getCasaMutex() = 0;
+
 //    virtual casa::ImageInterface<casa::Float> * getCasaIIfloat() = 0;
 
 
@@ -90,6 +101,9 @@ public:
         for ( int i = 0; i < indexCount; i++ ){
             newOrder[i] = indices[i];
         }
+        // the image may be read by views on other threads at the same time
+        QMutexLocker locker( & m_casaMutex );
+
         //Change the order of the axes in the coordinate system
         casa::CoordinateSystem coordSys = m_casaII->coordinates();
         coordSys.transpose( newOrder, newOrder );
@@ -150,6 +164,10 @@ public:
     virtual Carta::Lib::NdArray::RawViewInterface *
     getDataSlice( const SliceND & sliceInfo ) override
     {
+        // read the pixels straight from the file if we can
+        if ( m_fitsMmap ) {
+            return new FitsMmapRawView( m_fitsMmap, sliceInfo );
+        }
         return new CCRawView < PType > ( this, sliceInfo );
     }
 
@@ -215,6 +233,17 @@ public:
         return img;
     } // create
 
+    /// use the given memory mapped FITS file for getDataSlice() instead of casacore
+    /// \note the mapping must have the same shape as the casacore image, and since
+    /// it always produces floats, it only makes sense for CCImage<float>
+    void
+    setFitsMmap( FitsMmapFile::SharedPtr fitsMmap )
+    {
+        CARTA_ASSERT( ! fitsMmap || fitsMmap-> dims() == m_dims );
+        CARTA_ASSERT( m_pixelType == Carta::Lib::Image::PixelType::Real32 );
+        m_fitsMmap = fitsMmap;
+    }
+
     virtual casa::LatticeBase *
     getCasaImage() override
     {
@@ -225,6 +254,12 @@ public:
                return m_casaII->imageInfo();
            }
 
+    virtual QMutex &
+    getCasaMutex() override
+    {
+        return m_casaMutex;
+    }
+
     virtual
     ~CCImage() {
         //qDebug() << "~CCImage is getting called";
@@ -251,6 +286,14 @@ protected:
     /// meta data pointer
     CCMetaDataInterface::SharedPtr m_meta;
 
+    /// memory mapped data of FITS files (if available), see setFitsMmap()
+    FitsMmapFile::SharedPtr m_fitsMmap = nullptr;
+
+    /// casacore images cannot be read from several threads at once, but views can be
+    /// rendered in the background while the GUI thread reads the same image, so all
+    /// reads by CCRawView are serialized with this (recursive, views may be nested)
+    QMutex m_casaMutex { QMutex::Recursive };
+
     /// we want CCRawView to access our internals...
     /// \todo maybe we just need a public accessor, no? I don't like friends :) (Pavol)
     friend class CCRawView < PType >;
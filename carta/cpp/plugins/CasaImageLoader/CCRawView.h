@@ -8,6 +8,12 @@
 #include <casacore/lattices/Lattices/LatticeStepper.h>
 #include <casacore/lattices/Lattices/LatticeIterator.h>
 #include <casacore/casa/Arrays/IPosition.h>
+#include <casacore/casa/Arrays/Slicer.h>
+#include <QMutexLocker>
+#include <algorithm>
+#include <limits>
+#include <stdexcept>
+#include <vector>
 
 template < typename PType >
 class CCImage;
@@ -17,6 +23,10 @@ class CCImage;
 /// \warning We are not handling negative step
 /// \warning We are not handling 'index' slices, i.e. axis removal
 ///
+/// Traversal::Optimal visits the data in blocks made of whole tiles of the image
+/// (as reported by casacore), which keeps the table cache from thrashing on
+/// tiled PagedImages.
+///
 /// \todo Implement negative step
 /// \todo Implement indexed slices (i.e. axis removal)
 template < typename PType >
@@ -52,6 +62,12 @@ public:
     virtual const VI &
     currentPos() override;
 
+    virtual const VI &
+    currentBlockDims() override
+    {
+        return m_currBlockDims;
+    }
+
     virtual RawViewInterface *
     getView(const SliceND & sliceInfo) override
     {
@@ -65,21 +81,23 @@ public:
         return new CCRawView( m_ccimage, newAr);
     }
 
+    /// read in the next block of pixels (sequential order), see seek()
     virtual int64_t
     read( int64_t buffSize, char * buff,
           Traversal traversal = Traversal::Sequential ) override
     {
-        Q_UNUSED( buffSize);
-        Q_UNUSED( buff);
-        Q_UNUSED( traversal);
-        qFatal( "not implemented");
+        int64_t count = _readPixels( m_nextReadPixel, buffSize / sizeof( PType ),
+                                     reinterpret_cast < PType * > ( buff ), traversal );
+        m_nextReadPixel += count;
+        return count * sizeof( PType );
     }
 
+    /// set the index of the pixel that the next read() will start from
     virtual void
-    seek(int64_t ind) override
+    seek( int64_t ind ) override
     {
-        Q_UNUSED( ind);
-        qFatal( "not implemented");
+        CARTA_ASSERT( ind >= 0 );
+        m_nextReadPixel = ind;
     }
 
     /// another high performance accessor to data
@@ -89,29 +107,25 @@ public:
     read( int64_t chunk, int64_t buffSize, char * buff,
           Traversal traversal = Traversal::Sequential ) override
     {
-        Q_UNUSED( chunk );
-        Q_UNUSED( buffSize );
-        Q_UNUSED( buff );
-        Q_UNUSED( traversal );
-        qFatal( "not implemented" );
+        int64_t chunkPixels = buffSize / sizeof( PType );
+        int64_t count = _readPixels( chunk * chunkPixels, chunkPixels,
+                                     reinterpret_cast < PType * > ( buff ), traversal );
+        return count * sizeof( PType );
     }
 
     /// yet another high performance accessor... similar to forEach above,
     /// but this time the supplied function gets called with whatever number
     /// elements that fit into the buffer
+    ///
+    /// Each block is copied out of casacore's cursor once, while the image lock is
+    /// held, so that func runs without it: into buff if one is given (it has to
+    /// hold buffSize bytes), otherwise into a buffer of the view's own.
     virtual void
     forEach(
         int64_t buffSize,
         std::function < void (const char *, int64_t count) > func,
         char * buff = nullptr,
-        Traversal traversal = Traversal::Sequential ) override
-    {
-        Q_UNUSED( buffSize );
-        Q_UNUSED( func );
-        Q_UNUSED( buff );
-        Q_UNUSED( traversal );
-        qFatal( "not implemented" );
-    }
+        Traversal traversal = Traversal::Sequential ) override;
 
 protected:
 
@@ -128,6 +142,53 @@ protected:
 
     // minicache to make get() a little bit faster
     VI m_destPos;
+
+    // dimensions of the block visited by the buffered forEach()
+    VI m_currBlockDims;
+
+    /// number of pixels in this view
+    int64_t m_nPixels = 0;
+
+    /// where the next stateful read() will start
+    int64_t m_nextReadPixel = 0;
+
+    /// cursor size used by the per-pixel forEach(), so that we never pull the entire
+    /// view into memory at once
+    static constexpr int64_t DefaultCursorPixels = 1024 * 1024;
+
+    /// finish construction (common code for both constructors)
+    void
+    _init();
+
+    /// bottom-left corner, top-right corner and increment of this view in image
+    /// coordinates, in a form suitable for casa::LatticeStepper::subSection()
+    void
+    _subSection( casa::IPosition & blc, casa::IPosition & trc, casa::IPosition & inc );
+
+    /// largest cursor shape of at most maxPixels pixels, which still keeps the pixels
+    /// of consecutive cursors in sequential order
+    casa::IPosition
+    _sequentialCursorShape( int64_t maxPixels );
+
+    /// cursor shape of at most maxPixels pixels that follows the tiling of the image,
+    /// trimmed to the extent of this view
+    casa::IPosition
+    _optimalCursorShape( int64_t maxPixels );
+
+    /// read up to maxCount pixels starting at the given pixel index (in sequential
+    /// order) into dst, returns the number of pixels read
+    int64_t
+    _readPixels( int64_t first, int64_t maxCount, PType * dst, Traversal traversal );
+
+    /// iterate over the view using a cursor of the given shape, invoking func
+    /// for every cursor position with a pointer to contiguous pixel data
+    /// and keeping currentPos()/currentBlockDims() up to date
+    /// \param dst where the pixels of each cursor are copied to, large enough for
+    /// a whole cursor, or nullptr to use a buffer of our own
+    void
+    _forEachCursor( const casa::IPosition & cursorShape,
+                    std::function < void (const PType *, int64_t) > func,
+                    PType * dst = nullptr );
 };
 
 // public constructor
@@ -145,8 +206,7 @@ CCRawView < PType >::CCRawView( CCImage < PType > * ccimage, const SliceND & sli
         m_viewDims.push_back( x.count );
     }
 
-    // prepare destPos mini cache
-    m_destPos.resize( m_viewDims.size());
+    _init();
 }
 
 // protected constructor
@@ -167,8 +227,7 @@ CCRawView < PType >::CCRawView( CCImage < PType > * ccimage, const SliceND::Appl
         m_viewDims.push_back( x.count );
     }
 
-    // prepare destPos mini cache
-    m_destPos.resize( m_viewDims.size());
+    _init();
 }
 
 template < typename PType >
@@ -198,6 +257,7 @@ CCRawView < PType >::get( const Carta::Lib::NdArray::RawViewInterface::VI & pos
     // casa::ImageInterface::operator() returns the result by value
     // so in order to return reference (to satisfy our API) we need to store this
     // in a buffer first...
+    QMutexLocker locker( & m_ccimage-> m_casaMutex );
     m_buff = m_ccimage-> m_casaII->
                  operator() ( m_destPos );
 
@@ -210,53 +270,262 @@ CCRawView < PType >::forEach(
     std::function < void (const char *) > func,
     Carta::Lib::NdArray::RawViewInterface::Traversal traversal )
 {
-    if ( traversal != Carta::Lib::NdArray::RawViewInterface::Traversal::Sequential ) {
-        qFatal( "sorry, not implemented yet" );
+    // walk the view in bounded blocks, and then pixel by pixel inside each block
+    auto blockFunc = [& func] ( const PType * data, int64_t count ) -> void {
+        for ( int64_t i = 0 ; i < count ; ++i ) {
+            func( reinterpret_cast < const char * > ( data + i ) );
+        }
+    };
+    if ( traversal == Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal ) {
+        _forEachCursor( _optimalCursorShape( DefaultCursorPixels ), blockFunc );
+    }
+    else {
+        _forEachCursor( _sequentialCursorShape( DefaultCursorPixels ), blockFunc );
     }
-    auto casaII     = m_ccimage-> m_casaII;
-    int imgDims     = casaII-> ndim();
-    auto imageShape = casaII-> shape();
-
-//    qDebug() << "CCRawView::forEach=" << m_appliedSlice.toStr()  ;
-
-    /// \todo I guessed wrong as to what the cursor shape meant when using subSection()
-    /// \todo the shape refers to the shape within the subsection... so there is no need
-    /// \todo to specify cursor shape to be the whole image, it should instead be
-    /// \todo the shape of the subsection... e.g. [3:7:2,5:6] only needs a cursor
-    /// of size 2x1(x1x1x1....x1) regardless of the image size...
-    auto cursorShape = imageShape;
-    casa::LatticeStepper stepper( imageShape, cursorShape, casa::LatticeStepper::RESIZE );
-    casa::IPosition blc( imgDims, 0 );
-    auto trc = blc;
-    auto inc = blc;
+} // forEach
+
+template < typename PType >
+void
+CCRawView < PType >::forEach(
+    int64_t buffSize,
+    std::function < void (const char *, int64_t) > func,
+    char * buff,
+    Carta::Lib::NdArray::RawViewInterface::Traversal traversal )
+{
+    int64_t maxPixels = buffSize / sizeof( PType );
+    if ( maxPixels < 1 ) {
+        throw std::runtime_error( "buffer too small for a single pixel" );
+    }
+
+    // the cursors hold at most maxPixels pixels, so they are copied straight into
+    // the caller's buffer
+    PType * dst = reinterpret_cast < PType * > ( buff );
+    auto blockFunc = [& func] ( const PType * data, int64_t count ) -> void {
+        func( reinterpret_cast < const char * > ( data ), count );
+    };
+    if ( traversal == Carta::Lib::NdArray::RawViewInterface::Traversal::Optimal ) {
+        _forEachCursor( _optimalCursorShape( maxPixels ), blockFunc, dst );
+    }
+    else {
+        _forEachCursor( _sequentialCursorShape( maxPixels ), blockFunc, dst );
+    }
+} // forEach
+
+template < typename PType >
+void
+CCRawView < PType >::_init()
+{
+    // prepare destPos mini cache
+    m_destPos.resize( m_viewDims.size() );
+    m_currPosView.resize( m_viewDims.size(), 0 );
+    m_currBlockDims.resize( m_viewDims.size(), 0 );
+
+    // count the pixels, single index slices contribute a single pixel
+    m_nPixels = 1;
+    for ( auto & x : m_appliedSlice.dims() ) {
+        m_nPixels *= x.isSingle() ? 1 : x.count;
+    }
+}
+
+template < typename PType >
+void
+CCRawView < PType >::_subSection( casa::IPosition & blc, casa::IPosition & trc,
+                                  casa::IPosition & inc )
+{
+    size_t imgDims = m_ccimage-> m_casaII-> ndim();
+    blc.resize( imgDims );
+    trc.resize( imgDims );
+    inc.resize( imgDims );
     for ( size_t i = 0 ; i < imgDims ; i++ ) {
         const auto & slice1d = m_appliedSlice.dims()[i];
         blc( i ) = slice1d.start;
         trc( i ) = slice1d.end();
         inc( i ) = slice1d.step;
     }
+}
+
+template < typename PType >
+casa::IPosition
+CCRawView < PType >::_sequentialCursorShape( int64_t maxPixels )
+{
+    // Cursor spans the full extent of the leading axes, a partial extent of the next
+    // axis and 1 for the rest. Then consecutive cursor positions visit pixels in
+    // the same order as sequential traversal does.
+    const auto & dims = m_appliedSlice.dims();
+    casa::IPosition cursorShape( dims.size(), 1 );
+    int64_t remaining = std::max < int64_t > ( maxPixels, 1 );
+    for ( size_t i = 0 ; i < dims.size() ; i++ ) {
+        int64_t extent = dims[i].isSingle() ? 1 : dims[i].count;
+        if ( remaining >= extent ) {
+            cursorShape( i ) = extent;
+            remaining /= extent;
+        }
+        else {
+            cursorShape( i ) = remaining;
+            break;
+        }
+    }
+    return cursorShape;
+} // _sequentialCursorShape
+
+template < typename PType >
+casa::IPosition
+CCRawView < PType >::_optimalCursorShape( int64_t maxPixels )
+{
+    // casacore knows the tile shape of the image, and will give us a cursor
+    // made of whole tiles if it can
+    auto casaII = m_ccimage-> m_casaII;
+    casa::uInt maxPix = Carta::Lib::clamp < int64_t > (
+        maxPixels, 1, std::numeric_limits < casa::uInt >::max() );
+    casa::IPosition cursorShape = casaII-> niceCursorShape( maxPix );
+
+    // tiles could be bigger than our view
+    const auto & dims = m_appliedSlice.dims();
+    for ( size_t i = 0 ; i < dims.size() ; i++ ) {
+        int64_t extent = dims[i].isSingle() ? 1 : dims[i].count;
+        cursorShape( i ) = Carta::Lib::clamp < int64_t > ( cursorShape( i ), 1, extent );
+    }
+    return cursorShape;
+} // _optimalCursorShape
+
+template < typename PType >
+void
+CCRawView < PType >::_forEachCursor( const casa::IPosition & cursorShape,
+                                     std::function < void (const PType *, int64_t) > func,
+                                     PType * dst )
+{
+    if ( m_nPixels == 0 ) {
+        return;
+    }
+    QMutexLocker locker( & m_ccimage-> m_casaMutex );
+    auto casaII = m_ccimage-> m_casaII;
+    casa::IPosition blc, trc, inc;
+    _subSection( blc, trc, inc );
+
+    // cursor shape is relative to the subsection (with increments applied), and
+    // the cursor is trimmed at the edges
+    casa::LatticeStepper stepper( casaII-> shape(), cursorShape, casa::LatticeStepper::RESIZE );
     stepper.subSection( blc, trc, inc );
     casa::RO_LatticeIterator < PType > iterator( * casaII, stepper );
 
-    bool first = true;
-    for ( iterator.reset() ; ! iterator.atEnd() ; iterator++ ) {
-        if ( ! first ) {
-            // sanity check for now, to make sure I understand casa cursors
-            // if this works, the outer loop is not necessary...
-            qFatal( "something went wrong" );
+    // The lock is only held while casacore is reading, each cursor is copied out and
+    // handed to func with the lock released, so that other views of the image (e.g.
+    // on other threads) can read while func is busy with the pixels.
+    std::vector < PType > buffer;
+    iterator.reset();
+    while ( ! iterator.atEnd() ) {
+        const casa::Array < PType > & cursor = iterator.cursor();
+
+        // report where this block is, in view coordinates
+        casa::IPosition position = iterator.position();
+        casa::IPosition shape = cursor.shape();
+        for ( size_t i = 0 ; i < m_currPosView.size() ; i++ ) {
+            m_currPosView[i] = ( position( i ) - blc( i ) ) / inc( i );
+            m_currBlockDims[i] = shape( i );
+        }
+
+        int64_t count = cursor.nelements();
+        PType * cursorDst = dst;
+        if ( ! cursorDst ) {
+            buffer.resize( count );
+            cursorDst = buffer.data();
         }
-        const auto & cursor = iterator.cursor();
-        for ( const auto & val : cursor ) {
-            func( reinterpret_cast < const char * > ( & val ) );
+        bool deleteIt;
+        const PType * data = cursor.getStorage( deleteIt );
+        std::copy( data, data + count, cursorDst );
+        cursor.freeStorage( data, deleteIt );
+
+        locker.unlock();
+        try {
+            func( cursorDst, count );
         }
-        first = false;
+        catch ( ... ) {
+            // the iterator has to be destroyed with the lock held
+            locker.relock();
+            throw;
+        }
+        locker.relock();
+        iterator++;
     }
-} // forEach
+} // _forEachCursor
+
+template < typename PType >
+int64_t
+CCRawView < PType >::_readPixels( int64_t first, int64_t maxCount, PType * dst,
+                                  Traversal traversal )
+{
+    // the stateless API has to be able to find chunk N without visiting the chunks
+    // before it, so we always use sequential order here (which is a perfectly valid
+    // 'optimal' order), forEach() is the API that follows the tiles
+    Q_UNUSED( traversal );
+
+    if ( first < 0 || first >= m_nPixels || maxCount < 1 ) {
+        return 0;
+    }
+    int64_t count = std::min( maxCount, m_nPixels - first );
+    const auto & dims = m_appliedSlice.dims();
+    size_t nDims = dims.size();
+
+    casa::IPosition blc, trc, inc;
+    _subSection( blc, trc, inc );
+    QMutexLocker locker( & m_ccimage-> m_casaMutex );
+
+    // A contiguous range of pixels (in sequential order) is not a box in general, but
+    // it can be split into a handful of boxes. Each box spans the full extent of the
+    // axes below the first non-zero coordinate of its starting position.
+    VI pos( nDims, 0 );
+    int64_t done = 0;
+    while ( done < count ) {
+        // unravel the index of the first pixel of the box
+        int64_t ind = first + done;
+        for ( size_t i = 0 ; i < nDims ; i++ ) {
+            int64_t extent = dims[i].isSingle() ? 1 : dims[i].count;
+            pos[i] = ind % extent;
+            ind /= extent;
+        }
+
+        // find the highest axis at which a box starting at pos can still fit
+        size_t axis = 0;
+        int64_t slabSize = 1;
+        while ( axis + 1 < nDims && pos[axis] == 0 ) {
+            int64_t extent = dims[axis].isSingle() ? 1 : dims[axis].count;
+            if ( slabSize * extent > count - done ) {
+                break;
+            }
+            slabSize *= extent;
+            axis++;
+        }
+        int64_t axisExtent = dims[axis].isSingle() ? 1 : dims[axis].count;
+        int64_t nSlabs = std::min < int64_t > ( axisExtent - pos[axis], ( count - done ) / slabSize );
+        CARTA_ASSERT( nSlabs > 0 );
+
+        // read the box in
+        casa::IPosition start( nDims ), length( nDims, 1 );
+        for ( size_t i = 0 ; i < nDims ; i++ ) {
+            start( i ) = blc( i ) + pos[i] * inc( i );
+            if ( i < axis ) {
+                length( i ) = dims[i].isSingle() ? 1 : dims[i].count;
+            }
+        }
+        length( axis ) = nSlabs;
+        casa::Slicer slicer( start, length, inc, casa::Slicer::endIsLength );
+        casa::Array < PType > box;
+        m_ccimage-> m_casaII-> getSlice( box, slicer );
+
+        bool deleteIt;
+        const PType * data = box.getStorage( deleteIt );
+        std::copy( data, data + box.nelements(), dst + done );
+        box.freeStorage( data, deleteIt );
+
+        done += slabSize * nSlabs;
+    }
+    CARTA_ASSERT( done == count );
+    return count;
+} // _readPixels
 
 template < typename PType >
 const Carta::Lib::NdArray::RawViewInterface::VI &
 CCRawView < PType >::currentPos()
 {
-    qFatal( "Not implemented yet");
     return m_currPosView;
 }
@@ -112,6 +112,17 @@ Carta::Lib::Image::ImageInterface::SharedPtr CasaImageLoader::loadImage( const Q
 
     CCImageBase::SharedPtr res;
     res = tryCast<float>(lat);
+
+    // for plain FITS images we read the pixels from a memory mapping of the file,
+    // which is much faster than going through casacore, and casacore is still
+    // used for everything else
+    if( res && dynamic_cast<casa::FITSImage *>( lat)) {
+        FitsMmapFile::SharedPtr fitsMmap = FitsMmapFile::open( fname);
+        if( fitsMmap && fitsMmap-> dims() == res-> dims()) {
+            qDebug() << "\t-using memory mapped FITS data";
+            std::static_pointer_cast<CCImage<float> >( res)-> setFitsMmap( fitsMmap);
+        }
+    }
     if( ! res) res = tryCast<double>(lat);
     if( ! res) res = tryCast<u_int8_t>(lat);
     if( ! res) res = tryCast<int16_t>(lat);
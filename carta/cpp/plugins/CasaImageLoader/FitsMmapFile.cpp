@@ -0,0 +1,257 @@
+/**
+ *
+ **/
+
+#include "FitsMmapFile.h"
+#include <QtEndian>
+#include <QDebug>
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include <limits>
+
+namespace
+{
+// size of FITS header/data blocks
+static constexpr qint64 FitsBlockSize = 2880;
+
+// size of a single header card
+static constexpr int FitsCardSize = 80;
+
+// load a big-endian value of type Raw from (possibly unaligned) memory
+template < typename Raw, typename UInt >
+static inline Raw
+loadBigEndian( const char * src )
+{
+    static_assert( sizeof( Raw ) == sizeof( UInt ), "size mismatch" );
+    UInt bits;
+    std::memcpy( & bits, src, sizeof( bits ) );
+    bits = qFromBigEndian( bits );
+    Raw raw;
+    std::memcpy( & raw, & bits, sizeof( raw ) );
+    return raw;
+}
+
+// The loops are kept free of branches (apart from the BLANK test) so that the compiler
+// can vectorize them for the common stride == 1 case.
+template < typename Raw, typename UInt >
+static void
+convertRun( const char * __restrict__ src, int64_t count, int64_t stride,
+            float * __restrict__ dst,
+            bool scaling, double bscale, double bzero, bool hasBlank, int64_t blank )
+{
+    const int64_t step = stride * sizeof( Raw );
+    if ( hasBlank ) {
+        const float nan = std::numeric_limits < float >::quiet_NaN();
+        for ( int64_t i = 0 ; i < count ; ++i ) {
+            Raw raw = loadBigEndian < Raw, UInt > ( src + i * step );
+            dst[i] = int64_t( raw ) == blank ? nan : float (bzero + bscale * raw);
+        }
+    }
+    else if ( scaling ) {
+        for ( int64_t i = 0 ; i < count ; ++i ) {
+            Raw raw = loadBigEndian < Raw, UInt > ( src + i * step );
+            dst[i] = float (bzero + bscale * raw);
+        }
+    }
+    else {
+        for ( int64_t i = 0 ; i < count ; ++i ) {
+            dst[i] = float (loadBigEndian < Raw, UInt > ( src + i * step ));
+        }
+    }
+} // convertRun
+
+// parse the value part of a header card, stripping the comment
+static QString
+cardValue( const QByteArray & card )
+{
+    QString value = QString::fromLatin1( card.mid( 10 ) );
+    int slash = value.indexOf( '/' );
+    if ( slash >= 0 ) {
+        value.truncate( slash );
+    }
+    return value.trimmed();
+}
+
+// FITS allows Fortran style exponents (e.g. 1.0D+01)
+static double
+cardDouble( const QByteArray & card, bool * ok )
+{
+    QString value = cardValue( card );
+    value.replace( 'D', 'E' );
+    value.replace( 'd', 'e' );
+    return value.toDouble( ok );
+}
+}
+
+FitsMmapFile::SharedPtr
+FitsMmapFile::open( const QString & fname )
+{
+    // constructor is private, so no make_shared
+    SharedPtr res( new FitsMmapFile() );
+    if ( ! res-> _init( fname ) ) {
+        return nullptr;
+    }
+    return res;
+}
+
+FitsMmapFile::~FitsMmapFile()
+{
+    if ( m_data ) {
+        m_file.unmap( reinterpret_cast < uchar * > ( const_cast < char * > ( m_data ) ) );
+    }
+}
+
+bool
+FitsMmapFile::_init( const QString & fname )
+{
+    m_file.setFileName( fname );
+    if ( ! m_file.open( QIODevice::ReadOnly ) ) {
+        return false;
+    }
+
+    // read the header one block at a time, until we find the END card
+    int naxis = - 1;
+    bool simple = false, ok = true, end = false;
+    qint64 dataOffset = 0;
+    std::vector < int > naxisn;
+    while ( ! end ) {
+        QByteArray block = m_file.read( FitsBlockSize );
+        if ( block.size() != FitsBlockSize ) {
+            return false;
+        }
+        dataOffset += FitsBlockSize;
+        for ( int c = 0 ; c < FitsBlockSize && ! end ; c += FitsCardSize ) {
+            QByteArray card = block.mid( c, FitsCardSize );
+            QByteArray key = card.left( 8 ).trimmed();
+
+            // the very first card has to be SIMPLE
+            if ( dataOffset == FitsBlockSize && c == 0 ) {
+                simple = key == "SIMPLE" && cardValue( card ) == "T";
+                if ( ! simple ) {
+                    return false;
+                }
+                continue;
+            }
+            if ( key == "END" ) {
+                end = true;
+            }
+            else if ( card.mid( 8, 2 ) != "= " ) {
+                // comment, history, etc.
+                continue;
+            }
+            else if ( key == "BITPIX" ) {
+                m_bitpix = cardValue( card ).toInt( & ok );
+            }
+            else if ( key == "NAXIS" ) {
+                naxis = cardValue( card ).toInt( & ok );
+                naxisn.resize( std::max( naxis, 0 ), 0 );
+            }
+            else if ( key.startsWith( "NAXIS" ) ) {
+                int axis = QString::fromLatin1( key.mid( 5 ) ).toInt( & ok ) - 1;
+                if ( ok && axis >= 0 && axis < int ( naxisn.size() ) ) {
+                    naxisn[axis] = cardValue( card ).toInt( & ok );
+                }
+            }
+            else if ( key == "BSCALE" ) {
+                m_bscale = cardDouble( card, & ok );
+            }
+            else if ( key == "BZERO" ) {
+                m_bzero = cardDouble( card, & ok );
+            }
+            else if ( key == "BLANK" ) {
+                m_blank = cardValue( card ).toLongLong( & ok );
+                m_hasBlank = ok;
+            }
+            else if ( key == "GROUPS" ) {
+                // random groups are not an image
+                return false;
+            }
+            if ( ! ok ) {
+                qWarning() << "FitsMmapFile: cannot parse header card" << card;
+                return false;
+            }
+        }
+    }
+
+    // we only map primary HDUs that actually contain an image
+    if ( naxis < 1 ) {
+        return false;
+    }
+    switch ( m_bitpix )
+    {
+    case 8 :
+    case 16 :
+    case 32 :
+    case 64 :
+    case - 32 :
+    case - 64 :
+        m_pixelSize = std::abs( m_bitpix ) / 8;
+        break;
+    default :
+        qWarning() << "FitsMmapFile: unsupported BITPIX" << m_bitpix;
+        return false;
+    }
+    qint64 dataSize = m_pixelSize;
+    for ( int n : naxisn ) {
+        if ( n < 1 ) {
+            return false;
+        }
+        dataSize *= n;
+    }
+
+    // BLANK is only defined for integer data
+    if ( m_bitpix < 0 ) {
+        m_hasBlank = false;
+    }
+    m_native = Q_BYTE_ORDER == Q_BIG_ENDIAN && m_bitpix == - 32
+               && m_bscale == 1.0 && m_bzero == 0.0;
+
+    if ( m_file.size() < dataOffset + dataSize ) {
+        qWarning() << "FitsMmapFile: truncated file" << fname;
+        return false;
+    }
+    uchar * ptr = m_file.map( dataOffset, dataSize );
+    if ( ! ptr ) {
+        qWarning() << "FitsMmapFile: could not map" << fname << m_file.errorString();
+        return false;
+    }
+    m_data = reinterpret_cast < const char * > ( ptr );
+    m_dims = naxisn;
+    return true;
+} // _init
+
+void
+FitsMmapFile::convert( const char * src, int64_t count, int64_t stride, float * dst ) const
+{
+    bool scaling = m_bscale != 1.0 || m_bzero != 0.0;
+    switch ( m_bitpix )
+    {
+    case 8 :
+        convertRun < quint8, quint8 > ( src, count, stride, dst, scaling,
+                                        m_bscale, m_bzero, m_hasBlank, m_blank );
+        break;
+    case 16 :
+        convertRun < qint16, quint16 > ( src, count, stride, dst, scaling,
+                                         m_bscale, m_bzero, m_hasBlank, m_blank );
+        break;
+    case 32 :
+        convertRun < qint32, quint32 > ( src, count, stride, dst, scaling,
+                                         m_bscale, m_bzero, m_hasBlank, m_blank );
+        break;
+    case 64 :
+        convertRun < qint64, quint64 > ( src, count, stride, dst, scaling,
+                                         m_bscale, m_bzero, m_hasBlank, m_blank );
+        break;
+    case - 32 :
+        convertRun < float, quint32 > ( src, count, stride, dst, scaling,
+                                        m_bscale, m_bzero, false, 0 );
+        break;
+    case - 64 :
+        convertRun < double, quint64 > ( src, count, stride, dst, scaling,
+                                         m_bscale, m_bzero, false, 0 );
+        break;
+    default :
+        CARTA_ASSERT( false );
+    } // switch
+} // convert
@@ -0,0 +1,102 @@
+/**
+ * Read-only memory mapping of the primary HDU of a FITS file.
+ **/
+
+#pragma once
+
+#include "CartaLib/CartaLib.h"
+#include <QFile>
+#include <QString>
+#include <cstdint>
+#include <memory>
+#include <vector>
+
+/// Memory mapped data array of the primary HDU of a FITS file.
+///
+/// The pixels are never read in by us, the kernel pages them in from the page cache
+/// on first access, so opening even a huge cube is cheap and the pages are shared
+/// by all layers (and processes) that have the same file open.
+///
+/// FITS stores the data big-endian, possibly scaled by BSCALE/BZERO and with BLANK
+/// marking undefined integer pixels. convert() takes care of all of that, producing
+/// floats (which is also what casa::FITSImage reports for any BITPIX).
+class FitsMmapFile
+{
+    CLASS_BOILERPLATE( FitsMmapFile );
+
+public:
+
+    /// map the primary HDU of the given file
+    /// \return nullptr if the file is not a FITS file, or if the primary HDU does
+    /// not have a data array we can map (e.g. NAXIS = 0, or unsupported BITPIX)
+    static SharedPtr
+    open( const QString & fname );
+
+    ~FitsMmapFile();
+
+    /// dimensions of the data array (NAXIS1, NAXIS2, ...)
+    const std::vector < int > &
+    dims() const
+    {
+        return m_dims;
+    }
+
+    /// raw value of BITPIX
+    int
+    bitpix() const
+    {
+        return m_bitpix;
+    }
+
+    /// size of a single pixel in the mapping, in bytes
+    int
+    pixelSize() const
+    {
+        return m_pixelSize;
+    }
+
+    /// pointer to the first pixel of the data array
+    const char *
+    data() const
+    {
+        return m_data;
+    }
+
+    /// true if the pixels in the mapping are already native floats (i.e. BITPIX=-32
+    /// without scaling on a big-endian host), so they can be handed out directly
+    bool
+    isNative() const
+    {
+        return m_native;
+    }
+
+    /// convert 'count' pixels starting at src into floats, applying byte swapping,
+    /// BLANK, BSCALE and BZERO
+    /// \param stride distance between consecutive source pixels, in pixels
+    void
+    convert( const char * src, int64_t count, int64_t stride, float * dst ) const;
+
+private:
+
+    FitsMmapFile() { }
+
+    /// parse the header and map the data, returns false on failure
+    bool
+    _init( const QString & fname );
+
+    QFile m_file;
+    const char * m_data = nullptr;
+    std::vector < int > m_dims;
+    int m_bitpix = 0;
+    int m_pixelSize = 0;
+    double m_bscale = 1.0;
+    double m_bzero = 0.0;
+    bool m_hasBlank = false;
+    int64_t m_blank = 0;
+    bool m_native = false;
+
+    // disable copy
+    FitsMmapFile( const FitsMmapFile & ) = delete;
+    FitsMmapFile &
+    operator= ( const FitsMmapFile & ) = delete;
+};
@@ -0,0 +1,240 @@
+/**
+ *
+ **/
+
+#include "FitsMmapRawView.h"
+#include <algorithm>
+#include <stdexcept>
+
+FitsMmapRawView::FitsMmapRawView( FitsMmapFile::SharedPtr file, const SliceND & sliceInfo )
+{
+    m_file = file;
+
+    // figure out what data to extract for each of the dimensions
+    m_appliedSlice = sliceInfo.apply( m_file-> dims() );
+
+    _init();
+}
+
+FitsMmapRawView::FitsMmapRawView( FitsMmapFile::SharedPtr file,
+                                  const SliceND::ApplyResult & applyResult )
+{
+    m_file = file;
+    m_appliedSlice = applyResult;
+
+    _init();
+}
+
+void
+FitsMmapRawView::_init()
+{
+    const auto & dims = m_appliedSlice.dims();
+    const auto & fileDims = m_file-> dims();
+
+    // cache the dimensions of the result, and count the pixels
+    m_nPixels = 1;
+    int64_t stride = 1;
+    for ( size_t i = 0 ; i < dims.size() ; i++ ) {
+        m_viewDims.push_back( dims[i].count );
+        m_extents.push_back( dims[i].isSingle() ? 1 : dims[i].count );
+        m_nPixels *= m_extents.back();
+        m_fileStrides.push_back( stride );
+        stride *= fileDims[i];
+    }
+
+    // find out how many leading axes are stored in the file exactly as we see them
+    m_nContiguousAxes = 0;
+    while ( m_nContiguousAxes < dims.size()
+            && dims[m_nContiguousAxes].start == 0
+            && dims[m_nContiguousAxes].step == 1
+            && m_extents[m_nContiguousAxes] == fileDims[m_nContiguousAxes] ) {
+        m_nContiguousAxes++;
+    }
+
+    m_currPosView.resize( dims.size(), 0 );
+    m_currBlockDims.resize( dims.size(), 0 );
+} // _init
+
+const char *
+FitsMmapRawView::_pixelPtr( const VI & pos ) const
+{
+    const auto & dims = m_appliedSlice.dims();
+    int64_t offset = 0;
+    for ( size_t i = 0 ; i < dims.size() ; i++ ) {
+        offset += ( dims[i].start + int64_t( pos[i] ) * dims[i].step ) * m_fileStrides[i];
+    }
+    return m_file-> data() + offset * m_file-> pixelSize();
+}
+
+const char *
+FitsMmapRawView::get( const VI & pos )
+{
+    // preconditions
+    if ( CARTA_RUNTIME_CHECKS && pos.size() > dims().size() ) {
+        throw std::runtime_error( "invalid position" );
+    }
+
+    // missing coordinates are 0
+    VI fullPos( m_viewDims.size(), 0 );
+    std::copy( pos.begin(), pos.end(), fullPos.begin() );
+    m_file-> convert( _pixelPtr( fullPos ), 1, 1, & m_buff );
+    return reinterpret_cast < const char * > ( & m_buff );
+}
+
+Carta::Lib::NdArray::RawViewInterface *
+FitsMmapRawView::getView( const SliceND & sliceInfo )
+{
+    // apply the slice to dimensions of this view
+    SliceND::ApplyResult ar = sliceInfo.apply( dims() );
+
+    // create applied result that combines m_appliedSlice with ar
+    SliceND::ApplyResult newAr = SliceND::ApplyResult::combine( m_appliedSlice, ar );
+
+    // return a new view based on the new slice
+    return new FitsMmapRawView( m_file, newAr );
+}
+
+int64_t
+FitsMmapRawView::read( int64_t buffSize, char * buff, Traversal traversal )
+{
+    Q_UNUSED( traversal );
+    int64_t count = _readPixels( m_nextReadPixel, buffSize / sizeof( float ),
+                                 reinterpret_cast < float * > ( buff ) );
+    m_nextReadPixel += count;
+    return count * sizeof( float );
+}
+
+int64_t
+FitsMmapRawView::read( int64_t chunk, int64_t buffSize, char * buff, Traversal traversal )
+{
+    Q_UNUSED( traversal );
+    int64_t chunkPixels = buffSize / sizeof( float );
+    int64_t count = _readPixels( chunk * chunkPixels, chunkPixels,
+                                 reinterpret_cast < float * > ( buff ) );
+    return count * sizeof( float );
+}
+
+void
+FitsMmapRawView::forEach( std::function < void (const char *) > func, Traversal traversal )
+{
+    if ( m_nPixels == 0 ) {
+        return;
+    }
+
+    // walk the view in bounded blocks, and then pixel by pixel inside each block
+    int64_t blockPixels = DefaultBlockPixels;
+    blockPixels = std::min( blockPixels, m_nPixels );
+    std::vector < float > buffer( blockPixels );
+    auto blockFunc = [& func] ( const char * data, int64_t count ) -> void {
+        const float * ptr = reinterpret_cast < const float * > ( data );
+        for ( int64_t i = 0 ; i < count ; ++i ) {
+            func( reinterpret_cast < const char * > ( ptr + i ) );
+        }
+    };
+    forEach( blockPixels * sizeof( float ), blockFunc,
+             reinterpret_cast < char * > ( & buffer[0] ), traversal );
+} // forEach
+
+void
+FitsMmapRawView::forEach(
+    int64_t buffSize,
+    std::function < void (const char *, int64_t) > func,
+    char * buff,
+    Traversal traversal )
+{
+    // the data is stored in sequential order, so that is also the optimal order
+    Q_UNUSED( traversal );
+
+    int64_t maxPixels = buffSize / sizeof( float );
+    if ( maxPixels < 1 ) {
+        throw std::runtime_error( "buffer too small for a single pixel" );
+    }
+    if ( m_nPixels == 0 ) {
+        return;
+    }
+    const auto & dims = m_appliedSlice.dims();
+    size_t nDims = dims.size();
+
+    // Blocks span the full extent of the leading axes, a partial extent of the next
+    // axis and 1 for the rest, so consecutive blocks are consecutive ranges of pixels.
+    size_t axis = 0;
+    int64_t slabSize = 1;
+    while ( axis < nDims && slabSize * m_extents[axis] <= maxPixels ) {
+        slabSize *= m_extents[axis];
+        axis++;
+    }
+    int64_t nSlabs = axis < nDims ? maxPixels / slabSize : 1;
+
+    // can we hand out pointers into the mapping?
+    bool zeroCopy = ! buff && m_file-> isNative() && axis <= m_nContiguousAxes
+                    && ( axis == nDims || nSlabs == 1 || dims[axis].step == 1 );
+
+    std::vector < float > ownBuffer;
+    float * dst = reinterpret_cast < float * > ( buff );
+    if ( ! dst && ! zeroCopy ) {
+        ownBuffer.resize( std::min( m_nPixels, slabSize * nSlabs ) );
+        dst = & ownBuffer[0];
+    }
+
+    for ( int64_t first = 0 ; first < m_nPixels ; ) {
+        // unravel the index of the first pixel of the block
+        int64_t ind = first;
+        for ( size_t i = 0 ; i < nDims ; i++ ) {
+            m_currPosView[i] = ind % m_extents[i];
+            ind /= m_extents[i];
+            m_currBlockDims[i] = i < axis ? m_extents[i] : 1;
+        }
+        int64_t count = slabSize;
+        if ( axis < nDims ) {
+            m_currBlockDims[axis] = std::min < int64_t > (
+                nSlabs, m_extents[axis] - m_currPosView[axis] );
+            count *= m_currBlockDims[axis];
+        }
+
+        if ( zeroCopy ) {
+            func( _pixelPtr( m_currPosView ), count );
+        }
+        else {
+            _readPixels( first, count, dst );
+            func( reinterpret_cast < const char * > ( dst ), count );
+        }
+        first += count;
+    }
+} // forEach
+
+int64_t
+FitsMmapRawView::_readPixels( int64_t first, int64_t maxCount, float * dst )
+{
+    if ( first < 0 || first >= m_nPixels || maxCount < 1 ) {
+        return 0;
+    }
+    int64_t count = std::min( maxCount, m_nPixels - first );
+    const auto & dims = m_appliedSlice.dims();
+    size_t nDims = dims.size();
+
+    // unravel the index of the first pixel
+    VI pos( nDims, 0 );
+    int64_t ind = first;
+    for ( size_t i = 0 ; i < nDims ; i++ ) {
+        pos[i] = ind % m_extents[i];
+        ind /= m_extents[i];
+    }
+
+    // convert one row (or its remainder) at a time
+    int64_t done = 0;
+    while ( done < count ) {
+        int64_t n = std::min < int64_t > ( m_extents[0] - pos[0], count - done );
+        m_file-> convert( _pixelPtr( pos ), n, dims[0].step, dst + done );
+        done += n;
+
+        // advance to the beginning of the next row
+        pos[0] = 0;
+        for ( size_t i = 1 ; i < nDims ; i++ ) {
+            if ( ++pos[i] < m_extents[i] ) {
+                break;
+            }
+            pos[i] = 0;
+        }
+    }
+    return count;
+} // _readPixels
@@ -0,0 +1,134 @@
+/**
+ *
+ **/
+
+#pragma once
+
+#include "FitsMmapFile.h"
+#include "CartaLib/IImage.h"
+
+/// Raw view into a memory mapped FITS data array (see FitsMmapFile).
+///
+/// The pixels are read straight from the mapping and converted to floats block by
+/// block. When the mapping already contains native floats and a block is contiguous
+/// in the file, the buffered forEach() hands out pointers into the mapping itself.
+///
+/// The data array is stored in sequential order, which is therefore also the optimal
+/// traversal.
+///
+/// \warning We are not handling negative step
+/// \warning We are not handling 'index' slices, i.e. axis removal
+class FitsMmapRawView
+    : public Carta::Lib::NdArray::RawViewInterface
+{
+public:
+
+    /// construct a view on the mapped file from provided slice information
+    /// \param file the mapping, we keep a shared pointer so that the view can outlive
+    /// the image
+    /// \param sliceInfo for which part of the data to create view
+    FitsMmapRawView( FitsMmapFile::SharedPtr file, const SliceND & sliceInfo );
+
+    virtual PixelType
+    pixelType() override
+    {
+        return PixelType::Real32;
+    }
+
+    virtual const VI &
+    dims() override
+    {
+        return m_viewDims;
+    }
+
+    virtual const char *
+    get( const VI & pos ) override;
+
+    virtual void
+    forEach( std::function < void (const char *) > func, Traversal traversal ) override;
+
+    virtual const VI &
+    currentPos() override
+    {
+        return m_currPosView;
+    }
+
+    virtual const VI &
+    currentBlockDims() override
+    {
+        return m_currBlockDims;
+    }
+
+    virtual RawViewInterface *
+    getView( const SliceND & sliceInfo ) override;
+
+    virtual int64_t
+    read( int64_t buffSize, char * buff,
+          Traversal traversal = Traversal::Sequential ) override;
+
+    virtual void
+    seek( int64_t ind ) override
+    {
+        CARTA_ASSERT( ind >= 0 );
+        m_nextReadPixel = ind;
+    }
+
+    virtual int64_t
+    read( int64_t chunk, int64_t buffSize, char * buff,
+          Traversal traversal = Traversal::Sequential ) override;
+
+    /// If buff is nullptr and no conversion is needed, the function is handed
+    /// pointers straight into the mapping.
+    virtual void
+    forEach(
+        int64_t buffSize,
+        std::function < void (const char *, int64_t count) > func,
+        char * buff = nullptr,
+        Traversal traversal = Traversal::Sequential ) override;
+
+protected:
+
+    /// construct a view directly from applied slice
+    FitsMmapRawView( FitsMmapFile::SharedPtr file, const SliceND::ApplyResult & applyResult );
+
+    /// finish construction (common code for both constructors)
+    void
+    _init();
+
+    /// pointer to the pixel at the given view coordinates
+    const char *
+    _pixelPtr( const VI & pos ) const;
+
+    /// read up to maxCount pixels starting at the given pixel index (in sequential
+    /// order) into dst, returns the number of pixels read
+    int64_t
+    _readPixels( int64_t first, int64_t maxCount, float * dst );
+
+    FitsMmapFile::SharedPtr m_file = nullptr;
+    SliceND::ApplyResult m_appliedSlice;
+    VI m_viewDims;
+    VI m_currPosView;
+    VI m_currBlockDims;
+
+    /// extents of the view (single index slices have extent 1)
+    std::vector < int64_t > m_extents;
+
+    /// distance between neighbouring pixels along each axis of the file, in pixels
+    std::vector < int64_t > m_fileStrides;
+
+    /// number of leading axes that cover the whole file extent with step 1, i.e.
+    /// a block spanning these axes is contiguous in the mapping
+    size_t m_nContiguousAxes = 0;
+
+    /// number of pixels in this view
+    int64_t m_nPixels = 0;
+
+    /// where the next stateful read() will start
+    int64_t m_nextReadPixel = 0;
+
+    /// buffer for reporting results when calling get()
+    float m_buff;
+
+    /// block size used by the per-pixel forEach()
+    static constexpr int64_t DefaultBlockPixels = 1024 * 1024;
+};
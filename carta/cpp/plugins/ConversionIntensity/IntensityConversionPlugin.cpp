@@ -4,6 +4,7 @@
 #include "plugins/ConversionIntensity/IntensityConversionPlugin.h"
 #include "plugins/ConversionIntensity/ConverterIntensity.h"
 #include <QDebug>
+#include <QMutexLocker>
 
 IntensityConversionPlugin::IntensityConversionPlugin( QObject * parent ) :
     QObject( parent )
@@ -57,7 +58,9 @@ IntensityConversionPlugin::handleHook( BaseHook & hookData ){
             }
             CCImageBase * base = dynamic_cast<CCImageBase*>( image.get() );
             if ( base ){
+                QMutexLocker locker( &base->getCasaMutex() );
                 casa::ImageInfo information = base->getImageInfo();
+                locker.unlock();
                 casa::Double beamAngle;
                 casa::Double beamArea;
                 _getBeamInfo( information, beamAngle, beamArea );
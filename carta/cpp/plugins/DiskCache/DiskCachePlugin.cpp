@@ -0,0 +1,111 @@
+#include "DiskCachePlugin.h"
+#include "LogStore.h"
+#include "CartaLib/Hooks/GetPersistentCache.h"
+#include "CartaLib/Hooks/Initialize.h"
+#include <QDebug>
+#include <QDir>
+#include <algorithm>
+#include <stdexcept>
+
+typedef Carta::Lib::Hooks::GetPersistentCache GetPersistentCache;
+typedef Carta::Lib::Hooks::Initialize Initialize;
+
+/// IPCache on top of a LogStore
+class DiskCache : public Carta::Lib::IPCache
+{
+public:
+
+    DiskCache( const QString & dbPath, uint64_t maxStorage )
+        : m_store( dbPath, maxStorage )
+    { }
+
+    virtual uint64_t
+    maxStorage() override
+    {
+        return m_store.maxBytes();
+    }
+
+    virtual uint64_t
+    usedStorage() override
+    {
+        return m_store.usedBytes();
+    }
+
+    virtual uint64_t
+    nEntries() override
+    {
+        return m_store.count();
+    }
+
+    virtual void
+    deleteAll() override
+    {
+        m_store.clear();
+    }
+
+    virtual void
+    readEntry( const QByteArray & key, QByteArray & val ) override
+    {
+        m_store.read( key, val );
+    }
+
+    virtual void
+    setEntry( const QByteArray & key, const QByteArray & val, int64_t priority ) override
+    {
+        m_store.write( key, val, priority );
+    }
+
+private:
+
+    LogStore m_store;
+};
+
+DiskCachePlugin::DiskCachePlugin( QObject * parent ) :
+    QObject( parent )
+{ }
+
+bool
+DiskCachePlugin::handleHook( BaseHook & hookData )
+{
+    if ( hookData.is < Initialize > () ) {
+        return true;
+    }
+    else if ( hookData.is < GetPersistentCache > () ) {
+        GetPersistentCache & hook = static_cast < GetPersistentCache & > ( hookData );
+        if ( ! m_cache ) {
+            try {
+                m_cache = std::make_shared < DiskCache > ( m_dbPath, m_maxStorage );
+                qDebug() << "DiskCachePlugin: opened" << m_dbPath << "with"
+                         << m_cache-> nEntries() << "entries";
+            }
+            catch ( const std::runtime_error & err ) {
+                qWarning() << "DiskCachePlugin: could not open the cache:" << err.what();
+                return false;
+            }
+        }
+        hook.result = m_cache;
+        return true;
+    }
+
+    qWarning() << "DiskCachePlugin: Sorrry, dont' know how to handle this hook";
+    return false;
+} // handleHook
+
+std::vector < HookId >
+DiskCachePlugin::getInitialHookList()
+{
+    return {
+               Initialize::staticId,
+               GetPersistentCache::staticId
+    };
+}
+
+void
+DiskCachePlugin::initialize( const IPlugin::InitInfo & initInfo )
+{
+    // settings come from the "DiskCache" entry in the "plugins" section of config.json
+    m_dbPath = initInfo.json.value( "dbPath" ).toString(
+        QDir::homePath() + "/.cartavis/pcache" );
+    int maxStorageMB = initInfo.json.value( "maxStorageMB" ).toInt( 4096 );
+    m_maxStorage = uint64_t( std::max( maxStorageMB, 1 ) ) * 1024 * 1024;
+}
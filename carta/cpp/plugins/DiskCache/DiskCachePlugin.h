@@ -0,0 +1,39 @@
+/// This plugin provides a persistent cache, stored on disk.
+
+#pragma once
+
+#include "CartaLib/IPlugin.h"
+#include "CartaLib/IPCache.h"
+#include <QObject>
+#include <QString>
+
+class DiskCachePlugin : public QObject, public IPlugin
+{
+    Q_OBJECT
+    Q_PLUGIN_METADATA( IID "org.cartaviewer.IPlugin" )
+    Q_INTERFACES( IPlugin );
+
+public:
+
+    DiskCachePlugin( QObject * parent = 0 );
+
+    virtual bool
+    handleHook( BaseHook & hookData ) override;
+
+    virtual std::vector < HookId >
+    getInitialHookList() override;
+
+    virtual void
+    initialize( const InitInfo & initInfo ) override;
+
+private:
+
+    /// directory of the cache
+    QString m_dbPath;
+
+    /// size limit of the cache
+    uint64_t m_maxStorage = 0;
+
+    /// the cache, created when it is first asked for
+    Carta::Lib::IPCache::SharedPtr m_cache = nullptr;
+};
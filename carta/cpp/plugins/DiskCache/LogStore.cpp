@@ -0,0 +1,500 @@
+/**
+ *
+ **/
+
+#include "LogStore.h"
+#include <QDebug>
+#include <QDir>
+#include <QReadLocker>
+#include <QWriteLocker>
+#include <algorithm>
+#include <cstring>
+#include <stdexcept>
+#include <tuple>
+#include <vector>
+#include <fcntl.h>
+#include <sys/file.h>
+#include <unistd.h>
+
+constexpr uint64_t LogStore::HeaderBytes;
+constexpr uint64_t LogStore::MinGarbageBytes;
+
+namespace
+{
+/// marks the start of every record
+const uint32_t RecordMagic = 0x4c524350;
+
+/// value size of tombstones
+const uint32_t Tombstone = 0xffffffff;
+
+std::vector < uint32_t >
+makeCrcTable()
+{
+    std::vector < uint32_t > table( 256 );
+    for ( uint32_t i = 0 ; i < 256 ; ++i ) {
+        uint32_t c = i;
+        for ( int k = 0 ; k < 8 ; ++k ) {
+            c = ( c & 1 ) ? 0xedb88320 ^ ( c >> 1 ) : c >> 1;
+        }
+        table[i] = c;
+    }
+    return table;
+}
+
+/// CRC-32 (IEEE)
+uint32_t
+crc32( uint32_t crc, const char * data, uint64_t size )
+{
+    static const std::vector < uint32_t > table = makeCrcTable();
+    crc = ~crc;
+    for ( uint64_t i = 0 ; i < size ; ++i ) {
+        crc = table[( crc ^ uint8_t( data[i] ) ) & 0xff] ^ ( crc >> 8 );
+    }
+    return ~crc;
+}
+
+/// record header, as it is stored in the log (host byte order)
+struct Header {
+    uint32_t magic;
+
+    /// CRC of the rest of the header and the key
+    uint32_t headerCrc;
+    uint32_t valueCrc;
+    uint32_t keyBytes;
+    uint32_t valueBytes;
+    uint32_t reserved;
+    int64_t priority;
+};
+
+static_assert( sizeof( Header ) == 32, "unexpected padding in the record header" );
+
+uint32_t
+headerCrc( const Header & header, const char * key )
+{
+    const char * fields = reinterpret_cast < const char * > ( & header ) + 8;
+    uint32_t crc = crc32( 0, fields, sizeof( Header ) - 8 );
+    return crc32( crc, key, header.keyBytes );
+}
+
+/// pread() until all bytes are read, returns false on errors and end of file
+bool
+readFully( int fd, char * buff, uint64_t size, uint64_t offset )
+{
+    while ( size > 0 ) {
+        ssize_t n = ::pread( fd, buff, size, offset );
+        if ( n <= 0 ) {
+            return false;
+        }
+        buff += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+/// pwrite() until all bytes are written, returns false on errors
+bool
+writeFully( int fd, const char * buff, uint64_t size, uint64_t offset )
+{
+    while ( size > 0 ) {
+        ssize_t n = ::pwrite( fd, buff, size, offset );
+        if ( n <= 0 ) {
+            return false;
+        }
+        buff += n;
+        size -= n;
+        offset += n;
+    }
+    return true;
+}
+
+/// fsync() a directory, so that a rename in it is durable
+void
+syncDir( const QString & dirPath )
+{
+    int fd = ::open( dirPath.toLocal8Bit().constData(), O_RDONLY );
+    if ( fd >= 0 ) {
+        ::fsync( fd );
+        ::close( fd );
+    }
+}
+}
+
+LogStore::LogStore( const QString & dirPath, uint64_t maxBytes )
+    : m_clock( 0 )
+{
+    m_dirPath = dirPath;
+    m_logPath = QDir( dirPath ).filePath( "pcache.log" );
+    m_maxBytes = maxBytes;
+    if ( ! QDir().mkpath( dirPath ) ) {
+        throw std::runtime_error( "could not create " + dirPath.toStdString() );
+    }
+    _open();
+    try {
+        _load();
+    }
+    catch ( ... ) {
+        _close();
+        throw;
+    }
+
+    // the limit may have shrunk since last time
+    QWriteLocker locker( & m_lock );
+    if ( m_liveBytes > m_maxBytes ) {
+        _evict( m_maxBytes );
+    }
+    _compactIfNeeded();
+}
+
+LogStore::~LogStore()
+{
+    _close();
+}
+
+void
+LogStore::_open()
+{
+    QString lockPath = QDir( m_dirPath ).filePath( "pcache.lock" );
+    m_lockFd = ::open( lockPath.toLocal8Bit().constData(), O_RDWR | O_CREAT, 0644 );
+    if ( m_lockFd < 0 ) {
+        throw std::runtime_error( "could not open " + lockPath.toStdString() );
+    }
+    if ( ::flock( m_lockFd, LOCK_EX | LOCK_NB ) != 0 ) {
+        _close();
+        throw std::runtime_error( m_dirPath.toStdString() + " is locked by another store" );
+    }
+    m_fd = ::open( m_logPath.toLocal8Bit().constData(), O_RDWR | O_CREAT, 0644 );
+    if ( m_fd < 0 ) {
+        _close();
+        throw std::runtime_error( "could not open " + m_logPath.toStdString() );
+    }
+}
+
+void
+LogStore::_close()
+{
+    if ( m_fd >= 0 ) {
+        ::fsync( m_fd );
+        ::close( m_fd );
+        m_fd = - 1;
+    }
+
+    // closing the file releases the lock
+    if ( m_lockFd >= 0 ) {
+        ::close( m_lockFd );
+        m_lockFd = - 1;
+    }
+}
+
+void
+LogStore::_load()
+{
+    uint64_t fileSize = ::lseek( m_fd, 0, SEEK_END );
+    uint64_t offset = 0;
+    std::vector < char > key;
+    while ( offset + HeaderBytes <= fileSize ) {
+        Header header;
+        if ( ! readFully( m_fd, reinterpret_cast < char * > ( & header ), HeaderBytes, offset ) ||
+             header.magic != RecordMagic ) {
+            break;
+        }
+        uint64_t valueBytes = header.valueBytes == Tombstone ? 0 : header.valueBytes;
+        uint64_t recordBytes = HeaderBytes + header.keyBytes + valueBytes;
+        if ( offset + recordBytes > fileSize ) {
+            break;
+        }
+        key.resize( header.keyBytes );
+        if ( ! readFully( m_fd, key.data(), header.keyBytes, offset + HeaderBytes ) ||
+             headerCrc( header, key.data() ) != header.headerCrc ) {
+            break;
+        }
+
+        // replay the record
+        std::string keyStr( key.data(), key.size() );
+        auto it = m_index.find( keyStr );
+        if ( it != m_index.end() ) {
+            m_liveBytes -= it-> second.recordBytes;
+            m_index.erase( it );
+        }
+        if ( header.valueBytes != Tombstone ) {
+            Entry & entry = m_index[keyStr];
+            entry.valueOffset = offset + HeaderBytes + header.keyBytes;
+            entry.valueBytes = header.valueBytes;
+            entry.valueCrc = header.valueCrc;
+            entry.recordBytes = recordBytes;
+            entry.priority = header.priority;
+            entry.lastAccess = m_clock++;
+            m_liveBytes += recordBytes;
+        }
+        offset += recordBytes;
+    }
+
+    // whatever follows the last good record is the remains of an interrupted write
+    if ( offset < fileSize ) {
+        qWarning() << "LogStore: dropping" << fileSize - offset << "bytes of damaged records from"
+                   << m_logPath;
+        if ( ::ftruncate( m_fd, offset ) != 0 ) {
+            throw std::runtime_error( "could not truncate " + m_logPath.toStdString() );
+        }
+    }
+    m_fileBytes = offset;
+} // _load
+
+bool
+LogStore::_append( const std::string & key,
+                   const char * val,
+                   uint32_t valBytes,
+                   int64_t priority,
+                   Entry & entry )
+{
+    Header header;
+    header.magic = RecordMagic;
+    header.valueCrc = val ? crc32( 0, val, valBytes ) : 0;
+    header.keyBytes = key.size();
+    header.valueBytes = val ? valBytes : Tombstone;
+    header.reserved = 0;
+    header.priority = priority;
+    header.headerCrc = headerCrc( header, key.data() );
+
+    uint64_t valueBytes = val ? valBytes : 0;
+    std::vector < char > record( HeaderBytes + key.size() + valueBytes );
+    std::memcpy( record.data(), & header, HeaderBytes );
+    std::memcpy( record.data() + HeaderBytes, key.data(), key.size() );
+    if ( val ) {
+        std::memcpy( record.data() + HeaderBytes + key.size(), val, valueBytes );
+    }
+    if ( ! writeFully( m_fd, record.data(), record.size(), m_fileBytes ) ) {
+        qWarning() << "LogStore: could not write to" << m_logPath;
+
+        // cut off whatever made it, so that later records are not lost behind it
+        if ( ::ftruncate( m_fd, m_fileBytes ) != 0 ) {
+            qWarning() << "LogStore: could not truncate" << m_logPath;
+        }
+        return false;
+    }
+    entry.valueOffset = m_fileBytes + HeaderBytes + key.size();
+    entry.valueBytes = valBytes;
+    entry.valueCrc = header.valueCrc;
+    entry.recordBytes = record.size();
+    entry.priority = priority;
+    m_fileBytes += record.size();
+    return true;
+} // _append
+
+bool
+LogStore::read( const QByteArray & key, QByteArray & val )
+{
+    std::string keyStr( key.constData(), key.size() );
+    bool damaged = false;
+    uint64_t damagedOffset = 0;
+    uint32_t damagedBytes = 0;
+    {
+        QReadLocker locker( & m_lock );
+        auto it = m_index.find( keyStr );
+        if ( it == m_index.end() ) {
+            val = QByteArray();
+            return false;
+        }
+        Entry & entry = it-> second;
+        val.resize( entry.valueBytes );
+        if ( readFully( m_fd, val.data(), entry.valueBytes, entry.valueOffset ) &&
+             crc32( 0, val.constData(), entry.valueBytes ) == entry.valueCrc ) {
+            QMutexLocker accessLocker( & m_accessMutex );
+            entry.lastAccess = m_clock++;
+            return true;
+        }
+        damaged = true;
+        damagedOffset = entry.valueOffset;
+        damagedBytes = entry.valueBytes;
+    }
+
+    // the value did not survive, forget about it, unless another thread has written
+    // a new value for the key while we were not holding the lock
+    if ( damaged ) {
+        qWarning() << "LogStore: damaged value in" << m_logPath;
+        QWriteLocker locker( & m_lock );
+        auto it = m_index.find( keyStr );
+        if ( it != m_index.end() && it-> second.valueOffset == damagedOffset &&
+             it-> second.valueBytes == damagedBytes ) {
+            _remove( keyStr );
+        }
+    }
+    val = QByteArray();
+    return false;
+} // read
+
+void
+LogStore::write( const QByteArray & key, const QByteArray & val, int64_t priority )
+{
+    std::string keyStr( key.constData(), key.size() );
+    uint64_t recordBytes = HeaderBytes + key.size() + val.size();
+    QWriteLocker locker( & m_lock );
+    if ( recordBytes > m_maxBytes ) {
+        _remove( keyStr );
+        return;
+    }
+    Entry entry;
+    if ( ! _append( keyStr, val.constData(), val.size(), priority, entry ) ) {
+        return;
+    }
+    entry.lastAccess = m_clock++;
+    auto it = m_index.find( keyStr );
+    if ( it != m_index.end() ) {
+        m_liveBytes -= it-> second.recordBytes;
+    }
+    m_index[keyStr] = entry;
+    m_liveBytes += entry.recordBytes;
+
+    // evict a bit more than needed, so that the next few writes do not evict again
+    if ( m_liveBytes > m_maxBytes ) {
+        _evict( m_maxBytes - m_maxBytes / 10 );
+    }
+    _compactIfNeeded();
+} // write
+
+void
+LogStore::remove( const QByteArray & key )
+{
+    QWriteLocker locker( & m_lock );
+    _remove( std::string( key.constData(), key.size() ) );
+    _compactIfNeeded();
+}
+
+void
+LogStore::_remove( const std::string & key )
+{
+    auto it = m_index.find( key );
+    if ( it == m_index.end() ) {
+        return;
+    }
+    m_liveBytes -= it-> second.recordBytes;
+    m_index.erase( it );
+    Entry tombstone;
+    _append( key, nullptr, 0, 0, tombstone );
+}
+
+void
+LogStore::clear()
+{
+    QWriteLocker locker( & m_lock );
+    m_index.clear();
+    m_liveBytes = 0;
+    m_fileBytes = 0;
+    if ( ::ftruncate( m_fd, 0 ) != 0 ) {
+        qWarning() << "LogStore: could not truncate" << m_logPath;
+    }
+    ::fsync( m_fd );
+}
+
+uint64_t
+LogStore::usedBytes()
+{
+    QReadLocker locker( & m_lock );
+    return m_liveBytes;
+}
+
+uint64_t
+LogStore::count()
+{
+    QReadLocker locker( & m_lock );
+    return m_index.size();
+}
+
+uint64_t
+LogStore::fileBytes()
+{
+    QReadLocker locker( & m_lock );
+    return m_fileBytes;
+}
+
+void
+LogStore::_evict( uint64_t maxBytes )
+{
+    // lowest priority first, least recently used first among the same priority
+    std::vector < std::tuple < int64_t, uint64_t, std::string > > order;
+    order.reserve( m_index.size() );
+    for ( const auto & kv : m_index ) {
+        order.push_back( std::make_tuple( kv.second.priority, kv.second.lastAccess, kv.first ) );
+    }
+    std::sort( order.begin(), order.end() );
+    for ( const auto & item : order ) {
+        if ( m_liveBytes <= maxBytes ) {
+            break;
+        }
+        _remove( std::get < 2 > ( item ) );
+    }
+}
+
+void
+LogStore::compact()
+{
+    QWriteLocker locker( & m_lock );
+    _compact();
+}
+
+void
+LogStore::_compactIfNeeded()
+{
+    uint64_t garbage = m_fileBytes - m_liveBytes;
+    if ( garbage >= MinGarbageBytes && garbage > m_liveBytes ) {
+        _compact();
+    }
+}
+
+void
+LogStore::_compact()
+{
+    // copy the live records, least recently used first, so that reloading the log
+    // gives back the same LRU order
+    std::vector < std::pair < uint64_t, std::string > > order;
+    order.reserve( m_index.size() );
+    for ( const auto & kv : m_index ) {
+        order.push_back( std::make_pair( kv.second.lastAccess, kv.first ) );
+    }
+    std::sort( order.begin(), order.end() );
+
+    QString tmpPath = m_logPath + ".compact";
+    int fd = ::open( tmpPath.toLocal8Bit().constData(), O_RDWR | O_CREAT | O_TRUNC, 0644 );
+    if ( fd < 0 ) {
+        qWarning() << "LogStore: could not create" << tmpPath;
+        return;
+    }
+    std::vector < uint64_t > newOffsets;
+    newOffsets.reserve( order.size() );
+    uint64_t offset = 0;
+    std::vector < char > record;
+    bool ok = true;
+    for ( const auto & item : order ) {
+        const Entry & entry = m_index[item.second];
+        uint64_t recordStart = entry.valueOffset - HeaderBytes - item.second.size();
+        record.resize( entry.recordBytes );
+        if ( ! readFully( m_fd, record.data(), entry.recordBytes, recordStart ) ||
+             ! writeFully( fd, record.data(), entry.recordBytes, offset ) ) {
+            ok = false;
+            break;
+        }
+        newOffsets.push_back( offset + HeaderBytes + item.second.size() );
+        offset += entry.recordBytes;
+    }
+    if ( ok ) {
+        ok = ::fsync( fd ) == 0;
+    }
+    if ( ok ) {
+        ok = ::rename( tmpPath.toLocal8Bit().constData(), m_logPath.toLocal8Bit().constData() ) == 0;
+    }
+    if ( ! ok ) {
+        qWarning() << "LogStore: compaction of" << m_logPath << "failed";
+        ::close( fd );
+        ::unlink( tmpPath.toLocal8Bit().constData() );
+        return;
+    }
+    syncDir( m_dirPath );
+
+    // switch over to the new log
+    ::close( m_fd );
+    m_fd = fd;
+    m_fileBytes = offset;
+    for ( size_t i = 0 ; i < order.size() ; ++i ) {
+        m_index[order[i].second].valueOffset = newOffsets[i];
+    }
+} // _compact
@@ -0,0 +1,178 @@
+/**
+ * Embedded log-structured key/value store.
+ **/
+
+#pragma once
+
+#include "CartaLib/CartaLib.h"
+#include <QByteArray>
+#include <QMutex>
+#include <QReadWriteLock>
+#include <QString>
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include <unordered_map>
+
+/// Key/value store kept in a single append-only file.
+///
+/// Every write appends a record (header, key, value) to the log, and an in-memory
+/// index maps keys to the offset of their latest value. Removals append a tombstone.
+/// The header and key of each record are protected by a CRC, so if the application
+/// dies in the middle of a write, the damaged tail of the log is detected and cut off
+/// the next time the store is opened. Values have a CRC of their own, which is checked
+/// when they are read, so opening the store does not need to read all values.
+///
+/// Once the log holds too much garbage (old values and tombstones), the live records
+/// are copied into a new file, which then replaces the log atomically (rename), so a
+/// crash during compaction leaves the old log intact.
+///
+/// When the live data exceeds the size limit, entries are evicted in order of
+/// priority (lowest first), and among entries of the same priority, least recently
+/// used first.
+///
+/// Any number of threads can read at the same time (values are read with pread(),
+/// so readers do not share a file position), writes are serialized. Only one store
+/// (in any process) can have the directory open at a time, this is enforced with an
+/// flock() on a lock file next to the log. It is not taken on the log itself, because
+/// compaction replaces that file.
+class LogStore
+{
+    CLASS_BOILERPLATE( LogStore );
+
+public:
+
+    /// opens the store in the given directory, creating it if needed
+    /// \param dirPath directory for the log file
+    /// \param maxBytes size limit for the live data (records of the current values)
+    /// \throws std::runtime_error if the log cannot be opened, or another store has
+    /// it open already
+    LogStore( const QString & dirPath, uint64_t maxBytes );
+
+    ~LogStore();
+
+    /// read the value of an entry, returns false (and sets val to a null array)
+    /// if there is no such entry
+    bool
+    read( const QByteArray & key, QByteArray & val );
+
+    /// set the value of an entry, values larger than the limit are not stored
+    void
+    write( const QByteArray & key, const QByteArray & val, int64_t priority );
+
+    /// remove an entry
+    void
+    remove( const QByteArray & key );
+
+    /// remove all entries
+    void
+    clear();
+
+    /// size limit for the live data
+    uint64_t
+    maxBytes() const
+    {
+        return m_maxBytes;
+    }
+
+    /// size of the live data, in bytes
+    uint64_t
+    usedBytes();
+
+    /// number of entries
+    uint64_t
+    count();
+
+    /// size of the log file, including garbage
+    uint64_t
+    fileBytes();
+
+    /// rewrite the log with only the live records
+    void
+    compact();
+
+    /// bytes of a record, apart from the key and the value
+    static constexpr uint64_t HeaderBytes = 32;
+
+    /// the log is compacted when it has at least this much garbage, and the garbage
+    /// is more than the live data
+    static constexpr uint64_t MinGarbageBytes = 16 * 1024 * 1024;
+
+private:
+
+    struct Entry {
+        /// offset of the value in the log
+        uint64_t valueOffset;
+        uint32_t valueBytes;
+        uint32_t valueCrc;
+
+        /// bytes of the whole record
+        uint64_t recordBytes;
+        int64_t priority;
+
+        /// value of m_clock at the last access
+        uint64_t lastAccess;
+    };
+
+    /// reads the log and builds the index, the log is truncated after the last
+    /// good record
+    void
+    _load();
+
+    /// append a record, val == nullptr means tombstone, fills in entry (apart from
+    /// lastAccess), returns false if the record could not be written
+    bool
+    _append( const std::string & key, const char * val, uint32_t valBytes, int64_t priority,
+             Entry & entry );
+
+    /// remove an entry from the index and append a tombstone for it
+    void
+    _remove( const std::string & key );
+
+    /// evict entries until the live data fits into the limit
+    void
+    _evict( uint64_t maxBytes );
+
+    /// compact if the log is mostly garbage
+    void
+    _compactIfNeeded();
+
+    /// the actual compaction, the caller holds the write lock
+    void
+    _compact();
+
+    /// lock the directory and open the log file
+    void
+    _open();
+
+    /// close the log file and release the lock
+    void
+    _close();
+
+    QString m_dirPath;
+    QString m_logPath;
+    uint64_t m_maxBytes;
+
+    /// file descriptor of the log
+    int m_fd = - 1;
+
+    /// file descriptor of the lock file, which is locked while the store is open
+    int m_lockFd = - 1;
+
+    /// where the next record goes
+    uint64_t m_fileBytes = 0;
+
+    /// sum of recordBytes over the index
+    uint64_t m_liveBytes = 0;
+
+    std::unordered_map < std::string, Entry > m_index;
+
+    /// guards m_index, m_fd and the sizes, readers take it for reading
+    QReadWriteLock m_lock;
+
+    /// guards lastAccess of entries, which readers update
+    QMutex m_accessMutex;
+
+    /// logical time for LRU
+    std::atomic < uint64_t > m_clock;
+};
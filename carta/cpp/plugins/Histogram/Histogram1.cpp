@@ -7,6 +7,7 @@
 #include <casacore/coordinates/Coordinates/SpectralCoordinate.h>
 #include <casacore/images/Regions/ImageRegion.h>
 #include <QDebug>
+#include <QMutexLocker>
 
 Histogram1::Histogram1( QObject * parent ) :
     QObject( parent )
@@ -172,6 +173,10 @@ Histogram1::handleHook( BaseHook & hookData )
             qWarning() << "Histogram plugin: not an image created by casaimageloader...";
             return false;
         }
+
+        // views of the image may be read on other threads at the same time
+        CCImageBase * ccImage = dynamic_cast<CCImageBase*>( image.get() );
+        QMutexLocker locker( &ccImage->getCasaMutex() );
         if ( !m_histogram ){
             m_histogram.reset(new ImageHistogram < casa::Float >());
         }
@@ -8,6 +8,7 @@
 #include "StatisticsCASARegion.h"
 
 #include <QDebug>
+#include <QMutexLocker>
 
 
 StatisticsCASA::StatisticsCASA( QObject * parent ) :
@@ -43,6 +44,10 @@ StatisticsCASA::handleHook( BaseHook & hookData ){
                 return false;
             }
 
+            // views of the image may be read on other threads at the same time
+            CCImageBase * ccImage = dynamic_cast<CCImageBase*>( image.get() );
+            QMutexLocker locker( &ccImage->getCasaMutex() );
+
             QList< QList< Carta::Lib::StatInfo > > statResults;
 
             //Get the image statistics
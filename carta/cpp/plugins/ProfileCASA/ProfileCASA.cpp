@@ -22,6 +22,7 @@ using namespace std;
 
 #include <iostream>
 #include <QDebug>
+#include <QMutexLocker>
 
 
 ProfileCASA::ProfileCASA(QObject *parent) :
@@ -397,6 +398,11 @@ bool ProfileCASA::handleHook(BaseHook & hookData){
             return false;
         }
 
+        // profiles are computed on worker threads, while views of the same image may
+        // be read elsewhere, so we hold the image's casacore lock
+        CCImageBase * ccImage = dynamic_cast<CCImageBase*>( imagePtr.get() );
+        QMutexLocker locker( &ccImage->getCasaMutex() );
+
         std::shared_ptr<Carta::Lib::Regions::RegionBase> regionInfo = hook.paramsPtr->m_regionInfo;
         Carta::Lib::ProfileInfo profileInfo = hook.paramsPtr->m_profileInfo;
         hook.result = _generateProfile( casaImage, regionInfo, profileInfo );
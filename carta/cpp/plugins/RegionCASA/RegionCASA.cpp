@@ -14,6 +14,7 @@
 
 #include <QDebug>
 #include <QFile>
+#include <QMutexLocker>
 #include <QtCore/qmath.h>
 
 
@@ -111,6 +112,8 @@ RegionCASA::_loadRegion( const QString & fname,
 	casa::String fileName( fname.toStdString().c_str() );
 	CCImageBase * base = dynamic_cast<CCImageBase*>( imagePtr.get() );
 	if ( base ){
+		// views of the image may be read on other threads at the same time
+		QMutexLocker locker( &base->getCasaMutex() );
 		Carta::Lib::Image::MetaDataInterface::SharedPtr metaPtr = base->metaData();
 		CCMetaDataInterface* metaData = dynamic_cast<CCMetaDataInterface*>(metaPtr.get());
 		if ( metaData ){
@@ -46,6 +46,8 @@ FitsHeaderExtractor::getHeader()
     // was this created using CasaImageLoader plugin?
     CCImageBase * base = dynamic_cast < CCImageBase * > ( & * m_cartaImage );
     if ( base ) {
+        // views of the image may be read on other threads at the same time
+        QMutexLocker locker( & base-> getCasaMutex() );
         casa::LatticeBase * latticeBase = base-> getCasaImage();
         if ( latticeBase ) {
             // see if we can use a simple fits parser first
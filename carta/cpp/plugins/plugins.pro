@@ -15,6 +15,7 @@ SUBDIRS += ImageStatistics
 SUBDIRS += RegionCASA
 SUBDIRS += RegionDs9
 SUBDIRS += ProfileCASA
+SUBDIRS += DiskCache
 
 SUBDIRS += qimage
 
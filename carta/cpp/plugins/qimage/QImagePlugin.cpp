@@ -5,6 +5,7 @@
 #include <memory>
 #include <algorithm>
 #include <vector>
+#include <stdexcept>
 
 typedef Carta::Lib::HtmlString HtmlString;
 typedef Carta::Lib::AxisInfo AxisInfo;
@@ -89,12 +90,11 @@ public:
         return reinterpret_cast < const char * > ( & m_floatBuff );
     }
 
+    // the data is in memory, so sequential traversal is also the optimal one
     virtual void
     forEach( std::function < void (const char *) > func, Traversal traversal ) override
     {
-        if ( traversal != Carta::Lib::NdArray::RawViewInterface::Traversal::Sequential ) {
-            qFatal( "sorry, not implemented yet" );
-        }
+        Q_UNUSED( traversal );
 
         const std::vector < Slice1D::ApplyResult > & dims = m_appliedSlice.dims();
 
@@ -115,10 +115,15 @@ public:
     virtual const VI &
     currentPos() override
     {
-        qFatal( "Not implemented yet" );
         return m_currPosView;
     }
 
+    virtual const VI &
+    currentBlockDims() override
+    {
+        return m_currBlockDims;
+    }
+
     virtual Carta::Lib::NdArray::RawViewInterface *
     getView( const SliceND & sliceInfo ) override
     {
@@ -135,27 +140,28 @@ public:
     virtual int64_t
     read( int64_t buffSize, char * buff, Traversal traversal ) override
     {
-        Q_UNUSED( buffSize );
-        Q_UNUSED( buff );
         Q_UNUSED( traversal );
-        qFatal( "not implemented" );
+        int64_t count = readPixels( m_nextReadPixel, buffSize / sizeof( float ),
+                                    reinterpret_cast < float * > ( buff ) );
+        m_nextReadPixel += count;
+        return count * sizeof( float );
     }
 
     virtual void
     seek( int64_t ind ) override
     {
-        Q_UNUSED( ind );
-        qFatal( "not implemented" );
+        CARTA_ASSERT( ind >= 0 );
+        m_nextReadPixel = ind;
     }
 
     virtual int64_t
     read( int64_t chunk, int64_t buffSize, char * buff, Traversal traversal ) override
     {
-        Q_UNUSED( chunk );
-        Q_UNUSED( buffSize );
-        Q_UNUSED( buff );
         Q_UNUSED( traversal );
-        qFatal( "not implemented" );
+        int64_t chunkPixels = buffSize / sizeof( float );
+        int64_t count = readPixels( chunk * chunkPixels, chunkPixels,
+                                    reinterpret_cast < float * > ( buff ) );
+        return count * sizeof( float );
     }
 
     virtual void
@@ -164,12 +170,46 @@ public:
              char * buff,
              Traversal traversal ) override
     {
-        Q_UNUSED( buffSize );
-        Q_UNUSED( func );
-        Q_UNUSED( buff );
         Q_UNUSED( traversal );
-        qFatal( "not implemented" );
-    }
+        int64_t chunkPixels = buffSize / sizeof( float );
+        if ( chunkPixels < 1 ) {
+            throw std::runtime_error( "buffer too small for a single pixel" );
+        }
+
+        // an empty view (e.g. an empty slice) has no blocks
+        int64_t nCols = m_viewDims[0];
+        int64_t nRows = m_viewDims[1];
+        if ( nCols == 0 || nRows == 0 ) {
+            return;
+        }
+
+        // we always convert bytes to floats, so we need a buffer of our own
+        // if the caller did not give us one
+        std::vector < float > ownBuffer;
+        float * dst = reinterpret_cast < float * > ( buff );
+        if ( ! dst ) {
+            ownBuffer.resize( chunkPixels );
+            dst = & ownBuffer[0];
+        }
+
+        // blocks are whole rows when they fit, otherwise pieces of a single row,
+        // so that each block is a box
+        int64_t blockCols = std::min( chunkPixels, nCols );
+        int64_t blockRows = blockCols < nCols ? 1 : chunkPixels / nCols;
+        m_currPosView.assign( m_viewDims.size(), 0 );
+        m_currBlockDims.assign( m_viewDims.size(), 1 );
+        for ( int64_t y = 0 ; y < nRows ; y += blockRows ) {
+            for ( int64_t x = 0 ; x < nCols ; x += blockCols ) {
+                m_currPosView[0] = x;
+                m_currPosView[1] = y;
+                m_currBlockDims[0] = std::min( blockCols, nCols - x );
+                m_currBlockDims[1] = std::min( blockRows, nRows - y );
+                int64_t count = m_currBlockDims[0] * m_currBlockDims[1];
+                readPixels( y * nCols + x, count, dst );
+                func( reinterpret_cast < const char * > ( dst ), count );
+            }
+        }
+    } // forEach
 
 private:
 
@@ -186,9 +226,40 @@ private:
     unsigned char * m_rawData = nullptr;
     float m_floatBuff;
     VI m_currPosView;
+    VI m_currBlockDims;
 
     // the current resolved slice for the data we have
     SliceND::ApplyResult m_appliedSlice;
+
+    // where the next stateful read() will start
+    int64_t m_nextReadPixel = 0;
+
+    // read up to maxCount pixels starting at pixel index 'first' (in sequential order)
+    // into dst, returns number of pixels read
+    int64_t
+    readPixels( int64_t first, int64_t maxCount, float * dst )
+    {
+        const std::vector < Slice1D::ApplyResult > & dims = m_appliedSlice.dims();
+        int64_t nCols = dims[0].count;
+        int64_t nPixels = nCols * dims[1].count;
+        if ( first < 0 || first >= nPixels || maxCount < 1 ) {
+            return 0;
+        }
+        int64_t count = std::min( maxCount, nPixels - first );
+        int64_t xc = first % nCols;
+        int64_t yc = first / nCols;
+        for ( int64_t i = 0 ; i < count ; ) {
+            unsigned char * row = & m_rawData[m_origDims[0] * ( dims[1].start + yc * dims[1].step )];
+            int x = dims[0].start + xc * dims[0].step;
+            for ( ; xc < nCols && i < count ; ++xc, ++i ) {
+                * dst++ = float (row[x]) / float (255.0);
+                x += dims[0].step;
+            }
+            xc = 0;
+            yc++;
+        }
+        return count;
+    } // readPixels
 };
 
 /// we need to implement our own coordinate formatter